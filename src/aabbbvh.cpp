@@ -0,0 +1,238 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "aabbbvh.h"
+#include "unittest.h"
+
+#include <algorithm>
+
+// orders object ids by bounds center along an axis
+struct CenterLess
+{
+	const std::vector<Aabb<float> > & bounds;
+	int axis;
+
+	CenterLess(const std::vector<Aabb<float> > & bounds, int axis) :
+		bounds(bounds),
+		axis(axis)
+	{
+		// ctor
+	}
+
+	bool operator()(int a, int b) const
+	{
+		return bounds[a].GetCenter()[axis] < bounds[b].GetCenter()[axis];
+	}
+};
+
+// median split of ids[begin, end) along the longest axis of the centers
+static int Split(const std::vector<Aabb<float> > & bounds, std::vector<int> & ids, int begin, int end)
+{
+	Vec3 cmin = bounds[ids[begin]].GetCenter();
+	Vec3 cmax = cmin;
+	for (int i = begin + 1; i < end; ++i)
+	{
+		const Vec3 & c = bounds[ids[i]].GetCenter();
+		for (int n = 0; n < 3; ++n)
+		{
+			cmin[n] = std::min(cmin[n], c[n]);
+			cmax[n] = std::max(cmax[n], c[n]);
+		}
+	}
+
+	Vec3 extent = cmax - cmin;
+	int axis = 0;
+	if (extent[1] > extent[axis]) axis = 1;
+	if (extent[2] > extent[axis]) axis = 2;
+
+	int mid = begin + (end - begin) / 2;
+	std::nth_element(ids.begin() + begin, ids.begin() + mid, ids.begin() + end, CenterLess(bounds, axis));
+	return mid;
+}
+
+AabbBvh::AabbBvh() :
+	object_count(0)
+{
+	// ctor
+}
+
+void AabbBvh::Clear()
+{
+	nodes.clear();
+	object_count = 0;
+}
+
+void AabbBvh::Build(const std::vector<Aabb<float> > & bounds)
+{
+	Clear();
+	object_count = bounds.size();
+	if (bounds.empty())
+		return;
+
+	std::vector<int> ids(bounds.size());
+	for (unsigned i = 0; i < ids.size(); ++i)
+		ids[i] = i;
+
+	nodes.reserve(bounds.size() / 3 + 1);
+	Build(bounds, ids, 0, ids.size());
+}
+
+void AabbBvh::SetNodeData(const void * node_data, unsigned node_count, unsigned obj_count)
+{
+	const Node * n = static_cast<const Node *>(node_data);
+	nodes.assign(n, n + node_count);
+	object_count = obj_count;
+}
+
+int AabbBvh::Build(
+	const std::vector<Aabb<float> > & bounds,
+	std::vector<int> & ids,
+	int begin,
+	int end)
+{
+	int index = nodes.size();
+	nodes.push_back(Node());
+
+	// split into up to four ranges
+	int range[5] = {begin, begin + 1, begin + 2, begin + 3, begin + 4};
+	if (end - begin > 4)
+	{
+		range[2] = Split(bounds, ids, begin, end);
+		range[1] = Split(bounds, ids, begin, range[2]);
+		range[3] = Split(bounds, ids, range[2], end);
+		range[4] = end;
+	}
+
+	for (int n = 0; n < 4; ++n)
+	{
+		int child = 0;
+		Vec3 bmin, bmax;
+		int count = std::min(range[n + 1], end) - range[n];
+		if (count == 1)
+		{
+			const Aabb<float> & b = bounds[ids[range[n]]];
+			bmin = b.GetPos();
+			bmax = b.GetPos() + b.GetSize();
+			child = ~ids[range[n]];
+		}
+		else if (count > 1)
+		{
+			const Aabb<float> & b = bounds[ids[range[n]]];
+			bmin = b.GetPos();
+			bmax = b.GetPos() + b.GetSize();
+			for (int i = range[n] + 1; i < range[n + 1]; ++i)
+			{
+				const Aabb<float> & c = bounds[ids[i]];
+				const Vec3 cmin = c.GetPos();
+				const Vec3 cmax = c.GetPos() + c.GetSize();
+				for (int k = 0; k < 3; ++k)
+				{
+					bmin[k] = std::min(bmin[k], cmin[k]);
+					bmax[k] = std::max(bmax[k], cmax[k]);
+				}
+			}
+			child = Build(bounds, ids, range[n], range[n + 1]);
+		}
+
+		// nodes might have been reallocated by child build
+		Node & node = nodes[index];
+		node.child[n] = child;
+		for (int k = 0; k < 3; ++k)
+		{
+			node.min[k][n] = bmin[k];
+			node.max[k][n] = bmax[k];
+		}
+	}
+
+	return index;
+}
+
+// collects all visited ids
+struct RayIds
+{
+	std::vector<int> ids;
+
+	void operator()(int id, float & /*seglen*/)
+	{
+		ids.push_back(id);
+	}
+};
+
+QT_TEST(aabb_bvh_test)
+{
+	// grid of unit boxes
+	std::vector<Aabb<float> > bounds;
+	for (int x = 0; x < 10; ++x)
+	{
+		for (int y = 0; y < 7; ++y)
+		{
+			Vec3 pos(x * 2, y * 2, 0);
+			bounds.push_back(Aabb<float>(pos, pos + Vec3(1, 1, 1)));
+		}
+	}
+
+	AabbBvh bvh;
+	bvh.Build(bounds);
+	QT_CHECK_EQUAL(bvh.GetObjectCount(), bounds.size());
+	QT_CHECK(bvh.GetNodeCount() > 0);
+
+	// vertical rays hit exactly one box
+	for (unsigned i = 0; i < bounds.size(); ++i)
+	{
+		RayIds hits;
+		Vec3 origin = bounds[i].GetCenter() + Vec3(0, 0, 5);
+		bvh.QueryRay(origin, Vec3(0, 0, -1), 10, hits);
+		QT_CHECK_EQUAL(hits.ids.size(), 1);
+		QT_CHECK_EQUAL(hits.ids.front(), int(i));
+	}
+
+	// short ray misses
+	{
+		RayIds hits;
+		bvh.QueryRay(bounds[0].GetCenter() + Vec3(0, 0, 5), Vec3(0, 0, -1), 2, hits);
+		QT_CHECK(hits.ids.empty());
+	}
+
+	// axis parallel ray along a row hits all boxes of the row
+	{
+		RayIds hits;
+		bvh.QueryRay(Vec3(-1, 0.5, 0.5), Vec3(1, 0, 0), 100, hits);
+		QT_CHECK_EQUAL(hits.ids.size(), 10);
+	}
+
+	// ray between rows
+	{
+		RayIds hits;
+		bvh.QueryRay(Vec3(-1, 1.5, 0.5), Vec3(1, 0, 0), 100, hits);
+		QT_CHECK(hits.ids.empty());
+	}
+
+	// restored copy gives the same hits
+	{
+		AabbBvh copy;
+		copy.SetNodeData(bvh.GetNodeData(), bvh.GetNodeCount(), bvh.GetObjectCount());
+		QT_CHECK_EQUAL(copy.GetObjectCount(), bvh.GetObjectCount());
+		RayIds hits;
+		copy.QueryRay(Vec3(-1, 0.5, 0.5), Vec3(1, 0, 0), 100, hits);
+		QT_CHECK_EQUAL(hits.ids.size(), 10);
+	}
+
+	bvh.Clear();
+	QT_CHECK_EQUAL(bvh.GetNodeCount(), 0);
+}
@@ -0,0 +1,201 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _AABBBVH_H
+#define _AABBBVH_H
+
+#include "aabb.h"
+#include "mathvector.h"
+
+#include <vector>
+#include <cassert>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define AABB_BVH_SSE
+#include <xmmintrin.h>
+#endif
+
+/// Flattened bounding volume hierarchy for static objects.
+/// Nodes have four children, their bounds are stored per axis so that a ray
+/// is tested against all four boxes at once. Nodes live in one contiguous
+/// array, queries don't allocate.
+class AabbBvh
+{
+public:
+	AabbBvh();
+
+	/// build from object bounds, object id is the index into bounds
+	void Build(const std::vector<Aabb<float> > & bounds);
+
+	void Clear();
+
+	/// visitor(id, seglen) is called for objects whose bounds intersect the ray segment
+	/// visitor may shorten seglen to cull the remaining objects, for closest hit queries
+	template <class Visitor>
+	void QueryRay(const Vec3 & origin, const Vec3 & direction, float seglen, Visitor & visitor) const;
+
+	unsigned GetNodeCount() const;
+
+	unsigned GetObjectCount() const;
+
+	/// memory used by nodes in bytes
+	unsigned GetMemorySize() const;
+
+	/// node data of GetNodeCount() * GetNodeSize() bytes, for caching
+	const void * GetNodeData() const;
+
+	static unsigned GetNodeSize();
+
+	/// restore from node data of a built bvh
+	void SetNodeData(const void * node_data, unsigned node_count, unsigned obj_count);
+
+private:
+	struct Node
+	{
+		float min[3][4];	///< child bounds, [axis][child]
+		float max[3][4];
+		int child[4];		///< node index > 0, object ~id < 0, empty 0
+	};
+
+	// max depth is log4(objects), bounded by 2^31 objects
+	static const int stack_size = 64;
+
+	std::vector<Node> nodes;
+	unsigned object_count;
+
+	int Build(
+		const std::vector<Aabb<float> > & bounds,
+		std::vector<int> & ids,
+		int begin,
+		int end);
+
+	/// returns child hit mask
+	static int IntersectRay(
+		const Node & node,
+		const float origin[3],
+		const float invdir[3],
+		float seglen);
+};
+
+// implementation
+
+inline unsigned AabbBvh::GetNodeCount() const
+{
+	return nodes.size();
+}
+
+inline unsigned AabbBvh::GetObjectCount() const
+{
+	return object_count;
+}
+
+inline unsigned AabbBvh::GetMemorySize() const
+{
+	return nodes.capacity() * sizeof(Node);
+}
+
+inline const void * AabbBvh::GetNodeData() const
+{
+	return nodes.empty() ? 0 : &nodes[0];
+}
+
+inline unsigned AabbBvh::GetNodeSize()
+{
+	return sizeof(Node);
+}
+
+inline int AabbBvh::IntersectRay(
+	const Node & node,
+	const float origin[3],
+	const float invdir[3],
+	float seglen)
+{
+#ifdef AABB_BVH_SSE
+	__m128 tmin = _mm_setzero_ps();
+	__m128 tmax = _mm_set1_ps(seglen);
+	for (int i = 0; i < 3; ++i)
+	{
+		__m128 o = _mm_set1_ps(origin[i]);
+		__m128 d = _mm_set1_ps(invdir[i]);
+		__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.min[i]), o), d);
+		__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.max[i]), o), d);
+		tmin = _mm_max_ps(tmin, _mm_min_ps(t0, t1));
+		tmax = _mm_min_ps(tmax, _mm_max_ps(t0, t1));
+	}
+	return _mm_movemask_ps(_mm_cmple_ps(tmin, tmax));
+#else
+	int mask = 0;
+	for (int n = 0; n < 4; ++n)
+	{
+		float tmin = 0;
+		float tmax = seglen;
+		for (int i = 0; i < 3; ++i)
+		{
+			float t0 = (node.min[i][n] - origin[i]) * invdir[i];
+			float t1 = (node.max[i][n] - origin[i]) * invdir[i];
+			tmin = std::max(tmin, std::min(t0, t1));
+			tmax = std::min(tmax, std::max(t0, t1));
+		}
+		mask |= (tmin <= tmax) << n;
+	}
+	return mask;
+#endif
+}
+
+template <class Visitor>
+inline void AabbBvh::QueryRay(const Vec3 & origin, const Vec3 & direction, float seglen, Visitor & visitor) const
+{
+	if (nodes.empty())
+		return;
+
+	// avoid 0 * inf for axis parallel rays
+	float org[3], invdir[3];
+	for (int i = 0; i < 3; ++i)
+	{
+		org[i] = origin[i];
+		invdir[i] = (direction[i] > 1E-20f || direction[i] < -1E-20f) ? 1 / direction[i] : 1E20f;
+	}
+
+	int stack[stack_size];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		const Node & node = nodes[stack[--top]];
+		int mask = IntersectRay(node, org, invdir, seglen);
+		for (int n = 0; mask; ++n, mask >>= 1)
+		{
+			if (!(mask & 1))
+				continue;
+
+			int child = node.child[n];
+			if (child < 0)
+			{
+				visitor(~child, seglen);
+			}
+			else if (child > 0)
+			{
+				assert(top < stack_size);
+				stack[top++] = child;
+			}
+		}
+	}
+}
+
+#endif // _AABBBVH_H
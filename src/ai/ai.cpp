@@ -18,11 +18,35 @@
 /************************************************************************/
 
 #include "ai.h"
+#include "jobsystem.h"
 #include <cassert>
 // AI implementations:
 #include "ai_car_standard.h"
 #include "ai_car_experimental.h"
 
+// updates a range of ai cars, each car only modifies its own state
+struct AiRange : public JobRange
+{
+	std::vector <AiCar*> & ai_cars;
+	const CarDynamics * cars;
+	int cars_num;
+	float dt;
+
+	AiRange(std::vector <AiCar*> & ai_cars, const CarDynamics cars[], int cars_num, float dt) :
+		ai_cars(ai_cars), cars(cars), cars_num(cars_num), dt(dt)
+	{
+		// ctor
+	}
+
+	void Execute(int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+		{
+			ai_cars[i]->Update(dt, cars, cars_num);
+		}
+	}
+};
+
 const std::string Ai::default_type = "aistd";
 
 Ai::Ai() : empty_input(CarInput::INVALID, 0.0)
@@ -53,6 +77,7 @@ void Ai::AddCar(const CarDynamics * car, float difficulty, const std::string & t
 	AiFactory * factory = it->second;
 	AiCar * aicar = factory->Create(car, difficulty);
 	ai_cars.push_back(aicar);
+	ai_cars_created.push_back(std::make_pair(factory, difficulty));
 }
 
 void Ai::RemoveCar(const CarDynamics * car)
@@ -65,6 +90,7 @@ void Ai::RemoveCar(const CarDynamics * car)
 		{
 			delete ai_cars[i];
 			ai_cars.erase(ai_cars.begin() + i);
+			ai_cars_created.erase(ai_cars_created.begin() + i);
 			return;
 		}
 	}
@@ -78,17 +104,25 @@ void Ai::ClearCars()
 		delete ai_cars[i];
 	}
 	ai_cars.clear();
+	ai_cars_created.clear();
 }
 
-void Ai::Update(float dt, const CarDynamics cars[], const int cars_num)
+void Ai::ResetCars()
 {
-	int size = ai_cars.size();
-	for (int i = 0; i < size; i++)
+	for (size_t i = 0; i < ai_cars.size(); i++)
 	{
-		ai_cars[i]->Update(dt, cars, cars_num);
+		const CarDynamics * car = ai_cars[i]->GetCar();
+		delete ai_cars[i];
+		ai_cars[i] = ai_cars_created[i].first->Create(car, ai_cars_created[i].second);
 	}
 }
 
+void Ai::Update(float dt, const CarDynamics cars[], const int cars_num)
+{
+	AiRange range(ai_cars, cars, cars_num, dt);
+	JobSystem::instance().ParallelFor(0, ai_cars.size(), range);
+}
+
 const std::vector<float> & Ai::GetInputs(const CarDynamics * car) const
 {
 	int size = ai_cars.size();
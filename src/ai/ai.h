@@ -41,6 +41,9 @@ public:
 
 	void ClearCars();
 
+	/// Recreate the car controllers, for cars that were moved in time by a replay seek.
+	void ResetCars();
+
 	void Update(float dt, const CarDynamics cars[], const int cars_num);
 
 	///< Returns an empty vector if the car isn't AI-controlled.
@@ -56,6 +59,7 @@ public:
 
 private:
 	std::vector <AiCar*> ai_cars;
+	std::vector <std::pair<AiFactory*, float> > ai_cars_created; ///< factory and difficulty of each ai car
 	std::map <std::string, AiFactory*> ai_factories;
 	std::vector <float> empty_input;
 };
@@ -20,6 +20,7 @@
 #include "bezier.h"
 #include "unittest.h"
 
+#include <algorithm>
 #include <cmath>
 
 std::ostream & operator << (std::ostream &os, const Bezier & b)
@@ -437,6 +438,34 @@ Vec3 Bezier::SurfNorm(float px, float py) const
 	return n;
 }
 
+void Bezier::SurfDeriv(float px, float py, Vec3 & pos, Vec3 & dpx, Vec3 & dpy) const
+{
+	Vec3 tempy[4];
+	Vec3 tempx[4];
+	Vec3 temp2[4];
+
+	//get splines along x axis
+	for (int j = 0; j < 4; ++j)
+	{
+		tempy[j] = Bernstein(px, points[j]);
+	}
+
+	//get splines along y axis
+	for (int j = 0; j < 4; ++j)
+	{
+		for (int i = 0; i < 4; ++i)
+		{
+			temp2[i] = points[i][j];
+		}
+		tempx[j] = Bernstein(py, temp2);
+	}
+
+	//the bernstein tangent points towards decreasing coordinates
+	pos = Bernstein(py, tempy);
+	dpx = -BernsteinTangent(px, tempx);
+	dpy = -BernsteinTangent(py, tempy);
+}
+
 Bezier & Bezier::CopyFrom(const Bezier &other)
 {
 	for (int x = 0; x < 4; x++)
@@ -592,6 +621,40 @@ bool Bezier::CollideSubDivQuadSimpleNorm(const Vec3 & origin, const Vec3 & direc
 	return true;
 }
 
+bool Bezier::CollideNewton(const Vec3 & origin, const Vec3 & direction, float t, float px, float py, Vec3 &outtri, Vec3 & normal) const
+{
+	const int max_iterations = 4;
+	const float tolerance = 1E-4;
+
+	//solve origin + direction * t - surface(px, py) = 0
+	Vec3 pos, dpx, dpy;
+	for (int i = 0; i < max_iterations; ++i)
+	{
+		SurfDeriv(px, py, pos, dpx, dpy);
+		Vec3 r = pos - origin - direction * t;
+		if (r.MagnitudeSquared() < tolerance * tolerance)
+		{
+			outtri = pos;
+			normal = -dpx.cross(dpy).Normalize();
+			return true;
+		}
+
+		//cramer's rule for direction * dt - dpx * du - dpy * dv = r
+		Vec3 b = -dpx;
+		Vec3 c = -dpy;
+		Vec3 bc = b.cross(c);
+		float det = direction.dot(bc);
+		if (std::abs(det) < 1E-12)
+			return false;
+
+		t += r.dot(bc) / det;
+		px = std::min(std::max(px + direction.dot(r.cross(c)) / det, 0.0f), 1.0f);
+		py = std::min(std::max(py + direction.dot(b.cross(r)) / det, 0.0f), 1.0f);
+	}
+
+	return false;
+}
+
 void Bezier::DeCasteljauHalveCurve(Vec3 * points4, Vec3 * left4, Vec3 * right4) const
 {
 	left4[0] = points4[0];
@@ -26,11 +26,13 @@
 #include <fstream>
 
 class Track;
+class TrackCache;
 class RoadPatch;
 
 class Bezier
 {
 friend class Track;
+friend class TrackCache;
 friend class RoadPatch;
 
 public:
@@ -65,6 +67,10 @@ public:
 	bool CollideSubDivQuadSimple(const Vec3 & origin, const Vec3 & direction, Vec3 &outtri) const;
 	bool CollideSubDivQuadSimpleNorm(const Vec3 & origin, const Vec3 & direction, Vec3 &outtri, Vec3 & normal) const;
 
+	///refine an approximate ray hit (ray distance t, surface coordinates px, py) with newton iterations on the surface.
+	/// output the contact point and normal, return false if the iteration does not converge.
+	bool CollideNewton(const Vec3 & origin, const Vec3 & direction, float t, float px, float py, Vec3 &outtri, Vec3 & normal) const;
+
 	///read/write IO operations (ascii format)
 	void ReadFrom(std::istream & openfile);
 	void ReadFromYZX(std::istream & openfile);
@@ -110,6 +116,9 @@ public:
 	///return the normal of the bezier surface at the given normalized coordinates px and py
 	Vec3 SurfNorm(float px, float py) const;
 
+	///return the 3D point and the partial derivatives of the bezier surface at the given normalized coordinates px and py
+	void SurfDeriv(float px, float py, Vec3 & pos, Vec3 & dpx, Vec3 & dpy) const;
+
 	Bezier* GetNextPatch() const
 	{
 		return next_patch;
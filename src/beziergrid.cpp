@@ -0,0 +1,280 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "beziergrid.h"
+#include "bezier.h"
+#include "unittest.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+BezierGrid::BezierGrid() :
+	resolution(0)
+{
+	// ctor
+}
+
+void BezierGrid::Build(const Bezier & patch, int res)
+{
+	Clear();
+	if (res < 1)
+		return;
+
+	resolution = std::min(res, int(max_resolution));
+	const int n = resolution + 1;
+	const float delta = 1.0f / resolution;
+	points.resize(n * n);
+	for (int j = 0; j < n; ++j)
+	{
+		for (int i = 0; i < n; ++i)
+		{
+			points[j * n + i] = patch.SurfCoord(i * delta, j * delta);
+		}
+	}
+
+	// pad bounds, grid points are exact, the triangle test has some slack
+	const Vec3 pad(1E-3f, 1E-3f, 1E-3f);
+	rows.resize(resolution);
+	columns.resize(resolution);
+	for (int k = 0; k < resolution; ++k)
+	{
+		rows[k].min = rows[k].max = points[k * n];
+		columns[k].min = columns[k].max = points[k];
+	}
+	for (int j = 0; j < n; ++j)
+	{
+		for (int i = 0; i < n; ++i)
+		{
+			const Vec3 & p = points[j * n + i];
+			for (int a = 0; a < 3; ++a)
+			{
+				// a grid point borders the rows and columns k - 1 and k
+				for (int k = std::max(j - 1, 0); k <= std::min(j, resolution - 1); ++k)
+				{
+					rows[k].min[a] = std::min(rows[k].min[a], p[a]);
+					rows[k].max[a] = std::max(rows[k].max[a], p[a]);
+				}
+				for (int k = std::max(i - 1, 0); k <= std::min(i, resolution - 1); ++k)
+				{
+					columns[k].min[a] = std::min(columns[k].min[a], p[a]);
+					columns[k].max[a] = std::max(columns[k].max[a], p[a]);
+				}
+			}
+		}
+	}
+	for (int k = 0; k < resolution; ++k)
+	{
+		rows[k].min = rows[k].min - pad;
+		rows[k].max = rows[k].max + pad;
+		columns[k].min = columns[k].min - pad;
+		columns[k].max = columns[k].max + pad;
+	}
+}
+
+void BezierGrid::Clear()
+{
+	points.clear();
+	rows.clear();
+	columns.clear();
+	resolution = 0;
+}
+
+bool BezierGrid::CollideRay(
+	const Vec3 & origin,
+	const Vec3 & direction,
+	float seglen,
+	float & t,
+	float & px,
+	float & py) const
+{
+	if (points.empty())
+		return false;
+
+	// avoid 0 * inf for axis parallel rays
+	float invdir[3];
+	for (int a = 0; a < 3; ++a)
+	{
+		invdir[a] = (direction[a] > 1E-20f || direction[a] < -1E-20f) ? 1 / direction[a] : 1E20f;
+	}
+
+	float tmax = seglen / direction.Magnitude();
+	unsigned row_mask = IntersectBounds(rows, origin, invdir, tmax);
+	if (!row_mask)
+		return false;
+
+	unsigned column_mask = IntersectBounds(columns, origin, invdir, tmax);
+	if (!column_mask)
+		return false;
+
+	const int n = resolution + 1;
+	const float delta = 1.0f / resolution;
+	bool col = false;
+	for (int j = 0; row_mask; ++j, row_mask >>= 1)
+	{
+		if (!(row_mask & 1))
+			continue;
+
+		const Vec3 * p0 = &points[j * n];
+		const Vec3 * p1 = p0 + n;
+		unsigned mask = column_mask;
+		for (int i = 0; mask; ++i, mask >>= 1)
+		{
+			if (!(mask & 1))
+				continue;
+
+			// cell (p0[i], p0[i+1], p1[i+1], p1[i]) split along its diagonal
+			float tt, u, v;
+			if (IntersectTriangle(origin, direction, p0[i], p0[i + 1], p1[i + 1], tt, u, v) && tt <= tmax)
+			{
+				tmax = tt;
+				px = (i + u + v) * delta;
+				py = (j + v) * delta;
+				col = true;
+			}
+			if (IntersectTriangle(origin, direction, p0[i], p1[i + 1], p1[i], tt, u, v) && tt <= tmax)
+			{
+				tmax = tt;
+				px = (i + u) * delta;
+				py = (j + u + v) * delta;
+				col = true;
+			}
+		}
+	}
+
+	t = tmax;
+	return col;
+}
+
+unsigned BezierGrid::IntersectBounds(
+	const std::vector<Bounds> & bounds,
+	const Vec3 & origin,
+	const float invdir[3],
+	float seglen)
+{
+	unsigned mask = 0;
+	for (unsigned k = 0; k < bounds.size(); ++k)
+	{
+		float tmin = 0;
+		float tmax = seglen;
+		for (int a = 0; a < 3; ++a)
+		{
+			float t0 = (bounds[k].min[a] - origin[a]) * invdir[a];
+			float t1 = (bounds[k].max[a] - origin[a]) * invdir[a];
+			tmin = std::max(tmin, std::min(t0, t1));
+			tmax = std::min(tmax, std::max(t0, t1));
+		}
+		mask |= unsigned(tmin <= tmax) << k;
+	}
+	return mask;
+}
+
+bool BezierGrid::IntersectTriangle(
+	const Vec3 & origin,
+	const Vec3 & direction,
+	const Vec3 & v0,
+	const Vec3 & v1,
+	const Vec3 & v2,
+	float & t,
+	float & u,
+	float & v)
+{
+	// small slack to avoid cracks along shared triangle edges
+	const float eps = 1E-5f;
+
+	Vec3 e1 = v1 - v0;
+	Vec3 e2 = v2 - v0;
+	Vec3 p = direction.cross(e2);
+	float det = e1.dot(p);
+	if (std::abs(det) < 1E-12f)
+		return false;
+
+	float invdet = 1 / det;
+	Vec3 s = origin - v0;
+	u = s.dot(p) * invdet;
+	if (u < -eps || u > 1 + eps)
+		return false;
+
+	Vec3 q = s.cross(e1);
+	v = direction.dot(q) * invdet;
+	if (v < -eps || u + v > 1 + eps)
+		return false;
+
+	t = e2.dot(q) * invdet;
+	return t >= 0;
+}
+
+QT_TEST(bezier_grid_test)
+{
+	// curved 4x4 patch with a bump in the middle
+	std::stringstream s;
+	for (int x = 0; x < 4; ++x)
+	{
+		for (int y = 0; y < 4; ++y)
+		{
+			float h = (x == 1 || x == 2) && (y == 1 || y == 2) ? 1.0f : 0.0f;
+			s << y * 4.0f / 3 << " " << x * 4.0f / 3 << " " << h << "\n";
+		}
+	}
+	Bezier patch;
+	patch.ReadFrom(s);
+
+	BezierGrid grid;
+	QT_CHECK(grid.Empty());
+	grid.Build(patch, 8);
+	QT_CHECK(!grid.Empty());
+	QT_CHECK_EQUAL(grid.GetResolution(), 8);
+	QT_CHECK(grid.GetMemorySize() >= 81 * sizeof(Vec3));
+
+	// vertical rays, grid hits are close to the surface, refined hits are on it
+	const Vec3 dir(0, 0, -1);
+	for (int i = 0; i < 10; ++i)
+	{
+		for (int j = 0; j < 10; ++j)
+		{
+			Vec3 surf = patch.SurfCoord((i + 0.5f) / 10, (j + 0.5f) / 10);
+			Vec3 origin(surf[0], surf[1], 2);
+
+			float t, px, py;
+			QT_CHECK(grid.CollideRay(origin, dir, 4, t, px, py));
+			QT_CHECK_CLOSE(t, 2 - surf[2], 0.05);
+
+			Vec3 point, normal;
+			QT_CHECK(patch.CollideNewton(origin, dir, t, px, py, point, normal));
+			QT_CHECK_CLOSE(point[0], surf[0], 1E-3);
+			QT_CHECK_CLOSE(point[1], surf[1], 1E-3);
+			QT_CHECK_CLOSE(point[2], surf[2], 1E-3);
+
+			Vec3 n = patch.SurfNorm((i + 0.5f) / 10, (j + 0.5f) / 10);
+			QT_CHECK_CLOSE(normal.dot(n), 1, 1E-3);
+		}
+	}
+
+	// too short and off patch rays miss
+	float t, px, py;
+	QT_CHECK(!grid.CollideRay(Vec3(2, 2, 3), dir, 1, t, px, py));
+	QT_CHECK(!grid.CollideRay(Vec3(5, 2, 3), dir, 10, t, px, py));
+
+	grid.Build(patch, 100);
+	QT_CHECK_EQUAL(grid.GetResolution(), BezierGrid::max_resolution);
+	QT_CHECK(grid.CollideRay(Vec3(2, 2, 3), dir, 4, t, px, py));
+
+	grid.Build(patch, 0);
+	QT_CHECK(grid.Empty());
+}
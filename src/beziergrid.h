@@ -0,0 +1,112 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _BEZIERGRID_H
+#define _BEZIERGRID_H
+
+#include "mathvector.h"
+
+#include <vector>
+
+class Bezier;
+
+/// Precomputed triangle grid of a bezier patch surface.
+/// Ray queries only test the triangles of cells whose grid row and column bounds
+/// are both hit by the ray and return the surface coordinates of the closest hit,
+/// which can be refined on the analytic surface with Bezier::CollideNewton.
+class BezierGrid
+{
+public:
+	BezierGrid();
+
+	/// evaluate the patch surface at (resolution + 1)^2 points, resolution < 1 clears the grid
+	/// resolution is clamped to max_resolution
+	void Build(const Bezier & patch, int resolution);
+
+	void Clear();
+
+	bool Empty() const;
+
+	int GetResolution() const;
+
+	/// return true if the ray segment hits the grid.
+	/// output the ray distance t (in direction units) and surface coordinates px, py of the closest hit
+	bool CollideRay(
+		const Vec3 & origin,
+		const Vec3 & direction,
+		float seglen,
+		float & t,
+		float & px,
+		float & py) const;
+
+	/// memory used by the grid in bytes
+	unsigned GetMemorySize() const;
+
+	/// row and column hits are tracked in a bit mask
+	static const int max_resolution = 32;
+
+private:
+	struct Bounds
+	{
+		Vec3 min;
+		Vec3 max;
+	};
+
+	std::vector<Vec3> points;	///< surface points, [py][px]
+	std::vector<Bounds> rows;	///< bounds of the cells between py and py + 1
+	std::vector<Bounds> columns;	///< bounds of the cells between px and px + 1
+	int resolution;
+
+	/// return a mask of the bounds intersected by the ray segment
+	static unsigned IntersectBounds(
+		const std::vector<Bounds> & bounds,
+		const Vec3 & origin,
+		const float invdir[3],
+		float seglen);
+
+	/// two sided ray triangle test, output ray distance t and barycentric coordinates u, v
+	static bool IntersectTriangle(
+		const Vec3 & origin,
+		const Vec3 & direction,
+		const Vec3 & v0,
+		const Vec3 & v1,
+		const Vec3 & v2,
+		float & t,
+		float & u,
+		float & v);
+};
+
+// implementation
+
+inline bool BezierGrid::Empty() const
+{
+	return points.empty();
+}
+
+inline int BezierGrid::GetResolution() const
+{
+	return resolution;
+}
+
+inline unsigned BezierGrid::GetMemorySize() const
+{
+	return points.capacity() * sizeof(Vec3) + (rows.capacity() + columns.capacity()) * sizeof(Bounds);
+}
+
+#endif // _BEZIERGRID_H
@@ -765,6 +765,7 @@ std::vector<std::string> CarControlMap::InitCarInputStrings()
 	strings[GameInput::PAUSE] = "pause";
 	strings[GameInput::RELOAD_SHADERS] = "reload_shaders";
 	strings[GameInput::RELOAD_GUI] = "reload_gui";
+	strings[GameInput::REWIND] = "rewind";
 	strings[GameInput::GUI_LEFT] = "gui_left";
 	strings[GameInput::GUI_RIGHT] = "gui_right";
 	strings[GameInput::GUI_UP] = "gui_up";
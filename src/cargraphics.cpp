@@ -383,6 +383,28 @@ void CarGraphics::Update(const CarDynamics & dynamics)
 		ni->GetTransform().SetRotation(rot);
 	}
 
+	UpdateLights(dynamics.GetTransmission().GetGear());
+}
+
+void CarGraphics::Update(const std::vector<Vec3> & positions, const std::vector<Quat> & orientations, int gear)
+{
+	if (!bodynode.valid()) return;
+	assert(positions.size() == topnode.GetNodeList().size());
+	assert(orientations.size() == positions.size());
+
+	unsigned i = 0;
+	SceneNode::List & childlist = topnode.GetNodeList();
+	for (SceneNode::List::iterator ni = childlist.begin(); ni != childlist.end(); ++ni, ++i)
+	{
+		ni->GetTransform().SetTranslation(positions[i]);
+		ni->GetTransform().SetRotation(orientations[i]);
+	}
+
+	UpdateLights(gear);
+}
+
+void CarGraphics::UpdateLights(int gear)
+{
 	// brake/reverse lights
 	SceneNode & bodynoderef = topnode.GetNode(bodynode);
 	for (std::list<Light>::iterator i = lights.begin(); i != lights.end(); i++)
@@ -399,7 +421,7 @@ void CarGraphics::Update(const CarDynamics & dynamics)
 	if (reverselights.valid())
 	{
 		Drawable & draw = bodynoderef.GetDrawList().lights_emissive.get(reverselights);
-		draw.SetDrawEnable(dynamics.GetTransmission().GetGear() < 0);
+		draw.SetDrawEnable(gear < 0);
 	}
 
 	// steering
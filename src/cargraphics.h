@@ -66,6 +66,9 @@ public:
 	/// update graphics from car dynamics state
 	void Update(const CarDynamics & dynamics);
 
+	/// update graphics from body transforms and gear, as published by a simulation thread
+	void Update(const std::vector<Vec3> & positions, const std::vector<Quat> & orientations, int gear);
+
 	void SetColor(float r, float g, float b);
 
 	void EnableInteriorView(bool value);
@@ -75,6 +78,8 @@ public:
 	const std::vector<Camera*> & GetCameras() const;
 
 private:
+	void UpdateLights(int gear);
+
 	SceneNode topnode;
 	SceneNode::Handle bodynode;
 	SceneNode::Handle steernode;
@@ -37,7 +37,8 @@ struct CarInfo
 	Vec3 hsv;
 	float ailevel;
 
-	bool Serialize(joeserialize::Serializer & s)
+	template <class S>
+	bool Serialize(S & s)
 	{
 		_SERIALIZE_(s, config);
 		_SERIALIZE_(s, driver);
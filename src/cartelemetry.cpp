@@ -0,0 +1,118 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "cartelemetry.h"
+#include "telemetry.h"
+#include "physics/cardynamics.h"
+
+static const char * wheel_names[WHEEL_POSITION_SIZE] = {"fl", "fr", "rl", "rr"};
+
+static const char * wheel_channels[] =
+{
+	"tire.slip",
+	"tire.slip_angle",
+	"tire.fx",
+	"tire.fy",
+	"tire.mz",
+	"wheel.angvel",
+	"suspension.displacement",
+	"suspension.velocity",
+	"suspension.force",
+};
+static const int wheel_channel_count = sizeof(wheel_channels) / sizeof(wheel_channels[0]);
+
+static const char * car_channels[] =
+{
+	"driveline.engine_rpm",
+	"driveline.engine_torque",
+	"driveline.throttle",
+	"driveline.clutch",
+	"driveline.clutch_torque",
+	"driveline.gear",
+	"driveline.tacho_rpm",
+	"driveline.speed",
+	"aero.force.x",
+	"aero.force.y",
+	"aero.force.z",
+	"body.velocity.x",
+	"body.velocity.y",
+	"body.velocity.z",
+};
+static const int car_channel_count = sizeof(car_channels) / sizeof(car_channels[0]);
+
+const int CarTelemetry::channels = WHEEL_POSITION_SIZE * wheel_channel_count + car_channel_count;
+
+void CarTelemetry::Register(Telemetry & telemetry, const std::string & prefix)
+{
+	first = telemetry.GetNumChannels();
+	for (int w = 0; w < WHEEL_POSITION_SIZE; ++w)
+	{
+		for (int c = 0; c < wheel_channel_count; ++c)
+		{
+			telemetry.AddChannel(prefix + wheel_names[w] + "." + wheel_channels[c]);
+		}
+	}
+	for (int c = 0; c < car_channel_count; ++c)
+	{
+		telemetry.AddChannel(prefix + car_channels[c]);
+	}
+}
+
+void CarTelemetry::Sample(const CarDynamics & car, Telemetry & telemetry) const
+{
+	// same order as registered
+	int id = first;
+	for (int w = 0; w < WHEEL_POSITION_SIZE; ++w)
+	{
+		const WheelPosition wp = WheelPosition(w);
+		const CarTire & tire = car.GetTire(wp);
+		const CarSuspension & suspension = car.GetSuspension(wp);
+		telemetry.Set(id++, tire.getSlip());
+		telemetry.Set(id++, tire.getSlipAngle());
+		telemetry.Set(id++, tire.getFx());
+		telemetry.Set(id++, tire.getFy());
+		telemetry.Set(id++, tire.getMz());
+		telemetry.Set(id++, car.GetWheel(wp).GetAngularVelocity());
+		telemetry.Set(id++, suspension.GetDisplacement());
+		telemetry.Set(id++, suspension.GetVelocity());
+		telemetry.Set(id++, suspension.GetForce());
+	}
+
+	const CarEngine & engine = car.GetEngine();
+	const CarClutch & clutch = car.GetClutch();
+	telemetry.Set(id++, engine.GetRPM());
+	telemetry.Set(id++, engine.GetTorque());
+	telemetry.Set(id++, engine.GetThrottle());
+	telemetry.Set(id++, clutch.GetPosition());
+	telemetry.Set(id++, clutch.GetLastTorque());
+	telemetry.Set(id++, car.GetTransmission().GetGear());
+	telemetry.Set(id++, car.GetTachoRPM());
+	telemetry.Set(id++, car.GetSpeed());
+
+	const btVector3 aero = car.GetTotalAero();
+	telemetry.Set(id++, aero.x());
+	telemetry.Set(id++, aero.y());
+	telemetry.Set(id++, aero.z());
+
+	const btVector3 & velocity = car.GetVelocity();
+	telemetry.Set(id++, velocity.x());
+	telemetry.Set(id++, velocity.y());
+	telemetry.Set(id++, velocity.z());
+	assert(id == first + channels);
+}
@@ -20,76 +20,29 @@
 #ifndef _CARTELEMETRY_H
 #define _CARTELEMETRY_H
 
-#include <fstream>
+#include <string>
 
+class Telemetry;
+class CarDynamics;
+
+/// Telemetry channels of a car: tires, suspension, driveline and aero.
+/// Channel ids are consecutive, sampling writes them without name lookups.
 class CarTelemetry
 {
-	private:
-		typedef double T;
-
-		std::vector <std::pair <std::string, T> > variable_names;
-		T time;
-		bool wroteheader;
-		const std::string telemetryname;
-		std::ofstream file;
-
-		void WriteHeader(const std::string & filename)
-		{
-			std::ofstream f((filename+".plt").c_str());
-			if (f)
-			{
-				f << "plot ";
-				unsigned int count = 0;
-				for (std::vector <std::pair <std::string, T> >::iterator i =
-					variable_names.begin(); i != variable_names.end(); ++i)
-				{
-					f << "\\" << std::endl << "\"" << filename+".dat" << "\" u 1:" << count+2 << " t '" << i->first << "' w lines";
-					if (count < variable_names.size()-1)
-						f << ",";
-					f << " ";
-					count++;
-				}
-				f << std::endl;
-			}
-			wroteheader = true;
-		}
+public:
+	/// number of channels registered per car
+	static const int channels;
 
-	public:
-		CarTelemetry(const std::string & name) : time(0), wroteheader(false), telemetryname(name), file((name+".dat").c_str()) {}
-		CarTelemetry(const CarTelemetry & other) : variable_names(other.variable_names), time(other.time), wroteheader(other.wroteheader), telemetryname(other.telemetryname), file((telemetryname+".dat").c_str()) {}
+	CarTelemetry() : first(0) {}
 
-		void AddRecord(const std::string & name, T value)
-		{
-			bool found = false;
-			for (std::vector <std::pair <std::string, T> >::iterator i =
-				variable_names.begin(); i != variable_names.end(); ++i)
-			{
-				if (name == i->first)
-				{
-					i->second = value;
-					found = true;
-					break;
-				}
-			}
-			if (!found)
-				variable_names.push_back(std::make_pair(name, value));
-		}
+	/// register the car channels, names are prefixed with prefix
+	void Register(Telemetry & telemetry, const std::string & prefix);
 
-		void Update(T dt)
-		{
-			if (time != 0 && !wroteheader)
-				WriteHeader(telemetryname);
-			time += dt;
+	/// write the car state into the current telemetry frame
+	void Sample(const CarDynamics & car, Telemetry & telemetry) const;
 
-			if (file)
-			{
-				file << time << " ";
-				for (std::vector <std::pair <std::string, T> >::iterator i =
-					variable_names.begin(); i != variable_names.end(); ++i)
-					file << i->second << " ";
-				file << "\n";
-			}
-		}
+private:
+	int first;
 };
 
 #endif //_CARTELEMETRY_H
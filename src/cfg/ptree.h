@@ -277,7 +277,7 @@ inline PTree & PTree::set(const std::string & key, const T & value)
 		return p;
 	}
 	p._value = i->first; ///< store node key for error reporting
-	return p.set(key.substr(next), value);
+	return p.set(key.substr(next+1), value);
 }
 
 inline void PTree::set(const PTree & other)
@@ -342,6 +342,22 @@ inline void PTree::_get<const PTree *>(const PTree & p, const PTree * & value) c
 	value = &p;
 }
 
+template <>
+inline PTree & PTree::set(const std::string & key, const std::string & value)
+{
+	size_t next = key.find(".");
+	iterator i = _children.insert(std::make_pair(key.substr(0, next), PTree())).first;
+	PTree & p = i->second;
+	p._parent = this;
+	if (next >= key.length()-1)
+	{
+		p._value = value;
+		return p;
+	}
+	p._value = i->first;
+	return p.set(key.substr(next+1), value);
+}
+
 template <>
 inline PTree & PTree::set(const std::string & key, const PTree & value)
 {
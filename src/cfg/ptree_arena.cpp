@@ -0,0 +1,852 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "ptree_arena.h"
+#include "unittest.h"
+#include "microbench.h"
+
+#include <fstream>
+
+/// tree under construction, children are linked in parse order
+struct PTreeArena::Builder
+{
+	struct Entry
+	{
+		String key;
+		String value;
+		unsigned hash;		///< key hash
+		unsigned first;		///< first child, zero if none
+		unsigned last;		///< last child
+		unsigned next;		///< next sibling, zero if none
+		unsigned count;		///< children count
+	};
+
+	/// nodes in parse order, root first
+	std::vector<Entry> entries;
+
+	/// interned keys, open addressing
+	std::vector<String> keys;
+	unsigned key_count;
+
+	/// child lookup by parent and interned key, entry index plus one, open addressing
+	std::vector<unsigned> children;
+	std::vector<unsigned> parents;
+
+	Builder();
+
+	void readIni(const char * data, unsigned size);
+
+	void readInf(const char * data, unsigned size);
+
+	/// replace key data by its first occurrence, return key hash
+	unsigned intern(String & key);
+
+	/// get or add child node
+	unsigned child(unsigned parent, const char * begin, const char * end);
+
+	/// get or add compound key node: key1.key2
+	unsigned path(unsigned parent, const char * begin, const char * end);
+
+	void rehashKeys();
+
+	void rehashChildren();
+
+	static unsigned childHash(unsigned parent, unsigned key_hash)
+	{
+		return key_hash ^ (parent * 2654435761u);
+	}
+
+	struct KeyLess
+	{
+		const std::vector<Entry> & entries;
+
+		KeyLess(const std::vector<Entry> & entries) :
+			entries(entries)
+		{
+			// ctor
+		}
+
+		bool operator()(unsigned a, unsigned b) const
+		{
+			const String & ka = entries[a].key;
+			const String & kb = entries[b].key;
+			const int cmp = std::memcmp(ka.data, kb.data, ka.size < kb.size ? ka.size : kb.size);
+			return cmp < 0 || (cmp == 0 && ka.size < kb.size);
+		}
+	};
+};
+
+static const char * TrimRight(const char * begin, const char * end)
+{
+	while (end > begin && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
+		--end;
+	return end;
+}
+
+static const char * SkipSpace(const char * begin, const char * end)
+{
+	while (begin < end && (*begin == ' ' || *begin == '\t'))
+		++begin;
+	return begin;
+}
+
+PTreeArena::Builder::Builder() :
+	keys(64),
+	key_count(0),
+	children(64, 0),
+	parents(64, 0)
+{
+	Entry root;
+	root.key.data = "";
+	root.key.size = 0;
+	root.value = root.key;
+	root.hash = 0;
+	root.first = root.last = root.next = root.count = 0;
+	entries.reserve(256);
+	entries.push_back(root);
+	for (size_t i = 0; i < keys.size(); ++i)
+	{
+		keys[i].data = 0;
+		keys[i].size = 0;
+	}
+}
+
+unsigned PTreeArena::Builder::intern(String & key)
+{
+	// fnv-1a
+	unsigned hash = 2166136261u;
+	for (unsigned i = 0; i < key.size; ++i)
+		hash = (hash ^ (unsigned char)key.data[i]) * 16777619u;
+
+	const unsigned mask = keys.size() - 1;
+	for (unsigned i = hash & mask; ; i = (i + 1) & mask)
+	{
+		String & k = keys[i];
+		if (!k.data)
+		{
+			k = key;
+			if (++key_count * 2 > keys.size())
+				rehashKeys();
+			return hash;
+		}
+		if (k.size == key.size && !std::memcmp(k.data, key.data, key.size))
+		{
+			key = k;
+			return hash;
+		}
+	}
+}
+
+void PTreeArena::Builder::rehashKeys()
+{
+	std::vector<String> old(keys.size() * 2);
+	old.swap(keys);
+	for (size_t i = 0; i < keys.size(); ++i)
+	{
+		keys[i].data = 0;
+		keys[i].size = 0;
+	}
+	key_count = 0;
+	for (size_t i = 0; i < old.size(); ++i)
+	{
+		if (old[i].data)
+			intern(old[i]);
+	}
+}
+
+unsigned PTreeArena::Builder::child(unsigned parent, const char * begin, const char * end)
+{
+	String key;
+	key.data = begin;
+	key.size = end - begin;
+	const unsigned hash = intern(key);
+
+	// interned keys are equal if their data is
+	const unsigned mask = children.size() - 1;
+	unsigned i = childHash(parent, hash) & mask;
+	for (; children[i]; i = (i + 1) & mask)
+	{
+		const unsigned n = children[i] - 1;
+		if (parents[i] == parent && entries[n].key.data == key.data)
+			return n;
+	}
+
+	const unsigned n = entries.size();
+	Entry entry;
+	entry.key = key;
+	entry.value.data = "";
+	entry.value.size = 0;
+	entry.hash = hash;
+	entry.first = entry.last = entry.next = entry.count = 0;
+	entries.push_back(entry);
+
+	Entry & p = entries[parent];
+	if (p.count)
+		entries[p.last].next = n;
+	else
+		p.first = n;
+	p.last = n;
+	p.count++;
+
+	children[i] = n + 1;
+	parents[i] = parent;
+	if (entries.size() * 2 > children.size())
+		rehashChildren();
+
+	return n;
+}
+
+void PTreeArena::Builder::rehashChildren()
+{
+	children.assign(children.size() * 2, 0);
+	parents.assign(children.size(), 0);
+	const unsigned mask = children.size() - 1;
+	for (unsigned p = 0; p < entries.size(); ++p)
+	{
+		for (unsigned n = entries[p].first; n; n = entries[n].next)
+		{
+			unsigned i = childHash(p, entries[n].hash) & mask;
+			while (children[i])
+				i = (i + 1) & mask;
+			children[i] = n + 1;
+			parents[i] = p;
+		}
+	}
+}
+
+unsigned PTreeArena::Builder::path(unsigned parent, const char * begin, const char * end)
+{
+	while (begin < end)
+	{
+		const char * next = (const char *)std::memchr(begin, '.', end - begin);
+		if (!next)
+			next = end;
+		if (next > begin)
+			parent = child(parent, begin, next);
+		begin = next + 1;
+	}
+	return parent;
+}
+
+void PTreeArena::Builder::readIni(const char * data, unsigned size)
+{
+	const char * data_end = data + size;
+	unsigned section = 0;
+	for (const char * line = data; line < data_end; )
+	{
+		const char * line_end = (const char *)std::memchr(line, '\n', data_end - line);
+		if (!line_end)
+			line_end = data_end;
+
+		const char * begin = line;
+		while (begin < line_end && (*begin == ' ' || *begin == '\t' || *begin == '['))
+			++begin;
+		const char * end = begin;
+		while (end < line_end && *end != ';' && *end != '#' && *end != ']' && *end != '\r')
+			++end;
+		line = line_end + 1;
+		if (begin == end)
+			continue;
+
+		const char * next = (const char *)std::memchr(begin, '=', end - begin);
+		if (!next)
+		{
+			// new node
+			section = path(0, begin, TrimRight(begin, end));
+			continue;
+		}
+
+		const char * name_end = TrimRight(begin, next);
+		const char * value = SkipSpace(next + 1, end);
+		if (name_end == begin || value == end)
+			continue;
+
+		// new property
+		Entry & entry = entries[path(section, begin, name_end)];
+		entry.value.data = value;
+		entry.value.size = TrimRight(value, end) - value;
+	}
+}
+
+void PTreeArena::Builder::readInf(const char * data, unsigned size)
+{
+	const char * data_end = data + size;
+	std::vector<unsigned> nodes;
+	unsigned node = 0;
+	const char * name = 0;
+	const char * name_end = 0;
+	for (const char * line = data; line < data_end; )
+	{
+		const char * line_end = (const char *)std::memchr(line, '\n', data_end - line);
+		if (!line_end)
+			line_end = data_end;
+
+		const char * begin = SkipSpace(line, line_end);
+		const char * end = begin;
+		while (end < line_end && *end != ';' && *end != '#')
+			++end;
+		end = TrimRight(begin, end);
+		line = line_end + 1;
+		if (begin == end)
+			continue;
+
+		if (*begin == '{' && name)
+		{
+			// new node
+			nodes.push_back(node);
+			node = path(node, name, name_end);
+			name = 0;
+			continue;
+		}
+
+		if (*begin == '}' && !nodes.empty())
+		{
+			node = nodes.back();
+			nodes.pop_back();
+			continue;
+		}
+
+		const char * next = begin;
+		while (next < end && *next != ' ' && *next != '\t')
+			++next;
+		if (next == end)
+		{
+			// node name, expect {
+			name = begin;
+			name_end = end;
+			continue;
+		}
+
+		// new property
+		const char * value = SkipSpace(next, end);
+		Entry & entry = entries[path(node, begin, next)];
+		entry.value.data = value;
+		entry.value.size = end - value;
+		name = 0;
+	}
+}
+
+PTreeArena::PTreeArena() :
+	_format(INI)
+{
+	clear();
+}
+
+bool PTreeArena::loadIni(const std::string & path, std::ostream & error)
+{
+	clear();
+	if (!_file.Open(path))
+	{
+		error << "Failed to open " << path << std::endl;
+		return false;
+	}
+	readIni(_file.GetData(), _file.GetSize());
+	return true;
+}
+
+bool PTreeArena::loadInf(const std::string & path, std::ostream & error)
+{
+	clear();
+	if (!_file.Open(path))
+	{
+		error << "Failed to open " << path << std::endl;
+		return false;
+	}
+	readInf(_file.GetData(), _file.GetSize());
+	return true;
+}
+
+void PTreeArena::readIni(const char * data, unsigned size)
+{
+	Builder builder;
+	builder.readIni(data, size);
+	_format = INI;
+	_build(builder);
+}
+
+void PTreeArena::readInf(const char * data, unsigned size)
+{
+	Builder builder;
+	builder.readInf(data, size);
+	_format = INF;
+	_build(builder);
+}
+
+void PTreeArena::copy(PTree & p, Include * include) const
+{
+	_copy(root(), p, include);
+}
+
+void PTreeArena::clear()
+{
+	Builder builder;
+	_build(builder);
+	_file.Close();
+}
+
+void PTreeArena::_build(const Builder & builder)
+{
+	// breadth first, the children of a node are stored next to each other
+	const std::vector<Builder::Entry> & entries = builder.entries;
+	std::vector<unsigned> order(entries.size());
+	std::vector<Node>(entries.size()).swap(_nodes);
+	_nodes[0]._parent = 0;
+	unsigned next = 1;
+	for (unsigned i = 0; i < entries.size(); ++i)
+	{
+		const Builder::Entry & entry = entries[order[i]];
+		Node & node = _nodes[i];
+		node._key = entry.key;
+		node._value = entry.value;
+		node._children = &_nodes[0] + next;
+		node._size = entry.count;
+
+		const unsigned first = next;
+		for (unsigned n = entry.first; n; n = entries[n].next)
+			order[next++] = n;
+		std::sort(order.begin() + first, order.begin() + next, Builder::KeyLess(entries));
+
+		for (unsigned n = first; n < next; ++n)
+			_nodes[n]._parent = &node;
+	}
+}
+
+void PTreeArena::_copy(const Node & node, PTree & p, Include * include) const
+{
+	// inf includes replace the node contents
+	const Node * inc = (include && _format == INF) ? node.find("include", 7) : 0;
+	if (inc && !inc->size())
+	{
+		std::string value = inc->_value.str();
+		(*include)(p, value);
+	}
+
+	for (Node::const_iterator i = node.begin(); i != node.end(); ++i)
+	{
+		const std::string key = i->_key.str();
+		if (i->size() || !i->_value.size)
+		{
+			_copy(*i, p.set(key, PTree()), include);
+		}
+		else if (i == inc)
+		{
+			continue;
+		}
+		else if (include && _format == INI && i->_value.size && i->_value.data[0] == '&')
+		{
+			// value is a reference, include
+			std::string value(i->_value.data + 1, i->_value.size - 1);
+			(*include)(p.set(key, value), value);
+		}
+		else
+		{
+			p.set(key, i->_value.str());
+		}
+	}
+}
+
+std::string PTreeArena::Node::fullname(const std::string & name) const
+{
+	std::string full_name;
+	if (!name.empty())
+	{
+		full_name = '.' + name;
+	}
+
+	for (const Node * node = this; node && node->_key.size; node = node->_parent)
+	{
+		full_name = '.' + node->_key.str() + full_name;
+	}
+
+	return full_name;
+}
+
+/// locale independent number parser, false if there are no digits
+static bool ParseNumber(const char * & p, const char * end, double & value)
+{
+	static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+		1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+	const char * s = SkipSpace(p, end);
+	bool negative = false;
+	if (s < end && (*s == '-' || *s == '+'))
+		negative = (*s++ == '-');
+
+	double mantissa = 0;
+	int exponent = 0;
+	int digits = 0;
+	for (; s < end && *s >= '0' && *s <= '9'; ++s, ++digits)
+		mantissa = mantissa * 10 + (*s - '0');
+	if (s < end && *s == '.')
+	{
+		for (++s; s < end && *s >= '0' && *s <= '9'; ++s, ++digits, --exponent)
+			mantissa = mantissa * 10 + (*s - '0');
+	}
+	if (!digits)
+		return false;
+
+	if (s < end && (*s == 'e' || *s == 'E'))
+	{
+		const char * e = s + 1;
+		bool enegative = false;
+		if (e < end && (*e == '-' || *e == '+'))
+			enegative = (*e++ == '-');
+		if (e < end && *e >= '0' && *e <= '9')
+		{
+			int n = 0;
+			for (; e < end && *e >= '0' && *e <= '9'; ++e)
+			{
+				if (n < 1000)
+					n = n * 10 + (*e - '0');
+			}
+			exponent += enegative ? -n : n;
+			s = e;
+		}
+	}
+
+	for (; exponent > 22; exponent -= 22)
+		mantissa *= powers[22];
+	for (; exponent < -22; exponent += 22)
+		mantissa /= powers[22];
+	if (exponent > 0)
+		mantissa *= powers[exponent];
+	else if (exponent < 0)
+		mantissa /= powers[-exponent];
+
+	value = negative ? -mantissa : mantissa;
+	p = s;
+	return true;
+}
+
+template <>
+void PTreeArena::Node::_get<bool>(bool & value) const
+{
+	const unsigned n = _value.size;
+	value = (n == 1 && _value.data[0] == '1') ||
+		(n == 4 && !std::memcmp(_value.data, "true", 4)) ||
+		(n == 2 && !std::memcmp(_value.data, "on", 2));
+}
+
+template <>
+void PTreeArena::Node::_get<int>(int & value) const
+{
+	const char * s = SkipSpace(_value.data, _value.data + _value.size);
+	const char * end = _value.data + _value.size;
+	bool negative = false;
+	if (s < end && (*s == '-' || *s == '+'))
+		negative = (*s++ == '-');
+	if (s == end || *s < '0' || *s > '9')
+		return;
+
+	int n = 0;
+	for (; s < end && *s >= '0' && *s <= '9'; ++s)
+		n = n * 10 + (*s - '0');
+	value = negative ? -n : n;
+}
+
+template <>
+void PTreeArena::Node::_get<float>(float & value) const
+{
+	const char * s = _value.data;
+	double v;
+	if (ParseNumber(s, _value.data + _value.size, v))
+		value = v;
+}
+
+template <>
+void PTreeArena::Node::_get<double>(double & value) const
+{
+	const char * s = _value.data;
+	ParseNumber(s, _value.data + _value.size, value);
+}
+
+template <>
+void PTreeArena::Node::_get<std::vector<float> >(std::vector<float> & value) const
+{
+	// same as the stream operator, set the values if sized else fill
+	const bool fill = value.empty();
+	const char * end = _value.data + _value.size;
+	const char * s = _value.data;
+	for (size_t n = 0; fill || n < value.size(); ++n)
+	{
+		const char * next = (const char *)std::memchr(s, ',', end - s);
+		if (!next)
+			next = end;
+
+		double v = 0;
+		const char * p = s;
+		const bool valid = ParseNumber(p, next, v);
+		if (fill)
+			value.push_back(v);
+		else if (valid)
+			value[n] = v;
+
+		if (next == end)
+			break;
+		s = next + 1;
+	}
+}
+
+// Line based std::istream ini reader that read_ini used before it was moved
+// onto PTreeArena, kept as the test and ptreeload baseline.
+static void ReadIniStream(std::istream & in, PTree & root, PTree & node)
+{
+	std::string line, name;
+	while (in.good())
+	{
+		std::getline(in, line, '\n');
+		if (line.empty())
+			continue;
+
+		size_t begin = line.find_first_not_of(" \t[");
+		size_t end = line.find_first_of(";#]\r", begin);
+		if (begin >= end)
+			continue;
+
+		size_t next = line.find("=", begin);
+		if (next >= end)
+		{
+			// New node.
+			next = line.find_last_not_of(" \t\r]", end);
+			name = line.substr(begin, next);
+			ReadIniStream(in, root, root.set(name, PTree()));
+			continue;
+		}
+
+		size_t next2 = line.find_first_not_of(" \t\r", next + 1);
+		next = line.find_last_not_of(" \t", next - 1);
+		if (next2 >= end)
+			continue;
+
+		// New property.
+		name = line.substr(begin, next + 1);
+		node.set(name, line.substr(next2, end - next2));
+	}
+}
+
+// inf include test, sets the included keys
+struct TestInclude : public Include
+{
+	void operator()(PTree & node, std::string & value)
+	{
+		node.set("idle", 800);
+		node.set("base", value);
+	}
+};
+
+QT_TEST(ptree_arena_test)
+{
+	std::ostringstream err;
+	const std::string ini_str =
+		"# comment\r\n"
+		"name = test car ; comment\r\n"
+		"mass=1250.5\r\n"
+		"\r\n"
+		"[engine]\r\n"
+		"position = 0.1, -0.2, 1e1\r\n"
+		"  idle = 800\r\n"
+		"\r\n"
+		"[wheel.front]\r\n"
+		"radius = 0.3\r\n"
+		"driven = on\r\n"
+		"[engine]\r\n"
+		"idle = 900\r\n";
+
+	PTreeArena tree;
+	tree.readIni(ini_str.data(), ini_str.size());
+	const PTreeArena::Node & root = tree.root();
+	QT_CHECK_EQUAL(root.size(), 4);
+
+	std::string str;
+	QT_CHECK(root.get("name", str, err));
+	QT_CHECK_EQUAL(str, "test car");
+
+	float mass = 0;
+	QT_CHECK(root.get("mass", mass, err));
+	QT_CHECK_EQUAL(mass, 1250.5f);
+
+	int idle = 0;
+	QT_CHECK(root.get("engine.idle", idle, err));
+	QT_CHECK_EQUAL(idle, 900);
+
+	std::vector<float> position;
+	QT_CHECK(root.get("engine.position", position, err));
+	QT_CHECK_EQUAL(position.size(), 3u);
+	QT_CHECK(position.size() == 3 && position[0] == 0.1f && position[1] == -0.2f && position[2] == 10.0f);
+
+	const PTreeArena::Node * front = 0;
+	QT_CHECK(root.get("wheel.front", front, err));
+	bool driven = false;
+	QT_CHECK(front && front->get("driven", driven, err) && driven);
+	QT_CHECK_EQUAL(err.str(), "");
+
+	QT_CHECK(!front || !front->get("camber", str, err));
+	QT_CHECK_EQUAL(err.str(), ".wheel.front.camber not found.\n");
+
+	// keys are interned
+	const PTreeArena::Node * engine = root.find("engine", 6);
+	QT_CHECK(engine && engine->find("idle", 4) && engine->find("idle", 4)->key().data == ini_str.data() + ini_str.find("idle"));
+
+	// same tree as the stream reader where their behaviour is the same
+	{
+		const std::string plain_str =
+			"# comment\r\n"
+			"name = test car\r\n"
+			"mass=1250.5\r\n"
+			"\r\n"
+			"[engine]\r\n"
+			"position = 0.1, -0.2, 1e1\r\n"
+			"idle = 800\r\n"
+			"[wheel.front]\r\n"
+			"radius = 0.3\r\n";
+		PTreeArena plain;
+		plain.readIni(plain_str.data(), plain_str.size());
+		PTree ptree, ptree_stream;
+		plain.copy(ptree);
+		std::istringstream in(plain_str);
+		ReadIniStream(in, ptree_stream, ptree_stream);
+		std::ostringstream ini, ini_stream;
+		write_ini(ptree, ini);
+		write_ini(ptree_stream, ini_stream);
+		QT_CHECK_EQUAL(ini.str(), ini_stream.str());
+		QT_CHECK(ptree.size() == 4);
+	}
+
+	// values are trimmed, indented keys work, the stream reader did neither
+	{
+		const std::string changed_str =
+			"a = 1 ; comment\n"
+			"  b = 2\n";
+		PTreeArena changed;
+		changed.readIni(changed_str.data(), changed_str.size());
+		PTree ptree, ptree_stream;
+		changed.copy(ptree);
+		std::istringstream in(changed_str);
+		ReadIniStream(in, ptree_stream, ptree_stream);
+		QT_CHECK(ptree.get("a", str) && str == "1");
+		QT_CHECK(ptree_stream.get("a", str) && str == "1 ");
+		QT_CHECK(ptree.get("b", str) && str == "2");
+		QT_CHECK(!ptree_stream.get("b", str));
+	}
+
+	// a key with a value and a section is copied as the section, the value is dropped
+	{
+		const std::string both_str =
+			"engine = 1\n"
+			"[engine]\n"
+			"idle = 900\n";
+		PTreeArena both;
+		both.readIni(both_str.data(), both_str.size());
+		const PTreeArena::Node * node = both.root().find("engine", 6);
+		QT_CHECK(node && node->value().str() == "1" && node->size() == 1);
+		PTree ptree;
+		both.copy(ptree);
+		QT_CHECK(ptree.get("engine", str) && str != "1");
+		QT_CHECK(ptree.get("engine.idle", idle) && idle == 900);
+	}
+
+	const std::string inf_str =
+		"; comment\n"
+		"name test car\n"
+		"engine\n"
+		"{\n"
+		"\tidle 800 ; comment\n"
+		"\tposition 0.1,-0.2,10\n"
+		"}\n"
+		"mass 1250.5\n";
+
+	tree.readInf(inf_str.data(), inf_str.size());
+	idle = 0;
+	QT_CHECK(tree.root().get("engine.idle", idle, err));
+	QT_CHECK_EQUAL(idle, 800);
+	QT_CHECK(tree.root().get("name", str, err));
+	QT_CHECK_EQUAL(str, "test car");
+	QT_CHECK_EQUAL(tree.root().size(), 3);
+
+	// inf includes are resolved first, the keys of the node override them
+	const std::string include_str =
+		"engine\n"
+		"{\n"
+		"\tidle 900\n"
+		"\tinclude common\n"
+		"}\n";
+	tree.readInf(include_str.data(), include_str.size());
+	TestInclude include;
+	PTree ptree;
+	tree.copy(ptree, &include);
+	QT_CHECK(ptree.get("engine.idle", idle) && idle == 900);
+	QT_CHECK(ptree.get("engine.base", str) && str == "common");
+	QT_CHECK(!ptree.get("engine.include", str));
+}
+
+static unsigned CountNodes(const PTreeArena::Node & node)
+{
+	unsigned n = 1;
+	for (PTreeArena::Node::const_iterator i = node.begin(); i != node.end(); ++i)
+	{
+		n += CountNodes(*i);
+	}
+	return n;
+}
+
+MICROBENCH(ptreeload)
+{
+	std::vector<std::string> paths;
+	microbench::getDataFiles(ctx, microbench::CARS, "", ".car", paths);
+	microbench::getDataFiles(ctx, microbench::TRACKS, "", "track.txt", paths);
+	microbench::getDataFiles(ctx, microbench::TRACKS, "", "surfaces.txt", paths);
+
+	// parse every config a few times to get measurable timings
+	const int repeat = 10;
+	double stream = 0, arena = 0;
+	unsigned count = 0, bytes = 0, nodes = 0;
+	for (std::vector<std::string>::const_iterator i = paths.begin(); i != paths.end(); ++i)
+	{
+		std::ifstream file(i->c_str(), std::ios::binary);
+		if (!file.good())
+			continue;
+
+		const double stream_start = microbench::getTime();
+		for (int n = 0; n < repeat; ++n)
+		{
+			file.clear();
+			file.seekg(0);
+			PTree ptree;
+			ReadIniStream(file, ptree, ptree);
+		}
+		stream += microbench::getTime() - stream_start;
+
+		const double arena_start = microbench::getTime();
+		PTreeArena tree;
+		for (int n = 0; n < repeat; ++n)
+		{
+			tree.loadIni(*i, ctx.error_output);
+		}
+		arena += microbench::getTime() - arena_start;
+
+		file.clear();
+		file.seekg(0, std::ios::end);
+		bytes += file.tellg();
+		nodes += CountNodes(tree.root());
+		count++;
+	}
+
+	ctx.info_output << "ptree: " << count << " configs, " << bytes / 1024 << " KB, "
+		<< nodes << " nodes, stream " << stream / repeat << " s, arena " << arena / repeat << " s" << std::endl;
+}
@@ -0,0 +1,268 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _PTREE_ARENA_H
+#define _PTREE_ARENA_H
+
+#include "ptree.h"
+#include "mappedfile.h"
+#include <cstring>
+
+/// read only property tree parsed in place
+/// nodes are stored in a single array, the children of a node next to each other sorted by key
+/// keys and values point into the parsed buffer, equal keys share the first occurrence
+class PTreeArena
+{
+public:
+	/// string in the parsed buffer, not null terminated
+	struct String
+	{
+		const char * data;
+		unsigned size;
+
+		std::string str() const;
+	};
+
+	class Node
+	{
+	public:
+		typedef const Node * const_iterator;
+
+		/// children nodes begin
+		const_iterator begin() const;
+
+		/// children nodes end
+		const_iterator end() const;
+
+		/// get number of chidren nodes, 0 if leaf
+		int size() const;
+
+		/// get node key, empty for root
+		const String & key() const;
+
+		/// get leaf value
+		const String & value() const;
+
+		/// get parent node, null for root
+		const Node * parent() const;
+
+		/// get child node, null if not found
+		const Node * find(const char * key, unsigned length) const;
+
+		/// get key value
+		/// compound keys are supported: car.wheel.size
+		/// return false if not found
+		template <typename T>
+		bool get(const std::string & key, T & value) const;
+
+		/// get key value, log not found error
+		template <typename T>
+		bool get(const std::string & key, T & value, std::ostream & error) const;
+
+		/// get full node name (down to root)
+		std::string fullname(const std::string & name = std::string()) const;
+
+	private:
+		friend class PTreeArena;
+		String _key;
+		String _value;
+		const Node * _parent;
+		const Node * _children;
+		unsigned _size;
+
+		/// get typed value from value string template
+		template <typename T>
+		void _get(T & value) const;
+	};
+
+	PTreeArena();
+
+	/// map and parse an ini file, return false if it can't be opened
+	bool loadIni(const std::string & path, std::ostream & error);
+
+	/// map and parse an inf file, return false if it can't be opened
+	bool loadInf(const std::string & path, std::ostream & error);
+
+	/// parse ini data, the data has to stay valid while the tree is used
+	void readIni(const char * data, unsigned size);
+
+	/// parse inf data, the data has to stay valid while the tree is used
+	void readInf(const char * data, unsigned size);
+
+	/// copy into a property tree, resolve includes if include is set
+	void copy(PTree & p, Include * include = 0) const;
+
+	/// get root node
+	const Node & root() const;
+
+	/// clear nodes and unmap the file
+	void clear();
+
+private:
+	enum Format {INI, INF};
+	struct Builder;
+	std::vector<Node> _nodes;
+	MappedFile _file;
+	Format _format;
+
+	/// store the parsed tree, children sorted by key
+	void _build(const Builder & builder);
+
+	void _copy(const Node & node, PTree & p, Include * include) const;
+
+	PTreeArena(const PTreeArena & other);
+	PTreeArena & operator=(const PTreeArena & other);
+};
+
+// implementation
+
+inline std::string PTreeArena::String::str() const
+{
+	return std::string(data, size);
+}
+
+inline PTreeArena::Node::const_iterator PTreeArena::Node::begin() const
+{
+	return _children;
+}
+
+inline PTreeArena::Node::const_iterator PTreeArena::Node::end() const
+{
+	return _children + _size;
+}
+
+inline int PTreeArena::Node::size() const
+{
+	return _size;
+}
+
+inline const PTreeArena::String & PTreeArena::Node::key() const
+{
+	return _key;
+}
+
+inline const PTreeArena::String & PTreeArena::Node::value() const
+{
+	return _value;
+}
+
+inline const PTreeArena::Node * PTreeArena::Node::parent() const
+{
+	return _parent;
+}
+
+inline const PTreeArena::Node * PTreeArena::Node::find(const char * key, unsigned length) const
+{
+	// binary search of the sorted children
+	unsigned first = 0, last = _size;
+	while (first < last)
+	{
+		const unsigned middle = (first + last) / 2;
+		const String & k = _children[middle]._key;
+		int cmp = std::memcmp(k.data, key, k.size < length ? k.size : length);
+		if (cmp == 0)
+			cmp = int(k.size) - int(length);
+		if (cmp == 0)
+			return _children + middle;
+		if (cmp < 0)
+			first = middle + 1;
+		else
+			last = middle;
+	}
+	return 0;
+}
+
+template <typename T>
+inline bool PTreeArena::Node::get(const std::string & key, T & value) const
+{
+	const Node * node = this;
+	size_t begin = 0;
+	while (true)
+	{
+		size_t next = key.find('.', begin);
+		if (next == std::string::npos)
+			next = key.length();
+
+		node = node->find(key.data() + begin, next - begin);
+		if (!node)
+			return false;
+
+		if (next >= key.length() - 1)
+		{
+			node->_get(value);
+			return true;
+		}
+		begin = next + 1;
+	}
+}
+
+template <typename T>
+inline bool PTreeArena::Node::get(const std::string & key, T & value, std::ostream & error) const
+{
+	if (get(key, value))
+	{
+		return true;
+	}
+
+	error << fullname(key) << " not found." << std::endl;
+	return false;
+}
+
+template <typename T>
+inline void PTreeArena::Node::_get(T & value) const
+{
+	std::istringstream s(_value.str());
+	s >> value;
+}
+
+inline const PTreeArena::Node & PTreeArena::root() const
+{
+	return _nodes[0];
+}
+
+// specialization
+
+template <>
+inline void PTreeArena::Node::_get<std::string>(std::string & value) const
+{
+	value.assign(_value.data, _value.size);
+}
+
+template <>
+inline void PTreeArena::Node::_get<const PTreeArena::Node *>(const Node * & value) const
+{
+	value = this;
+}
+
+template <>
+void PTreeArena::Node::_get<bool>(bool & value) const;
+
+template <>
+void PTreeArena::Node::_get<int>(int & value) const;
+
+template <>
+void PTreeArena::Node::_get<float>(float & value) const;
+
+template <>
+void PTreeArena::Node::_get<double>(double & value) const;
+
+template <>
+void PTreeArena::Node::_get<std::vector<float> >(std::vector<float> & value) const;
+
+#endif // _PTREE_ARENA_H
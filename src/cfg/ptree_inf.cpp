@@ -33,60 +33,7 @@
  *
  */
 
-#include "ptree.h"
-
-static void read_inf(std::istream & in, PTree & node, Include * include, bool child)
-{
-	std::string line, name;
-	while (in.good())
-	{
-		std::getline(in, line, '\n');
-		if (line.empty())
-		{
-			continue;
-		}
-
-		size_t begin = line.find_first_not_of(" \t");
-		size_t end = line.find_first_of(";#");
-		if (begin >= end)
-		{
-			continue;
-		}
-
-		line = line.substr(begin, end);
-		if (line[0] == '{' && name.length())
-		{
-			// New node.
-			read_inf(in, node.set(name, PTree()), include, true);
-			continue;
-		}
-
-		if (line[0] == '}' && child)
-		{
-			break;
-		}
-
-		size_t next = line.find(" ");
-		end = line.length();
-		name = line.substr(0, next);
-		if (next < end)
-		{
-			// New property.
-			std::string value = line.substr(next+1, end);
-
-			// Include?
-			if (include && name == "include")
-			{
-				(*include)(node, value);
-			}
-			else
-			{
-				node.set(name, value);
-			}
-			name.clear();
-		}
-	}
-}
+#include "ptree_arena.h"
 
 static void write_inf(const PTree & p, std::ostream & out, std::string indent)
 {
@@ -109,7 +56,13 @@ static void write_inf(const PTree & p, std::ostream & out, std::string indent)
 
 void read_inf(std::istream & in, PTree & p, Include * inc)
 {
-	read_inf(in, p, inc, false);
+	std::ostringstream s;
+	s << in.rdbuf();
+	const std::string data = s.str();
+
+	PTreeArena tree;
+	tree.readInf(data.data(), data.size());
+	tree.copy(p, inc);
 }
 
 void write_inf(const PTree & p, std::ostream & out)
@@ -31,78 +31,7 @@
  *
  */
 
-#include "ptree.h"
-
-struct ini
-{
-	std::istream & in;
-	PTree & root;
-	Include * include;
-
-	ini(std::istream & in, PTree & root, Include * inc) :
-		in(in), root(root), include(inc)
-	{
-		// Constructor.
-	}
-
-	void read()
-	{
-		read(root);
-	}
-
-	void read(PTree & node)
-	{
-		std::string line, name;
-		while (in.good())
-		{
-			std::getline(in, line, '\n');
-			if (line.empty())
-			{
-				continue;
-			}
-
-			size_t begin = line.find_first_not_of(" \t[");
-			size_t end = line.find_first_of(";#]\r", begin);
-			if (begin >= end)
-			{
-				continue;
-			}
-
-			size_t next = line.find("=", begin);
-			if (next >= end)
-			{
-				// New node.
-				next = line.find_last_not_of(" \t\r]", end);
-				name = line.substr(begin, next);
-				read(root.set(name, PTree()));
-				continue;
-			}
-
-			size_t next2 = line.find_first_not_of(" \t\r", next+1);
-			next = line.find_last_not_of(" \t", next-1);
-			if (next2 >= end)
-			{
-				continue;
-			}
-
-			// New property.
-			name = line.substr(begin, next+1);
-			//std::string value = line.substr(next2, end-next2-1);
-			if (include && line.at(next2) == '&')//name == "include")
-			{
-				// Value is a reference, include.
-				std::string value = line.substr(next2+1, end-next2-1);
-				//(*include)(node, value);
-				(*include)(node.set(name, value), value);
-			}
-			else
-			{
-				std::string value = line.substr(next2, end-next2);
-				node.set(name, value);
-			}
-		}
-	}
-};
+#include "ptree_arena.h"
 
 static void write_ini(const PTree & p, std::ostream & out, std::string key_name)
 {
@@ -127,8 +56,13 @@ static void write_ini(const PTree & p, std::ostream & out, std::string key_name)
 
 void read_ini(std::istream & in, PTree & p, Include * inc)
 {
-	ini reader(in, p, inc);
-	reader.read();
+	std::ostringstream s;
+	s << in.rdbuf();
+	const std::string data = s.str();
+
+	PTreeArena tree;
+	tree.readIni(data.data(), data.size());
+	tree.copy(p, inc);
 }
 
 void write_ini(const PTree & p, std::ostream & out)
@@ -18,17 +18,139 @@
 /************************************************************************/
 
 #include "contentmanager.h"
+#include "graphics/texture.h"
+#include "graphics/model.h"
+#include "sound/soundbuffer.h"
+#include "cfg/ptree.h"
+#include "microbench.h"
+#include "unittest.h"
+#include <SDL2/SDL_surface.h>
+#include <SDL2/SDL_timer.h>
+#include <algorithm>
+#include <fstream>
 
 ContentManager::ContentManager(std::ostream & error) :
-	error(error)
+	queue_lock(SDL_CreateMutex()),
+	sequence(0),
+	running(0),
+	max_loads(0),
+	budget(0),
+	main_thread(SDL_ThreadID()),
+	error(error),
+	error_lock(SDL_CreateMutex())
 {
 	// ctor
 }
 
 ContentManager::~ContentManager()
 {
-	sweep();
+	// drop queued requests, wait for the running ones
+	SDL_LockMutex(queue_lock);
+	for (size_t i = 0; i < queue.size(); ++i)
+	{
+		queue[i]->setState(Request::DONE);
+	}
+	queue.clear();
+	std::vector<RequestPtr> pending = requests;
+	SDL_UnlockMutex(queue_lock);
+
+	for (size_t i = 0; i < pending.size(); ++i)
+	{
+		JobSystem::instance().Wait(pending[i]->counter);
+		pending[i]->release();
+	}
+	pending.clear();
+	requests.clear();
+	finishing.clear();
+
+	// drop all unreferenced content regardless of the budget
+	_release();
+	for (size_t i = 0; i < factory_cached.m_caches.size(); ++i)
+	{
+		factory_cached.m_caches[i]->sweep(false);
+	}
 	_logleaks();
+
+	SDL_DestroyMutex(error_lock);
+	SDL_DestroyMutex(queue_lock);
+}
+
+int ContentManager::update()
+{
+	JobSystem & jobs = JobSystem::instance();
+
+	// without worker threads jobs only run while they are waited for
+	if (jobs.GetNumThreads() < 2)
+	{
+		RequestPtr request;
+		SDL_LockMutex(queue_lock);
+		for (size_t i = 0; i < requests.size() && !request.get(); ++i)
+		{
+			if (requests[i]->getState() == Request::RUNNING)
+				request = requests[i];
+		}
+		SDL_UnlockMutex(queue_lock);
+
+		if (request.get())
+			jobs.Wait(request->counter);
+	}
+
+	std::vector<RequestPtr> finished;
+	SDL_LockMutex(queue_lock);
+	finished.swap(finishing);
+	SDL_UnlockMutex(queue_lock);
+
+	for (size_t i = 0; i < finished.size(); ++i)
+	{
+		Request & request = *finished[i];
+		request.finish();
+		_log(request.log);
+		request.setState(Request::DONE);
+	}
+
+	_release();
+
+	if (budget)
+		_evict();
+
+	return finished.size();
+}
+
+void ContentManager::setMaxLoads(int value)
+{
+	SDL_LockMutex(queue_lock);
+	max_loads = value;
+	_start();
+	SDL_UnlockMutex(queue_lock);
+}
+
+bool ContentManager::find(
+	const std::string & path,
+	const std::string & name,
+	std::string & relpath,
+	std::string & abspath) const
+{
+	for (size_t i = 0; i < basepaths.size(); ++i)
+	{
+		const std::string filepath = basepaths[i] + "/" + path + "/" + name;
+		if (std::ifstream(filepath.c_str()))
+		{
+			relpath = path;
+			abspath = filepath;
+			return true;
+		}
+	}
+	for (size_t i = 0; i < sharedpaths.size(); ++i)
+	{
+		const std::string filepath = sharedpaths[i] + "/" + name;
+		if (std::ifstream(filepath.c_str()))
+		{
+			relpath.clear();
+			abspath = filepath;
+			return true;
+		}
+	}
+	return false;
 }
 
 void ContentManager::addSharedPath(const std::string & path)
@@ -43,10 +165,50 @@ void ContentManager::addPath(const std::string & path)
 
 void ContentManager::sweep()
 {
+	_release();
+
+	// the budget only applies to content with a footprint
 	for (size_t i = 0; i < factory_cached.m_caches.size(); ++i)
 	{
-		factory_cached.m_caches[i]->sweep();
+		factory_cached.m_caches[i]->sweep(budget != 0);
 	}
+
+	if (budget)
+		_evict();
+}
+
+void ContentManager::setBudget(size_t bytes)
+{
+	budget = bytes;
+}
+
+void ContentManager::logStats(std::ostream & out) const
+{
+	size_t bytes = 0;
+	for (size_t i = 0; i < factory_cached.m_caches.size(); ++i)
+	{
+		const Cache & cache = *factory_cached.m_caches[i];
+		cache.stats(out);
+		SDL_LockMutex(cache.lock);
+		bytes += cache.bytes;
+		SDL_UnlockMutex(cache.lock);
+	}
+	out << "Content " << (bytes >> 10) << " KB";
+	if (budget)
+		out << " of " << (budget >> 10) << " KB budget";
+	out << std::endl;
+}
+
+void ContentManager::_log(const std::ostringstream & log)
+{
+	const std::string str = log.str();
+	if (str.empty())
+		return;
+
+	SDL_LockMutex(error_lock);
+	error << str;
+	error.flush();
+	SDL_UnlockMutex(error_lock);
 }
 
 bool ContentManager::_logleaks()
@@ -59,29 +221,453 @@ bool ContentManager::_logleaks()
 	if (n == 0)
 		return false;
 
+	logStats(error);
+
 	error << "Leaked " << n << " cached objects:";
 	for (size_t i = 0; i < factory_cached.m_caches.size(); ++i)
 	{
-		error << "\n";
 		factory_cached.m_caches[i]->log(error);
 	}
 	error << std::endl;
 	return false;
 }
 
+void ContentManager::_evict()
+{
+	size_t bytes = 0;
+	for (size_t i = 0; i < factory_cached.m_caches.size(); ++i)
+	{
+		const Cache & cache = *factory_cached.m_caches[i];
+		SDL_LockMutex(cache.lock);
+		bytes += cache.bytes;
+		SDL_UnlockMutex(cache.lock);
+	}
+	if (bytes <= budget)
+		return;
+
+	std::vector<CacheUnused> entries;
+	for (size_t i = 0; i < factory_cached.m_caches.size(); ++i)
+	{
+		factory_cached.m_caches[i]->unused(entries);
+	}
+	std::sort(entries.begin(), entries.end());
+
+	for (size_t i = 0; i < entries.size() && bytes > budget; ++i)
+	{
+		bytes -= entries[i].cache->evict(entries[i].key);
+	}
+}
+
+size_t ContentManager::_footprint(const Texture & texture)
+{
+	return texture.GetMemorySize();
+}
+
+size_t ContentManager::_footprint(const Model & model)
+{
+	return model.GetMemorySize();
+}
+
+size_t ContentManager::_footprint(const SoundBuffer & sound)
+{
+	return sound.GetMemorySize();
+}
+
 bool ContentManager::_logerror(
 	const std::string & path,
-	const std::string & name)
+	const std::string & name,
+	std::ostream & log)
 {
-	error << "Failed to load \"" << name << "\" from:";
+	log << "Failed to load \"" << name << "\" from:";
 	for (size_t i = 0; i < basepaths.size(); ++i)
 	{
-		error << "\n" << basepaths[i] + '/' + path;
+		log << "\n" << basepaths[i] + '/' + path;
 	}
 	for (size_t i = 0; i < sharedpaths.size(); ++i)
 	{
-		error << "\n" << sharedpaths[i];
+		log << "\n" << sharedpaths[i];
 	}
-	error << std::endl;
+	log << "\n";
 	return false;
 }
+
+void ContentManager::_queue(const RequestPtr & request)
+{
+	SDL_LockMutex(queue_lock);
+	request->sequence = sequence++;
+	requests.push_back(request);
+	queue.push_back(request);
+	std::push_heap(queue.begin(), queue.end(), RequestOrder());
+	_start();
+	SDL_UnlockMutex(queue_lock);
+}
+
+void ContentManager::_start()
+{
+	const int slots = (max_loads > 0) ? max_loads :
+		std::max(1, JobSystem::instance().GetNumThreads() - 1);
+	while (!queue.empty() && running < slots)
+	{
+		std::pop_heap(queue.begin(), queue.end(), RequestOrder());
+		RequestPtr request = queue.back();
+		queue.pop_back();
+		_run(*request);
+	}
+}
+
+void ContentManager::_run(Request & request)
+{
+	request.setState(Request::RUNNING);
+	running++;
+	JobSystem::instance().Run(request, &request.counter);
+}
+
+void ContentManager::_loaded(Request & request, bool finish)
+{
+	if (!finish)
+	{
+		_log(request.log);
+	}
+
+	SDL_LockMutex(queue_lock);
+	running--;
+	if (finish)
+	{
+		request.setState(Request::LOADED);
+		finishing.push_back(request.shared_from_this());
+	}
+	else
+	{
+		request.setState(Request::DONE);
+	}
+	_start();
+	SDL_UnlockMutex(queue_lock);
+}
+
+void ContentManager::_waitworker(Request & request)
+{
+	// needed now, start it regardless of the free slots
+	SDL_LockMutex(queue_lock);
+	if (request.getState() == Request::QUEUED)
+	{
+		queue.erase(std::find(queue.begin(), queue.end(), request.shared_from_this()));
+		std::make_heap(queue.begin(), queue.end(), RequestOrder());
+		_run(request);
+	}
+	SDL_UnlockMutex(queue_lock);
+
+	JobSystem::instance().Wait(request.counter);
+}
+
+void ContentManager::_waitrequest(Request & request)
+{
+	_waitworker(request);
+
+	if (request.getState() == Request::LOADED)
+	{
+		if (SDL_ThreadID() == main_thread)
+		{
+			_finish(request);
+		}
+		else
+		{
+			while (request.getState() != Request::DONE)
+				SDL_Delay(0);
+		}
+	}
+}
+
+void ContentManager::_finish(Request & request)
+{
+	SDL_LockMutex(queue_lock);
+	std::vector<RequestPtr>::iterator i =
+		std::find(finishing.begin(), finishing.end(), request.shared_from_this());
+	if (i == finishing.end())
+	{
+		// finished already
+		SDL_UnlockMutex(queue_lock);
+		return;
+	}
+	RequestPtr ptr = *i;
+	finishing.erase(i);
+	SDL_UnlockMutex(queue_lock);
+
+	request.finish();
+	_log(request.log);
+	request.setState(Request::DONE);
+}
+
+void ContentManager::_release()
+{
+	// the job system might still touch the counter of a request until it is done
+	std::vector<RequestPtr> released;
+	SDL_LockMutex(queue_lock);
+	for (size_t i = 0; i < requests.size();)
+	{
+		if (requests[i]->getState() == Request::DONE && requests[i]->counter.Done())
+		{
+			released.push_back(requests[i]);
+			requests[i] = requests.back();
+			requests.pop_back();
+		}
+		else
+		{
+			++i;
+		}
+	}
+	SDL_UnlockMutex(queue_lock);
+
+	for (size_t i = 0; i < released.size(); ++i)
+	{
+		released[i]->release();
+	}
+}
+
+ContentManager::Request::Request(ContentManager & manager, int priority) :
+	manager(manager),
+	priority(priority),
+	sequence(0),
+	time(0)
+{
+	SDL_AtomicSet(&state, QUEUED);
+}
+
+ContentManager::Request::State ContentManager::Request::getState() const
+{
+	return State(SDL_AtomicGet(&state));
+}
+
+void ContentManager::Request::setState(State value)
+{
+	SDL_AtomicSet(&state, value);
+}
+
+void ContentManager::Request::Execute()
+{
+	const double start = microbench::getTime();
+	const bool finish = load();
+	time = microbench::getTime() - start;
+	manager._loaded(*this, finish);
+}
+
+ContentManager::Cache::Cache() :
+	lock(SDL_CreateMutex()),
+	clock(0),
+	name(""),
+	bytes(0),
+	hits(0),
+	loads(0),
+	evictions(0)
+{
+	// ctor
+}
+
+ContentManager::Cache::~Cache()
+{
+	SDL_DestroyMutex(lock);
+}
+
+void ContentManager::Cache::stats(std::ostream & out) const
+{
+	SDL_LockMutex(lock);
+	const unsigned int lookups = hits + loads;
+	out << name << ": " << size() << " cached, " << (bytes >> 10) << " KB, " <<
+		hits << " hits, " << loads << " loads, " <<
+		(lookups ? hits * 100 / lookups : 0) << "% hit rate, " <<
+		evictions << " evicted" << std::endl;
+	SDL_UnlockMutex(lock);
+}
+
+ContentManager::RequestParam<Texture, TextureInfo>::RequestParam(
+	ContentManager & manager,
+	const std::string & path,
+	const std::string & name,
+	const TextureInfo & param,
+	int priority) :
+	RequestShared<Texture>(manager, path + name, priority),
+	path(path),
+	name(name),
+	param(param)
+{
+	this->param.surface = 0;
+	this->param.dds = 0;
+}
+
+ContentManager::RequestParam<Texture, TextureInfo>::~RequestParam()
+{
+	SDL_FreeSurface(param.surface);
+}
+
+bool ContentManager::RequestParam<Texture, TextureInfo>::load()
+{
+	// cached textures need no upload, done without the main thread
+	if (manager._get(sptr, path + name))
+	{
+		loaded = true;
+		return false;
+	}
+
+	// headless textures are not uploaded either, loading them only looks up the default
+	if (manager.getFactory<Texture>().getHeadless())
+	{
+		finish();
+		return false;
+	}
+
+	std::string abspath;
+	if (manager.find(path, name, relpath, abspath))
+	{
+		loadtrace::Scope trace("Texture::Decode", name);
+
+		// images which can't be cooked are decoded
+		if (!manager.getFactory<Texture>().cook(abspath, param, dds, param.surface) && !param.surface)
+			param.surface = Texture::Decode(abspath);
+
+		trace.countFile(abspath);
+	}
+	return true;
+}
+
+void ContentManager::RequestParam<Texture, TextureInfo>::finish()
+{
+	// upload the cooked or decoded texture, load the file if it hasn't been decoded
+	if (!dds.empty())
+	{
+		param.dds = &dds[0];
+		param.ddssize = dds.size();
+		loaded = manager._load(sptr, manager.basepaths, relpath, name, param, log);
+		param.dds = 0;
+		std::vector<char>().swap(dds);
+	}
+	else if (param.surface)
+	{
+		loaded = manager._load(sptr, manager.basepaths, relpath, name, param, log);
+		SDL_FreeSurface(param.surface);
+		param.surface = 0;
+	}
+	if (!loaded)
+	{
+		loaded =
+			manager._load(sptr, manager.basepaths, path, name, param, log) ||
+			manager._load(sptr, manager.sharedpaths, "", name, param, log) ||
+			manager._getdefault(sptr) ||
+			manager._logerror(path, name, log);
+	}
+}
+
+QT_TEST(contentmanager_budget_test)
+{
+	std::ostringstream error;
+	std::vector<float> vertices(3 * 8192, 1.0f);
+	std::vector<unsigned int> faces(3 * 8192, 0);
+	VertexArray varray;
+	varray.Add(&faces[0], faces.size(), &vertices[0], vertices.size());
+	Model model;
+	model.Load(varray, error);
+	const size_t size = model.GetMemorySize();
+
+	std::tr1::weak_ptr<Model> a, b, c;
+	{
+		ContentManager content(error);
+		content.addPath("");
+		content.setBudget(size * 5 / 2);
+		content.getFactory<PTree>().init(read_ini, write_ini, content);
+
+		std::tr1::shared_ptr<Model> sa, sb, sc;
+		content.load(sa, "", "a", varray);
+		content.load(sb, "", "b", varray);
+		content.load(sc, "", "c", varray);
+		a = sa;
+		b = sb;
+		c = sc;
+
+		// referenced content is kept over budget
+		content.sweep();
+		QT_CHECK(!a.expired() && !b.expired() && !c.expired());
+
+		// least recently used unreferenced content is evicted until within budget
+		content.get(sa, "", "a");
+		sa.reset();
+		sb.reset();
+		sc.reset();
+		content.sweep();
+		QT_CHECK(b.expired());
+		QT_CHECK(!a.expired() && !c.expired());
+
+		std::ostringstream expected, stats;
+		expected << "Model: 2 cached, " << ((2 * size) >> 10) << " KB, 1 hits, 3 loads, 25% hit rate, 1 evicted";
+		content.logStats(stats);
+		QT_CHECK(stats.str().find(expected.str()) != std::string::npos);
+
+		// content without a footprint is dropped within budget
+		std::tr1::shared_ptr<PTree> sp;
+		content.load(sp, "", "p", std::string("a = 1"));
+		std::tr1::weak_ptr<PTree> p = sp;
+		sp.reset();
+		content.sweep();
+		QT_CHECK(p.expired());
+		QT_CHECK(!a.expired() && !c.expired());
+	}
+
+	// unreferenced content is released on shutdown regardless of the budget
+	QT_CHECK(a.expired() && c.expired());
+	QT_CHECK_EQUAL(error.str().find("Leaked"), std::string::npos);
+}
+
+static int GetTexture(void * data)
+{
+	std::tr1::shared_ptr<Texture> sptr;
+	static_cast<ContentHandle<Texture> *>(data)->get(sptr);
+	return 0;
+}
+
+QT_TEST(contentmanager_async_test)
+{
+	std::ostringstream error;
+	std::vector<float> vertices(9, 1.0f);
+	std::vector<unsigned int> faces(3, 0);
+	VertexArray varray;
+	varray.Add(&faces[0], faces.size(), &vertices[0], vertices.size());
+
+	ContentManager content(error);
+	content.addPath("");
+	content.setMaxLoads(1);
+	content.getFactory<Texture>().setHeadless(true);
+
+	// requests for content in flight share the request
+	ContentHandle<Model> a = content.loadAsync<Model>("", "a", varray);
+	ContentHandle<Model> b = content.loadAsync<Model>("", "b", varray);
+	ContentHandle<Model> c = content.loadAsync<Model>("", "c", varray, 1);
+	ContentHandle<Model> d = content.loadAsync<Model>("", "b", varray);
+
+	// without worker threads requests only run when waited for, one per update
+	if (JobSystem::instance().GetNumThreads() < 2)
+	{
+		QT_CHECK(!a.ready() && !b.ready() && !c.ready());
+		content.update();
+		QT_CHECK(a.ready() && !b.ready() && !c.ready());
+		content.update();
+		QT_CHECK(c.ready() && !b.ready() && !d.ready());
+		content.update();
+		QT_CHECK(b.ready() && d.ready());
+	}
+
+	std::tr1::shared_ptr<Model> sb, sd;
+	QT_CHECK(b.get(sb) && d.get(sd));
+	QT_CHECK(sb && sb == sd);
+
+	// cached content is ready right away
+	ContentHandle<Model> e = content.loadAsync<Model>("", "a", varray);
+	QT_CHECK(e.ready());
+
+	std::ostringstream stats;
+	content.logStats(stats);
+	QT_CHECK(stats.str().find("Model: 3 cached") != std::string::npos);
+
+	// headless textures have no main thread stage, other threads get them without update()
+	ContentHandle<Texture> t = content.loadAsync<Texture>("", "t", TextureInfo());
+	SDL_Thread * thread = SDL_CreateThread(&GetTexture, "content test", &t);
+	SDL_WaitThread(thread, 0);
+	QT_CHECK(t.ready());
+	QT_CHECK_EQUAL(error.str(), "");
+}
@@ -24,8 +24,16 @@
 #include "texturefactory.h"
 #include "modelfactory.h"
 #include "configfactory.h"
+#include "tiretablefactory.h"
+#include "jobsystem.h"
+#include "loadtrace.h"
+#include <SDL2/SDL_thread.h>
 #include <vector>
 #include <map>
+#include <sstream>
+
+template <class T>
+class ContentHandle;
 
 class ContentManager
 {
@@ -56,33 +64,208 @@ public:
 		const std::string & name,
 		const P & param);
 
+	/// load shared object on the job system, the handle is used to wait for it
+	/// requests for content which is being loaded already share the handle
+	/// higher priority requests are started first
+	template <class T>
+	ContentHandle<T> loadAsync(
+		const std::string & path,
+		const std::string & name,
+		int priority = 0);
+
+	/// support additional optional parameters
+	template <class T, class P>
+	ContentHandle<T> loadAsync(
+		const std::string & path,
+		const std::string & name,
+		const P & param,
+		int priority = 0);
+
+	/// finish asynchronous loads which need the main thread (texture uploads)
+	/// to be called once per frame by the main thread, returns number of finished loads
+	/// the main thread is the thread which created the content manager
+	int update();
+
+	/// max number of concurrent asynchronous loads
+	/// zero uses the number of job system threads minus one
+	void setMaxLoads(int value);
+
+	/// locate a content file, searching the paths in the same order as load
+	/// relpath is the cache path the content would be stored under
+	/// safe to call from worker threads as long as no paths are added
+	bool find(
+		const std::string & path,
+		const std::string & name,
+		std::string & relpath,
+		std::string & abspath) const;
+
 	/// add shared content directory path
 	void addSharedPath(const std::string & path);
 
 	/// add content directory path
 	void addPath(const std::string & path);
 
-	/// garbage collect unused content
+	/// garbage collect unused content, keeps the most recently used content within the budget
+	/// content without a footprint is always dropped
 	void sweep();
 
+	/// memory budget of the cached content in bytes, zero disables it
+	/// unreferenced content is evicted least recently used first while the budget is exceeded
+	void setBudget(size_t bytes);
+
+	/// per type cached content count, size and cache hit rate
+	void logStats(std::ostream & out) const;
+
 	/// factories access
 	template <class T>
 	Factory<T> & getFactory();
 
 private:
+	template <class T>
+	friend class ContentHandle;
+
+	/// asynchronous load request, executed as job
+	class Request : public Job, public std::tr1::enable_shared_from_this<Request>
+	{
+	public:
+		enum State { QUEUED, RUNNING, LOADED, DONE };
+
+		Request(ContentManager & manager, int priority);
+
+		virtual ~Request() {}
+
+		State getState() const;
+
+		void setState(State value);
+
+		void Execute();
+
+		/// worker thread stage, returns true if the main thread stage is required
+		virtual bool load() = 0;
+
+		/// main thread stage
+		virtual void finish() {}
+
+		/// remove from the requests in flight
+		virtual void release() = 0;
+
+		ContentManager & manager;
+		JobCounter counter;
+		std::ostringstream log;
+		mutable SDL_atomic_t state;
+		int priority;
+		unsigned int sequence;
+		double time; ///< worker stage time in seconds
+	};
+	typedef std::tr1::shared_ptr<Request> RequestPtr;
+
+	/// higher priority first, first come first served otherwise
+	struct RequestOrder
+	{
+		bool operator()(const RequestPtr & a, const RequestPtr & b) const
+		{
+			return a->priority < b->priority ||
+				(a->priority == b->priority && a->sequence > b->sequence);
+		}
+	};
+
+	template <class T>
+	class RequestShared : public Request
+	{
+	public:
+		RequestShared(ContentManager & manager, const std::string & key, int priority);
+
+		void release();
+
+		std::tr1::shared_ptr<T> sptr;
+		std::string key;
+		bool loaded;
+	};
+
+	template <class T, class P>
+	class RequestParam : public RequestShared<T>
+	{
+	public:
+		RequestParam(
+			ContentManager & manager,
+			const std::string & path,
+			const std::string & name,
+			const P & param,
+			int priority);
+
+		bool load();
+
+		std::string path;
+		std::string name;
+		P param;
+	};
+
+	struct Cache;
+
+	/// unreferenced cached content, eviction candidate
+	struct CacheUnused
+	{
+		Cache * cache;
+		std::string key;
+		int used;
+
+		bool operator<(const CacheUnused & other) const
+		{
+			return used - other.used < 0;
+		}
+	};
+
+	/// caches are guarded by a lock each, it also guards the requests in flight
 	struct Cache
 	{
+		Cache();
+		virtual ~Cache();
 		virtual void log(std::ostream & log) const = 0;
 		virtual size_t size() const = 0;
-		virtual void sweep() = 0;
+
+		/// drop unreferenced content, keep_accounted keeps the content with a footprint
+		virtual void sweep(bool keep_accounted) = 0;
+
+		/// append the unreferenced content
+		virtual void unused(std::vector<CacheUnused> & entries) const = 0;
+
+		/// drop content if it is still unreferenced, returns its size
+		virtual size_t evict(const std::string & key) = 0;
+
+		/// cached content count, size and hit rate
+		void stats(std::ostream & out) const;
+
+		SDL_mutex * lock;
+		SDL_atomic_t * clock;	///< use stamps, shared by all caches
+		const char * name;		///< content type
+		size_t bytes;			///< memory footprint of the cached content
+		unsigned int hits;		///< lookups which found the content
+		unsigned int loads;		///< content loaded into the cache
+		unsigned int evictions;	///< content dropped to stay within the budget
 	};
 
+	/// cached content with its memory footprint and last use stamp
 	template <class T>
-	class CacheShared : public Cache, public std::map<std::string, std::tr1::shared_ptr<T> >
+	struct CacheEntry
 	{
+		std::tr1::shared_ptr<T> sptr;
+		size_t bytes;
+		int used;
+	};
+
+	template <class T>
+	class CacheShared : public Cache, public std::map<std::string, CacheEntry<T> >
+	{
+	public:
+		typedef std::map<std::string, std::tr1::shared_ptr<RequestShared<T> > > RequestMap;
+		RequestMap loading;
+
+	private:
 		void log(std::ostream & log) const;
 		size_t size() const;
-		void sweep();
+		void sweep(bool keep_accounted);
+		void unused(std::vector<CacheUnused> & entries) const;
+		size_t evict(const std::string & key);
 	};
 
 	/// register content factories
@@ -90,6 +273,7 @@ private:
 	struct FactoryCached
 	{
 		std::vector<Cache*> m_caches;
+		SDL_atomic_t m_clock;
 
 		#define REGISTER(T)\
 		Factory<T> T ## _factory;\
@@ -100,15 +284,20 @@ private:
 		REGISTER(Texture)
 		REGISTER(Model)
 		REGISTER(PTree)
+		REGISTER(TireTable)
 		#undef REGISTER
 
 		FactoryCached()
 		{
-			#define INIT(T) m_caches.push_back(&T ## _cache);
+			SDL_AtomicSet(&m_clock, 0);
+			#define INIT(T) m_caches.push_back(&T ## _cache);\
+			T ## _cache.clock = &m_clock;\
+			T ## _cache.name = #T;
 			INIT(SoundBuffer)
 			INIT(Texture)
 			INIT(Model)
 			INIT(PTree)
+			INIT(TireTable)
 			#undef INIT
 		}
 
@@ -118,16 +307,46 @@ private:
 	std::vector<std::string> sharedpaths;
 	std::vector<std::string> basepaths;
 
-	/// error log
+	/// asynchronous loads, the queue is a heap ordered by RequestOrder
+	std::vector<RequestPtr> requests; ///< requests not released yet
+	std::vector<RequestPtr> queue; ///< requests waiting for a free slot
+	std::vector<RequestPtr> finishing; ///< requests waiting for the main thread
+	SDL_mutex * queue_lock;
+	unsigned int sequence;
+	int running;
+	int max_loads;
+
+	/// cached content memory budget, zero if unlimited
+	size_t budget;
+
+	/// thread owning the graphics context, runs the main thread stage of requests
+	SDL_threadID main_thread;
+
+	/// error log, guarded by the error lock
 	std::ostream & error;
+	SDL_mutex * error_lock;
+
+	/// write messages to the error log, thread safe
+	void _log(const std::ostringstream & log);
 
 	/// content leak logger
 	bool _logleaks();
 
+	/// evict unreferenced content until the caches fit into the budget, main thread only
+	void _evict();
+
+	/// memory footprint of content, zero for content types which don't report it
+	template <class T>
+	static size_t _footprint(const T &) {return 0;}
+	static size_t _footprint(const Texture & texture);
+	static size_t _footprint(const Model & model);
+	static size_t _footprint(const SoundBuffer & sound);
+
 	/// error logger
 	bool _logerror(
 		const std::string & path,
-		const std::string & name);
+		const std::string & name,
+		std::ostream & log);
 
 	/// get implementation
 	template <class T>
@@ -142,11 +361,92 @@ private:
 		const std::vector<std::string> & basepaths,
 		const std::string & relpath,
 		const std::string & name,
-		const P & param);
+		const P & param,
+		std::ostream & log);
 
 	/// get default object instance
 	template <class T>
 	bool _getdefault(std::tr1::shared_ptr<T> & sptr);
+
+	/// wait for an asynchronous load of the content, if any
+	template <class T>
+	bool _wait(
+		std::tr1::shared_ptr<T> & sptr,
+		const std::string & key);
+
+	/// queue request, start it if there is a free slot
+	void _queue(const RequestPtr & request);
+
+	/// start queued requests while there are free slots, queue lock required
+	void _start();
+
+	/// start request, queue lock required
+	void _run(Request & request);
+
+	/// worker thread stage has finished
+	void _loaded(Request & request, bool finish);
+
+	/// wait for the worker stage of the request, starts it if it is still queued
+	void _waitworker(Request & request);
+
+	/// wait for the request, starts it if it is still queued
+	/// the main thread stage is left to update() when called from another thread
+	void _waitrequest(Request & request);
+
+	/// run main thread stage of the request
+	void _finish(Request & request);
+
+	/// release finished requests
+	void _release();
+};
+
+/// Handle to content loaded by ContentManager::loadAsync.
+template <class T>
+class ContentHandle
+{
+public:
+	/// true if the content has finished loading or failed to load
+	bool ready() const;
+
+	/// wait for the worker stage of the load, get() runs the main thread stage
+	void wait() const;
+
+	/// worker stage time in seconds, zero if the content was cached
+	double time() const;
+
+	/// wait for the content, false if loading failed and sptr is the default object
+	/// content with a main thread stage (texture uploads) is finished by the calling thread
+	/// if it is the main thread, other threads block until the main thread calls update()
+	bool get(std::tr1::shared_ptr<T> & sptr) const;
+
+private:
+	friend class ContentManager;
+	std::tr1::shared_ptr<ContentManager::RequestShared<T> > request;
+};
+
+/// textures are decoded or read from the texture cache by a worker thread, the upload is done on the main thread
+template <>
+class ContentManager::RequestParam<Texture, TextureInfo> : public ContentManager::RequestShared<Texture>
+{
+public:
+	RequestParam(
+		ContentManager & manager,
+		const std::string & path,
+		const std::string & name,
+		const TextureInfo & param,
+		int priority);
+
+	~RequestParam();
+
+	bool load();
+
+	void finish();
+
+	std::string path;
+	std::string name;
+	std::string relpath;
+	TextureInfo param;
+	std::vector<char> dds;
 };
 
 template <class T>
@@ -177,12 +477,72 @@ inline bool ContentManager::load(
 	const std::string & name,
 	const P & param)
 {
+	// content might be loading asynchronously
+	if (_wait(sptr, path + name))
+	{
+		return true;
+	}
+
 	// check for the specialised version in basepaths
 	// fall back to the generic one in shared paths
-	return 	_load(sptr, basepaths, path, name, param) ||
-			_load(sptr, sharedpaths, "", name, param) ||
+	std::ostringstream log;
+	const bool loaded =
+			_load(sptr, basepaths, path, name, param, log) ||
+			_load(sptr, sharedpaths, "", name, param, log) ||
 			_getdefault(sptr) ||
-			_logerror(path, name);
+			_logerror(path, name, log);
+	_log(log);
+	return loaded;
+}
+
+template <class T>
+inline ContentHandle<T> ContentManager::loadAsync(
+	const std::string & path,
+	const std::string & name,
+	int priority)
+{
+	return loadAsync<T>(path, name, typename Factory<T>::empty(), priority);
+}
+
+template <class T, class P>
+inline ContentHandle<T> ContentManager::loadAsync(
+	const std::string & path,
+	const std::string & name,
+	const P & param,
+	int priority)
+{
+	ContentHandle<T> handle;
+	const std::string key = path + name;
+	CacheShared<T> & cache = factory_cached;
+	SDL_LockMutex(cache.lock);
+
+	// share requests in flight
+	typename CacheShared<T>::RequestMap::const_iterator i = cache.loading.find(key);
+	if (i != cache.loading.end())
+	{
+		handle.request = i->second;
+		SDL_UnlockMutex(cache.lock);
+		return handle;
+	}
+
+	std::tr1::shared_ptr<RequestParam<T, P> > request(
+		new RequestParam<T, P>(*this, path, name, param, priority));
+	handle.request = request;
+
+	// cached content needs no request
+	if (_get(request->sptr, key))
+	{
+		request->loaded = true;
+		request->setState(Request::DONE);
+		SDL_UnlockMutex(cache.lock);
+		return handle;
+	}
+
+	cache.loading[key] = request;
+	SDL_UnlockMutex(cache.lock);
+
+	_queue(request);
+	return handle;
 }
 
 template <class T>
@@ -192,13 +552,17 @@ inline bool ContentManager::_get(
 {
 	// retrieve from cache
 	CacheShared<T> & cache = factory_cached;
-	typename CacheShared<T>::const_iterator i = cache.find(name);
-	if (i != cache.end())
+	SDL_LockMutex(cache.lock);
+	typename CacheShared<T>::iterator i = cache.find(name);
+	const bool found = (i != cache.end());
+	if (found)
 	{
-		sptr = i->second;
-		return true;
+		sptr = i->second.sptr;
+		i->second.used = SDL_AtomicAdd(cache.clock, 1);
+		cache.hits++;
 	}
-	return false;
+	SDL_UnlockMutex(cache.lock);
+	return found;
 }
 
 template <class T, class P>
@@ -207,7 +571,8 @@ inline bool ContentManager::_load(
 	const std::vector<std::string> & basepaths,
 	const std::string & relpath,
 	const std::string & name,
-	const P & param)
+	const P & param,
+	std::ostream & log)
 {
 	// check cache
 	if (_get(sptr, relpath + name))
@@ -216,14 +581,31 @@ inline bool ContentManager::_load(
 	}
 
 	// load from basepaths
+	CacheShared<T> & cache = factory_cached;
+	loadtrace::Scope trace(cache.name, name);
 	Factory<T>& factory = getFactory<T>();
 	for (size_t i = 0; i < basepaths.size(); ++i)
 	{
-		if (factory.create(sptr, error, basepaths[i], relpath, name, param))
+		if (factory.create(sptr, log, basepaths[i], relpath, name, param))
 		{
-			// cache loaded content
-			CacheShared<T> & cache = factory_cached;
-			cache[relpath + name] = sptr;
+			if (trace.isActive())
+				trace.countFile(basepaths[i] + "/" + relpath + "/" + name);
+
+			// cache loaded content, keep the first one if loaded concurrently
+			CacheEntry<T> entry;
+			entry.sptr = sptr;
+			entry.bytes = _footprint(*sptr);
+			SDL_LockMutex(cache.lock);
+			entry.used = SDL_AtomicAdd(cache.clock, 1);
+			std::pair<typename CacheShared<T>::iterator, bool> i =
+				cache.insert(std::make_pair(relpath + name, entry));
+			if (i.second)
+			{
+				cache.bytes += entry.bytes;
+				cache.loads++;
+			}
+			sptr = i.first->second.sptr;
+			SDL_UnlockMutex(cache.lock);
 			return true;
 		}
 	}
@@ -238,33 +620,183 @@ inline bool ContentManager::_getdefault(std::tr1::shared_ptr<T> & sptr)
 	return false;
 }
 
+template <class T>
+inline bool ContentManager::_wait(
+	std::tr1::shared_ptr<T> & sptr,
+	const std::string & key)
+{
+	ContentHandle<T> handle;
+	CacheShared<T> & cache = factory_cached;
+	SDL_LockMutex(cache.lock);
+	typename CacheShared<T>::RequestMap::const_iterator i = cache.loading.find(key);
+	if (i != cache.loading.end())
+	{
+		handle.request = i->second;
+	}
+	SDL_UnlockMutex(cache.lock);
+	return handle.get(sptr);
+}
+
+template <class T>
+inline ContentManager::RequestShared<T>::RequestShared(
+	ContentManager & manager,
+	const std::string & key,
+	int priority) :
+	Request(manager, priority),
+	key(key),
+	loaded(false)
+{
+	// ctor
+}
+
+template <class T>
+inline void ContentManager::RequestShared<T>::release()
+{
+	CacheShared<T> & cache = this->manager.factory_cached;
+	SDL_LockMutex(cache.lock);
+	typename CacheShared<T>::RequestMap::iterator i = cache.loading.find(key);
+	if (i != cache.loading.end() && i->second.get() == this)
+	{
+		cache.loading.erase(i);
+	}
+	SDL_UnlockMutex(cache.lock);
+}
+
+template <class T, class P>
+inline ContentManager::RequestParam<T, P>::RequestParam(
+	ContentManager & manager,
+	const std::string & path,
+	const std::string & name,
+	const P & param,
+	int priority) :
+	RequestShared<T>(manager, path + name, priority),
+	path(path),
+	name(name),
+	param(param)
+{
+	// ctor
+}
+
+template <class T, class P>
+inline bool ContentManager::RequestParam<T, P>::load()
+{
+	ContentManager & m = this->manager;
+	this->loaded =
+		m._load(this->sptr, m.basepaths, path, name, param, this->log) ||
+		m._load(this->sptr, m.sharedpaths, "", name, param, this->log) ||
+		m._getdefault(this->sptr) ||
+		m._logerror(path, name, this->log);
+	return false;
+}
+
+template <class T>
+inline bool ContentHandle<T>::ready() const
+{
+	return request.get() && request->getState() == ContentManager::Request::DONE;
+}
+
+template <class T>
+inline void ContentHandle<T>::wait() const
+{
+	if (request.get())
+	{
+		request->manager._waitworker(*request);
+	}
+}
+
+template <class T>
+inline double ContentHandle<T>::time() const
+{
+	return request.get() ? request->time : 0;
+}
+
+template <class T>
+inline bool ContentHandle<T>::get(std::tr1::shared_ptr<T> & sptr) const
+{
+	if (!request.get())
+	{
+		return false;
+	}
+	request->manager._waitrequest(*request);
+	sptr = request->sptr;
+	return request->loaded;
+}
+
 template <class T>
 inline void ContentManager::CacheShared<T>::log(std::ostream & log) const
 {
+	SDL_LockMutex(lock);
 	typename CacheShared<T>::const_iterator it = CacheShared<T>::begin();
-	while (it != CacheShared<T>::end())
+	for (; it != CacheShared<T>::end(); ++it)
 	{
-		log << it->second.use_count() << " : " << it->first;
+		log << "\n" << it->second.sptr.use_count() << " : " << it->first;
 	}
+	SDL_UnlockMutex(lock);
 }
 
 template <class T>
 inline size_t ContentManager::CacheShared<T>::size() const
 {
-	return std::map<std::string, std::tr1::shared_ptr<T> >::size();
+	SDL_LockMutex(lock);
+	const size_t n = std::map<std::string, CacheEntry<T> >::size();
+	SDL_UnlockMutex(lock);
+	return n;
 }
 
 template <class T>
-inline void ContentManager::CacheShared<T>::sweep()
+inline void ContentManager::CacheShared<T>::sweep(bool keep_accounted)
 {
+	SDL_LockMutex(lock);
 	typename CacheShared<T>::iterator it = CacheShared<T>::begin();
 	while (it != CacheShared<T>::end())
 	{
-		if (it->second.unique())
+		if (it->second.sptr.unique() && !(keep_accounted && it->second.bytes))
+		{
+			bytes -= it->second.bytes;
 			CacheShared<T>::erase(it++);
+		}
 		else
+		{
 			++it;
+		}
+	}
+	SDL_UnlockMutex(lock);
+}
+
+template <class T>
+inline void ContentManager::CacheShared<T>::unused(std::vector<CacheUnused> & entries) const
+{
+	SDL_LockMutex(lock);
+	typename CacheShared<T>::const_iterator it = CacheShared<T>::begin();
+	for (; it != CacheShared<T>::end(); ++it)
+	{
+		if (it->second.sptr.unique())
+		{
+			CacheUnused entry;
+			entry.cache = const_cast<CacheShared<T> *>(this);
+			entry.key = it->first;
+			entry.used = it->second.used;
+			entries.push_back(entry);
+		}
+	}
+	SDL_UnlockMutex(lock);
+}
+
+template <class T>
+inline size_t ContentManager::CacheShared<T>::evict(const std::string & key)
+{
+	size_t freed = 0;
+	SDL_LockMutex(lock);
+	typename CacheShared<T>::iterator it = CacheShared<T>::find(key);
+	if (it != CacheShared<T>::end() && it->second.sptr.unique())
+	{
+		freed = it->second.bytes;
+		bytes -= freed;
+		evictions++;
+		CacheShared<T>::erase(it);
 	}
+	SDL_UnlockMutex(lock);
+	return freed;
 }
 
 template <class T>
@@ -90,6 +90,24 @@ bool Factory<Model>::create(
 	return false;
 }
 
+// adopt a model loaded elsewhere, e.g. by a worker thread
+template <>
+bool Factory<Model>::create(
+	std::tr1::shared_ptr<Model>& sptr,
+	std::ostream& error,
+	const std::string& basepath,
+	const std::string& path,
+	const std::string& name,
+	const std::tr1::shared_ptr<Model>& model)
+{
+	if (model.get())
+	{
+		sptr = model;
+		return true;
+	}
+	return false;
+}
+
 const std::tr1::shared_ptr<Model> & Factory<Model>::getDefault() const
 {
 	return m_default;
@@ -19,6 +19,8 @@
 
 #include "texturefactory.h"
 #include "graphics/texture.h"
+#include "graphics/texturecache.h"
+#include <SDL2/SDL_surface.h>
 #include <fstream>
 #include <sstream>
 
@@ -27,7 +29,8 @@ Factory<Texture>::Factory() :
 	m_zero(new Texture()),
 	m_size(TextureInfo::LARGE),
 	m_compress(true),
-	m_srgb(false)
+	m_srgb(false),
+	m_headless(false)
 {
 	// ctor
 }
@@ -58,6 +61,34 @@ void Factory<Texture>::init(int max_size, bool use_srgb, bool compress)
 	m_zero->Load("", info, error);
 }
 
+void Factory<Texture>::setHeadless(bool value)
+{
+	m_headless = value;
+}
+
+bool Factory<Texture>::getHeadless() const
+{
+	return m_headless;
+}
+
+void Factory<Texture>::setCachePath(const std::string & path)
+{
+	m_cachepath = path;
+}
+
+bool Factory<Texture>::cook(
+	const std::string & abspath,
+	const TextureInfo & info,
+	std::vector<char> & dds,
+	SDL_Surface * & surface) const
+{
+	surface = 0;
+	if (m_headless || m_cachepath.empty() || info.cube)
+		return false;
+
+	return TextureCache::Load(m_cachepath, abspath, TextureInfo::Size(m_size), dds, surface);
+}
+
 template <>
 bool Factory<Texture>::create(
 	std::tr1::shared_ptr<Texture> & sptr,
@@ -67,15 +98,37 @@ bool Factory<Texture>::create(
 	const std::string & name,
 	const TextureInfo& info)
 {
+	if (m_headless)
+	{
+		sptr = m_default;
+		return true;
+	}
+
 	const std::string abspath = basepath + "/" + path + "/" + name;
-	if (info.data || std::ifstream(abspath.c_str()))
+	if (info.data || info.surface || info.dds || std::ifstream(abspath.c_str()))
 	{
 		TextureInfo info_temp = info;
 		info_temp.srgb = info.compress && m_srgb; 			// non compressible means non color data
 		info_temp.compress = info.compress && m_compress;	// allow to disable compression
 		info_temp.maxsize = TextureInfo::Size(m_size);
+
+		// use the cooked texture if the caller hasn't decoded the image
+		std::vector<char> dds;
+		SDL_Surface * surface = 0;
+		if (!info.data && !info.surface && !info.dds)
+		{
+			if (cook(abspath, info_temp, dds, surface))
+			{
+				info_temp.dds = &dds[0];
+				info_temp.ddssize = dds.size();
+			}
+			info_temp.surface = surface;
+		}
+
 		std::tr1::shared_ptr<Texture> temp(new Texture());
-		if (temp->Load(abspath, info_temp, error))
+		const bool loaded = temp->Load(abspath, info_temp, error);
+		SDL_FreeSurface(surface);
+		if (loaded)
 		{
 			sptr = temp;
 			return true;
@@ -23,6 +23,8 @@
 #include "contentfactory.h"
 #include "graphics/textureinfo.h"
 
+#include <vector>
+
 class Texture;
 
 template <>
@@ -38,6 +40,23 @@ public:
 	/// limit texture size to max size
 	void init(int max_size, bool use_srgb, bool compress);
 
+	/// skip texture loading, all textures are the default texture
+	/// for running without a graphics context
+	void setHeadless(bool value);
+
+	bool getHeadless() const;
+
+	/// cook textures into dds files with prebuilt mip levels in path, disabled if empty
+	void setCachePath(const std::string & path);
+
+	/// read the cooked texture or decode, cook and cache the image at abspath, safe to call from worker threads
+	/// returns false if caching is disabled or the image can't be cooked, surface is the decoded image then
+	bool cook(
+		const std::string & abspath,
+		const TextureInfo & info,
+		std::vector<char> & dds,
+		SDL_Surface * & surface) const;
+
 	template <class P>
 	bool create(
 		std::tr1::shared_ptr<Texture> & sptr,
@@ -56,9 +75,11 @@ public:
 private:
 	std::tr1::shared_ptr<Texture> m_default;
 	std::tr1::shared_ptr<Texture> m_zero;
+	std::string m_cachepath;
 	int m_size;
 	bool m_compress;
 	bool m_srgb;
+	bool m_headless;
 };
 
 #endif // _TEXTUREFACTORY_H
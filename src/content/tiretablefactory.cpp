@@ -17,10 +17,30 @@
 /*                                                                      */
 /************************************************************************/
 
-#include "parallel_task.h"
+#include "tiretablefactory.h"
+#include "physics/tiretable.h"
 
-int Parallel::Dispatch(void * data)
+Factory<TireTable>::Factory()
 {
-	((Task *) data)->Run();
-	return 0;
+	// ctor
+}
+
+template <>
+bool Factory<TireTable>::create(
+	std::tr1::shared_ptr<TireTable> & sptr,
+	std::ostream & error,
+	const std::string & basepath,
+	const std::string & path,
+	const std::string & name,
+	const TireInfo & info)
+{
+	std::tr1::shared_ptr<TireTable> temp(new TireTable());
+	temp->init(info);
+	sptr = temp;
+	return true;
+}
+
+const std::tr1::shared_ptr<TireTable> & Factory<TireTable>::getDefault() const
+{
+	return m_default;
 }
@@ -0,0 +1,54 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _TIRETABLEFACTORY_H
+#define _TIRETABLEFACTORY_H
+
+#include "contentfactory.h"
+
+class TireTable;
+struct TireInfo;
+
+/// tire tables are baked from tire parameters, nothing is read from disk
+/// name should be unique for the parameters, see TireTable::getName
+template <>
+class Factory<TireTable>
+{
+public:
+	struct empty {};
+
+	Factory();
+
+	template <class P>
+	bool create(
+		std::tr1::shared_ptr<TireTable> & sptr,
+		std::ostream & error,
+		const std::string & basepath,
+		const std::string & path,
+		const std::string & name,
+		const P & param);
+
+	/// null, tire falls back to the analytic model
+	const std::tr1::shared_ptr<TireTable> & getDefault() const;
+
+private:
+	std::tr1::shared_ptr<TireTable> m_default;
+};
+
+#endif // _TIRETABLEFACTORY_H
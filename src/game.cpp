@@ -25,7 +25,12 @@
 #include "physics/carwheelposition.h"
 #include "physics/tracksurface.h"
 #include "numprocessors.h"
+#include "jobsystem.h"
 #include "performance_testing.h"
+#include "replayrunner.h"
+#include "replayanalyzer.h"
+#include "microbench.h"
+#include "loadtrace.h"
 #include "quickprof.h"
 #include "utils.h"
 #include "graphics/graphics_gl2.h"
@@ -38,6 +43,8 @@
 #include "hsvtorgb.h"
 #include "camera_orbit.h"
 
+#include <SDL2/SDL.h>
+
 #include <fstream>
 #include <string>
 #include <map>
@@ -115,6 +122,7 @@ Game::Game(std::ostream & info_out, std::ostream & error_out) :
 	car_edit_id(0),
 	race_laps(0),
 	practice(true),
+	rewind(false),
 	collisiondispatch(
 		&collisionconfig),
 	dynamics(
@@ -127,7 +135,12 @@ Game::Game(std::ostream & info_out, std::ostream & error_out) :
 	particle_timer(0),
 	track(),
 	replay(timestep),
-	http("/tmp")
+	http("/tmp"),
+	sim_thread(0),
+	sim_lock(0),
+	sim_state_lock(0),
+	sim_state_new(false),
+	sim_quit(false)
 {
 	carcontrols_local.first = NULL;
 	dynamics.setContactAddedCallback(&CarDynamics::WheelContactCallback);
@@ -149,6 +162,8 @@ void Game::Start(std::list <std::string> & args)
 
 	info_output << "Starting VDrift: " << VERSION << ", Revision: " << REVISION << ", O/S: " << OS_NAME << std::endl;
 
+	InitThreading();
+
 	if (!InitCoreSubsystems())
 	{
 		return;
@@ -234,6 +249,12 @@ void Game::Start(std::list <std::string> & args)
 	}
 
 	DoneStartingUp();
+	loadtrace::mark("Startup done");
+
+	if (multithreaded)
+	{
+		StartSimulation();
+	}
 
 	MainLoop();
 
@@ -252,12 +273,24 @@ void Game::End()
 	}
 
 	if (profilingmode)
+	{
 		info_output << "Profiling summary:\n" << PROFILER.getSummary(quickprof::PERCENT) << std::endl;
+		JobSystem::instance().PrintStats(info_output);
+	}
 
 	info_output << "Shutting down..." << std::endl;
 
+	StopSimulation();
+
 	LeaveGame();
 
+	JobSystem::instance().Deinit();
+
+	if (!trace_file.empty() && loadtrace::write(trace_file, error_output))
+	{
+		info_output << "Load trace written to " << trace_file << std::endl;
+	}
+
 	// Save settings first incase later deinits cause crashes.
 	settings.Save(pathmanager.GetSettingsFile(), error_output);
 
@@ -265,9 +298,23 @@ void Game::End()
 	delete graphics;
 }
 
+/* Start the job system workers, sized by the number of processors... */
+void Game::InitThreading()
+{
+	if (!multithreaded)
+		return;
+
+	JobSystem & jobs = JobSystem::instance();
+	jobs.Init(NUMPROCESSORS::GetNumProcessors());
+	dynamics.setParallelActions(jobs.GetNumThreads() > 1);
+	info_output << "Job system: " << jobs.GetNumThreads() << " threads" << std::endl;
+}
+
 /* Initialize the most important, basic subsystems... */
 bool Game::InitCoreSubsystems()
 {
+	loadtrace::Scope trace("Game::InitCoreSubsystems");
+
 	pathmanager.Init(info_output, error_output);
 	http.SetTemporaryFolder(pathmanager.GetTemporaryFolder());
 
@@ -334,6 +381,8 @@ bool Game::InitCoreSubsystems()
 	const int renderer_count = 2;
 	for (int i = 0; i < renderer_count; i++)
 	{
+		loadtrace::Scope trace("Graphics::Init", render_ver);
+
 		// Attempt to enable the GL3 renderer...
 		if (using_gl3)
 		{
@@ -383,6 +432,8 @@ bool Game::InitCoreSubsystems()
 
 	// Init content factories
 	content.getFactory<Texture>().init(texture_size, using_gl3, settings.GetTextureCompress());
+	content.getFactory<Texture>().setCachePath(pathmanager.GetTextureCachePath());
+	content.setBudget(size_t(std::max(settings.GetContentBudget(), 0)) << 20);
 	content.getFactory<PTree>().init(read_ini, write_ini, content);
 
 	// Init content paths
@@ -414,6 +465,8 @@ void Game::InitPlayerCar()
 
 bool Game::InitGUI()
 {
+	loadtrace::Scope trace("Game::InitGUI");
+
 	std::list <std::string> menufiles;
 	std::string menufolder = pathmanager.GetGUIMenuPath(settings.GetSkin());
 	if (!pathmanager.GetFileList(menufolder, menufiles))
@@ -485,6 +538,8 @@ bool Game::InitGUI()
 
 bool Game::InitSound()
 {
+	loadtrace::Scope trace("Game::InitSound");
+
 	if (sound.Init(2048, info_output, error_output))
 	{
 		sound.SetVolume(settings.GetSoundVolume());
@@ -550,6 +605,92 @@ bool Game::ParseArguments(std::list <std::string> & args)
 	}
 	arghelp["-cartest CAR"] = "Run car performance testing on given CAR.";
 
+	if (argmap.find("-microbench") != argmap.end())
+	{
+		pathmanager.Init(info_output, error_output);
+		content.getFactory<PTree>().init(read_ini, write_ini, content);
+		content.addPath(pathmanager.GetWriteableDataPath());
+		content.addPath(pathmanager.GetDataPath());
+		content.addSharedPath(pathmanager.GetCarPartsPath());
+		content.addSharedPath(pathmanager.GetTrackPartsPath());
+
+		microbench::Context context(pathmanager, content, info_output, error_output);
+		microbench::runBenchmarks(argmap["-microbench"], context);
+		continue_game = false;
+	}
+	arghelp["-microbench [NAME]"] = "Run micro benchmarks, optionally only those matching NAME.";
+
+	if (!argmap["-convertreplay"].empty())
+	{
+		const std::string infile = argmap["-convertreplay"];
+		const size_t n = infile.rfind(".vdr");
+		const std::string outfile = infile.substr(0, n) + "-v2.vdr";
+		if (replay.Convert(infile, outfile, error_output))
+			info_output << "Converted replay to " << outfile << std::endl;
+		continue_game = false;
+	}
+	arghelp["-convertreplay FILE"] = "Convert replay FILE to the streamed format, saved as FILE-v2.vdr.";
+
+	if (!argmap["-replaycheck"].empty())
+	{
+		pathmanager.Init(info_output, error_output);
+		settings.Load(pathmanager.GetSettingsFile(), error_output);
+		content.getFactory<PTree>().init(read_ini, write_ini, content);
+		content.getFactory<Texture>().setHeadless(true);
+		content.addPath(pathmanager.GetWriteableDataPath());
+		content.addPath(pathmanager.GetDataPath());
+		content.addSharedPath(pathmanager.GetCarPartsPath());
+		content.addSharedPath(pathmanager.GetTrackPartsPath());
+
+		ReplayRunner runner(dynamics, content, pathmanager, settings, timestep);
+		if (runner.Run(argmap["-replaycheck"], info_output, error_output))
+			info_output << "Replay playback is deterministic" << std::endl;
+		continue_game = false;
+	}
+	arghelp["-replaycheck FILE"] = "Play replay FILE without graphics and sound as fast as possible, check its car states.";
+
+	if (!argmap["-analyzereplays"].empty())
+	{
+		pathmanager.Init(info_output, error_output);
+		settings.Load(pathmanager.GetSettingsFile(), error_output);
+		content.getFactory<PTree>().init(read_ini, write_ini, content);
+		content.getFactory<Texture>().setHeadless(true);
+		content.addPath(pathmanager.GetWriteableDataPath());
+		content.addPath(pathmanager.GetDataPath());
+		content.addSharedPath(pathmanager.GetCarPartsPath());
+		content.addSharedPath(pathmanager.GetTrackPartsPath());
+
+		JobSystem::instance().Init(NUMPROCESSORS::GetNumProcessors());
+		ReplayAnalyzer analyzer(content, pathmanager, settings, timestep);
+		analyzer.Run(argmap["-analyzereplays"], info_output, error_output);
+		JobSystem::instance().Deinit();
+		continue_game = false;
+	}
+	arghelp["-analyzereplays DIR"] = "Simulate all replays in DIR on all cores, write lap and crash summaries to DIR/replays.csv and DIR/replays.json.";
+
+	if (!argmap["-telemetry"].empty())
+	{
+		telemetry_file = argmap["-telemetry"];
+	}
+	arghelp["-telemetry FILE"] = "Record car telemetry of every simulation step to FILE.";
+
+	if (!argmap["-trace"].empty())
+	{
+		trace_file = argmap["-trace"];
+		loadtrace::enable();
+	}
+	arghelp["-trace FILE"] = "Record startup and loading phases, written to FILE as chrome trace json on exit.";
+
+	if (!argmap["-exporttelemetry"].empty())
+	{
+		const std::string filename = argmap["-exporttelemetry"];
+		const std::string name = filename.substr(0, filename.rfind('.'));
+		if (Telemetry::Export(filename, name, error_output))
+			info_output << "Telemetry exported to " << name << ".dat and " << name << ".plt" << std::endl;
+		continue_game = false;
+	}
+	arghelp["-exporttelemetry FILE"] = "Convert telemetry FILE to gnuplot .dat and .plt files next to it.";
+
 	if (!argmap["-profile"].empty())
 	{
 		pathmanager.SetProfile(argmap["-profile"]);
@@ -611,7 +752,7 @@ bool Game::ParseArguments(std::list <std::string> & args)
 		if (processors > 1)
 			info_output << "Multi-processor system detected.  Run with -multithreaded argument to enable multithreading (EXPERIMENTAL)." << std::endl;
 	}
-	arghelp["-multithreaded"] = "Use multithreading where possible.";
+	arghelp["-multithreaded"] = "Run the simulation on its own thread, use multithreading where possible.";
 	#endif
 
 	if (argmap.find("-nosound") != argmap.end())
@@ -726,7 +867,9 @@ void Game::Draw(float dt)
 		float fov = active_camera->GetFOV() > 0 ? active_camera->GetFOV() : settings.GetFOV();
 
 		Vec3 reflection_location = active_camera->GetPosition();
-		if (carcontrols_local.first)
+		if (carcontrols_local.first && sim_thread)
+			reflection_location = render_car_center;
+		else if (carcontrols_local.first)
 			reflection_location = ToMathVector<float>(carcontrols_local.first->GetCenterOfMass());
 
 		Quat camlook;
@@ -799,30 +942,77 @@ void Game::Tick(float deltat)
 	if (deltat > maxtime)
         deltat = maxtime;
 
-	target_time += deltat;
-
 	http.Tick();
 
-	// Increment game logic by however many tick periods have passed since the last GAME::Tick...
-	while (target_time - timestep * frame > timestep && curticks < maxticks)
+	content.update();
+
+	if (sim_thread)
 	{
-		frame++;
+		// The simulation runs on its own thread, only do the per frame work here.
+		SDL_LockMutex(sim_lock);
 
-		AdvanceGameLogic();
+		ProcessInputs(deltat);
 
-		curticks++;
-	}
+		if (!pause)
+		{
+			for (int i = 0; i < car_dynamics.size(); ++i)
+			{
+				car_sounds[i].Update(car_dynamics[i], deltat);
 
-	// Debug draw dynamics
-	if (dynamics_drawmode && track.Loaded())
-	{
-		dynamicsdraw.clear();
-		dynamics.debugDrawWorld();
-	}
+				AddTireSmokeParticles(car_dynamics[i], deltat);
+			}
+
+			track.Update();
 
-	if (dumpfps && curticks > 0 && frame % 100 == 0)
+			UpdateParticles(deltat);
+
+			UpdateTrackMap();
+		}
+
+		UpdateSound();
+
+		UpdateForceFeedback(deltat);
+
+		if (dynamics_drawmode && track.Loaded())
+		{
+			dynamicsdraw.clear();
+			dynamics.debugDrawWorld();
+		}
+
+		if (dumpfps && displayframe % 100 == 0)
+		{
+			info_output << "Current FPS: " << eventsystem.GetFPS() << std::endl;
+		}
+
+		SDL_UnlockMutex(sim_lock);
+
+		UpdateFromSimState(SDL_GetPerformanceCounter() / double(SDL_GetPerformanceFrequency()), deltat);
+	}
+	else
 	{
-		info_output << "Current FPS: " << eventsystem.GetFPS() << std::endl;
+		target_time += deltat;
+
+		// Increment game logic by however many tick periods have passed since the last GAME::Tick...
+		while (target_time - timestep * frame > timestep && curticks < maxticks)
+		{
+			frame++;
+
+			AdvanceGameLogic();
+
+			curticks++;
+		}
+
+		// Debug draw dynamics
+		if (dynamics_drawmode && track.Loaded())
+		{
+			dynamicsdraw.clear();
+			dynamics.debugDrawWorld();
+		}
+
+		if (dumpfps && curticks > 0 && frame % 100 == 0)
+		{
+			info_output << "Current FPS: " << eventsystem.GetFPS() << std::endl;
+		}
 	}
 
 	UpdateParticleGraphics();
@@ -832,6 +1022,37 @@ void Game::Tick(float deltat)
 
 /* Increment game logic by one frame... */
 void Game::AdvanceGameLogic()
+{
+	ProcessInputs(timestep);
+
+	if (!pause)
+	{
+		AdvanceSimulation();
+
+		PROFILER.beginBlock("car");
+		UpdateCars(timestep);
+		PROFILER.endBlock("car");
+
+		// Update dynamic track objects.
+		track.Update();
+
+		//PROFILER.beginBlock("particles");
+		UpdateParticles(timestep);
+		//PROFILER.endBlock("particles");
+
+		//PROFILER.beginBlock("trackmap-update");
+		UpdateTrackMap();
+		//PROFILER.endBlock("trackmap-update");
+	}
+
+	UpdateSound();
+
+	//PROFILER.beginBlock("force-feedback");
+	UpdateForceFeedback(timestep);
+	//PROFILER.endBlock("force-feedback");
+}
+
+void Game::ProcessInputs(float dt)
 {
 	//PROFILER.beginBlock("input-processing");
 
@@ -844,7 +1065,7 @@ void Game::AdvanceGameLogic()
 	carcontrols_local.second.ProcessInput(
 			settings.GetJoyType(),
 			eventsystem,
-			timestep,
+			dt,
 			settings.GetJoy200(),
 			car_speed,
 			settings.GetSpeedSensitivity(),
@@ -858,38 +1079,270 @@ void Game::AdvanceGameLogic()
 	ProcessGameInputs();
 
 	//PROFILER.endBlock("input-processing");
+}
 
-	if (!pause)
+/* Advance the simulation by one time step, this doesn't touch any graphics or sound state... */
+void Game::AdvanceSimulation()
+{
+	// The profiler is not thread safe, the main thread owns it.
+	const bool profile = !sim_thread;
+
+	// Rewinding replaces the simulation step, one recorded step back per step.
+	// A recording replay drops the rewound frames, a playing replay is not rewound.
+	const bool can_rewind = car_dynamics.size() && !replay.GetPlaying();
+	if (can_rewind)
 	{
-		PROFILER.beginBlock("ai");
-		ai.Visualize();
-		ai.Update(timestep, &car_dynamics[0], car_dynamics.size());
-		PROFILER.endBlock("ai");
+		if (rewind && car_history.GetFrames() > 0 &&
+			(!replay.GetRecording() || replay.Rewind(1)) &&
+			car_history.Rewind(&car_dynamics[0], car_dynamics.size(), 1))
+			return;
 
-		PROFILER.beginBlock("physics");
-		dynamics.update(timestep);
-		PROFILER.endBlock("physics");
+		car_history.Record(&car_dynamics[0], car_dynamics.size());
+	}
 
-		PROFILER.beginBlock("car");
-		UpdateCars(timestep);
-		PROFILER.endBlock("car");
+	// Keep the lap timing at replay keyframes to resync it when seeking back.
+	if (replay.GetKeyFrame())
+		timer.GetState(replay_timer_states[replay.GetFrame()]);
 
-		// Update dynamic track objects.
-		track.Update();
+	if (profile) PROFILER.beginBlock("ai");
+	ai.Visualize();
+	ai.Update(timestep, &car_dynamics[0], car_dynamics.size());
+	if (profile) PROFILER.endBlock("ai");
 
-		//PROFILER.beginBlock("timer");
-		UpdateTimer();
-		//PROFILER.endBlock("timer");
+	if (profile) PROFILER.beginBlock("physics");
+	dynamics.update(timestep);
+	if (profile) PROFILER.endBlock("physics");
 
-		//PROFILER.beginBlock("particles");
-		UpdateParticles(timestep);
-		//PROFILER.endBlock("particles");
+	car_inputs.resize(car_dynamics.size());
+	for (int i = 0; i < car_dynamics.size(); ++i)
+	{
+		UpdateCarInputs(i);
 
-		//PROFILER.beginBlock("trackmap-update");
-		UpdateTrackMap();
-		//PROFILER.endBlock("trackmap-update");
+		UpdateDriftScore(i, timestep);
 	}
 
+	UpdateTimer();
+
+	if (telemetry.GetRecording())
+	{
+		if (profile) PROFILER.beginBlock("telemetry");
+		for (int i = 0; i < car_dynamics.size(); ++i)
+		{
+			car_telemetry[i].Sample(car_dynamics[i], telemetry);
+		}
+		telemetry.Update(timestep);
+		if (profile) PROFILER.endBlock("telemetry");
+	}
+}
+
+void Game::StartSimulation()
+{
+	assert(!sim_thread);
+	sim_lock = SDL_CreateMutex();
+	sim_state_lock = SDL_CreateMutex();
+	sim_quit = false;
+
+	// Hold the lock so the thread doesn't step before sim_thread is set.
+	SDL_LockMutex(sim_lock);
+	sim_thread = SDL_CreateThread(&Game::SimulationThread, "simulation", this);
+	SDL_UnlockMutex(sim_lock);
+	if (!sim_thread)
+	{
+		error_output << "Failed to create simulation thread: " << SDL_GetError() << std::endl;
+		SDL_DestroyMutex(sim_state_lock);
+		SDL_DestroyMutex(sim_lock);
+		sim_state_lock = 0;
+		sim_lock = 0;
+		return;
+	}
+	info_output << "Simulation thread started" << std::endl;
+}
+
+void Game::StopSimulation()
+{
+	if (!sim_thread)
+		return;
+
+	SDL_LockMutex(sim_lock);
+	sim_quit = true;
+	SDL_UnlockMutex(sim_lock);
+
+	SDL_WaitThread(sim_thread, 0);
+	SDL_DestroyMutex(sim_state_lock);
+	SDL_DestroyMutex(sim_lock);
+	sim_thread = 0;
+	sim_state_lock = 0;
+	sim_lock = 0;
+}
+
+int Game::SimulationThread(void * game)
+{
+	static_cast<Game *>(game)->RunSimulation();
+	return 0;
+}
+
+void Game::RunSimulation()
+{
+	// Throw away wall clock time if we fall behind by more than this.
+	const double maxlag = 0.1;
+	const double freq = SDL_GetPerformanceFrequency();
+	double next_time = SDL_GetPerformanceCounter() / freq;
+	while (true)
+	{
+		double time = SDL_GetPerformanceCounter() / freq;
+		if (time < next_time)
+		{
+			SDL_Delay(Uint32((next_time - time) * 1000));
+			continue;
+		}
+		if (time - next_time > maxlag)
+			next_time = time;
+		next_time += timestep;
+
+		SDL_LockMutex(sim_lock);
+
+		if (sim_quit)
+		{
+			SDL_UnlockMutex(sim_lock);
+			break;
+		}
+
+		frame++;
+
+		if (!pause)
+		{
+			AdvanceSimulation();
+
+			PublishSimState(time);
+		}
+
+		SDL_UnlockMutex(sim_lock);
+	}
+}
+
+void Game::GetSimState(SimState & state, double time)
+{
+	state.time = time;
+	state.hud.valid = false;
+	state.cars.resize(car_dynamics.size());
+	for (int i = 0; i < car_dynamics.size(); ++i)
+	{
+		const CarDynamics & car = car_dynamics[i];
+		CarState & car_state = state.cars[i];
+		const unsigned num_bodies = car.GetNumBodies();
+		car_state.positions.resize(num_bodies);
+		car_state.orientations.resize(num_bodies);
+		for (unsigned n = 0; n < num_bodies; ++n)
+		{
+			car_state.positions[n] = ToMathVector<float>(car.GetPosition(n));
+			car_state.orientations[n] = ToQuaternion<float>(car.GetOrientation(n));
+		}
+		car_state.inputs = car_inputs[i];
+		car_state.position = ToMathVector<float>(car.GetPosition());
+		car_state.orientation = ToQuaternion<float>(car.GetOrientation());
+		car_state.center = ToMathVector<float>(car.GetCenterOfMass());
+		car_state.gear = car.GetTransmission().GetGear();
+
+		if (carcontrols_local.first == &car)
+			GetHudState(i, state.hud);
+	}
+}
+
+void Game::PublishSimState(double time)
+{
+	GetSimState(sim_states.getFirst(), time);
+
+	SDL_LockMutex(sim_state_lock);
+	sim_states.swapFirst();
+	sim_state_new = true;
+	SDL_UnlockMutex(sim_state_lock);
+}
+
+void Game::UpdateFromSimState(double time, float dt)
+{
+	SDL_LockMutex(sim_state_lock);
+	if (sim_state_new)
+	{
+		std::swap(sim_state_prev, sim_states.getLast());
+		sim_states.swapLast();
+		sim_state_new = false;
+	}
+	SDL_UnlockMutex(sim_state_lock);
+
+	// States published before the cars got (re)loaded have been reset.
+	const SimState & state = sim_states.getLast();
+	if (state.cars.size() != car_graphics.size())
+		return;
+
+	// Render one time step behind the simulation, blending towards the latest state.
+	const bool blend = (sim_state_prev.cars.size() == state.cars.size());
+	const float alpha = std::min(std::max(float((time - state.time) / timestep), 0.0f), 1.0f);
+
+	std::vector<Vec3> positions;
+	std::vector<Quat> orientations;
+	for (size_t i = 0; i < state.cars.size(); ++i)
+	{
+		const CarState & car_state = state.cars[i];
+		const CarState & car_prev = blend ? sim_state_prev.cars[i] : car_state;
+		const size_t num_bodies = car_state.positions.size();
+		const bool blend_car = (car_prev.positions.size() == num_bodies);
+
+		positions.resize(num_bodies);
+		orientations.resize(num_bodies);
+		for (size_t n = 0; n < num_bodies; ++n)
+		{
+			if (blend_car)
+			{
+				positions[n] = car_prev.positions[n] + (car_state.positions[n] - car_prev.positions[n]) * alpha;
+				orientations[n] = car_prev.orientations[n].QuatSlerp(car_state.orientations[n], alpha);
+			}
+			else
+			{
+				positions[n] = car_state.positions[n];
+				orientations[n] = car_state.orientations[n];
+			}
+		}
+
+		CarGraphics & car_gfx = car_graphics[i];
+		car_gfx.Update(car_state.inputs);
+		car_gfx.Update(positions, orientations, car_state.gear);
+
+		if (carcontrols_local.first != &car_dynamics[i])
+			continue;
+
+		Vec3 pos = car_state.position;
+		Quat rot = car_state.orientation;
+		render_car_center = car_state.center;
+		if (blend_car)
+		{
+			pos = car_prev.position + (car_state.position - car_prev.position) * alpha;
+			rot = car_prev.orientation.QuatSlerp(car_state.orientation, alpha);
+			render_car_center = car_prev.center + (car_state.center - car_prev.center) * alpha;
+		}
+
+		if (state.hud.valid && settings.GetHUD() != "NoHud")
+			UpdateHUD(state.hud);
+
+		UpdateCamera(i, pos, rot, dt);
+	}
+}
+
+void Game::ResetSimState()
+{
+	if (!sim_thread)
+		return;
+
+	SDL_LockMutex(sim_state_lock);
+	sim_states.getFirst().cars.clear();
+	sim_states.getSecond().cars.clear();
+	sim_states.getLast().cars.clear();
+	sim_state_prev.cars.clear();
+	sim_state_new = false;
+	SDL_UnlockMutex(sim_state_lock);
+}
+
+void Game::UpdateSound()
+{
 	if (sound.Enabled())
 	{
 		PROFILER.beginBlock("sound");
@@ -905,10 +1358,6 @@ void Game::AdvanceGameLogic()
 		sound.Update(pause);
 		PROFILER.endBlock("sound");
 	}
-
-	//PROFILER.beginBlock("force-feedback");
-	UpdateForceFeedback(timestep);
-	//PROFILER.endBlock("force-feedback");
 }
 
 /* Process inputs used only for higher level game functions... */
@@ -965,6 +1414,24 @@ void Game::ProcessGameInputs()
 
 		gui.ActivatePage(currentPage, 0.5, error_output);
 	}
+
+	rewind = carcontrols_local.second.GetInput(GameInput::REWIND) > 0;
+
+	// Skip ten seconds forward or back in a replay.
+	if (replay.GetPlaying() && car_dynamics.size())
+	{
+		int skip = 0;
+		if (carcontrols_local.second.GetInput(GameInput::REPLAY_FF) == 1.0)
+			skip = int(10 / timestep);
+		if (carcontrols_local.second.GetInput(GameInput::REPLAY_RW) == 1.0)
+			skip = -int(10 / timestep);
+		if (skip)
+		{
+			int frame = std::max(int(replay.GetFrame()) + skip, 0);
+			if (replay.Seek(frame, &car_dynamics[0], car_dynamics.size(), dynamics, this))
+				ai.ResetCars();
+		}
+	}
 }
 
 void Game::UpdateTimer()
@@ -972,71 +1439,45 @@ void Game::UpdateTimer()
 	// Check for cars doing a lap.
 	for (int i = 0; i != car_dynamics.size(); ++i)
 	{
-		const CarDynamics & car = car_dynamics[i];
-		bool advance = false;
-		int nextsector = 0;
-		if (track.GetSectors() > 0)
-		{
-			nextsector = (timer.GetLastSector(i) + 1) % track.GetSectors();
-			for (int p = 0; p < 4; ++p)
-			{
-				const Bezier * patch = car.GetWheelContact(WheelPosition(p)).GetPatch();
-				if (patch == track.GetSectorPatch(nextsector))
-				{
-					advance = true;
-				}
-			}
-		}
+		timer.UpdateCar(i, car_dynamics[i], track);
+	}
 
-		if (advance)
-			timer.Lap(i, nextsector);
+	timer.Tick(timestep);
+	//timer.DebugPrint(info_output);
+}
 
-		// Update how far the car is on the track...
-		// Find the patch under the front left wheel...
-		const Bezier * curpatch = car.GetWheelContact(FRONT_LEFT).GetPatch();
-		if (!curpatch)
-			curpatch = car.GetWheelContact(FRONT_RIGHT).GetPatch();
+void Game::SeekRestored(unsigned frame)
+{
+	// Keyframes up to the furthest played frame have their lap timing recorded.
+	// A keyframe beyond continues from the last recorded one, laps completed in
+	// between are not counted.
+	std::map <unsigned, Timer::State>::const_iterator i = replay_timer_states.upper_bound(frame);
+	if (i == replay_timer_states.begin())
+		return;
 
-		// Only update if car is on track.
-		if (curpatch)
+	--i;
+	timer.SetState(i->second);
+	if (i->first != frame)
+	{
+		timer.Tick((frame - i->first) * timestep);
+		for (int n = 0; n != car_dynamics.size(); ++n)
 		{
-			Vec3 pos = ToMathVector<float>(car.GetCenterOfMass());
-			Vec3 back_left, back_right, front_left;
-			if (!track.IsReversed())
-			{
-				back_left = curpatch->GetBL();
-				back_right = curpatch->GetBR();
-				front_left = curpatch->GetFL();
-			}
-			else
-			{
-				back_left = curpatch->GetFL();
-				back_right = curpatch->GetFR();
-				front_left = curpatch->GetBL();
-			}
-
-			Vec3 forwardvec = front_left - back_left;
-			Vec3 relative_pos = pos - back_left;
-			float dist_from_back = 0;
-
-			if (forwardvec.Magnitude() > 0.0001)
-				dist_from_back = relative_pos.dot(forwardvec.Normalize());
-
-			timer.UpdateDistance(i, curpatch->GetDistFromStart() + dist_from_back);
-			//std::cout << curpatch->GetDistFromStart() << ", " << dist_from_back << std::endl;
-			//std::cout << curpatch->GetDistFromStart() + dist_from_back << std::endl;
+			timer.UpdateCar(n, car_dynamics[n], track);
 		}
+	}
+}
 
-		/*info_output << "sector=" << i->GetSector() << ", next=" << track.GetSectorPatch(nextsector) << ", ";
-		for (int w = 0; w < 4; w++)
-		{
-			info_output << w << "=" << i->GetCurPatch(WHEEL_POSITION(w)) << ", ";
-		}
-		info_output << std::endl;*/
+void Game::SeekStepped(unsigned frame)
+{
+	for (int i = 0; i < car_dynamics.size(); ++i)
+	{
+		UpdateDriftScore(i, timestep);
 	}
 
-	timer.Tick(timestep);
-	//timer.DebugPrint(info_output);
+	UpdateTimer();
+
+	if (replay.GetKeyFrame())
+		timer.GetState(replay_timer_states[frame]);
 }
 
 void Game::UpdateTrackMap()
@@ -1220,15 +1661,28 @@ void Game::UpdateCars(float dt)
 {
 	for (int i = 0; i < car_dynamics.size(); ++i)
 	{
-		UpdateCarInputs(i);
+		const CarDynamics & car = car_dynamics[i];
+
+		car_graphics[i].Update(car_inputs[i]);
 
-		car_graphics[i].Update(car_dynamics[i]);
+		car_graphics[i].Update(car);
 
-		car_sounds[i].Update(car_dynamics[i], dt);
+		car_sounds[i].Update(car, dt);
 
-		AddTireSmokeParticles(car_dynamics[i], dt);
+		AddTireSmokeParticles(car, dt);
 
-		UpdateDriftScore(i, dt);
+		if (carcontrols_local.first != &car)
+			continue;
+
+		// Update player HUD
+		if (settings.GetHUD() != "NoHud")
+		{
+			HudState hud;
+			GetHudState(i, hud);
+			UpdateHUD(hud);
+		}
+
+		UpdateCamera(i, ToMathVector<float>(car.GetPosition()), ToQuaternion<float>(car.GetOrientation()), dt);
 	}
 }
 
@@ -1236,10 +1690,9 @@ void Game::UpdateCarInputs(const int carid)
 {
 	assert(carid >= 0 && carid < car_dynamics.size());
 	CarDynamics & car = car_dynamics[carid];
-	CarGraphics & car_gfx = car_graphics[carid];
-	CarSound & car_snd = car_sounds[carid];
 
-	std::vector <float> carinputs(CarInput::INVALID, 0.0f);
+	std::vector <float> & carinputs = car_inputs[carid];
+	carinputs.assign(CarInput::INVALID, 0.0f);
 	if (replay.GetPlaying())
 	{
 		const std::vector<float> inputs = replay.PlayFrame(carid, car);
@@ -1302,19 +1755,17 @@ void Game::UpdateCarInputs(const int carid)
 	}
 
 	car.Update(carinputs);
-	car_gfx.Update(carinputs);
 
 	// Record car state.
 	if (replay.GetRecording())
 		replay.RecordFrame(carid, carinputs, car);
+}
 
-	// Local player input processing starts here.
-	if (carcontrols_local.first != &car)
-		return;
-
-	// Update player HUD
-	if (settings.GetHUD() != "NoHud")
-		UpdateHUD(carid, carinputs);
+void Game::UpdateCamera(const int carid, const Vec3 & pos, const Quat & rot, float dt)
+{
+	assert(carid >= 0 && carid < car_graphics.size());
+	CarGraphics & car_gfx = car_graphics[carid];
+	CarSound & car_snd = car_sounds[carid];
 
 	// Handle camera mode change inputs.
 	Camera * old_camera = active_camera;
@@ -1349,21 +1800,20 @@ void Game::UpdateCarInputs(const int carid)
 	settings.SetCamera(camera_id);
 
 	// handle rear view
-	Vec3 pos = ToMathVector<float>(car.GetPosition());
-	Quat rot = ToQuaternion<float>(car.GetOrientation());
+	Quat view_rot = rot;
 	if (carcontrol.GetInput(GameInput::VIEW_REAR))
-		rot.Rotate(M_PI, 0, 0, 1);
+		view_rot.Rotate(M_PI, 0, 0, 1);
 
 	// reset camera on change
 	if (old_camera != active_camera)
-		active_camera->Reset(pos, rot);
+		active_camera->Reset(pos, view_rot);
 	else
-		active_camera->Update(pos, rot, timestep);
+		active_camera->Update(pos, view_rot, dt);
 
 	// Handle camera inputs.
-	float left = timestep * (carcontrol.GetInput(GameInput::PAN_LEFT) - carcontrol.GetInput(GameInput::PAN_RIGHT));
-	float up = timestep * (carcontrol.GetInput(GameInput::PAN_UP) - carcontrol.GetInput(GameInput::PAN_DOWN));
-	float dy = timestep * (carcontrol.GetInput(GameInput::ZOOM_IN) - carcontrol.GetInput(GameInput::ZOOM_OUT));
+	float left = dt * (carcontrol.GetInput(GameInput::PAN_LEFT) - carcontrol.GetInput(GameInput::PAN_RIGHT));
+	float up = dt * (carcontrol.GetInput(GameInput::PAN_UP) - carcontrol.GetInput(GameInput::PAN_DOWN));
+	float dy = dt * (carcontrol.GetInput(GameInput::ZOOM_IN) - carcontrol.GetInput(GameInput::ZOOM_OUT));
 	Vec3 zoom(Direction::Forward * 4 * dy);
 	active_camera->Rotate(up, left);
 	active_camera->Move(zoom[0], zoom[1], zoom[2]);
@@ -1377,28 +1827,60 @@ void Game::UpdateCarInputs(const int carid)
 	graphics->SetCloseShadow(incar ? 1.0 : 5.0);
 }
 
-void Game::UpdateHUD(const int carid, const std::vector<float> & carinputs)
+void Game::GetHudState(const int carid, HudState & hud)
 {
 	assert(carid >= 0 && carid < car_dynamics.size());
 	const CarDynamics & car = car_dynamics[carid];
+
+	if (settings.GetDebugInfo() && !profilingmode)
+	{
+		std::ostringstream debug_info[4];
+		car.DebugPrint(debug_info[0], true, false, false, false);
+		car.DebugPrint(debug_info[1], false, true, false, false);
+		car.DebugPrint(debug_info[2], false, false, true, false);
+		car.DebugPrint(debug_info[3], false, false, false, true);
+		for (int i = 0; i < 4; ++i)
+			hud.debug_info[i] = debug_info[i].str();
+	}
+
+	hud.inputs = car_inputs[carid];
+	hud.place = timer.GetPlayerPlace();
+	hud.lap = timer.GetPlayerCurrentLap();
+	hud.gear = car.GetTransmission().GetGear();
+	hud.drift_score = timer.GetDriftScore(carid);
+	hud.this_drift_score = timer.GetThisDriftScore(carid);
+	hud.staging_time_left = timer.GetStagingTimeLeft();
+	hud.player_time = timer.GetPlayerTime();
+	hud.last_lap = timer.GetLastLap();
+	hud.best_lap = timer.GetBestLap();
+	hud.speed = std::fabs(car.GetSpeedMPS());
+	hud.max_speed = car.GetMaxSpeedMPS();
+	hud.rpm = car.GetTachoRPM();
+	hud.rpm_limit = car.GetEngine().GetRPMLimit();
+	hud.redline = car.GetEngine().GetRedline();
+	hud.drifting = timer.GetIsDrifting(carid);
+	hud.abs = car.GetABSActive();
+	hud.tcs = car.GetTCSActive();
+	hud.fuel = (car.GetFuelAmount() != 0);
+	hud.nos = (car.GetNosAmount() != 0);
+	hud.valid = true;
+}
+
+void Game::UpdateHUD(const HudState & hud)
+{
+	const std::vector<float> & carinputs = hud.inputs;
 	const GuiLanguage & lang = gui.GetLanguageDict();
 
 	if (settings.GetDebugInfo())
 	{
 		if (!profilingmode)
 		{
-			std::ostringstream debug_info[4];
-			car.DebugPrint(debug_info[0], true, false, false, false);
-			car.DebugPrint(debug_info[1], false, true, false, false);
-			car.DebugPrint(debug_info[2], false, false, true, false);
-			car.DebugPrint(debug_info[3], false, false, false, true);
-
-			signal_debug_info[0](debug_info[0].str());
-			signal_debug_info[1](debug_info[1].str());
-			signal_debug_info[2](debug_info[2].str());
-			signal_debug_info[3](debug_info[3].str());
+			signal_debug_info[0](hud.debug_info[0]);
+			signal_debug_info[1](hud.debug_info[1]);
+			signal_debug_info[2](hud.debug_info[2]);
+			signal_debug_info[3](hud.debug_info[3]);
 		}
-		else if (frame % 10 == 0)
+		else if (displayframe % 10 == 0)
 		{
 			std::ostringstream gpu_profile;
 			graphics->printProfilingInfo(gpu_profile);
@@ -1420,38 +1902,38 @@ void Game::UpdateHUD(const int carid, const std::vector<float> & carinputs)
 		signal_brake(brakestr.str());
 	}
 
-	std::pair <int, int> curplace = timer.GetPlayerPlace();
+	std::pair <int, int> curplace = hud.place;
 	std::ostringstream placestr;
 	placestr << curplace.first << " / " << curplace.second;
 
-	int cur_lap = std::max(1, std::min(timer.GetPlayerCurrentLap(), race_laps));
+	int cur_lap = std::max(1, std::min(hud.lap, race_laps));
 	std::ostringstream lapstr;
 	if (race_laps > 0)
 		lapstr << cur_lap << " / " << race_laps;
 	else
 		lapstr << "0 / 0";
 
-	int score = timer.GetDriftScore(carid);
+	int score = hud.drift_score;
 	std::ostringstream scorestr;
 	scorestr << score;
 
 	std::ostringstream msgstr;
 	if (race_laps > 0)
 	{
-		float stagingtimeleft = timer.GetStagingTimeLeft();
+		float stagingtimeleft = hud.staging_time_left;
 		if (stagingtimeleft > 0.5)
 			msgstr << (int)stagingtimeleft + 1;
 		else if (stagingtimeleft > 0.0)
 			msgstr << lang("Ready");
 		else if (stagingtimeleft < 0.0 && stagingtimeleft > -1.0)
 			msgstr << lang("GO");
-		else if (timer.GetPlayerCurrentLap() > race_laps)
+		else if (hud.lap > race_laps)
 			msgstr << ((curplace.first == 1) ? lang("You won!") : lang("You lost"));
 	}
-	if (msgstr.tellp() <= 0 && timer.GetIsDrifting(carid))
-		msgstr << "+" << (int)timer.GetThisDriftScore(carid);
+	if (msgstr.tellp() <= 0 && hud.drifting)
+		msgstr << "+" << (int)hud.this_drift_score;
 
-	int gear = car.GetTransmission().GetGear();
+	int gear = hud.gear;
 	std::ostringstream gearstr;
 	if (gear == -1)
 		gearstr << "R";
@@ -1461,12 +1943,12 @@ void Game::UpdateHUD(const int carid, const std::vector<float> & carinputs)
 		gearstr << gear;
 
 	float speed_scale = (settings.GetMPH() ? 2.237 : 3.6);
-	float speed = std::fabs(car.GetSpeedMPS()) * speed_scale;
-	float speedometer = car.GetMaxSpeedMPS() * speed_scale;
+	float speed = hud.speed * speed_scale;
+	float speedometer = hud.max_speed * speed_scale;
 	speedometer = std::min(320.0f, std::max(120.0f, std::ceil(speedometer / 40.0f) * 40.0f));
 
-	float rpm = car.GetTachoRPM();
-	float tachometer = car.GetEngine().GetRPMLimit();
+	float rpm = hud.rpm;
+	float tachometer = hud.rpm_limit;
 	tachometer = std::min(20000.0f, std::max(8000.0f, std::ceil(tachometer / 2000.0f) * 2000.0f));
 
 	std::ostringstream speedostr, speednstr, speedstr;
@@ -1475,20 +1957,20 @@ void Game::UpdateHUD(const int carid, const std::vector<float> & carinputs)
 	speedstr << std::setfill('0') << std::setw(3) << int(speed);
 
 	std::ostringstream shiftstr, tachostr, rpmnstr, rpmstr;
-	shiftstr << int(rpm >= car.GetEngine().GetRedline());
+	shiftstr << int(rpm >= hud.redline);
 	tachostr << int(tachometer);
 	rpmnstr << rpm / tachometer;
 	rpmstr << int(rpm);
 
 	std::ostringstream absstr, tcsstr, gasstr, nosstr;
-	absstr << (car.GetABSActive() ? 1.0 : 0.3);
-	tcsstr << (car.GetTCSActive() ? 1.0 : 0.3);
-	gasstr << (car.GetFuelAmount() ? 0.3 : 1.0);
-	nosstr << ((car.GetNosAmount() && carinputs[CarInput::NOS]) ? 1.0 : 0.3);
+	absstr << (hud.abs ? 1.0 : 0.3);
+	tcsstr << (hud.tcs ? 1.0 : 0.3);
+	gasstr << (hud.fuel ? 0.3 : 1.0);
+	nosstr << ((hud.nos && carinputs[CarInput::NOS]) ? 1.0 : 0.3);
 
-	signal_lap_time[0](GetTimeString(timer.GetPlayerTime()));
-	signal_lap_time[1](GetTimeString(timer.GetLastLap()));
-	signal_lap_time[2](GetTimeString(timer.GetBestLap()));
+	signal_lap_time[0](GetTimeString(hud.player_time));
+	signal_lap_time[1](GetTimeString(hud.last_lap));
+	signal_lap_time[2](GetTimeString(hud.best_lap));
 
 	signal_pos(placestr.str());
 	signal_lap(lapstr.str());
@@ -1514,6 +1996,8 @@ void Game::UpdateHUD(const int carid, const std::vector<float> & carinputs)
 
 bool Game::NewGame(bool playreplay, bool addopponents, int num_laps)
 {
+	loadtrace::Scope trace("Game::NewGame");
+
 	// This should clear out all data.
 	LeaveGame();
 
@@ -1583,6 +2067,9 @@ bool Game::NewGame(bool playreplay, bool addopponents, int num_laps)
 			timer.SetPlayerCarId(i);
 	}
 
+	// Keep the last ten seconds of car states for rewinding.
+	car_history.Init(car_dynamics.size(), int(10 / timestep));
+
 	// Bind vertex data.
 	std::vector<SceneNode *> nodes;
 	nodes.push_back(&track.GetRacinglineNode());
@@ -1623,7 +2110,28 @@ bool Game::NewGame(bool playreplay, bool addopponents, int num_laps)
 			}
 		}
 
-		replay.StartRecording(car_info, settings.GetTrack(), error_output);
+		Replay::Setup setup;
+		setup.abs = settings.GetABS();
+		setup.tcs = settings.GetTCS();
+		setup.autoshift = settings.GetAutoShift();
+		setup.autoclutch = settings.GetAutoClutch();
+		setup.damage = settings.GetVehicleDamage();
+		setup.track_reverse = settings.GetTrackReverse();
+		setup.track_dynamic = settings.GetTrackDynamic();
+		replay.StartRecording(car_info, settings.GetTrack(), setup, pathmanager.GetReplayPath() + "/recording.tmp", error_output);
+	}
+
+	// Record telemetry of all cars.
+	if (!telemetry_file.empty())
+	{
+		telemetry.ClearChannels();
+		car_telemetry.resize(car_dynamics.size());
+		for (int i = 0; i < car_dynamics.size(); ++i)
+		{
+			car_telemetry[i].Register(telemetry, "car" + cast(i) + ".");
+		}
+		if (telemetry.Start(telemetry_file, error_output))
+			info_output << "Recording " << telemetry.GetNumChannels() << " telemetry channels to " << telemetry_file << std::endl;
 	}
 
 	// Clean up asset cache.
@@ -1636,6 +2144,8 @@ bool Game::NewGame(bool playreplay, bool addopponents, int num_laps)
 	// not strictly needed, is expected to be called by Hud page onfocus event
 	ContinueGame();
 
+	loadtrace::mark("Race ready");
+
 	return true;
 }
 
@@ -1662,6 +2172,8 @@ bool Game::LoadCar(
 	const Quat & orientation,
 	const bool sound_enabled)
 {
+	loadtrace::Scope trace("Game::LoadCar", info.name);
+
 	const size_t n0 = info.name.find("/");
 	const size_t n1 = info.name.length();
 	const std::string carname = info.name.substr(n0 + 1, n1 - n0 - 1);
@@ -1743,6 +2255,8 @@ bool Game::LoadCar(
 
 bool Game::LoadTrack(const std::string & trackname)
 {
+	loadtrace::Scope trace("Game::LoadTrack", trackname);
+
 	gui.ActivatePage("Loading", 0.5, error_output);
 
 	if (!track.DeferredLoad(
@@ -1752,6 +2266,7 @@ bool Game::LoadTrack(const std::string & trackname)
 		pathmanager.GetTracksDir()+"/"+trackname,
 		pathmanager.GetEffectsTextureDir(),
 		pathmanager.GetTrackPartsPath(),
+		pathmanager.GetTrackCachePath() + "/" + trackname,
 		settings.GetAnisotropy(),
 		settings.GetTrackReverse(),
 		settings.GetTrackDynamic(),
@@ -1818,6 +2333,8 @@ bool Game::LoadTrack(const std::string & trackname)
 
 void Game::LoadGarage()
 {
+	loadtrace::Scope trace("Game::LoadGarage");
+
 	LeaveGame();
 
 	// Load track explicitly to avoid track reversed car orientation issue.
@@ -1834,6 +2351,7 @@ void Game::LoadGarage()
 		pathmanager.GetSkinsDir() + "/" + settings.GetSkin(),
 		pathmanager.GetEffectsTextureDir(),
 		pathmanager.GetTrackPartsPath(),
+		std::string(),
 		settings.GetAnisotropy(),
 		track_reverse, track_dynamic,
 		graphics->GetShadows()))
@@ -1881,8 +2399,12 @@ void Game::SetGarageCar()
 	// clear previous car
 	carcontrols_local.first = NULL;
 	car_dynamics.clear();
+	car_inputs.clear();
+	car_history.Init(0, 0);
+	replay_timer_states.clear();
 	car_graphics.clear();
 	car_sounds.clear();
+	ResetSimState();
 
 	// load car
 	std::vector<SceneNode *> nodes;
@@ -1920,6 +2442,8 @@ void Game::SetCarColor()
 
 bool Game::LoadFonts()
 {
+	loadtrace::Scope trace("Game::LoadFonts");
+
 	const std::string fontdir = pathmanager.GetFontDir(settings.GetSkin());
 	const std::string fontpath = pathmanager.GetDataPath()+"/"+fontdir;
 
@@ -2579,13 +3103,26 @@ void Game::LeaveGame()
 	if (replay.GetPlaying())
 		replay.Reset();
 
+	if (telemetry.GetRecording())
+	{
+		if (!telemetry.Stop())
+			error_output << "Error writing telemetry to " << telemetry_file << std::endl;
+		else if (telemetry.GetDropped())
+			error_output << "Telemetry dropped " << telemetry.GetDropped() << " frames" << std::endl;
+	}
+	car_telemetry.clear();
+
 	graphics->ClearStaticDrawables();
 
 	tire_smoke.Clear();
 	track.Clear();
 	car_dynamics.clear();
+	car_inputs.clear();
+	car_history.Init(0, 0);
+	replay_timer_states.clear();
 	car_graphics.clear();
 	car_sounds.clear();
+	ResetSimState();
 	sound.Update(true);
 	trackmap.Unload();
 	timer.Unload();
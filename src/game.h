@@ -35,6 +35,7 @@
 #include "gui/font.h"
 #include "physics/dynamicsworld.h"
 #include "physics/cardynamics.h"
+#include "physics/carhistory.h"
 #include "dynamicsdraw.h"
 #include "carcontrolmap.h"
 #include "cargraphics.h"
@@ -46,12 +47,15 @@
 #include "trackmap.h"
 #include "timer.h"
 #include "replay.h"
+#include "telemetry.h"
+#include "cartelemetry.h"
 #include "forcefeedback.h"
 #include "particle.h"
 #include "ai/ai.h"
 #include "content/contentmanager.h"
 #include "updatemanager.h"
 #include "game_downloader.h"
+#include "tripplebuffer.h"
 
 #include "BulletCollision/CollisionDispatch/btDefaultCollisionConfiguration.h"
 #include "BulletCollision/BroadphaseCollision/btDbvtBroadphase.h"
@@ -64,7 +68,10 @@
 #include <vector>
 #include <memory>
 
-class Game
+struct SDL_mutex;
+struct SDL_Thread;
+
+class Game : private Replay::SeekListener
 {
 friend class GameDownloader;
 public:
@@ -75,6 +82,53 @@ public:
 	void Start(std::list <std::string> & args);
 
 private:
+	/// Car state published by the simulation for rendering.
+	struct CarState
+	{
+		std::vector<Vec3> positions; ///< body positions
+		std::vector<Quat> orientations; ///< body orientations
+		std::vector<float> inputs;
+		Vec3 position; ///< chassis position
+		Quat orientation; ///< chassis orientation
+		Vec3 center; ///< center of mass
+		int gear;
+	};
+
+	/// Player HUD values gathered by the simulation.
+	struct HudState
+	{
+		std::string debug_info[4];
+		std::vector<float> inputs;
+		std::pair<int, int> place;
+		int lap;
+		int gear;
+		int drift_score;
+		float this_drift_score;
+		float staging_time_left;
+		float player_time;
+		float last_lap;
+		float best_lap;
+		float speed; ///< m/s
+		float max_speed; ///< m/s
+		float rpm;
+		float rpm_limit;
+		float redline;
+		bool drifting;
+		bool abs;
+		bool tcs;
+		bool fuel;
+		bool nos;
+		bool valid;
+	};
+
+	/// Simulation state snapshot, passed from the simulation thread to the main thread.
+	struct SimState
+	{
+		std::vector<CarState> cars;
+		HudState hud;
+		double time; ///< wall clock time of publication
+	};
+
 	void End();
 
 	void MainLoop();
@@ -99,11 +153,47 @@ private:
 
 	void AdvanceGameLogic();
 
+	/// Process events, control and gui inputs.
+	void ProcessInputs(float dt);
+
+	/// Advance ai, physics, car inputs, replay and timer by one time step.
+	void AdvanceSimulation();
+
+	/// Start the fixed rate simulation thread (-multithreaded mode).
+	void StartSimulation();
+
+	/// Stop and join the simulation thread.
+	void StopSimulation();
+
+	/// Simulation thread loop, steps the simulation at the fixed time step.
+	void RunSimulation();
+
+	static int SimulationThread(void * game);
+
+	/// Fill state from the current simulation, called with sim_lock held.
+	void GetSimState(SimState & state, double time);
+
+	/// Publish the simulation state to the main thread (simulation thread).
+	void PublishSimState(double time);
+
+	/// Update car graphics, camera and hud from the published states,
+	/// interpolated to the given wall clock time (main thread).
+	void UpdateFromSimState(double time, float dt);
+
+	/// Discard published states, called on car (un)loading with sim_lock held.
+	void ResetSimState();
+
 	void UpdateCars(float dt);
 
+	void UpdateSound();
+
 	void UpdateCarInputs(const int carid);
 
-	void UpdateHUD(const int carid, const std::vector<float> & carinputs);
+	void UpdateCamera(const int carid, const Vec3 & pos, const Quat & rot, float dt);
+
+	void GetHudState(const int carid, HudState & hud);
+
+	void UpdateHUD(const HudState & hud);
 
 	void UpdateTimer();
 
@@ -187,6 +277,12 @@ private:
 
 	void UpdateDriftScore(const int carid, const float dt);
 
+	/// Resync the lap timing when a replay seek restored the cars to a keyframe.
+	void SeekRestored(unsigned frame);
+
+	/// Update the lap timing and drift scores for a frame simulated by a replay seek.
+	void SeekStepped(unsigned frame);
+
 	std::string GetReplayRecordingFilename();
 
 	void Draw(float dt);
@@ -339,6 +435,9 @@ private:
 
 	std::pair <CarDynamics *, CarControlMap> carcontrols_local;
 	btAlignedObjectArray <CarDynamics> car_dynamics;
+	std::vector <std::vector<float> > car_inputs;
+	CarHistory car_history; ///< recent car states, for rewinding
+	bool rewind; ///< step back through car_history instead of simulating
 	std::vector <CarGraphics> car_graphics;
 	std::vector <CarSound> car_sounds;
 	std::vector <CarInfo> car_info;
@@ -363,11 +462,29 @@ private:
 	Gui gui;
 	Timer timer;
 	Replay replay;
+	std::map <unsigned, Timer::State> replay_timer_states; ///< lap timing at replay keyframes, restored on seek
+	Telemetry telemetry; ///< car channels of every simulation step, -telemetry mode only
+	std::vector <CarTelemetry> car_telemetry;
+	std::string telemetry_file;
+	std::string trace_file; ///< load phase trace output, -trace mode only
 	Ai ai;
 	Http http;
 
 	std::auto_ptr <ForceFeedback> forcefeedback;
 	double ff_update_time;
+
+	// Simulation thread, -multithreaded mode only. sim_lock is held by the
+	// simulation thread while stepping and by the main thread while it
+	// touches game state. Car transforms and hud values are passed to the
+	// main thread through sim_states, guarded by sim_state_lock.
+	SDL_Thread * sim_thread;
+	SDL_mutex * sim_lock;
+	SDL_mutex * sim_state_lock;
+	TrippleBuffer<SimState> sim_states;
+	SimState sim_state_prev;
+	bool sim_state_new;
+	bool sim_quit;
+	Vec3 render_car_center;
 };
 
 #endif
@@ -49,6 +49,7 @@ enum Enum
 	PAUSE,
 	RELOAD_SHADERS,
 	RELOAD_GUI,
+	REWIND,
 	GUI_LEFT,
 	GUI_RIGHT,
 	GUI_UP,
@@ -20,6 +20,7 @@
 #include <algorithm>
 #include "renderer.h"
 #include "utils.h"
+#include "loadtrace.h"
 
 Renderer::Renderer(GLWrapper & glwrapper) : gl(glwrapper)
 {
@@ -461,6 +462,8 @@ void Renderer::printProfilingInfo(std::ostream & out) const
 
 bool Renderer::loadShader(const std::string & path, const std::string & name, const std::set <std::string> & defines, GLenum shaderType, std::ostream & errorOutput)
 {
+	loadtrace::Scope trace("Renderer::loadShader", path);
+
 	std::string shaderSource = Utils::LoadFileIntoString(path, errorOutput);
 	if (shaderSource.empty())
 	{
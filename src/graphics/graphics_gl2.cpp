@@ -25,6 +25,7 @@
 #include "uniforms.h"
 #include "vertexattrib.h"
 #include "sky.h"
+#include "jobsystem.h"
 
 /// array end ptr
 template <typename T, size_t N>
@@ -601,6 +602,7 @@ void GraphicsGL2::SetupScene(
 	{
 		CullScenePass(*i, error_output);
 	}
+	CullDrawLists();
 
 	renderscene.SetFSAA(fsaa);
 	renderscene.SetContrast(contrast);
@@ -972,8 +974,11 @@ void GraphicsGL2::ClearCulledDrawLists()
 	for(CulledDrawListMap::iterator i = culled_drawlists.begin(); i != culled_drawlists.end(); i++)
 	{
 		i->second.drawables.clear();
+		i->second.static_drawables = 0;
+		i->second.dynamic_drawables = 0;
 		i->second.valid = false;
 	}
+	cull_queue.clear();
 }
 
 void GraphicsGL2::CullScenePass(
@@ -1057,10 +1062,10 @@ void GraphicsGL2::CullScenePass(
 				}
 				const GraphicsCamera & cam = ci->second;
 
-				Frustum frustum;
-				frustum.Extract(GetProjMatrix(cam).GetArray(), GetViewMatrix(cam).GetArray());
-
-				container->Query(frustum, drawlist.drawables);
+				drawlist.frustum.Extract(GetProjMatrix(cam).GetArray(), GetViewMatrix(cam).GetArray());
+				drawlist.static_drawables = &container.get();
+				drawlist.cull = true;
+				cull_queue.push_back(&drawlist);
 
 				// cull dynamic drawlist
 				reseatable_reference <PtrVector <Drawable> > container_dynamic = dynamic_drawlist.GetByName(*d);
@@ -1069,11 +1074,7 @@ void GraphicsGL2::CullScenePass(
 					ReportOnce(&pass, "Drawable container " + *d + " couldn't be found", error_output);
 					return;
 				}
-				for (size_t i = 0; i < container_dynamic->size(); ++i)
-				{
-					if (!Cull(frustum, *(*container_dynamic)[i]))
-						drawlist.drawables.push_back((*container_dynamic)[i]);
-				}
+				drawlist.dynamic_drawables = &container_dynamic.get();
 			}
 			else
 			{
@@ -1084,7 +1085,9 @@ void GraphicsGL2::CullScenePass(
 					ReportOnce(&pass, "Drawable container " + *d + " couldn't be found", error_output);
 					return;
 				}
-				container->Query(Aabb<float>::IntersectAlways(), drawlist.drawables);
+				drawlist.static_drawables = &container.get();
+				drawlist.cull = false;
+				cull_queue.push_back(&drawlist);
 
 				// copy dynamic drawlist
 				reseatable_reference <PtrVector <Drawable> > container_dynamic = dynamic_drawlist.GetByName(*d);
@@ -1093,15 +1096,67 @@ void GraphicsGL2::CullScenePass(
 					ReportOnce(&pass, "Drawable container " + *d + " couldn't be found", error_output);
 					return;
 				}
-				drawlist.drawables.insert(
-					drawlist.drawables.end(),
-					container_dynamic->begin(),
-					container_dynamic->end());
+				drawlist.dynamic_drawables = &container_dynamic.get();
 			}
 		}
 	}
 }
 
+struct GraphicsGL2::CullRange : public JobRange
+{
+	std::vector <CulledDrawList *> & queue;
+
+	CullRange(std::vector <CulledDrawList *> & queue) : queue(queue)
+	{
+		// ctor
+	}
+
+	void Execute(int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+		{
+			CullDrawList(*queue[i]);
+		}
+	}
+};
+
+void GraphicsGL2::CullDrawLists()
+{
+	// drawlists are independent, each query only reads the scene
+	CullRange range(cull_queue);
+	JobSystem::instance().ParallelFor(0, cull_queue.size(), range);
+}
+
+void GraphicsGL2::CullDrawList(CulledDrawList & drawlist)
+{
+	if (drawlist.cull)
+	{
+		drawlist.static_drawables->Query(drawlist.frustum, drawlist.drawables);
+
+		if (!drawlist.dynamic_drawables)
+			return;
+
+		const PtrVector <Drawable> & dynamic_drawables = *drawlist.dynamic_drawables;
+		for (size_t i = 0; i < dynamic_drawables.size(); ++i)
+		{
+			if (!Cull(drawlist.frustum, *dynamic_drawables[i]))
+				drawlist.drawables.push_back(dynamic_drawables[i]);
+		}
+	}
+	else
+	{
+		drawlist.static_drawables->Query(Aabb<float>::IntersectAlways(), drawlist.drawables);
+
+		if (!drawlist.dynamic_drawables)
+			return;
+
+		drawlist.drawables.insert(
+			drawlist.drawables.end(),
+			drawlist.dynamic_drawables->begin(),
+			drawlist.dynamic_drawables->end());
+	}
+}
+
 void GraphicsGL2::DrawScenePass(
 	const GraphicsConfigPass & pass,
 	std::ostream & error_output)
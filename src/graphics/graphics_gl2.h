@@ -31,6 +31,7 @@
 #include "render_output.h"
 #include "vertexarray.h"
 #include "vertexbuffer.h"
+#include "frustum.h"
 #include "memory.h"
 
 struct GraphicsCamera;
@@ -172,12 +173,20 @@ private:
 
 	struct CulledDrawList
 	{
-		CulledDrawList() : valid(false) {};
+		CulledDrawList() : valid(false), static_drawables(0), dynamic_drawables(0), cull(false) {};
 		PtrVector <Drawable> drawables;
 		bool valid;
+
+		// queued query, executed by CullDrawLists
+		const AabbTreeNodeAdapter <Drawable> * static_drawables;
+		const PtrVector <Drawable> * dynamic_drawables;
+		Frustum frustum;
+		bool cull;
 	};
 	typedef std::map <std::string, CulledDrawList> CulledDrawListMap;
 	CulledDrawListMap culled_drawlists;
+	std::vector <CulledDrawList *> cull_queue;
+	struct CullRange;
 
 	// render outputs
 	typedef std::map <std::string, RenderOutput> RenderOutputMap;
@@ -228,10 +237,16 @@ private:
 
 	void ClearCulledDrawLists();
 
+	/// queue culling queries of the pass
 	void CullScenePass(
 		const GraphicsConfigPass & pass,
 		std::ostream & error_output);
 
+	/// execute the queued culling queries in parallel
+	void CullDrawLists();
+
+	static void CullDrawList(CulledDrawList & drawlist);
+
 	void DrawScenePass(
 		const GraphicsConfigPass & pass,
 		std::ostream & error_output);
@@ -18,9 +18,11 @@
 /************************************************************************/
 
 #include "model.h"
+#include "mappedfile.h"
 #include <fstream>
 #include <string>
 #include <limits>
+#include <cstring>
 
 static const std::string file_magic = "OGLVARRAYV01";
 
@@ -72,48 +74,57 @@ bool Model::Load(const VertexArray & nvarray, std::ostream & error_output)
 	return true;
 }
 
-bool Model::Serialize(joeserialize::Serializer & s)
+template <class S>
+bool Model::Serialize(S & s)
 {
 	_SERIALIZE_(s, varray);
 	return true;
 }
 
+_SERIALIZE_INSTANTIATE_(Model);
+
 bool Model::WriteToFile(const std::string & filepath)
 {
-	std::ofstream fileout(filepath.c_str());
+	std::ofstream fileout(filepath.c_str(), std::ios_base::binary);
 	if (!fileout)
 		return false;
 
 	fileout.write(file_magic.c_str(), file_magic.size());
-	joeserialize::BinaryOutputSerializer s(fileout);
-	return Serialize(s);
+	std::string data;
+	joeserialize::BinaryWriter s(data);
+	if (!Serialize(s))
+		return false;
+
+	fileout.write(data.data(), data.size());
+	return fileout.good();
 }
 
 bool Model::ReadFromFile(const std::string & filepath, std::ostream & error_output)
 {
-	std::ifstream filein(filepath.c_str(), std::ios_base::binary);
-	if (!filein)
+	Clear();
+
+	MappedFile file;
+	if (!file.Open(filepath))
 	{
 		error_output << "Can't find file: " << filepath << std::endl;
 		return false;
 	}
 
-	std::vector<char> fmagic(file_magic.size() + 1, 0);
-	filein.read(&fmagic[0], file_magic.size());
-	if (!filein)
+	if (file.GetSize() < file_magic.size())
 	{
 		error_output << "File magic read error: " << filepath << std::endl;
 		return false;
 	}
 
-	if (!file_magic.compare(&fmagic[0]))
+	if (std::memcmp(file.GetData(), file_magic.data(), file_magic.size()) != 0)
 	{
-		error_output << "File magic is incorrect: \"" << file_magic << "\" != \"" << &fmagic[0] << "\" in " << filepath << std::endl;
+		error_output << "File magic is incorrect: \"" << file_magic << "\" != \""
+			<< std::string(file.GetData(), file_magic.size()) << "\" in " << filepath << std::endl;
 		return false;
 	}
 
-	joeserialize::BinaryInputSerializer s(filein);
-	if (!Serialize(s))
+	joeserialize::BinaryReader s(file.GetData() + file_magic.size(), file.GetSize() - file_magic.size());
+	if (!Serialize(s) || !varray.Validate())
 	{
 		error_output << "Serialization error: " << filepath << std::endl;
 		Clear();
@@ -170,6 +181,14 @@ float Model::GetRadius() const
 	return radius;
 }
 
+size_t Model::GetMemorySize() const
+{
+	const VertexFormat & format = VertexFormat::Get(varray.GetVertexFormat());
+	return varray.GetMemorySize() +
+		varray.GetNumVertices() * format.stride +
+		varray.GetNumIndices() * sizeof(unsigned int);
+}
+
 void Model::Clear()
 {
 	ClearMeshData();
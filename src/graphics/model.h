@@ -48,7 +48,8 @@ public:
 
 	bool Load(const VertexArray & nvarray, std::ostream & error_output);
 
-	bool Serialize(joeserialize::Serializer & s);
+	template <class S>
+	bool Serialize(S & s);
 
 	bool WriteToFile(const std::string & filepath);
 
@@ -69,6 +70,9 @@ public:
 	/// Get bounding radius relative to center.
 	float GetRadius() const;
 
+	/// Vertex array size plus the size of its copy in the vertex buffer.
+	size_t GetMemorySize() const;
+
 	void Clear();
 
 	const VertexArray & GetVertexArray() const;
@@ -19,10 +19,14 @@
 
 #include "model_joe03.h"
 #include "joepack.h"
+#include "mappedfile.h"
 #include "mathvector.h"
 #include "endian_utility.h"
 #include "unordered_map.h"
+#include "microbench.h"
 
+#include <cstring>
+#include <sstream>
 #include <vector>
 using std::vector;
 
@@ -144,23 +148,44 @@ static void CorrectEndian(std::vector<JoeTexCoord> & p)
 	}
 }
 
-static int BinaryRead ( void * buffer, unsigned int size, unsigned int count, FILE * f, const JoePack * pack )
+// bounds checked reads from the joe file contents
+struct JoeReader
 {
-	unsigned int bytesread = 0;
+	const char * pos;
+	const char * end;
 
-	if ( pack == NULL )
+	JoeReader(const char * data, unsigned size) :
+		pos(data),
+		end(data + size)
 	{
-		bytesread = fread ( buffer, size, count, f );
+		// ctor
 	}
-	else
+
+	unsigned Remaining() const
 	{
-		bytesread = pack->fread ( buffer, size, count );
+		return end - pos;
 	}
 
-	assert(bytesread == count);
+	bool Read(void * buffer, unsigned size, unsigned count)
+	{
+		if (count > Remaining() / size)
+			return false;
 
-	return bytesread;
-}
+		std::memcpy(buffer, pos, size * count);
+		pos += size * count;
+		return true;
+	}
+
+	template <typename T>
+	bool Read(std::vector<T> & v, unsigned count)
+	{
+		if (count > Remaining() / sizeof(T))
+			return false;
+
+		v.resize(count);
+		return count == 0 || Read(&v[0], sizeof(T), count);
+	}
+};
 
 ///fix invalid normals (my own fault, i suspect.  the DOF converter i wrote may have flipped Y & Z normals)
 static bool NeedsNormalSwap(JoeObject & object)
@@ -207,34 +232,30 @@ bool ModelJoe03::Load ( const std::string & filename, std::ostream & err_output,
 {
 	Clear();
 
-	FILE * m_FilePointer = NULL;
-
-	//open file
+	// parse directly from the mapped file or pack
+	MappedFile file;
+	const char * data = 0;
+	unsigned size = 0;
 	if ( pack == NULL )
 	{
-		m_FilePointer = fopen(filename.c_str(), "rb");
-		if (!m_FilePointer)
+		if (!file.Open(filename))
 		{
 			err_output << "MODEL_JOE03: Failed to open file " << filename << std::endl;
 			return false;
 		}
+		data = file.GetData();
+		size = file.GetSize();
 	}
 	else
 	{
-		if (!pack->fopen(filename))
+		if (!pack->GetFile(filename, data, size))
 		{
 			err_output << "MODEL_JOE03: Failed to open file " << filename << " in " << pack->GetPath() << std::endl;
 			return false;
 		}
 	}
 
-	bool loaded = LoadFromHandle ( m_FilePointer, pack, err_output );
-
-	// Clean up after everything
-	if ( pack == NULL )
-		fclose ( m_FilePointer );
-	else
-		pack->fclose();
+	bool loaded = Load ( data, size, err_output );
 
 	if (!loaded)
 		err_output << "in " << filename << std::endl;
@@ -242,12 +263,19 @@ bool ModelJoe03::Load ( const std::string & filename, std::ostream & err_output,
 	return loaded;
 }
 
-bool ModelJoe03::LoadFromHandle ( FILE * m_FilePointer, const JoePack * pack, std::ostream & err_output )
+bool ModelJoe03::Load ( const char * data, unsigned size, std::ostream & err_output )
 {
+	Clear();
+
 	JoeObject object;
+	JoeReader reader(data, size);
 
 	// Read the header data and store it in our variable
-	BinaryRead ( &object.info, sizeof ( JoeHeader ), 1, m_FilePointer, pack );
+	if (!reader.Read ( &object.info, sizeof ( JoeHeader ), 1 ))
+	{
+		err_output << "Unexpected end of file. ";
+		return false;
+	}
 
 	object.info.magic = ENDIAN_SWAP_32 ( object.info.magic );
 	object.info.version = ENDIAN_SWAP_32 ( object.info.version );
@@ -269,7 +297,11 @@ bool ModelJoe03::LoadFromHandle ( FILE * m_FilePointer, const JoePack * pack, st
 	}
 
 	// Read in the model data
-	ReadData ( m_FilePointer, pack, object );
+	if (!ReadData ( reader, object ))
+	{
+		err_output << "Unexpected end of file. ";
+		return false;
+	}
 
 	//generate metrics such as bounding box, etc
 	GenMeshMetrics();
@@ -278,38 +310,41 @@ bool ModelJoe03::LoadFromHandle ( FILE * m_FilePointer, const JoePack * pack, st
 	return true;
 }
 
-void ModelJoe03::ReadData ( FILE * m_FilePointer, const JoePack * pack, JoeObject & object )
+bool ModelJoe03::ReadData ( JoeReader & reader, JoeObject & object )
 {
 	unsigned int num_frames = object.info.num_frames;
 	unsigned int num_faces = object.info.num_faces;
 
+	// each frame holds at least the faces and three counts
+	if ( num_frames > reader.Remaining() / ( sizeof ( JoeFace ) * num_faces + 3 * sizeof ( unsigned int ) ) )
+		return false;
+
 	object.frames.resize(num_frames);
 
 	for ( unsigned int i = 0; i < num_frames; i++ )
 	{
 		JoeFrame & frame = object.frames[i];
 
-		frame.faces.resize(num_faces);
-
-		BinaryRead ( &frame.faces[0], sizeof ( JoeFace ), num_faces, m_FilePointer, pack );
+		if (!reader.Read ( frame.faces, num_faces ))
+			return false;
 		CorrectEndian ( frame.faces );
 
-		BinaryRead ( &frame.num_verts, sizeof ( unsigned int ), 1, m_FilePointer, pack );
+		if (!reader.Read ( &frame.num_verts, sizeof ( unsigned int ), 1 ) ||
+			!reader.Read ( &frame.num_texcoords, sizeof ( unsigned int ), 1 ) ||
+			!reader.Read ( &frame.num_normals, sizeof ( unsigned int ), 1 ))
+			return false;
 		frame.num_verts = ENDIAN_SWAP_32 ( frame.num_verts );
-		BinaryRead ( &frame.num_texcoords, sizeof ( unsigned int ), 1, m_FilePointer, pack );
 		frame.num_texcoords = ENDIAN_SWAP_32 ( frame.num_texcoords );
-		BinaryRead ( &frame.num_normals, sizeof ( unsigned int ), 1, m_FilePointer, pack );
 		frame.num_normals = ENDIAN_SWAP_32 ( frame.num_normals );
 
-		frame.verts.resize(frame.num_verts);
-		frame.normals.resize(frame.num_normals);
-		frame.texcoords.resize(frame.num_texcoords);
-
-		BinaryRead ( &frame.verts[0], sizeof ( JoeVertex ), frame.num_verts, m_FilePointer, pack );
+		if (!reader.Read ( frame.verts, frame.num_verts ))
+			return false;
 		CorrectEndian ( frame.verts );
-		BinaryRead ( &frame.normals[0], sizeof ( JoeVertex ), frame.num_normals, m_FilePointer, pack );
+		if (!reader.Read ( frame.normals, frame.num_normals ))
+			return false;
 		CorrectEndian ( frame.normals );
-		BinaryRead ( &frame.texcoords[0], sizeof ( JoeTexCoord ), frame.num_texcoords, m_FilePointer, pack );
+		if (!reader.Read ( frame.texcoords, frame.num_texcoords ))
+			return false;
 		CorrectEndian ( frame.texcoords );
 
 		// there seem to be models without texcoords like ct/glass.joe, why???
@@ -437,5 +472,76 @@ void ModelJoe03::ReadData ( FILE * m_FilePointer, const JoePack * pack, JoeObjec
 		&v_vertices[0], v_vertices.size(),
 		&v_texcoords[0], v_texcoords.size(),
 		&v_normals[0], v_normals.size());
+
+	return true;
 }
 
+
+// reads one byte per page, returns the page in time
+static double TouchPages(const char * data, unsigned size, unsigned & sum)
+{
+	const double start = microbench::getTime();
+	for (unsigned i = 0; i < size; i += 4096)
+		sum += (unsigned char)data[i];
+	return microbench::getTime() - start;
+}
+
+// i/o and parse time of the track packs and car models
+MICROBENCH(joeload)
+{
+	unsigned sum = 0;
+	std::ostringstream error;
+	std::vector<std::string> packs;
+	microbench::getDataFiles(ctx, microbench::TRACKS, "objects", "objects.jpk", packs);
+	for (std::vector<std::string>::const_iterator t = packs.begin(); t != packs.end(); ++t)
+	{
+		JoePack pack;
+		double io = microbench::getTime();
+		if (!pack.Load(*t))
+			continue;
+		io = microbench::getTime() - io;
+
+		double parse = 0;
+		unsigned bytes = 0;
+		for (unsigned i = 0; i < pack.GetFileCount(); ++i)
+		{
+			const std::string & name = pack.GetFileName(i);
+			const char * data;
+			unsigned size;
+			if (name.find(".joe") == std::string::npos || !pack.GetFile(name, data, size))
+				continue;
+
+			io += TouchPages(data, size, sum);
+			bytes += size;
+
+			ModelJoe03 model;
+			const double start = microbench::getTime();
+			model.Load(data, size, error);
+			parse += microbench::getTime() - start;
+		}
+		ctx.info_output << *t << ": " << pack.GetFileCount() << " packed files, "
+			<< bytes / 1024 << " KB, i/o " << io << " s, parse " << parse << " s\n";
+	}
+
+	std::vector<std::string> models;
+	microbench::getDataFiles(ctx, microbench::CARS, "", ".joe", models);
+	double io = 0, parse = 0;
+	unsigned count = 0, bytes = 0;
+	for (std::vector<std::string>::const_iterator m = models.begin(); m != models.end(); ++m)
+	{
+		MappedFile file;
+		const double start = microbench::getTime();
+		if (!file.Open(*m))
+			continue;
+		io += microbench::getTime() - start + TouchPages(file.GetData(), file.GetSize(), sum);
+		bytes += file.GetSize();
+		count++;
+
+		ModelJoe03 model;
+		const double parse_start = microbench::getTime();
+		model.Load(file.GetData(), file.GetSize(), error);
+		parse += microbench::getTime() - parse_start;
+	}
+	ctx.info_output << "cars: " << count << " models, " << bytes / 1024 << " KB, i/o "
+		<< io << " s, parse " << parse << " s (checksum " << sum << ")" << std::endl;
+}
@@ -20,18 +20,21 @@
 #include "model_obj.h"
 #include "unittest.h"
 #include "vertexarray.h"
+#include "mappedfile.h"
+#include "microbench.h"
+#include "pathmanager.h"
 
+#include <sys/stat.h>
 #include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
 
 #include <fstream>
-using std::ifstream;
 
 #include <string>
 using std::string;
 
-#include <sstream>
-using std::istringstream;
-
 #include <iostream>
 using std::ostream;
 using std::endl;
@@ -39,146 +42,258 @@ using std::endl;
 #include <vector>
 using std::vector;
 
-///extract a formatted string from the output, ignoring comments
-string ReadFromStream(std::istream & s)
-{
-	if (!s)
-		return "";
-	std::streampos curpos = s.tellg();
-	assert(curpos >= 0);
-	string str;
-	s >> str;
-	if (!s || str.empty())
-		return "";
-	if (str[0] == '#')
-	{
-		s.seekg(curpos);
-		std::getline(s,str);
-		return ReadFromStream(s);
-	}
-	return str;
+static inline bool IsDigit(char c)
+{
+	return c >= '0' && c <= '9';
 }
 
-///extract a repeating value, return true on success.
-template <typename T>
-bool ExtractRepeating(std::vector <T> & output_vector, unsigned int repeats, std::istream & s)
+static inline bool IsSpace(char c)
 {
-	if (!s)
-		return false;
-	for (unsigned int i = 0; i < repeats; i++)
-	{
-		string strformat = ReadFromStream(s);
-		if (strformat.empty())
-			return false;
-		istringstream reformat(strformat);
-		T reformatted;
-		reformat >> reformatted;
-		output_vector.push_back(reformatted);
-	}
+	return c == ' ' || c == '\t' || c == '\r';
+}
 
-	if (output_vector.size() != repeats)
-		return false;
+static inline const char * SkipSpace(const char * p, const char * end)
+{
+	while (p < end && IsSpace(*p))
+		++p;
+	return p;
+}
 
-	return true;
+static inline const char * SkipToken(const char * p, const char * end)
+{
+	while (p < end && !IsSpace(*p) && *p != '\n')
+		++p;
+	return p;
 }
 
-bool ExtractTriFloat(vector <VertexArray::Float3> & output_vector, const std::string & section, std::istream & s,  std::ostream & error_log, const std::string & filepath)
+static inline const char * NextLine(const char * p, const char * end)
 {
-	vector <float> coords;
-	if (!ExtractRepeating(coords, 3, s))
+	const char * eol = static_cast<const char *>(std::memchr(p, '\n', end - p));
+	return eol ? eol + 1 : end;
+}
+
+///locale independent float parser, returns false if the token has no digits
+static bool ParseFloat(const char * & p, const char * end, float & value)
+{
+	static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+		1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+	const char * s = SkipSpace(p, end);
+	bool negative = false;
+	if (s < end && (*s == '-' || *s == '+'))
+		negative = (*s++ == '-');
+
+	double mantissa = 0;
+	int exponent = 0;
+	int digits = 0;
+	for (; s < end && IsDigit(*s); ++s, ++digits)
+		mantissa = mantissa * 10 + (*s - '0');
+	if (s < end && *s == '.')
 	{
-		error_log << "Error reading " << section << " in " << filepath << endl;
+		for (++s; s < end && IsDigit(*s); ++s, ++digits, --exponent)
+			mantissa = mantissa * 10 + (*s - '0');
+	}
+	if (!digits)
 		return false;
+
+	if (s < end && (*s == 'e' || *s == 'E'))
+	{
+		const char * e = s + 1;
+		bool enegative = false;
+		if (e < end && (*e == '-' || *e == '+'))
+			enegative = (*e++ == '-');
+		if (e < end && IsDigit(*e))
+		{
+			int n = 0;
+			for (; e < end && IsDigit(*e); ++e)
+			{
+				if (n < 1000)
+					n = n * 10 + (*e - '0');
+			}
+			exponent += enegative ? -n : n;
+			s = e;
+		}
 	}
-	output_vector.push_back(VertexArray::Float3(coords[0],coords[1],coords[2]));
+
+	for (; exponent > 22; exponent -= 22)
+		mantissa *= powers[22];
+	for (; exponent < -22; exponent += 22)
+		mantissa /= powers[22];
+	if (exponent >= 0)
+		mantissa *= powers[exponent];
+	else
+		mantissa /= powers[-exponent];
+
+	value = negative ? -mantissa : mantissa;
+	p = SkipToken(s, end);
 	return true;
 }
 
-bool ExtractTwoFloat(vector <VertexArray::Float2> & output_vector, const std::string & section, std::istream & s,  std::ostream & error_log, const std::string & filepath)
+static bool ParseFloats(const char * & p, const char * end, float * values, int count)
 {
-	vector <float> coords;
-	if (!ExtractRepeating(coords, 2, s))
+	for (int i = 0; i < count; ++i)
 	{
-		error_log << "Error reading " << section << " in " << filepath << endl;
-		return false;
+		if (!ParseFloat(p, end, values[i]))
+			return false;
 	}
-	output_vector.push_back(VertexArray::Float2(coords[0],coords[1]));
 	return true;
 }
 
-bool BuildVertex(VertexArray::VertexData & outputvert, vector <VertexArray::Float3> & verts, vector <VertexArray::Float3> & normals, vector <VertexArray::Float2> & texcoords, const string & facestr)
+///parse a positive one based index
+static bool ParseIndex(const char * & p, const char * end, unsigned & index)
 {
-	if (std::count(facestr.begin(), facestr.end(), '/') != 2)
+	index = 0;
+	const char * s = p;
+	for (; s < end && IsDigit(*s) && index < 0x10000000; ++s)
+		index = index * 10 + (*s - '0');
+	if (s == p || index == 0)
 		return false;
+	p = s;
+	return true;
+}
 
-	if (facestr.find("//") != string::npos)
+///parse a v/t/n face vertex token
+static bool ParseFaceVertex(
+	const char * & p, const char * end,
+	const vector <VertexArray::Float3> & verts,
+	const vector <VertexArray::Float3> & normals,
+	const vector <VertexArray::Float2> & texcoords,
+	VertexArray::VertexData & outputvert)
+{
+	unsigned v, t, n;
+	const char * s = p;
+	if (!ParseIndex(s, end, v) || s == end || *s++ != '/' ||
+		!ParseIndex(s, end, t) || s == end || *s++ != '/' ||
+		!ParseIndex(s, end, n) || SkipToken(s, end) != s)
 		return false;
 
-	string facestr2 = facestr;
-	std::replace(facestr2.begin(), facestr2.end(), '/', ' ');
-	istringstream s(facestr2);
-	int v(-1),t(-1),n(-1);
-	s >> v >> t >> n;
-	if (v <= 0 || t <= 0 || n <= 0)
+	if (v > verts.size() || t > texcoords.size() || n > normals.size())
 		return false;
 
 	outputvert.vertex = verts[v-1];
 	outputvert.normal = normals[n-1];
 	outputvert.texcoord = texcoords[t-1];
-
+	p = s;
 	return true;
 }
 
+///true if the cache file exists and isn't older than the source
+static bool IsCacheCurrent(const std::string & sourcepath, const std::string & cachepath)
+{
+	struct stat source, cache;
+	return stat(sourcepath.c_str(), &source) == 0 &&
+		stat(cachepath.c_str(), &cache) == 0 &&
+		cache.st_mtime >= source.st_mtime;
+}
+
 bool ModelObj::Load(const std::string & filepath, std::ostream & error_log)
 {
-	ifstream f(filepath.c_str());
-	if (!f)
+	const std::string cachepath = filepath + ".ova";
+	if (IsCacheCurrent(filepath, cachepath))
+	{
+		// a stale or broken cache is silently rebuilt
+		std::ostringstream cache_error;
+		if (ReadFromFile(cachepath, cache_error))
+			return true;
+	}
+
+	MappedFile file;
+	if (!file.Open(filepath))
 	{
 		error_log << "Couldn't open object file: " << filepath << endl;
 		return false;
 	}
 
+	if (!Load(file.GetData(), file.GetSize(), error_log))
+	{
+		error_log << "in " << filepath << endl;
+		return false;
+	}
+
+	// the sidecar is optional, data directories might be read only
+	const std::string temppath = cachepath + ".tmp";
+	if (WriteToFile(temppath))
+	{
+		std::remove(cachepath.c_str());
+		if (std::rename(temppath.c_str(), cachepath.c_str()) != 0)
+			std::remove(temppath.c_str());
+	}
+	else
+	{
+		std::remove(temppath.c_str());
+	}
+
+	return true;
+}
+
+bool ModelObj::Load(const char * data, unsigned size, std::ostream & error_log)
+{
+	Clear();
+
 	vector <VertexArray::Float3> verts;
 	vector <VertexArray::Float3> normals;
 	vector <VertexArray::Float2> texcoords;
 	vector <VertexArray::Face> faces;
 
-	while (f)
+	const char * end = data + size;
+	unsigned line = 1;
+	for (const char * p = data; p < end; p = NextLine(p, end), ++line)
 	{
-		string id = ReadFromStream(f);
+		p = SkipSpace(p, end);
+		const char * id = p;
+		p = SkipToken(p, end);
+		const size_t idlen = p - id;
 
-		if (id == "v")
-		{
-			if (!ExtractTriFloat(verts, "vertices", f, error_log, filepath)) return false;
-		}
-		else if (id == "vn")
+		if (idlen == 1 && id[0] == 'v')
 		{
-			if (!ExtractTriFloat(normals, "normals", f, error_log, filepath)) return false;
+			float c[3];
+			if (!ParseFloats(p, end, c, 3))
+			{
+				error_log << "Error reading vertices on line " << line << " ";
+				return false;
+			}
+			verts.push_back(VertexArray::Float3(c[0], c[1], c[2]));
 		}
-		else if (id == "vt")
+		else if (idlen == 2 && id[0] == 'v' && id[1] == 'n')
 		{
-			if (!ExtractTwoFloat(texcoords, "texcoords", f, error_log, filepath)) return false;
-			texcoords.back().v = 1.0-texcoords.back().v;
+			float c[3];
+			if (!ParseFloats(p, end, c, 3))
+			{
+				error_log << "Error reading normals on line " << line << " ";
+				return false;
+			}
+			normals.push_back(VertexArray::Float3(c[0], c[1], c[2]));
 		}
-		else if (id == "f")
+		else if (idlen == 2 && id[0] == 'v' && id[1] == 't')
 		{
-			vector <string> faceverts;
-			if (!ExtractRepeating(faceverts, 3, f))
+			float c[2];
+			if (!ParseFloats(p, end, c, 2))
 			{
-				error_log << "Error reading faces in " << filepath << endl;
+				error_log << "Error reading texcoords on line " << line << " ";
 				return false;
 			}
+			texcoords.push_back(VertexArray::Float2(c[0], 1.0f - c[1]));
+		}
+		else if (idlen == 1 && id[0] == 'f')
+		{
 			VertexArray::VertexData newverts[3];
 			for (int i = 0; i < 3; i++)
 			{
-				if (!BuildVertex(newverts[i], verts, normals, texcoords, faceverts[i]))
+				p = SkipSpace(p, end);
+				const char * token = p;
+				if (p == end || *p == '\n')
+				{
+					error_log << "Error reading faces on line " << line << " ";
+					return false;
+				}
+				if (!ParseFaceVertex(p, end, verts, normals, texcoords, newverts[i]))
 				{
-					error_log << "Error: obj file has faces without texture and normal data: " << faceverts[i] << " in " << filepath << endl;
+					error_log << "Error: obj file has faces without texture and normal data: "
+						<< string(token, SkipToken(token, end)) << " on line " << line << " ";
 					return false;
 				}
 			}
-			VertexArray::Face newface(newverts[0], newverts[1], newverts[2]);
-			faces.push_back(newface);
+			faces.push_back(VertexArray::Face(newverts[0], newverts[1], newverts[2]));
 		}
 	}
 
@@ -248,3 +363,89 @@ bool ModelObj::Save(const std::string & strFileName, std::ostream & error_output
 	return true;
 }
 
+
+QT_TEST(model_obj_test)
+{
+	std::ostringstream error;
+	const std::string obj =
+		"# comment\r\n"
+		"v 0 0 0\r\n"
+		"v 1.5e1 -2 .25\n"
+		"v -1E-1 +3. 4\n"
+		"vt 0 0.25\n"
+		"vn 0 0 1 # trailing comment\n"
+		"g group\n"
+		"f 1/1/1 2/1/1 3/1/1\n"
+		"f 3/1/1 2/1/1 1/1/1";
+	ModelObj model;
+	QT_CHECK(model.Load(obj.data(), obj.size(), error));
+
+	const VertexArray & va = model.GetVertexArray();
+	const float * verts;
+	const float * tcos;
+	const unsigned int * faces;
+	int vcount, tcount, fcount;
+	va.GetVertices(verts, vcount);
+	va.GetTexCoords(tcos, tcount);
+	va.GetFaces(faces, fcount);
+	QT_CHECK_EQUAL(vcount, 9);
+	QT_CHECK_EQUAL(fcount, 6);
+	QT_CHECK_EQUAL(faces[3], faces[2]);
+	QT_CHECK_EQUAL(faces[5], faces[0]);
+	QT_CHECK_EQUAL(verts[3], 15.0f);
+	QT_CHECK_EQUAL(verts[5], 0.25f);
+	QT_CHECK_CLOSE(verts[6], -0.1f, 0.000001f);
+	QT_CHECK_EQUAL(verts[7], 3.0f);
+	QT_CHECK_EQUAL(tcos[1], 0.75f);
+
+	const std::string nonormals = "v 0 0 0\nvt 0 0\nf 1//1 1//1 1//1\n";
+	QT_CHECK(!model.Load(nonormals.data(), nonormals.size(), error));
+	const std::string badindex = "v 0 0 0\nvt 0 0\nvn 0 0 1\nf 1/1/1 2/1/1 1/1/1\n";
+	QT_CHECK(!model.Load(badindex.data(), badindex.size(), error));
+	const std::string shortvertex = "v 0 0\nv 0 0 0\n";
+	QT_CHECK(!model.Load(shortvertex.data(), shortvertex.size(), error));
+}
+
+MICROBENCH(objload)
+{
+	std::ostringstream error;
+	std::vector<std::string> paths;
+	microbench::getDataFiles(ctx, microbench::TRACKS, "objects", ".obj", paths);
+	microbench::getDataFiles(ctx, microbench::CARS, "", ".obj", paths);
+
+	// the sidecar is written to the track cache directory, bundled data might be read only
+	const std::string cache_path = ctx.paths.GetTrackCachePath() + "/objload.ova";
+	double parse = 0, cached = 0;
+	unsigned count = 0, bytes = 0, triangles = 0;
+	for (std::vector<std::string>::const_iterator i = paths.begin(); i != paths.end(); ++i)
+	{
+		MappedFile file;
+		if (!file.Open(*i))
+			continue;
+
+		ModelObj model;
+		const double parse_start = microbench::getTime();
+		if (!model.Load(file.GetData(), file.GetSize(), error))
+		{
+			ctx.error_output << error.str() << "in " << *i << std::endl;
+			error.str("");
+			continue;
+		}
+		parse += microbench::getTime() - parse_start;
+		if (!model.WriteToFile(cache_path))
+			continue;
+
+		ModelObj cache;
+		const double cache_start = microbench::getTime();
+		cache.ReadFromFile(cache_path, error);
+		cached += microbench::getTime() - cache_start;
+
+		bytes += file.GetSize();
+		triangles += model.GetVertexArray().GetNumIndices() / 3;
+		count++;
+	}
+	std::remove(cache_path.c_str());
+
+	ctx.info_output << "obj: " << count << " models, " << bytes / 1024 << " KB, "
+		<< triangles << " triangles, parse " << parse << " s, cached " << cached << " s" << std::endl;
+}
@@ -25,15 +25,23 @@
 #include <iosfwd>
 #include <string>
 
+/// Wavefront obj loader, triangulated faces with texture coordinates and normals only.
+/// Parsed models are cached in a binary sidecar file next to the obj.
 class ModelObj : public Model
 {
 private:
 
 public:
-	ModelObj(const std::string & filepath, std::ostream & error_output) : Model(filepath, error_output) {}
+	ModelObj() {}
 
-	///returns true on success
+	ModelObj(const std::string & filepath, std::ostream & error_output) {Load(filepath, error_output);}
+
+	///returns true on success, uses filepath.ova if it is newer than filepath
 	virtual bool Load(const std::string & filepath, std::ostream & error_log);
+
+	///parse obj file contents, returns true on success
+	bool Load(const char * data, unsigned size, std::ostream & error_log);
+
 	virtual bool CanSave() const {return true;}
 	virtual bool Save(const std::string & strFileName, std::ostream & error_output) const;
 };
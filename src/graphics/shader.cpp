@@ -19,6 +19,7 @@
 
 #include "shader.h"
 #include "utils.h"
+#include "loadtrace.h"
 
 #include <cassert>
 #include <sstream>
@@ -101,6 +102,8 @@ bool Shader::Load(
 	std::ostream & info_output,
 	std::ostream & error_output)
 {
+	loadtrace::Scope trace("Shader::Load", fragment_filename);
+
 	Unload();
 
 	// get shader sources
@@ -21,6 +21,7 @@
 #include "glcore.h"
 #include "glutil.h"
 #include "dds.h"
+#include "texturecache.h"
 
 #ifdef __APPLE__
 #include <SDL2_image/SDL_image.h>
@@ -34,93 +35,6 @@
 #include <vector>
 #include <cassert>
 
-// averaging downsampler
-// bytespp is the size of a pixel (number of channels)
-// dst width/height are multiples of src width, height in pixels
-// pitch is size of a pixel row in bytes
-template <unsigned bytespp>
-static void SampleDownAvg(
-	const unsigned src_width,
-	const unsigned src_height,
-	const unsigned src_pitch,
-	const unsigned char src[],
-	const unsigned dst_width,
-	const unsigned dst_height,
-	const unsigned dst_pitch,
-	unsigned char dst[])
-{
-	const unsigned scalex = src_width / dst_width;
-	const unsigned scaley = src_height / dst_height;
-	const unsigned div = scalex * scaley;
-	assert(scalex * dst_width == src_width);
-	assert(scaley * dst_height == src_height);
-
-	unsigned acc[bytespp];
-	for (unsigned y = 0; y < dst_height; ++y)
-	{
-		unsigned char * dp = dst + y * dst_pitch;
-		const unsigned char * spy = src + y * src_pitch * scaley;
-		for (unsigned x = 0; x < dst_width; ++x)
-		{
-			const unsigned char * sp = spy + x * scalex * bytespp;
-			for (unsigned i = 0; i < bytespp; ++i)
-				acc[i] = 0;
-			for (unsigned dy = 0; dy < scaley; ++dy)
-			{
-				for (unsigned dx = 0; dx < scalex; ++dx)
-				{
-					for (unsigned i = 0; i < bytespp; ++i, ++sp)
-						acc[i] += *sp;
-				}
-				sp += (src_pitch - scalex * bytespp);
-			}
-			for (unsigned i = 0; i < bytespp; ++i, ++dp)
-				*dp = acc[i] / div;
-		}
-	}
-}
-
-static void SampleDownAvg(
-	const unsigned bytespp,
-	const unsigned src_width,
-	const unsigned src_height,
-	const unsigned src_pitch,
-	const unsigned char src[],
-	const unsigned dst_width,
-	const unsigned dst_height,
-	const unsigned dst_pitch,
-	unsigned char dst[])
-{
-	if (bytespp == 1)
-	{
-		SampleDownAvg<1>(
-			src_width, src_height, src_pitch, src,
-			dst_width, dst_height, dst_pitch, dst);
-	}
-	else if (bytespp == 2)
-	{
-		SampleDownAvg<2>(
-			src_width, src_height, src_pitch, src,
-			dst_width, dst_height, dst_pitch, dst);
-	}
-	else if (bytespp == 3)
-	{
-		SampleDownAvg<3>(
-			src_width, src_height, src_pitch, src,
-			dst_width, dst_height, dst_pitch, dst);
-	}
-	else if (bytespp == 4)
-	{
-		SampleDownAvg<4>(
-			src_width, src_height, src_pitch, src,
-			dst_width, dst_height, dst_pitch, dst);
-	}
-	else
-	{
-		assert(0);
-	}
-}
-
 static void GetTextureFormat(
 	const SDL_Surface * surface,
 	const TextureInfo & info,
@@ -213,7 +127,8 @@ static void SetSampler(const TextureInfo & info, bool hasmiplevels = false)
 		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, (float)info.anisotropy);
 }
 
-Texture::Texture()
+Texture::Texture() :
+	memsize(0)
 {
 	// ctor
 }
@@ -232,13 +147,18 @@ bool Texture::Load(const std::string & path, const TextureInfo & info, std::ostr
 		return false;
 	}
 
-	if (!info.data && path.empty())
+	if (!info.data && !info.surface && !info.dds && path.empty())
 	{
 		error << "Tried to load a texture with an empty name" << std::endl;
 		return false;
 	}
 
-	if (!info.data && LoadDDS(path, info, error))
+	if (info.dds)
+	{
+		return LoadDDS(info.dds, info.ddssize, info, error);
+	}
+
+	if (!info.data && !info.surface && LoadDDS(path, info, error))
 	{
 		return true;
 	}
@@ -268,6 +188,10 @@ bool Texture::Load(const std::string & path, const TextureInfo & info, std::ostr
 			info.bytespp * 8, info.width * info.bytespp,
 			rmask, gmask, bmask, amask);
 	}
+	else if (info.surface)
+	{
+		surface = info.surface;
+	}
 	else
 	{
 		surface = IMG_Load(path.c_str());
@@ -288,33 +212,13 @@ bool Texture::Load(const std::string & path, const TextureInfo & info, std::ostr
 
 	// downsample if requested by application
 	std::vector<unsigned char> pixelsd;
-	unsigned wd = w;
-	unsigned hd = h;
-	if (info.maxsize == TextureInfo::SMALL)
-	{
-		if (w > 256)
-			wd = w / 4;
-		else if (w > 128)
-			wd = w / 2;
-
-		if (h > 256)
-			hd = h / 4;
-		else if (h > 128)
-			hd = h / 2;
-	}
-	else if (info.maxsize == TextureInfo::MEDIUM)
-	{
-		if (w > 256)
-			wd = w / 2;
-
-		if (h > 256)
-			hd = h / 2;
-	}
+	unsigned wd, hd;
+	TextureCache::GetSize(info.maxsize, w, h, wd, hd);
 	if (wd < w || hd < h)
 	{
 		pixelsd.resize(wd * hd * bytespp);
 
-		SampleDownAvg(
+		TextureCache::SampleDown(
 			bytespp, w, h, pitch, pixels,
 			wd, hd, wd * bytespp, &pixelsd[0]);
 
@@ -327,6 +231,7 @@ bool Texture::Load(const std::string & path, const TextureInfo & info, std::ostr
 	// store dimensions
 	width = w;
 	height = h;
+	memsize = w * h * bytespp * 4 / 3; // with mip levels
 
 	target = GL_TEXTURE_2D;
 
@@ -351,16 +256,33 @@ bool Texture::Load(const std::string & path, const TextureInfo & info, std::ostr
 	if (GLC_ARB_framebuffer_object)
 		glGenerateMipmap(GL_TEXTURE_2D);
 
-	SDL_FreeSurface(surface);
+	if (surface != info.surface)
+		SDL_FreeSurface(surface);
 
 	return true;
 }
 
+SDL_Surface * Texture::Decode(const std::string & path)
+{
+	std::ifstream file(path.c_str(), std::ifstream::in | std::ifstream::binary);
+	char magic[4];
+	if (!file.read(magic, 4) || IsDDS(magic, 4))
+		return 0;
+
+	return IMG_Load(path.c_str());
+}
+
 void Texture::Unload()
 {
 	if (texid)
 		glDeleteTextures(1, &texid);
 	texid = 0;
+	memsize = 0;
+}
+
+size_t Texture::GetMemorySize() const
+{
+	return memsize;
 }
 
 bool Texture::LoadCubeVerticalCross(const std::string & path, const TextureInfo & info, std::ostream & error)
@@ -399,6 +321,7 @@ bool Texture::LoadCubeVerticalCross(const std::string & path, const TextureInfo
 
 	// upload texture
 	unsigned bytespp = surface->format->BytesPerPixel;
+	memsize = 6 * width * height * bytespp;
 	std::vector<unsigned char> cubeface(width * height * bytespp);
 	for (int i = 0; i < 6; ++i)
 	{
@@ -553,6 +476,7 @@ bool Texture::LoadCube(const std::string & path, const TextureInfo & info, std::
 		}
 		width = surface->w;
 		height = surface->h;
+		memsize += width * height * surface->format->BytesPerPixel;
 
 		// detect channels
 		int format = GL_RGB;
@@ -633,28 +557,38 @@ bool Texture::LoadDDS(const std::string & path, const TextureInfo & info, std::o
 	std::vector<char> data(length);
 	file.read(&data[0], length);
 
+	return LoadDDS(&data[0], length, info, error);
+}
+
+bool Texture::LoadDDS(const char * data, unsigned long length, const TextureInfo & info, std::ostream & error)
+{
 	// load dds
 	const char * texdata(0);
 	unsigned long texlen(0);
 	unsigned format(0);
 	unsigned levels(0);
 	if (!ReadDDS(
-		(void*)&data[0], length,
+		(const void*)data, length,
 		(const void*&)texdata, texlen,
 		format, width, height, levels))
 	{
 		return false;
 	}
 
-	// gl3 renderer expects srgb
 	unsigned iformat = format;
-	if (info.srgb)
+	if (format == GL_BGR || format == GL_BGRA)
 	{
+		// uncompressed data is compressed by the driver like decoded images
+		const bool compress = info.compress && (width > 512 || height > 512);
 		if (format == GL_BGR)
-			iformat = GL_SRGB8;
-		else if (format == GL_BGRA)
-			iformat = GL_SRGB8_ALPHA8;
-		else if (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT)
+			iformat = compress ? (info.srgb ? GL_COMPRESSED_SRGB : GL_COMPRESSED_RGB) : (info.srgb ? GL_SRGB8 : GL_RGB8);
+		else
+			iformat = compress ? (info.srgb ? GL_COMPRESSED_SRGB_ALPHA : GL_COMPRESSED_RGBA) : (info.srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8);
+	}
+	else if (info.srgb)
+	{
+		// gl3 renderer expects srgb
+		if (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT)
 			iformat = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT;
 		else if (format == GL_COMPRESSED_RGBA_S3TC_DXT3_EXT)
 			iformat = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT;
@@ -673,7 +607,11 @@ bool Texture::LoadDDS(const std::string & path, const TextureInfo & info, std::o
 
 	SetSampler(info, levels > 1);
 
+	// mip levels are tightly packed
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
 	const char * idata = texdata;
+	const char * dataend = data + length;
 	unsigned blocklen = 16 * texlen / (width * height);
 	unsigned ilen = texlen;
 	unsigned iw = width;
@@ -681,26 +619,37 @@ bool Texture::LoadDDS(const std::string & path, const TextureInfo & info, std::o
 	for (unsigned i = 0; i < levels; ++i)
 	{
 		if (format == GL_BGR || format == GL_BGRA)
-		{
-			// fixme: support compression here?
 			ilen = iw * ih * blocklen / 16;
-			glTexImage2D(GL_TEXTURE_2D, i, iformat, iw, ih, 0, format, GL_UNSIGNED_BYTE, idata);
-		}
 		else
-		{
 			ilen = std::max(1u, iw / 4) * std::max(1u, ih / 4) * blocklen;
-			glCompressedTexImage2D(GL_TEXTURE_2D, i, iformat, iw, ih, 0, ilen, idata);
+
+		if (ilen > unsigned(dataend - idata))
+		{
+			error << "DDS texture data is truncated at level " << i << std::endl;
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			return false;
 		}
+
+		if (format == GL_BGR || format == GL_BGRA)
+			glTexImage2D(GL_TEXTURE_2D, i, iformat, iw, ih, 0, format, GL_UNSIGNED_BYTE, idata);
+		else
+			glCompressedTexImage2D(GL_TEXTURE_2D, i, iformat, iw, ih, 0, ilen, idata);
 		CheckForOpenGLErrors("Texture creation", error);
 
 		idata += ilen;
+		memsize += ilen;
 		iw = std::max(1u, iw / 2);
 		ih = std::max(1u, ih / 2);
 	}
 
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
 	// force mipmaps for GL3
 	if (levels == 1 && GLC_ARB_framebuffer_object)
+	{
 		glGenerateMipmap(GL_TEXTURE_2D);
+		memsize = memsize * 4 / 3;
+	}
 
 	return true;
 }
@@ -37,12 +37,23 @@ public:
 
 	void Unload();
 
+	/// Estimated gpu memory use in bytes, textures compressed by the driver are counted uncompressed.
+	size_t GetMemorySize() const;
+
+	/// Decode image file for TextureInfo::surface, safe to call from worker threads.
+	/// Returns null for dds files, they are loaded as they are.
+	static SDL_Surface * Decode(const std::string & path);
+
 private:
+	size_t memsize;
+
 	bool LoadCubeVerticalCross(const std::string & path, const TextureInfo & info, std::ostream & error);
 
 	bool LoadCube(const std::string & path, const TextureInfo & info, std::ostream & error);
 
 	bool LoadDDS(const std::string & path, const TextureInfo & info, std::ostream & error);
+
+	bool LoadDDS(const char * data, unsigned long length, const TextureInfo & info, std::ostream & error);
 };
 
 #endif //_TEXTURE_H
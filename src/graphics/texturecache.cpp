@@ -0,0 +1,614 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+#include "texturecache.h"
+#include "texture.h"
+#include "dds.h"
+#include "jobsystem.h"
+#include "microbench.h"
+#include "pathmanager.h"
+#include "unittest.h"
+
+#include <SDL2/SDL_surface.h>
+#include <SDL2/SDL_thread.h>
+
+#include <sys/stat.h>
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define TEXTURE_CACHE_SSE
+#include <emmintrin.h>
+#endif
+
+static const unsigned cooked_version = 1;
+static const unsigned cooked_tag = 0x43544456; // 'VDTC' stored in the dds reserved words
+static const unsigned dds_size = 128; // magic and header
+static const unsigned dds_key_offset = 32; // first reserved word
+
+static void Hash(unsigned & hash, const void * data, unsigned size)
+{
+	const unsigned char * bytes = static_cast<const unsigned char *>(data);
+	for (unsigned i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+}
+
+static void Hash(unsigned & hash, unsigned value)
+{
+	Hash(hash, &value, sizeof(value));
+}
+
+static void PutU32(char * out, unsigned value)
+{
+	out[0] = char(value);
+	out[1] = char(value >> 8);
+	out[2] = char(value >> 16);
+	out[3] = char(value >> 24);
+}
+
+static unsigned GetU32(const char * in)
+{
+	const unsigned char * p = reinterpret_cast<const unsigned char *>(in);
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (unsigned(p[3]) << 24);
+}
+
+static unsigned GetMipCount(unsigned w, unsigned h)
+{
+	unsigned levels = 1;
+	while (w > 1 || h > 1)
+	{
+		w = std::max(1u, w / 2);
+		h = std::max(1u, h / 2);
+		levels++;
+	}
+	return levels;
+}
+
+static unsigned GetMipChainSize(unsigned w, unsigned h, unsigned levels, unsigned bytespp)
+{
+	unsigned size = 0;
+	for (unsigned i = 0; i < levels; ++i)
+	{
+		size += w * h * bytespp;
+		w = std::max(1u, w / 2);
+		h = std::max(1u, h / 2);
+	}
+	return size;
+}
+
+/// Uncompressed dds header, see dds.cpp for the format.
+static void WriteHeader(char * out, unsigned w, unsigned h, unsigned levels, unsigned bytespp, unsigned key)
+{
+	std::memset(out, 0, dds_size);
+	std::memcpy(out, "DDS ", 4);
+	PutU32(out + 4, 124);						// header size
+	PutU32(out + 8, 0x1 | 0x2 | 0x4 | 0x8 | 0x1000 | 0x20000); // caps, height, width, pitch, pixel format, mip count
+	PutU32(out + 12, h);
+	PutU32(out + 16, w);
+	PutU32(out + 20, w * bytespp);				// pitch
+	PutU32(out + 28, levels);
+	PutU32(out + dds_key_offset, cooked_tag);
+	PutU32(out + dds_key_offset + 4, key);
+	PutU32(out + 76, 32);						// pixel format size
+	PutU32(out + 80, bytespp == 4 ? 0x40 | 0x1 : 0x40); // rgb, alpha
+	PutU32(out + 88, bytespp * 8);
+	PutU32(out + 92, 0x00FF0000);
+	PutU32(out + 96, 0x0000FF00);
+	PutU32(out + 100, 0x000000FF);
+	PutU32(out + 104, bytespp == 4 ? 0xFF000000 : 0);
+	PutU32(out + 108, levels > 1 ? 0x1000 | 0x8 | 0x400000 : 0x1000); // texture, complex, mipmap
+}
+
+template <unsigned bytespp>
+static void SampleDownAvg(
+	const unsigned src_width,
+	const unsigned src_height,
+	const unsigned src_pitch,
+	const unsigned char src[],
+	const unsigned dst_width,
+	const unsigned dst_height,
+	const unsigned dst_pitch,
+	unsigned char dst[])
+{
+	const unsigned scalex = src_width / dst_width;
+	const unsigned scaley = src_height / dst_height;
+	const unsigned div = scalex * scaley;
+	assert(scalex * dst_width == src_width);
+	assert(scaley * dst_height == src_height);
+
+	unsigned acc[bytespp];
+	for (unsigned y = 0; y < dst_height; ++y)
+	{
+		unsigned char * dp = dst + y * dst_pitch;
+		const unsigned char * spy = src + y * src_pitch * scaley;
+		for (unsigned x = 0; x < dst_width; ++x)
+		{
+			const unsigned char * sp = spy + x * scalex * bytespp;
+			for (unsigned i = 0; i < bytespp; ++i)
+				acc[i] = 0;
+			for (unsigned dy = 0; dy < scaley; ++dy)
+			{
+				for (unsigned dx = 0; dx < scalex; ++dx)
+				{
+					for (unsigned i = 0; i < bytespp; ++i, ++sp)
+						acc[i] += *sp;
+				}
+				sp += (src_pitch - scalex * bytespp);
+			}
+			for (unsigned i = 0; i < bytespp; ++i, ++dp)
+				*dp = acc[i] / div;
+		}
+	}
+}
+
+#ifdef TEXTURE_CACHE_SSE
+// four 32 bit destination pixels per iteration, returns the number of pixels done
+static unsigned SampleMipRow4(
+	const unsigned count,
+	const unsigned char src0[],
+	const unsigned char src1[],
+	unsigned char dst[])
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi16(2);
+	unsigned x = 0;
+	for (; x + 4 <= count; x += 4)
+	{
+		const __m128i a0 = _mm_loadu_si128((const __m128i *)(src0 + x * 8));
+		const __m128i a1 = _mm_loadu_si128((const __m128i *)(src0 + x * 8 + 16));
+		const __m128i b0 = _mm_loadu_si128((const __m128i *)(src1 + x * 8));
+		const __m128i b1 = _mm_loadu_si128((const __m128i *)(src1 + x * 8 + 16));
+
+		// vertical sums, two pixels per register
+		const __m128i v0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+		const __m128i v1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+		const __m128i v2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+		const __m128i v3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+
+		// horizontal sums of the pixel pairs
+		const __m128i h0 = _mm_add_epi16(_mm_unpacklo_epi64(v0, v1), _mm_unpackhi_epi64(v0, v1));
+		const __m128i h1 = _mm_add_epi16(_mm_unpacklo_epi64(v2, v3), _mm_unpackhi_epi64(v2, v3));
+
+		const __m128i r0 = _mm_srli_epi16(_mm_add_epi16(h0, round), 2);
+		const __m128i r1 = _mm_srli_epi16(_mm_add_epi16(h1, round), 2);
+		_mm_storeu_si128((__m128i *)(dst + x * 4), _mm_packus_epi16(r0, r1));
+	}
+	return x;
+}
+#endif
+
+// odd sizes drop the last row/column, a size of one repeats it
+template <unsigned bytespp>
+static void SampleMip(
+	const unsigned width,
+	const unsigned height,
+	const unsigned char src[],
+	unsigned char dst[])
+{
+	const unsigned dst_width = std::max(1u, width / 2);
+	const unsigned dst_height = std::max(1u, height / 2);
+	const unsigned pitch = width * bytespp;
+	const unsigned stepx = width > 1 ? bytespp : 0;
+	for (unsigned y = 0; y < dst_height; ++y)
+	{
+		const unsigned char * s0 = src + 2 * y * pitch;
+		const unsigned char * s1 = height > 1 ? s0 + pitch : s0;
+		unsigned char * d = dst + y * dst_width * bytespp;
+		unsigned x = 0;
+#ifdef TEXTURE_CACHE_SSE
+		if (bytespp == 4 && width > 1)
+			x = SampleMipRow4(dst_width, s0, s1, d);
+#endif
+		for (; x < dst_width; ++x)
+		{
+			const unsigned x0 = 2 * x * bytespp;
+			const unsigned x1 = x0 + stepx;
+			for (unsigned i = 0; i < bytespp; ++i)
+				d[x * bytespp + i] = (s0[x0 + i] + s0[x1 + i] + s1[x0 + i] + s1[x1 + i] + 2) >> 2;
+		}
+	}
+}
+
+unsigned TextureCache::GetKey(const std::string & path, TextureInfo::Size maxsize)
+{
+	unsigned hash = 2166136261u;
+	Hash(hash, cooked_version);
+	Hash(hash, maxsize);
+	Hash(hash, path.data(), path.size());
+	struct stat st;
+	if (stat(path.c_str(), &st) == 0)
+	{
+		Hash(hash, unsigned(st.st_size));
+		Hash(hash, unsigned(st.st_mtime));
+	}
+	return hash;
+}
+
+std::string TextureCache::GetPath(const std::string & cachedir, const std::string & path)
+{
+	unsigned hash = 2166136261u;
+	Hash(hash, path.data(), path.size());
+	char name[16];
+	std::sprintf(name, "%08x.dds", hash);
+	return cachedir + "/" + name;
+}
+
+bool TextureCache::Read(const std::string & cachepath, unsigned key, std::vector<char> & dds)
+{
+	std::ifstream file(cachepath.c_str(), std::ifstream::in | std::ifstream::binary);
+	if (!file)
+		return false;
+
+	char header[dds_size];
+	if (!file.read(header, dds_size) ||
+		GetU32(header + dds_key_offset) != cooked_tag ||
+		GetU32(header + dds_key_offset + 4) != key)
+		return false;
+
+	file.seekg(0, file.end);
+	const unsigned long length = file.tellg();
+	file.seekg(0, file.beg);
+	dds.resize(length);
+	if (!file.read(&dds[0], length))
+		return false;
+
+	// reject truncated files, the uploader trusts the level sizes
+	const void * texdata;
+	unsigned long texlen;
+	unsigned format, w, h, levels;
+	if (!ReadDDS(&dds[0], length, texdata, texlen, format, w, h, levels) ||
+		!w || !h || w > 0x8000 || h > 0x8000 || levels != GetMipCount(w, h) ||
+		(texlen != w * h * 3 && texlen != w * h * 4) ||
+		length - dds_size != GetMipChainSize(w, h, levels, texlen / (w * h)))
+	{
+		dds.clear();
+		return false;
+	}
+	return true;
+}
+
+bool TextureCache::Write(const std::string & cachepath, const std::vector<char> & dds)
+{
+	// concurrent loads of the same image write their own file
+	std::ostringstream temp;
+	temp << cachepath << "." << SDL_ThreadID() << ".tmp";
+	const std::string temp_path = temp.str();
+	{
+		std::ofstream file(temp_path.c_str(), std::ios::binary);
+		if (!file || !file.write(&dds[0], dds.size()))
+		{
+			std::remove(temp_path.c_str());
+			return false;
+		}
+	}
+	std::remove(cachepath.c_str());
+	if (std::rename(temp_path.c_str(), cachepath.c_str()) != 0)
+	{
+		std::remove(temp_path.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool TextureCache::Cook(SDL_Surface * surface, TextureInfo::Size maxsize, unsigned key, std::vector<char> & dds)
+{
+	// dds stores the bgr(a) byte order of the masks used in dds.cpp
+	const unsigned bytespp = surface->format->BytesPerPixel;
+	if (bytespp != 3 && bytespp != 4)
+		return false;
+
+	SDL_Surface * converted = SDL_ConvertSurfaceFormat(
+		surface, bytespp == 4 ? SDL_PIXELFORMAT_BGRA32 : SDL_PIXELFORMAT_BGR24, 0);
+	if (!converted)
+		return false;
+
+	unsigned w, h;
+	GetSize(maxsize, converted->w, converted->h, w, h);
+	const unsigned levels = GetMipCount(w, h);
+	dds.resize(dds_size + GetMipChainSize(w, h, levels, bytespp));
+	WriteHeader(&dds[0], w, h, levels, bytespp, key);
+
+	unsigned char * level = reinterpret_cast<unsigned char *>(&dds[dds_size]);
+	const unsigned char * pixels = static_cast<const unsigned char *>(converted->pixels);
+	if (w < unsigned(converted->w) || h < unsigned(converted->h))
+	{
+		SampleDown(bytespp, converted->w, converted->h, converted->pitch, pixels, w, h, w * bytespp, level);
+	}
+	else
+	{
+		for (unsigned y = 0; y < h; ++y)
+			std::memcpy(level + y * w * bytespp, pixels + y * converted->pitch, w * bytespp);
+	}
+	SDL_FreeSurface(converted);
+
+	for (unsigned i = 1; i < levels; ++i)
+	{
+		unsigned char * next = level + w * h * bytespp;
+		SampleMip(bytespp, w, h, level, next);
+		level = next;
+		w = std::max(1u, w / 2);
+		h = std::max(1u, h / 2);
+	}
+	return true;
+}
+
+bool TextureCache::Load(
+	const std::string & cachedir,
+	const std::string & path,
+	TextureInfo::Size maxsize,
+	std::vector<char> & dds,
+	SDL_Surface * & surface)
+{
+	surface = 0;
+	const unsigned key = GetKey(path, maxsize);
+	const std::string cachepath = GetPath(cachedir, path);
+	if (Read(cachepath, key, dds))
+		return true;
+
+	surface = Texture::Decode(path);
+	if (!surface || !Cook(surface, maxsize, key, dds))
+		return false;
+
+	SDL_FreeSurface(surface);
+	surface = 0;
+
+	// the cache is optional, failing to write it is not an error
+	Write(cachepath, dds);
+	return true;
+}
+
+void TextureCache::GetSize(TextureInfo::Size maxsize, unsigned w, unsigned h, unsigned & wd, unsigned & hd)
+{
+	wd = w;
+	hd = h;
+	if (maxsize == TextureInfo::SMALL)
+	{
+		if (w > 256)
+			wd = w / 4;
+		else if (w > 128)
+			wd = w / 2;
+
+		if (h > 256)
+			hd = h / 4;
+		else if (h > 128)
+			hd = h / 2;
+	}
+	else if (maxsize == TextureInfo::MEDIUM)
+	{
+		if (w > 256)
+			wd = w / 2;
+
+		if (h > 256)
+			hd = h / 2;
+	}
+}
+
+void TextureCache::SampleDown(
+	unsigned bytespp,
+	unsigned src_width,
+	unsigned src_height,
+	unsigned src_pitch,
+	const unsigned char src[],
+	unsigned dst_width,
+	unsigned dst_height,
+	unsigned dst_pitch,
+	unsigned char dst[])
+{
+	if (bytespp == 1)
+	{
+		SampleDownAvg<1>(
+			src_width, src_height, src_pitch, src,
+			dst_width, dst_height, dst_pitch, dst);
+	}
+	else if (bytespp == 2)
+	{
+		SampleDownAvg<2>(
+			src_width, src_height, src_pitch, src,
+			dst_width, dst_height, dst_pitch, dst);
+	}
+	else if (bytespp == 3)
+	{
+		SampleDownAvg<3>(
+			src_width, src_height, src_pitch, src,
+			dst_width, dst_height, dst_pitch, dst);
+	}
+	else if (bytespp == 4)
+	{
+		SampleDownAvg<4>(
+			src_width, src_height, src_pitch, src,
+			dst_width, dst_height, dst_pitch, dst);
+	}
+	else
+	{
+		assert(0);
+	}
+}
+
+void TextureCache::SampleMip(
+	unsigned bytespp,
+	unsigned width,
+	unsigned height,
+	const unsigned char src[],
+	unsigned char dst[])
+{
+	if (bytespp == 3)
+		::SampleMip<3>(width, height, src, dst);
+	else if (bytespp == 4)
+		::SampleMip<4>(width, height, src, dst);
+	else
+		assert(0);
+}
+
+QT_TEST(texturecache_test)
+{
+	// simd and scalar paths against each other, odd and unit sizes
+	const unsigned sizes[][2] = {{16, 4}, {13, 7}, {1, 9}, {9, 1}, {2, 2}};
+	for (unsigned n = 0; n < sizeof(sizes) / sizeof(sizes[0]); ++n)
+	{
+		const unsigned w = sizes[n][0], h = sizes[n][1];
+		std::vector<unsigned char> src(w * h * 4);
+		std::vector<unsigned char> rgb(w * h * 3);
+		for (unsigned i = 0; i < w * h; ++i)
+		{
+			for (unsigned c = 0; c < 3; ++c)
+				rgb[i * 3 + c] = src[i * 4 + c] = (i * 37 + c * 101) & 255;
+			src[i * 4 + 3] = 255 - i;
+		}
+
+		const unsigned dw = std::max(1u, w / 2), dh = std::max(1u, h / 2);
+		std::vector<unsigned char> dst(dw * dh * 4);
+		std::vector<unsigned char> dst_rgb(dw * dh * 3);
+		TextureCache::SampleMip(4, w, h, &src[0], &dst[0]);
+		TextureCache::SampleMip(3, w, h, &rgb[0], &dst_rgb[0]);
+
+		bool match = true;
+		for (unsigned y = 0; y < dh; ++y)
+		{
+			for (unsigned x = 0; x < dw; ++x)
+			{
+				const unsigned x0 = 2 * x, x1 = w > 1 ? 2 * x + 1 : 0;
+				const unsigned y0 = 2 * y, y1 = h > 1 ? 2 * y + 1 : 0;
+				for (unsigned c = 0; c < 4; ++c)
+				{
+					const unsigned sum = src[(y0 * w + x0) * 4 + c] + src[(y0 * w + x1) * 4 + c] +
+						src[(y1 * w + x0) * 4 + c] + src[(y1 * w + x1) * 4 + c];
+					match = match && dst[(y * dw + x) * 4 + c] == (sum + 2) / 4;
+					if (c < 3)
+						match = match && dst_rgb[(y * dw + x) * 3 + c] == dst[(y * dw + x) * 4 + c];
+				}
+			}
+		}
+		QT_CHECK(match);
+	}
+
+	// cooked textures pass the dds reader and the cache read, stale and truncated files are rejected
+	std::ostringstream info, error;
+	PathManager paths;
+	paths.Init(info, error);
+	const std::string cachepath = paths.GetTemporaryFolder() + "/texturecache_test.dds";
+	for (unsigned bytespp = 3; bytespp <= 4; ++bytespp)
+	{
+		const unsigned w = 13, h = 7, key = 1234;
+		std::vector<unsigned char> pixels(w * h * bytespp);
+		for (unsigned i = 0; i < pixels.size(); ++i)
+			pixels[i] = (i * 37) & 255;
+
+		std::vector<char> dds, read;
+		SDL_Surface * surface = SDL_CreateRGBSurfaceFrom(&pixels[0], w, h, bytespp * 8, w * bytespp, 0, 0, 0, 0);
+		const bool cooked = surface && TextureCache::Cook(surface, TextureInfo::LARGE, key, dds);
+		SDL_FreeSurface(surface);
+		QT_CHECK(cooked);
+		if (!cooked)
+			continue;
+
+		const void * texdata;
+		unsigned long texlen;
+		unsigned format, tw, th, levels;
+		QT_CHECK(ReadDDS(&dds[0], dds.size(), texdata, texlen, format, tw, th, levels));
+		QT_CHECK(tw == w && th == h && levels == GetMipCount(w, h) && texlen == w * h * bytespp);
+
+		QT_CHECK(TextureCache::Write(cachepath, dds));
+		QT_CHECK(TextureCache::Read(cachepath, key, read) && read == dds);
+		QT_CHECK(!TextureCache::Read(cachepath, key + 1, read));
+
+		dds.resize(dds.size() - 1);
+		QT_CHECK(TextureCache::Write(cachepath, dds));
+		QT_CHECK(!TextureCache::Read(cachepath, key, read));
+	}
+	PathManager::RemoveFile(cachepath);
+}
+
+struct CookJob : public JobRange
+{
+	const std::vector<std::string> & paths;
+	std::vector<std::vector<char> > & cooked;
+
+	CookJob(const std::vector<std::string> & paths, std::vector<std::vector<char> > & cooked) :
+		paths(paths), cooked(cooked)
+	{
+		// ctor
+	}
+
+	void Execute(int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+		{
+			SDL_Surface * surface = Texture::Decode(paths[i]);
+			if (!surface)
+				continue;
+			TextureCache::Cook(surface, TextureInfo::LARGE, 0, cooked[i]);
+			SDL_FreeSurface(surface);
+		}
+	}
+};
+
+// decode, mip chain and cache read times of the track textures, serial and on the job system
+MICROBENCH(texturecook)
+{
+	std::vector<std::string> paths;
+	microbench::getDataFiles(ctx, microbench::TRACKS, "objects", ".png", paths);
+	microbench::getDataFiles(ctx, microbench::TRACKS, "objects", ".jpg", paths);
+
+	const std::string cache_path = ctx.paths.GetTemporaryFolder() + "/texturecook.dds";
+	double decode = 0, mip = 0, hit = 0;
+	unsigned count = 0, bytes = 0;
+	std::vector<char> dds;
+	for (std::vector<std::string>::const_iterator i = paths.begin(); i != paths.end(); ++i)
+	{
+		const double decode_start = microbench::getTime();
+		SDL_Surface * surface = Texture::Decode(*i);
+		if (!surface)
+			continue;
+		decode += microbench::getTime() - decode_start;
+
+		const double mip_start = microbench::getTime();
+		const bool cooked = TextureCache::Cook(surface, TextureInfo::LARGE, 1, dds);
+		mip += microbench::getTime() - mip_start;
+		SDL_FreeSurface(surface);
+		if (!cooked || !TextureCache::Write(cache_path, dds))
+			continue;
+
+		const double hit_start = microbench::getTime();
+		TextureCache::Read(cache_path, 1, dds);
+		hit += microbench::getTime() - hit_start;
+
+		bytes += dds.size();
+		count++;
+	}
+	std::remove(cache_path.c_str());
+	ctx.info_output << "textures: " << count << " cooked, " << bytes / 1024 << " KB, decode " << decode
+		<< " s, mip chain " << mip << " s, cache hit " << hit << " s" << std::endl;
+
+	JobSystem & jobs = JobSystem::instance();
+	const int job_threads = jobs.GetNumThreads();
+	jobs.Init();
+	std::vector<std::vector<char> > cooked(paths.size());
+	CookJob job(paths, cooked);
+	const double start = microbench::getTime();
+	jobs.ParallelFor(0, paths.size(), job);
+	ctx.info_output << jobs.GetNumThreads() << " threads: decode and mip chain "
+		<< microbench::getTime() - start << " s" << std::endl;
+	jobs.Init(job_threads);
+}
@@ -0,0 +1,84 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+#ifndef _TEXTURECACHE_H
+#define _TEXTURECACHE_H
+
+#include "textureinfo.h"
+
+#include <string>
+#include <vector>
+
+/// Cooked textures, decoded images with a prebuilt mip chain stored as
+/// uncompressed BGR/BGRA dds files, uploaded by Texture::LoadDDS one level
+/// at a time. Nothing here needs a graphics context, it is safe to call
+/// from worker threads.
+class TextureCache
+{
+public:
+	/// Key over size and modification time of the source image and the max size.
+	static unsigned GetKey(const std::string & path, TextureInfo::Size maxsize);
+
+	/// Cache file for the source image in cachedir.
+	static std::string GetPath(const std::string & cachedir, const std::string & path);
+
+	/// Read the cooked texture, false if it is missing, broken or stale.
+	static bool Read(const std::string & cachepath, unsigned key, std::vector<char> & dds);
+
+	/// Write the cooked texture, false on error.
+	static bool Write(const std::string & cachepath, const std::vector<char> & dds);
+
+	/// Downsample the image for maxsize and build its mip chain.
+	/// Returns false for images which aren't 24 or 32 bit.
+	static bool Cook(SDL_Surface * surface, TextureInfo::Size maxsize, unsigned key, std::vector<char> & dds);
+
+	/// Read the cooked texture or decode, cook and cache the image.
+	/// Returns false if the image can't be cooked, surface is the decoded image then, owned by the caller.
+	static bool Load(
+		const std::string & cachedir,
+		const std::string & path,
+		TextureInfo::Size maxsize,
+		std::vector<char> & dds,
+		SDL_Surface * & surface);
+
+	/// Size after downsampling for maxsize.
+	static void GetSize(TextureInfo::Size maxsize, unsigned w, unsigned h, unsigned & wd, unsigned & hd);
+
+	/// Averaging downsampler, src width/height are multiples of dst width/height.
+	/// bytespp is the number of channels, pitch is the size of a pixel row in bytes.
+	static void SampleDown(
+		unsigned bytespp,
+		unsigned src_width,
+		unsigned src_height,
+		unsigned src_pitch,
+		const unsigned char src[],
+		unsigned dst_width,
+		unsigned dst_height,
+		unsigned dst_pitch,
+		unsigned char dst[]);
+
+	/// Next mip level of a tightly packed image, 2x2 box filter.
+	static void SampleMip(
+		unsigned bytespp,
+		unsigned width,
+		unsigned height,
+		const unsigned char src[],
+		unsigned char dst[]);
+};
+
+#endif // _TEXTURECACHE_H
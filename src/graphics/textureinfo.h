@@ -20,10 +20,15 @@
 #ifndef _TEXTUREINFO_H
 #define _TEXTUREINFO_H
 
+struct SDL_Surface;
+
 struct TextureInfo
 {
 	enum Size { SMALL, LARGE, MEDIUM };
 	unsigned char* data;	///< raw data pointer
+	SDL_Surface* surface;	///< decoded image, owned by the caller, used instead of the file if not null
+	const char* dds;		///< cooked dds file contents, owned by the caller, used instead of the file if not null
+	unsigned ddssize;		///< dds contents size in bytes
 	short width;			///< texture width, only set if data not null
 	short height;			///< texture height, only set if data not null
 	char bytespp;			///< bytes per pixel, only set if data not null
@@ -42,6 +47,9 @@ struct TextureInfo
 
 	TextureInfo() :
 		data(0),
+		surface(0),
+		dds(0),
+		ddssize(0),
 		width(0),
 		height(0),
 		bytespp(4),
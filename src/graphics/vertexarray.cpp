@@ -20,6 +20,9 @@
 #include "vertexarray.h"
 #include "quaternion.h"
 #include "unittest.h"
+#include "unordered_map.h"
+
+#include <cstring>
 
 VertexArray::VertexArray() :
 	format(VertexFormat::P3)
@@ -466,22 +469,49 @@ void VertexArray::SetToUnitCube()
 	BuildFromFaces(cubesides);
 }
 
+/// hashes the bit patterns, -0 and 0 are folded to match operator==
+struct VertexDataHash
+{
+	static unsigned Hash(unsigned hash, float value)
+	{
+		value += 0.0f;
+		unsigned bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		return (hash ^ bits) * 16777619u;
+	}
+
+	size_t operator()(const VertexArray::VertexData & v) const
+	{
+		unsigned hash = 2166136261u;
+		hash = Hash(hash, v.vertex.x);
+		hash = Hash(hash, v.vertex.y);
+		hash = Hash(hash, v.vertex.z);
+		hash = Hash(hash, v.normal.x);
+		hash = Hash(hash, v.normal.y);
+		hash = Hash(hash, v.normal.z);
+		hash = Hash(hash, v.texcoord.u);
+		hash = Hash(hash, v.texcoord.v);
+		return hash;
+	}
+};
+
 void VertexArray::BuildFromFaces(const std::vector <Face> & newfaces)
 {
 	Clear();
 
-	std::map <VertexData, unsigned int> indexmap;
+	typedef std::tr1::unordered_map <VertexData, unsigned int, VertexDataHash> IndexMap;
+	IndexMap indexmap;
+	indexmap.rehash(newfaces.size() * 2);
+	faces.reserve(newfaces.size() * 3);
 	for (std::vector <Face>::const_iterator i = newfaces.begin(); i != newfaces.end(); ++i) //loop through input triangles
 	{
 		for (int n = 0; n < 3; n++) //loop through vertices in triangle
 		{
 			const VertexData & curvertdata = i->v[n]; //grab vertex
-			std::map <VertexData, unsigned int>::iterator result = indexmap.find(curvertdata);
-			if (result == indexmap.end()) //new vertex
+			const unsigned int newidx = indexmap.size();
+			std::pair <IndexMap::iterator, bool> result = indexmap.insert(std::make_pair(curvertdata, newidx));
+			if (result.second) //new vertex
 			{
-				unsigned int newidx = indexmap.size();
-				indexmap[curvertdata] = newidx;
-
 				vertices.push_back(curvertdata.vertex.x);
 				vertices.push_back(curvertdata.vertex.y);
 				vertices.push_back(curvertdata.vertex.z);
@@ -492,11 +522,8 @@ void VertexArray::BuildFromFaces(const std::vector <Face> & newfaces)
 
 				texcoords.push_back(curvertdata.texcoord.u);
 				texcoords.push_back(curvertdata.texcoord.v);
-
-				faces.push_back(newidx);
 			}
-			else //non-unique vertex
-				faces.push_back(result->second);
+			faces.push_back(result.first->second); //new or non-unique vertex
 		}
 	}
 
@@ -507,6 +534,12 @@ void VertexArray::BuildFromFaces(const std::vector <Face> & newfaces)
 	assert(vertices.size()/3 <= faces.size());
 }
 
+size_t VertexArray::GetMemorySize() const
+{
+	return (vertices.size() + normals.size() + texcoords.size()) * sizeof(float) +
+		colors.size() + faces.size() * sizeof(unsigned int);
+}
+
 void VertexArray::Translate(float x, float y, float z)
 {
 	assert(vertices.size() % 3 == 0);
@@ -618,7 +651,8 @@ void VertexArray::FixWindingOrder()
 	}
 }
 
-bool VertexArray::Serialize(joeserialize::Serializer & s)
+template <class S>
+bool VertexArray::Serialize(S & s)
 {
 	_SERIALIZE_(s,vertices);
 	_SERIALIZE_(s,normals);
@@ -627,6 +661,28 @@ bool VertexArray::Serialize(joeserialize::Serializer & s)
 	_SERIALIZE_(s,faces);
 	return true;
 }
+
+bool VertexArray::Validate()
+{
+	// colors aren't serialized, reject data the renderer can't index
+	const size_t count = vertices.size() / 3;
+	if (vertices.size() % 3 || faces.size() % 3 ||
+		(!normals.empty() && normals.size() != vertices.size()) ||
+		(!texcoords.empty() && texcoords.size() != count * 2))
+		return false;
+	for (std::vector <unsigned int>::const_iterator i = faces.begin(); i != faces.end(); ++i)
+	{
+		if (*i >= count)
+			return false;
+	}
+	format = VertexFormat::P3;
+	if (!texcoords.empty())
+		format = normals.empty() ? VertexFormat::PT32 : VertexFormat::PNT332;
+	colors.clear();
+	return true;
+}
+
+_SERIALIZE_INSTANTIATE_(VertexArray);
 /* fixme
 QT_TEST(vertexarray_test)
 {
@@ -53,6 +53,9 @@ public:
 
 	unsigned int GetNumIndices() const { return faces.size(); }
 
+	/// size of the vertex data and indices in bytes
+	size_t GetMemorySize() const;
+
 	VertexFormat::Enum GetVertexFormat() const { return format; }
 
 	void Add(
@@ -127,6 +130,13 @@ public:
 			else
 				return false; //they are equal
 		}
+
+		bool operator==(const VertexData & other) const
+		{
+			return vertex.x == other.vertex.x && vertex.y == other.vertex.y && vertex.z == other.vertex.z &&
+				normal.x == other.normal.x && normal.y == other.normal.y && normal.z == other.normal.z &&
+				texcoord.u == other.texcoord.u && texcoord.v == other.texcoord.v;
+		}
 	};
 
 	struct Face
@@ -157,7 +167,11 @@ public:
 	// set winding order to match normal direction, used by scale
 	void FixWindingOrder();
 
-	bool Serialize(joeserialize::Serializer & s);
+	template <class S>
+	bool Serialize(S & s);
+
+	// check deserialized data and restore the vertex format, false if faces index past the vertices
+	bool Validate();
 
 private:
 	friend class joeserialize::Serializer;
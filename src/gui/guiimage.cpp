@@ -44,16 +44,23 @@ void GuiImage::Update(SceneNode & scene, float dt)
 
 		if (m_load)
 		{
+			// keep showing the previous image until the new one is loaded
 			assert(m_content);
 			TextureInfo texinfo;
 			texinfo.mipmap = false;
 			texinfo.repeatu = false;
 			texinfo.repeatv = false;
-			m_content->load(m_texture, m_path, m_name + m_ext, texinfo);
-			d.SetTextures(m_texture->GetId());
+			m_loading = m_content->loadAsync<Texture>(m_path, m_name + m_ext, texinfo, 1);
 			m_load = false;
 		}
 	}
+
+	if (m_loading.ready())
+	{
+		m_loading.get(m_texture);
+		m_loading = ContentHandle<Texture>();
+		GetDrawable(scene).SetTextures(m_texture->GetId());
+	}
 }
 
 void GuiImage::SetupDrawable(
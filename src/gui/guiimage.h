@@ -23,11 +23,9 @@
 #include "guiwidget.h"
 #include "graphics/scenenode.h"
 #include "graphics/vertexarray.h"
+#include "content/contentmanager.h"
 #include "memory.h"
 
-class ContentManager;
-class Texture;
-
 class GuiImage : public GuiWidget
 {
 public:
@@ -55,6 +53,7 @@ private:
 	std::string m_path, m_name, m_ext;
 	SceneNode::DrawableHandle m_draw;
 	std::tr1::shared_ptr<Texture> m_texture;
+	ContentHandle<Texture> m_loading;
 	VertexArray m_varray;
 	bool m_load;
 
@@ -0,0 +1,492 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "jobsystem.h"
+#include "numprocessors.h"
+#include "unittest.h"
+
+#include <SDL2/SDL.h>
+
+#include <algorithm>
+#include <cassert>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+
+struct JobSystem::Worker
+{
+	JobSystem * system;
+	int index;
+	SDL_Thread * thread;
+	SDL_threadID thread_id;
+
+	// job deque, owner works at the back, thieves at the front
+	std::deque<Entry> jobs;
+	SDL_SpinLock lock;
+
+	// statistics, guarded by lock
+	unsigned int jobs_run;
+	unsigned int jobs_stolen;
+	double busy_time;
+
+	Worker(JobSystem * system, int index) :
+		system(system),
+		index(index),
+		thread(0),
+		thread_id(0),
+		lock(0),
+		jobs_run(0),
+		jobs_stolen(0),
+		busy_time(0)
+	{
+		// ctor
+	}
+};
+
+static double GetTime()
+{
+	return SDL_GetPerformanceCounter() / double(SDL_GetPerformanceFrequency());
+}
+
+JobCounter::JobCounter() :
+	lock(0)
+{
+	SDL_AtomicSet(&count, 0);
+}
+
+JobCounter::~JobCounter()
+{
+	// make sure the finishing thread has released the counter
+	SDL_AtomicLock(&lock);
+	SDL_AtomicUnlock(&lock);
+	assert(Done() && waiting.empty());
+}
+
+bool JobCounter::Done() const
+{
+	return SDL_AtomicGet(&count) == 0;
+}
+
+JobSystem & JobSystem::instance()
+{
+	static JobSystem jobs;
+	return jobs;
+}
+
+JobSystem::JobSystem() :
+	wake(0),
+	started(0),
+	stats_time(GetTime())
+{
+	SDL_AtomicSet(&quit, 0);
+
+	// without worker threads all jobs go through the shared deque
+	workers.push_back(new Worker(this, 0));
+}
+
+JobSystem::~JobSystem()
+{
+	Deinit();
+	delete workers.back();
+}
+
+void JobSystem::Init(int num_threads)
+{
+	Deinit();
+
+	if (num_threads <= 0)
+		num_threads = NUMPROCESSORS::GetNumProcessors();
+	if (num_threads < 2)
+		return;
+
+	assert(workers.size() == 1 && workers.back()->jobs.empty());
+	Worker * shared = workers.back();
+	workers.clear();
+	for (int i = 0; i < num_threads; ++i)
+	{
+		workers.push_back(new Worker(this, i));
+	}
+	shared->index = num_threads;
+	workers.push_back(shared);
+
+	wake = SDL_CreateSemaphore(0);
+	started = SDL_CreateSemaphore(0);
+	SDL_AtomicSet(&quit, 0);
+
+	workers[0]->thread_id = SDL_ThreadID();
+	for (int i = 1; i < num_threads; ++i)
+	{
+		workers[i]->thread = SDL_CreateThread(&JobSystem::WorkerThread, "worker", workers[i]);
+	}
+
+	// wait for the workers to register their thread ids
+	for (int i = 1; i < num_threads; ++i)
+	{
+		SDL_SemWait(started);
+	}
+
+	ResetStats();
+}
+
+void JobSystem::Deinit()
+{
+	if (workers.size() < 2)
+		return;
+
+	SDL_AtomicSet(&quit, 1);
+	const int num_threads = workers.size() - 1;
+	for (int i = 1; i < num_threads; ++i)
+	{
+		SDL_SemPost(wake);
+	}
+	for (int i = 1; i < num_threads; ++i)
+	{
+		SDL_WaitThread(workers[i]->thread, 0);
+	}
+
+	SDL_DestroySemaphore(started);
+	SDL_DestroySemaphore(wake);
+	started = 0;
+	wake = 0;
+
+	// hand remaining jobs over to the shared deque
+	Worker * shared = workers.back();
+	for (int i = 0; i < num_threads; ++i)
+	{
+		shared->jobs.insert(shared->jobs.end(), workers[i]->jobs.begin(), workers[i]->jobs.end());
+		delete workers[i];
+	}
+	shared->index = 0;
+	workers.clear();
+	workers.push_back(shared);
+
+	ResetStats();
+}
+
+int JobSystem::GetNumThreads() const
+{
+	return std::max(int(workers.size()) - 1, 1);
+}
+
+void JobSystem::Run(Job & job, JobCounter * counter, JobCounter * dependency)
+{
+	Entry entry(&job, counter);
+	if (counter)
+		SDL_AtomicIncRef(&counter->count);
+
+	if (dependency)
+	{
+		SDL_AtomicLock(&dependency->lock);
+		if (!dependency->Done())
+		{
+			dependency->waiting.push_back(entry);
+			SDL_AtomicUnlock(&dependency->lock);
+			return;
+		}
+		SDL_AtomicUnlock(&dependency->lock);
+	}
+
+	Push(GetWorkerIndex(), entry);
+}
+
+void JobSystem::Wait(JobCounter & counter)
+{
+	const int index = GetWorkerIndex();
+	while (!counter.Done())
+	{
+		Entry entry;
+		if (Pop(index, entry))
+			Execute(index, entry, false);
+		else if (Steal(index, entry))
+			Execute(index, entry, true);
+		else
+			SDL_Delay(0);
+	}
+}
+
+namespace
+{
+	struct RangeJob : public Job
+	{
+		JobRange * range;
+		int begin;
+		int end;
+
+		void Execute()
+		{
+			range->Execute(begin, end);
+		}
+	};
+}
+
+void JobSystem::ParallelFor(int begin, int end, JobRange & range, int min_range)
+{
+	const int count = end - begin;
+	if (count <= 0)
+		return;
+
+	// a few ranges per thread to give work stealing something to balance
+	int num_ranges = std::min(GetNumThreads() * 4, count / std::max(min_range, 1));
+	if (num_ranges < 2)
+	{
+		range.Execute(begin, end);
+		return;
+	}
+
+	std::vector<RangeJob> jobs(num_ranges);
+	JobCounter counter;
+	for (int i = 0; i < num_ranges; ++i)
+	{
+		jobs[i].range = &range;
+		jobs[i].begin = begin + int(count * (long long)i / num_ranges);
+		jobs[i].end = begin + int(count * (long long)(i + 1) / num_ranges);
+		Run(jobs[i], &counter);
+	}
+	Wait(counter);
+}
+
+void JobSystem::PrintStats(std::ostream & out) const
+{
+	const double time = std::max(GetTime() - stats_time, 1E-6);
+	out << "Job system: " << GetNumThreads() << " threads, " << time << " s\n";
+	for (size_t i = 0; i < workers.size(); ++i)
+	{
+		Worker & w = *workers[i];
+		SDL_AtomicLock(&w.lock);
+		if (i + 1 < workers.size())
+			out << "Worker " << i << ": ";
+		else
+			out << "Other threads: ";
+		out << w.jobs_run << " jobs, " << w.jobs_stolen << " stolen, ";
+		out << std::fixed << std::setprecision(1) << w.busy_time / time * 100 << "% busy\n";
+		out.unsetf(std::ios_base::floatfield);
+		SDL_AtomicUnlock(&w.lock);
+	}
+	out << std::flush;
+}
+
+void JobSystem::ResetStats()
+{
+	for (size_t i = 0; i < workers.size(); ++i)
+	{
+		Worker & w = *workers[i];
+		SDL_AtomicLock(&w.lock);
+		w.jobs_run = 0;
+		w.jobs_stolen = 0;
+		w.busy_time = 0;
+		SDL_AtomicUnlock(&w.lock);
+	}
+	stats_time = GetTime();
+}
+
+int JobSystem::WorkerThread(void * data)
+{
+	Worker * w = static_cast<Worker *>(data);
+	w->system->RunWorker(w->index);
+	return 0;
+}
+
+void JobSystem::RunWorker(int index)
+{
+	workers[index]->thread_id = SDL_ThreadID();
+	SDL_SemPost(started);
+
+	while (true)
+	{
+		Entry entry;
+		if (Pop(index, entry))
+		{
+			Execute(index, entry, false);
+		}
+		else if (Steal(index, entry))
+		{
+			Execute(index, entry, true);
+		}
+		else if (SDL_AtomicGet(&quit))
+		{
+			break;
+		}
+		else
+		{
+			SDL_SemWait(wake);
+		}
+	}
+}
+
+int JobSystem::GetWorkerIndex() const
+{
+	const SDL_threadID id = SDL_ThreadID();
+	const int num_threads = workers.size() - 1;
+	for (int i = 0; i < num_threads; ++i)
+	{
+		if (workers[i]->thread_id == id)
+			return i;
+	}
+	return num_threads;
+}
+
+void JobSystem::Push(int index, const Entry & entry)
+{
+	Worker & w = *workers[index];
+	SDL_AtomicLock(&w.lock);
+	w.jobs.push_back(entry);
+	SDL_AtomicUnlock(&w.lock);
+
+	if (wake)
+		SDL_SemPost(wake);
+}
+
+bool JobSystem::Pop(int index, Entry & entry)
+{
+	Worker & w = *workers[index];
+	SDL_AtomicLock(&w.lock);
+	const bool found = !w.jobs.empty();
+	if (found)
+	{
+		entry = w.jobs.back();
+		w.jobs.pop_back();
+	}
+	SDL_AtomicUnlock(&w.lock);
+	return found;
+}
+
+bool JobSystem::Steal(int index, Entry & entry)
+{
+	const int count = workers.size();
+	for (int n = 1; n < count; ++n)
+	{
+		Worker & w = *workers[(index + n) % count];
+		SDL_AtomicLock(&w.lock);
+		const bool found = !w.jobs.empty();
+		if (found)
+		{
+			entry = w.jobs.front();
+			w.jobs.pop_front();
+		}
+		SDL_AtomicUnlock(&w.lock);
+		if (found)
+			return true;
+	}
+	return false;
+}
+
+void JobSystem::Execute(int index, const Entry & entry, bool stolen)
+{
+	const double start = GetTime();
+	entry.first->Execute();
+	const double time = GetTime() - start;
+
+	Worker & w = *workers[index];
+	SDL_AtomicLock(&w.lock);
+	w.jobs_run++;
+	w.jobs_stolen += stolen;
+	w.busy_time += time;
+	SDL_AtomicUnlock(&w.lock);
+
+	Finish(entry.second);
+}
+
+void JobSystem::Finish(JobCounter * counter)
+{
+	if (!counter)
+		return;
+
+	// the counter may be destroyed once it is done and released
+	std::vector<Entry> waiting;
+	SDL_AtomicLock(&counter->lock);
+	if (SDL_AtomicDecRef(&counter->count))
+		waiting.swap(counter->waiting);
+	SDL_AtomicUnlock(&counter->lock);
+
+	const int index = GetWorkerIndex();
+	for (size_t i = 0; i < waiting.size(); ++i)
+	{
+		Push(index, waiting[i]);
+	}
+}
+
+struct SumRange : public JobRange
+{
+	std::vector<int> & values;
+	SDL_atomic_t sum;
+
+	SumRange(std::vector<int> & values) : values(values)
+	{
+		SDL_AtomicSet(&sum, 0);
+	}
+
+	void Execute(int begin, int end)
+	{
+		int s = 0;
+		for (int i = begin; i < end; ++i)
+		{
+			values[i]++;
+			s += i;
+		}
+		SDL_AtomicAdd(&sum, s);
+	}
+};
+
+struct OrderJob : public Job
+{
+	SDL_atomic_t * step;
+	int expected;
+	bool ok;
+
+	void Execute()
+	{
+		ok = (SDL_AtomicGet(step) == expected);
+		SDL_AtomicIncRef(step);
+	}
+};
+
+QT_TEST(jobsystem_test)
+{
+	for (int threads = 1; threads <= 4; threads += 3)
+	{
+		JobSystem jobs;
+		jobs.Init(threads);
+		QT_CHECK_EQUAL(jobs.GetNumThreads(), threads);
+
+		// every index is visited exactly once
+		std::vector<int> values(1000, 0);
+		SumRange range(values);
+		jobs.ParallelFor(0, values.size(), range);
+		QT_CHECK_EQUAL(SDL_AtomicGet(&range.sum), 999 * 1000 / 2);
+		QT_CHECK_EQUAL(int(std::count(values.begin(), values.end(), 1)), 1000);
+
+		// dependent jobs run in order
+		SDL_atomic_t step;
+		SDL_AtomicSet(&step, 0);
+		OrderJob order[3];
+		JobCounter counter[3];
+		for (int i = 0; i < 3; ++i)
+		{
+			order[i].step = &step;
+			order[i].expected = i;
+			order[i].ok = false;
+			jobs.Run(order[i], &counter[i], i > 0 ? &counter[i - 1] : 0);
+		}
+		jobs.Wait(counter[2]);
+		QT_CHECK(order[0].ok && order[1].ok && order[2].ok);
+
+		jobs.Deinit();
+		QT_CHECK_EQUAL(jobs.GetNumThreads(), 1);
+	}
+}
@@ -0,0 +1,144 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _JOBSYSTEM_H
+#define _JOBSYSTEM_H
+
+#include <SDL2/SDL_atomic.h>
+#include <SDL2/SDL_mutex.h>
+
+#include <iosfwd>
+#include <utility>
+#include <vector>
+
+class JobCounter;
+
+/// A unit of work executed by the JobSystem.
+class Job
+{
+public:
+	virtual ~Job() {}
+
+	virtual void Execute() = 0;
+};
+
+/// Loop body for JobSystem::ParallelFor, executed for index ranges [begin, end).
+class JobRange
+{
+public:
+	virtual ~JobRange() {}
+
+	virtual void Execute(int begin, int end) = 0;
+};
+
+/// Counts unfinished jobs. It can be waited on and used as dependency for other jobs.
+class JobCounter
+{
+public:
+	JobCounter();
+
+	~JobCounter();
+
+	/// True if all jobs counted by this counter have finished.
+	bool Done() const;
+
+private:
+	friend class JobSystem;
+	mutable SDL_atomic_t count;
+	SDL_SpinLock lock;
+	std::vector<std::pair<Job *, JobCounter *> > waiting; ///< jobs depending on this counter
+
+	JobCounter(const JobCounter & other);
+	JobCounter & operator=(const JobCounter & other);
+};
+
+/// Work stealing job scheduler. Each worker thread owns a job deque, it
+/// executes its own jobs last in first out and steals the oldest jobs of other
+/// workers when it runs out of work. Threads waiting on a counter execute jobs
+/// too, so jobs can spawn and wait on further jobs. Threads which are not
+/// workers share a common deque.
+class JobSystem
+{
+public:
+	/// The process wide job system.
+	static JobSystem & instance();
+
+	JobSystem();
+
+	~JobSystem();
+
+	/// Start num_threads - 1 worker threads, the calling thread becomes worker 0.
+	/// Zero uses the number of processors.
+	void Init(int num_threads = 0);
+
+	/// Stop the worker threads. Queued jobs are executed by the waiting threads.
+	void Deinit();
+
+	/// Number of threads executing jobs, 1 if there are no worker threads.
+	int GetNumThreads() const;
+
+	/// Queue job for execution. The counter, if any, is incremented now and
+	/// decremented once the job has finished. The job is held back until the
+	/// dependency counter, if any, has reached zero. Jobs are guaranteed to have
+	/// run only after waiting on their counter.
+	void Run(Job & job, JobCounter * counter = 0, JobCounter * dependency = 0);
+
+	/// Execute jobs until the counter has reached zero.
+	void Wait(JobCounter & counter);
+
+	/// Split [begin, end) into ranges of at least min_range indices, execute
+	/// them in parallel and wait for completion.
+	void ParallelFor(int begin, int end, JobRange & range, int min_range = 1);
+
+	/// Print jobs, steals and busy time of each worker since the last reset.
+	void PrintStats(std::ostream & out) const;
+
+	void ResetStats();
+
+private:
+	struct Worker;
+	typedef std::pair<Job *, JobCounter *> Entry;
+
+	std::vector<Worker *> workers; ///< worker threads, followed by the shared deque of other threads
+	SDL_sem * wake;
+	SDL_sem * started;
+	SDL_atomic_t quit;
+	double stats_time;
+
+	static int WorkerThread(void * data);
+
+	void RunWorker(int index);
+
+	int GetWorkerIndex() const;
+
+	void Push(int index, const Entry & entry);
+
+	bool Pop(int index, Entry & entry);
+
+	bool Steal(int index, Entry & entry);
+
+	void Execute(int index, const Entry & entry, bool stolen);
+
+	void Finish(JobCounter * counter);
+
+	JobSystem(const JobSystem & other);
+	JobSystem & operator=(const JobSystem & other);
+};
+
+#endif // _JOBSYSTEM_H
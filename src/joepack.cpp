@@ -18,157 +18,122 @@
 /************************************************************************/
 
 #include "joepack.h"
+#include "mappedfile.h"
 #include "endian_utility.h"
 #include "unittest.h"
 
-#include <map>
-#include <fstream>
+#include <algorithm>
+#include <vector>
 #include <cassert>
+#include <cstring>
 
 using std::string;
-using std::map;
-using std::ios_base;
 
 struct JoePack::Impl
 {
 	struct FatEntry
 	{
 		FatEntry() : offset(0), length(0) { }
+		std::string name;
 		unsigned offset;
 		unsigned length;
+
+		bool operator<(const FatEntry & other) const
+		{
+			return name < other.name;
+		}
 	};
 	const std::string versionstr;
-	std::map <std::string, FatEntry> fat;
-	std::map <std::string, FatEntry>::iterator curfa;
-	std::ifstream f;
+	std::vector<FatEntry> fat; ///< sorted by name
+	MappedFile file;
 
 	Impl();
 	bool Load(const string & fn);
 	void Close();
-	void fclose();
-	bool fopen(const string & fn);
-	int fread(void * buffer, const unsigned size, const unsigned count);
+	const FatEntry * Find(const string & fn) const;
 };
 
+// reads a little endian 32 bit value from unaligned memory
+static unsigned ReadUint32(const char * data)
+{
+	unsigned value;
+	std::memcpy(&value, data, sizeof(value));
+	return ENDIAN_SWAP_32(value);
+}
+
 JoePack::Impl::Impl() : versionstr("JPK01.00")
 {
-	curfa = fat.end();
+	// ctor
 }
 
 bool JoePack::Impl::Load(const string & fn)
 {
 	Close();
-	f.clear();
-	f.open(fn.c_str(), ios_base::binary);
-	if (f)
-	{
-		//load header
-		char * versioncstr = new char[versionstr.length() + 1];
-		f.read(versioncstr, versionstr.length());
-		versioncstr[versionstr.length()] = '\0';
-		string fversionstr = versioncstr;
-		delete [] versioncstr;
-		if (fversionstr != versionstr)
-		{
-			//write out an error?
-			return false;
-		}
-
-		unsigned int numobjs = 0;
-		assert(sizeof(unsigned int) == 4);
-		f.read((char*)(&numobjs), sizeof(unsigned int));
-		numobjs = ENDIAN_SWAP_32(numobjs);
-
-		//DPRINT(numobjs << " objects");
-
-		unsigned int maxstrlen = 0;
-		f.read((char*)(&maxstrlen), sizeof(unsigned int));
-		maxstrlen = ENDIAN_SWAP_32(maxstrlen);
-
-		//DPRINT(maxstrlen << " max string length");
-
-		char * fnch = new char[maxstrlen+1];
-
-		//load FAT
-		for (unsigned int i = 0; i < numobjs; i++)
-		{
-			FatEntry fa;
-			f.read((char*)(&(fa.offset)), sizeof(unsigned int));
-			fa.offset = ENDIAN_SWAP_32(fa.offset);
-			f.read((char*)(&(fa.length)), sizeof(unsigned int));
-			fa.length = ENDIAN_SWAP_32(fa.length);
-			f.read(fnch, maxstrlen);
-			fnch[maxstrlen] = '\0';
-			string filename = fnch;
-			fat[filename] = fa;
-
-			//DPRINT(filename << ": offest " << fa.offset << " length " << fa.length);
-		}
-
-		delete [] fnch;
-		return true;
-	}
-	else
+	if (!file.Open(fn))
 	{
 		//write an error?
 		return false;
 	}
-}
 
-void JoePack::Impl::Close()
-{
-	if (f.is_open()) f.close();
-	fat.clear();
-	curfa = fat.end();
-}
+	const char * data = file.GetData();
+	const std::size_t size = file.GetSize();
+	const std::size_t header_size = versionstr.length() + 2 * sizeof(unsigned);
+	assert(sizeof(unsigned int) == 4);
 
-void JoePack::Impl::fclose()
-{
-	curfa = fat.end();
-}
-
-bool JoePack::Impl::fopen(const string & fn)
-{
-	curfa = fat.find(fn);
-	if (curfa == fat.end())
+	//load header
+	if (size < header_size || versionstr.compare(0, versionstr.length(), data, versionstr.length()) != 0)
 	{
+		//write out an error?
+		Close();
 		return false;
 	}
-	else
+
+	const unsigned numobjs = ReadUint32(data + versionstr.length());
+	const unsigned maxstrlen = ReadUint32(data + versionstr.length() + sizeof(unsigned));
+	const std::size_t entry_size = 2 * sizeof(unsigned) + std::size_t(maxstrlen);
+	if (numobjs > (size - header_size) / entry_size)
 	{
-		f.seekg(curfa->second.offset);
-		return true;
+		Close();
+		return false;
 	}
-}
 
-int JoePack::Impl::fread(void * buffer, const unsigned size, const unsigned count)
-{
-	if (curfa != fat.end())
+	//load FAT
+	fat.resize(numobjs);
+	const char * entry = data + header_size;
+	for (unsigned int i = 0; i < numobjs; i++, entry += entry_size)
 	{
-		unsigned int abspos = f.tellg();
-		assert(abspos >= curfa->second.offset);
-		unsigned int relpos = abspos - curfa->second.offset;
-		assert(curfa->second.length >= relpos);
-		unsigned int fileleft = curfa->second.length - relpos;
-		unsigned int requestedread = size*count;
-
-		assert(size != 0);
-
-		if (requestedread > fileleft)
+		FatEntry & fa = fat[i];
+		fa.offset = ReadUint32(entry);
+		fa.length = ReadUint32(entry + sizeof(unsigned));
+		const char * name = entry + 2 * sizeof(unsigned);
+		fa.name.assign(name, std::find(name, name + maxstrlen, '\0'));
+		if (fa.offset > size || fa.length > size - fa.offset)
 		{
-			//overflow
-			requestedread = fileleft/size;
+			Close();
+			return false;
 		}
-
-		//DPRINT("JOEPACK fread: " << abspos << "," << relpos << "," << fileleft << "," << requestedread);
-		f.read((char *)buffer, requestedread);
-		return f.gcount()/size;
 	}
-	else
+	std::sort(fat.begin(), fat.end());
+
+	return true;
+}
+
+void JoePack::Impl::Close()
+{
+	file.Close();
+	fat.clear();
+}
+
+const JoePack::Impl::FatEntry * JoePack::Impl::Find(const string & fn) const
+{
+	FatEntry key;
+	key.name = fn;
+	std::vector<FatEntry>::const_iterator i = std::lower_bound(fat.begin(), fat.end(), key);
+	if (i == fat.end() || i->name != fn)
 	{
-		//write error?
 		return 0;
 	}
+	return &*i;
 }
 
 JoePack::JoePack()
@@ -194,40 +159,49 @@ void JoePack::Close()
 	impl->Close();
 }
 
-void JoePack::fclose() const
+bool JoePack::GetFile(const std::string & fn, const char *& data, unsigned & size) const
 {
-	impl->fclose();
-}
-
-bool JoePack::fopen(const string & fn) const
-{
-	string newfn;
+	const Impl::FatEntry * fa;
 	if (fn.find(packpath, 0) < fn.length())
 	{
-		newfn = fn.substr(packpath.length()+1);
+		fa = impl->Find(fn.substr(packpath.length()+1));
 	}
 	else
 	{
-		newfn = fn;
+		fa = impl->Find(fn);
 	}
-	return impl->fopen(newfn);
+
+	if (!fa)
+	{
+		return false;
+	}
+
+	data = impl->file.GetData() + fa->offset;
+	size = fa->length;
+	return true;
+}
+
+unsigned JoePack::GetFileCount() const
+{
+	return impl->fat.size();
 }
 
-int JoePack::fread(void * buffer, const unsigned size, const unsigned count) const
+const std::string & JoePack::GetFileName(unsigned n) const
 {
-	return impl->fread(buffer, size, count);
+	assert(n < impl->fat.size());
+	return impl->fat[n].name;
 }
 
 QT_TEST(joepack_test)
 {
 	JoePack p;
 	QT_CHECK(p.Load("data/test/test1.jpk"));
-	QT_CHECK(p.fopen("testlist.txt"));
-	char buf[1000];
-	unsigned int chars = p.fread(buf, 1, 999);
-	QT_CHECK_EQUAL(chars, 16);
-	buf[chars] = '\0';
+	const char * data = 0;
+	unsigned size = 0;
+	QT_CHECK(p.GetFile("testlist.txt", data, size));
+	QT_CHECK_EQUAL(size, 16);
 	string comparisonstr = "This is\na test.\n";
-	string filestr = buf;
-	QT_CHECK_EQUAL(buf,comparisonstr);
+	string filestr(data, size);
+	QT_CHECK_EQUAL(filestr, comparisonstr);
+	QT_CHECK(!p.GetFile("missing.txt", data, size));
 }
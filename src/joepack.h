@@ -22,6 +22,8 @@
 
 #include <string>
 
+/// Read only JoePack archive, the pack file is memory mapped.
+/// File lookups and contents are thread safe once the pack is loaded.
 class JoePack
 {
 public:
@@ -35,11 +37,13 @@ public:
 
 	void Close();
 
-	bool fopen(const std::string & fn) const;
+	/// Contents of a packed file, valid until the pack is closed.
+	/// The file name may be prefixed with the pack path.
+	bool GetFile(const std::string & fn, const char *& data, unsigned & size) const;
 
-	void fclose() const;
+	unsigned GetFileCount() const;
 
-	int fread(void * buffer, const unsigned size, const unsigned count) const;
+	const std::string & GetFileName(unsigned n) const;
 
 private:
 	std::string packpath;
@@ -57,7 +57,8 @@ class TestVertex
 		bool operator==(const TestVertex & other) const {return (memcmp(this,&other,sizeof(TestVertex)) == 0);}
 		bool operator!=(const TestVertex & other) const {return !operator==(other);}
 
-		bool Serialize(joeserialize::Serializer & s)
+		template <class S>
+		bool Serialize(S & s)
 		{
 			if (!s.Serialize("x", x)) return false;
 			if (!s.Serialize("y", y)) return false;
@@ -131,7 +132,8 @@ class TestPlayer
 			}
 		}
 
-		bool Serialize(Serializer & s)
+		template <class S>
+		bool Serialize(S & s)
 		{
 			_SERIALIZE_(s,position);
 			_SERIALIZE_(s,animframe);
@@ -341,6 +343,76 @@ QT_TEST(BinarySerializer_test)
 	QT_CHECK_EQUAL(player2.somepair.second, 4321);
 }
 
+QT_TEST(BinaryWriter_test)
+{
+	// byte compatible with the virtual binary serializer
+	std::ostringstream serializestream;
+	std::string data;
+	{
+		TestPlayer player1(true);
+		BinaryOutputSerializer out(serializestream);
+		QT_CHECK(player1.Serialize(out));
+		BinaryWriter writer(data);
+		QT_CHECK(player1.Serialize(writer));
+	}
+	QT_CHECK(data == serializestream.str());
+
+	// reads back what it wrote
+	TestPlayer player2(false);
+	{
+		BinaryReader reader(data);
+		QT_CHECK(player2.Serialize(reader));
+		QT_CHECK_EQUAL(reader.GetRemaining(), 0);
+	}
+	QT_CHECK_EQUAL(player2.position,TestVertex(1,1,1));
+	QT_CHECK_EQUAL(player2.animframe,1337);
+	QT_CHECK_EQUAL(player2.x,(float)1.337);
+	QT_CHECK_EQUAL(player2.name,"Test player");
+	QT_CHECK_EQUAL(player2.simplelist.size(),2);
+	QT_CHECK_EQUAL(player2.complexlist.size(),3);
+	QT_CHECK_EQUAL(player2.mymap["testing654"], TestVertex(6,5,4));
+	QT_CHECK_EQUAL(player2.myvector.size(), 2);
+	QT_CHECK_EQUAL(player2.player_description, "Hello there.\nHow are you??");
+	QT_CHECK_EQUAL(player2.alive, true);
+	QT_CHECK_EQUAL(player2.curtime, 0.123456789);
+	QT_CHECK_EQUAL(player2.somepair.second, 4321);
+
+	// plain value vectors are copied in one run
+	{
+		std::vector<float> floats;
+		for (int i = 0; i < 100; ++i)
+			floats.push_back(i * 0.25f);
+		std::vector<int> ints(floats.begin(), floats.end());
+
+		std::ostringstream stream;
+		BinaryOutputSerializer out(stream);
+		Serializer & s = out;
+		QT_CHECK(s.Serialize("floats", floats));
+		QT_CHECK(s.Serialize("ints", ints));
+
+		std::string run;
+		BinaryWriter writer(run);
+		QT_CHECK(writer.Serialize("floats", floats));
+		QT_CHECK(writer.Serialize("ints", ints));
+		QT_CHECK(run == stream.str());
+
+		std::vector<float> floats2;
+		std::vector<int> ints2;
+		BinaryReader reader(run);
+		QT_CHECK(reader.Serialize("floats", floats2));
+		QT_CHECK(reader.Serialize("ints", ints2));
+		QT_CHECK(floats2 == floats);
+		QT_CHECK(ints2 == ints);
+	}
+
+	// truncated data fails instead of reading past the end
+	{
+		TestPlayer player3(false);
+		BinaryReader reader(data.data(), data.size() - 1);
+		QT_CHECK(!player3.Serialize(reader));
+	}
+}
+
 QT_TEST(ReflectionSerializer_test)
 {
 	ReflectionSerializer reflection;
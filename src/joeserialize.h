@@ -30,6 +30,7 @@
 #include <vector>
 #include <iomanip>
 #include <fstream>
+#include <cstring>
 
 #ifdef USE_TR1
 #include <tr1/unordered_map>
@@ -767,6 +768,9 @@ class TextOutputSerializer : public SerializerOutput
 		}
 
 	public:
+		///template Serialize members of classes take the concrete serializer, keep the base overloads visible
+		using Serializer::Serialize;
+
 		TextOutputSerializer(std::ostream & newout) : out_(newout),indent_(0) {}
 
 		virtual bool Serialize(const std::string & name, int & i)
@@ -934,6 +938,8 @@ class TextInputSerializer : public SerializerInput
 		}
 
 	public:
+		using Serializer::Serialize;
+
 		TextInputSerializer() : error_output_(NULL) {}
 		TextInputSerializer(std::istream & in) : error_output_(NULL) {Parse(in);}
 
@@ -1148,6 +1154,8 @@ class BinaryOutputSerializer : public SerializerOutput
 		}
 
 	public:
+		using Serializer::Serialize;
+
 		BinaryOutputSerializer(std::ostream & newout) : out_(newout),bigendian_(IsBigEndian()) {}
 
 		virtual bool Serialize(const std::string & name, int & i)
@@ -1242,6 +1250,8 @@ class BinaryInputSerializer : public SerializerInput
 		}
 
 	public:
+		using Serializer::Serialize;
+
 		BinaryInputSerializer(std::istream & newin) : in_(newin),bigendian_(IsBigEndian()) {}
 
 		virtual bool Serialize(const std::string & name, int & i)
@@ -1270,6 +1280,348 @@ class BinaryInputSerializer : public SerializerInput
 		}
 };
 
+///field name of the template serialization path, binary formats ignore it so it is never copied
+struct Name
+{
+	Name(const char * name) { (void) name; }
+	Name(const std::string & name) { (void) name; }
+};
+
+///byte order helpers of the template serialization path, binary data is always big-endian
+struct ByteOrder
+{
+	static bool IsBigEndian()
+	{
+		short word = 0x4321;
+		return (*(char *)& word) != 0x21;
+	}
+
+	///copy count values of type T, swapping each value to or from big-endian in the same pass
+	template <typename T>
+	static void Copy(char * to, const char * from, size_t count, bool bigendian)
+	{
+		std::memcpy(to, from, count * sizeof(T));
+		if (bigendian)
+			return;
+
+		for (char * end = to + count * sizeof(T); to != end; to += sizeof(T))
+		{
+			for (size_t i = 0, j = sizeof(T) - 1; i < j; ++i, --j)
+				std::swap(to[i], to[j]);
+		}
+	}
+};
+
+///compile-time counterpart of BinaryOutputSerializer, the output is byte-compatible.
+///objects with a template Serialize member are visited without virtual dispatch or name strings,
+///contiguous runs of plain values are appended with one copy. data is appended to a string.
+class BinaryWriter
+{
+	private:
+		std::string & out_;
+		const bool bigendian_;
+
+		template <typename T>
+		bool Write(const T * data, size_t count)
+		{
+			const size_t size = out_.size();
+			out_.resize(size + count * sizeof(T));
+			if (count)
+				ByteOrder::Copy<T>(&out_[size], reinterpret_cast<const char *>(data), count, bigendian_);
+			return true;
+		}
+
+		template <typename I>
+		bool WriteItems(I begin, I end, int size)
+		{
+			Write(&size, 1);
+			for (I i = begin; i != end; ++i)
+			{
+				if (!Serialize("", *i)) return false;
+			}
+			return true;
+		}
+
+		template <typename T>
+		bool WriteVector(std::vector <T> & t)
+		{
+			int size = t.size();
+			Write(&size, 1);
+			return t.empty() || Write(&t[0], t.size());
+		}
+
+	public:
+		BinaryWriter(std::string & newout) : out_(newout), bigendian_(ByteOrder::IsBigEndian()) {}
+
+		Serializer::Direction GetIODirection() {return Serializer::DIRECTION_OUTPUT;}
+
+		template <typename T>
+		bool Serialize(T & t)
+		{
+			return t.Serialize(*this);
+		}
+
+		template <typename T>
+		bool Serialize(Name, T & t)
+		{
+			return t.Serialize(*this);
+		}
+
+		bool Serialize(Name, int & i) {return Write(&i, 1);}
+		bool Serialize(Name, unsigned int & i) {return Write(&i, 1);}
+		bool Serialize(Name, float & i) {return Write(&i, 1);}
+		bool Serialize(Name, double & i) {return Write(&i, 1);}
+
+		bool Serialize(Name, bool & t)
+		{
+			int boolint = t;
+			return Write(&boolint, 1);
+		}
+
+		bool Serialize(Name, std::string & t)
+		{
+			int length = t.length();
+			Write(&length, 1);
+			out_.append(t);
+			return true;
+		}
+
+		bool Serialize(Name, std::vector <int> & t) {return WriteVector(t);}
+		bool Serialize(Name, std::vector <unsigned int> & t) {return WriteVector(t);}
+		bool Serialize(Name, std::vector <float> & t) {return WriteVector(t);}
+		bool Serialize(Name, std::vector <double> & t) {return WriteVector(t);}
+
+		/// \verbatim vector <bool> is special \endverbatim
+		bool Serialize(Name, std::vector <bool> & t)
+		{
+			int size = t.size();
+			Write(&size, 1);
+			for (size_t i = 0; i < t.size(); ++i)
+			{
+				int boolint = t[i];
+				Write(&boolint, 1);
+			}
+			return true;
+		}
+
+		template <typename U, typename T>
+		bool Serialize(Name, std::pair <U, T> & t)
+		{
+			return Serialize("", t.first) && Serialize("", t.second);
+		}
+
+		template <typename T>
+		bool Serialize(Name, std::vector <T> & t) {return WriteItems(t.begin(), t.end(), t.size());}
+
+		template <typename T>
+		bool Serialize(Name, std::list <T> & t) {return WriteItems(t.begin(), t.end(), t.size());}
+
+		template <typename T>
+		bool Serialize(Name, std::deque <T> & t) {return WriteItems(t.begin(), t.end(), t.size());}
+
+		template <typename T>
+		bool Serialize(Name, std::set <T> & t)
+		{
+			int size = t.size();
+			Write(&size, 1);
+			for (typename std::set <T>::iterator i = t.begin(); i != t.end(); ++i)
+			{
+				if (!Serialize("", const_cast<T&>(*i))) return false;
+			}
+			return true;
+		}
+
+		template <typename U, typename T>
+		bool Serialize(Name, std::map <U, T> & t)
+		{
+			int size = t.size();
+			Write(&size, 1);
+			for (typename std::map <U, T>::iterator i = t.begin(); i != t.end(); ++i)
+			{
+				U key = i->first;
+				if (!Serialize("", key)) return false;
+				if (!Serialize("", i->second)) return false;
+			}
+			return true;
+		}
+};
+
+///compile-time counterpart of BinaryInputSerializer, reads data written by either binary output serializer.
+///like the virtual version it can't validate the data, but reads past the end of the buffer fail.
+class BinaryReader
+{
+	private:
+		const char * in_;
+		const char * end_;
+		const bool bigendian_;
+
+		template <typename T>
+		bool Read(T * data, size_t count)
+		{
+			if (size_t(end_ - in_) / sizeof(T) < count) return false;
+			if (count)
+				ByteOrder::Copy<T>(reinterpret_cast<char *>(data), in_, count, bigendian_);
+			in_ += count * sizeof(T);
+			return true;
+		}
+
+		bool ReadSize(int & size)
+		{
+			return Read(&size, 1) && size >= 0;
+		}
+
+		template <typename T>
+		bool ReadVector(std::vector <T> & t)
+		{
+			int size;
+			if (!ReadSize(size)) return false;
+			if (size_t(end_ - in_) / sizeof(T) < size_t(size)) return false;
+			t.resize(size);
+			return t.empty() || Read(&t[0], t.size());
+		}
+
+	public:
+		BinaryReader(const char * data, size_t size) : in_(data), end_(data + size), bigendian_(ByteOrder::IsBigEndian()) {}
+
+		BinaryReader(const std::string & data) : in_(data.data()), end_(data.data() + data.size()), bigendian_(ByteOrder::IsBigEndian()) {}
+
+		Serializer::Direction GetIODirection() {return Serializer::DIRECTION_INPUT;}
+
+		///bytes not read yet
+		size_t GetRemaining() const {return end_ - in_;}
+
+		template <typename T>
+		bool Serialize(T & t)
+		{
+			return t.Serialize(*this);
+		}
+
+		template <typename T>
+		bool Serialize(Name, T & t)
+		{
+			return t.Serialize(*this);
+		}
+
+		bool Serialize(Name, int & i) {return Read(&i, 1);}
+		bool Serialize(Name, unsigned int & i) {return Read(&i, 1);}
+		bool Serialize(Name, float & i) {return Read(&i, 1);}
+		bool Serialize(Name, double & i) {return Read(&i, 1);}
+
+		bool Serialize(Name, bool & t)
+		{
+			int boolint;
+			if (!Read(&boolint, 1)) return false;
+			t = boolint;
+			return true;
+		}
+
+		bool Serialize(Name, std::string & t)
+		{
+			int length;
+			if (!ReadSize(length) || size_t(end_ - in_) < size_t(length)) return false;
+			t.assign(in_, length);
+			in_ += length;
+			return true;
+		}
+
+		bool Serialize(Name, std::vector <int> & t) {return ReadVector(t);}
+		bool Serialize(Name, std::vector <unsigned int> & t) {return ReadVector(t);}
+		bool Serialize(Name, std::vector <float> & t) {return ReadVector(t);}
+		bool Serialize(Name, std::vector <double> & t) {return ReadVector(t);}
+
+		/// \verbatim vector <bool> is special \endverbatim
+		bool Serialize(Name, std::vector <bool> & t)
+		{
+			int size;
+			if (!ReadSize(size) || size_t(end_ - in_) / sizeof(int) < size_t(size)) return false;
+			t.resize(size);
+			for (int i = 0; i < size; ++i)
+			{
+				int boolint;
+				Read(&boolint, 1);
+				t[i] = boolint;
+			}
+			return true;
+		}
+
+		template <typename U, typename T>
+		bool Serialize(Name, std::pair <U, T> & t)
+		{
+			return Serialize("", t.first) && Serialize("", t.second);
+		}
+
+		///only resize, don't clear, like BinaryInputSerializer
+		template <typename T>
+		bool Serialize(Name, std::vector <T> & t)
+		{
+			int size;
+			if (!ReadSize(size) || size_t(end_ - in_) < size_t(size)) return false;
+			t.resize(size);
+			for (int i = 0; i < size; ++i)
+			{
+				if (!Serialize("", t[i])) return false;
+			}
+			return true;
+		}
+
+		template <typename T>
+		bool Serialize(Name, std::deque <T> & t)
+		{
+			int size;
+			if (!ReadSize(size) || size_t(end_ - in_) < size_t(size)) return false;
+			t.resize(size);
+			for (int i = 0; i < size; ++i)
+			{
+				if (!Serialize("", t[i])) return false;
+			}
+			return true;
+		}
+
+		template <typename T>
+		bool Serialize(Name, std::list <T> & t)
+		{
+			t.clear();
+			int size;
+			if (!ReadSize(size)) return false;
+			for (int i = 0; i < size; ++i)
+			{
+				t.push_back(T());
+				if (!Serialize("", t.back())) return false;
+			}
+			return true;
+		}
+
+		template <typename T>
+		bool Serialize(Name, std::set <T> & t)
+		{
+			t.clear();
+			int size;
+			if (!ReadSize(size)) return false;
+			for (int i = 0; i < size; ++i)
+			{
+				T prototype;
+				if (!Serialize("", prototype)) return false;
+				t.insert(prototype);
+			}
+			return true;
+		}
+
+		template <typename U, typename T>
+		bool Serialize(Name, std::map <U, T> & t)
+		{
+			t.clear();
+			int size;
+			if (!ReadSize(size)) return false;
+			for (int i = 0; i < size; ++i)
+			{
+				U key;
+				if (!Serialize("", key)) return false;
+				if (!Serialize("", t[key])) return false;
+			}
+			return true;
+		}
+};
+
 ///serializer that provides a reflection interface so the application can use dynamic programming techniques.  the treemap class is used to store data.  this can be either an output or input serializer depending on its mode.  note that internally all data is stored as strings.  this class should not be used via the normal serialization method, but instead use the ReadFromObject and WriteToObject functions.
 class ReflectionSerializer : public Serializer
 {
@@ -1327,6 +1679,8 @@ class ReflectionSerializer : public Serializer
 		}
 
 	public:
+		using Serializer::Serialize;
+
 		ReflectionSerializer() : direction_(DIRECTION_INPUT), error_output_(NULL) {}
 
 		void set_error_output(std::ostream & value)
@@ -1502,6 +1856,17 @@ class ReflectionSerializer : public Serializer
 		}
 };
 
+///explicitly instantiate a template Serialize member defined in a source file for all serializers
+#define _SERIALIZE_INSTANTIATE_(type) \
+	template bool type::Serialize(joeserialize::Serializer & s); \
+	template bool type::Serialize(joeserialize::TextOutputSerializer & s); \
+	template bool type::Serialize(joeserialize::TextInputSerializer & s); \
+	template bool type::Serialize(joeserialize::BinaryOutputSerializer & s); \
+	template bool type::Serialize(joeserialize::BinaryInputSerializer & s); \
+	template bool type::Serialize(joeserialize::ReflectionSerializer & s); \
+	template bool type::Serialize(joeserialize::BinaryWriter & s); \
+	template bool type::Serialize(joeserialize::BinaryReader & s)
+
 //utility functions
 
 ///returns true on success
@@ -0,0 +1,213 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "loadtrace.h"
+#include "microbench.h"
+
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_thread.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <vector>
+#include <map>
+
+namespace loadtrace
+{
+
+bool enabled = false;
+
+struct Event
+{
+	const char * name;
+	std::string detail;
+	double start;
+	double duration;
+	SDL_threadID thread;
+	std::size_t bytes;
+	bool instant;
+};
+
+/// recorder state, guarded by the lock
+static SDL_mutex * lock = 0;
+static SDL_threadID main_thread = 0;
+static double origin = 0;
+static std::vector<Event> events;
+static std::map<SDL_threadID, Scope *> current;
+
+void enable()
+{
+	if (enabled)
+		return;
+
+	lock = SDL_CreateMutex();
+	main_thread = SDL_ThreadID();
+	origin = microbench::getTime();
+	events.reserve(4096);
+	enabled = true;
+}
+
+void addBytes(std::size_t bytes)
+{
+	if (!enabled)
+		return;
+
+	SDL_LockMutex(lock);
+	std::map<SDL_threadID, Scope *>::iterator i = current.find(SDL_ThreadID());
+	if (i != current.end() && i->second)
+		i->second->bytes += bytes;
+	SDL_UnlockMutex(lock);
+}
+
+void mark(const char * name)
+{
+	if (!enabled)
+		return;
+
+	Event event;
+	event.name = name;
+	event.start = microbench::getTime() - origin;
+	event.duration = 0;
+	event.thread = SDL_ThreadID();
+	event.bytes = 0;
+	event.instant = true;
+
+	SDL_LockMutex(lock);
+	events.push_back(event);
+	SDL_UnlockMutex(lock);
+}
+
+static void WriteString(std::ostream & out, const std::string & str)
+{
+	static const char hex[] = "0123456789abcdef";
+	out << '"';
+	for (std::string::const_iterator i = str.begin(); i != str.end(); ++i)
+	{
+		const unsigned char c = *i;
+		if (c == '"' || c == '\\')
+			out << '\\' << c;
+		else if (c < 0x20)
+			out << "\\u00" << hex[c >> 4] << hex[c & 15];
+		else
+			out << c;
+	}
+	out << '"';
+}
+
+bool write(const std::string & path, std::ostream & error)
+{
+	if (!enabled)
+		return false;
+
+	std::ofstream out(path.c_str());
+	if (!out)
+	{
+		error << "Failed to write trace " << path << std::endl;
+		return false;
+	}
+
+	SDL_LockMutex(lock);
+
+	// thread names, the workers are numbered in order of appearance
+	std::map<SDL_threadID, int> threads;
+	threads[main_thread] = 0;
+	for (std::vector<Event>::const_iterator i = events.begin(); i != events.end(); ++i)
+	{
+		threads.insert(std::make_pair(i->thread, int(threads.size())));
+	}
+
+	out << "{\"traceEvents\":[\n";
+	for (std::map<SDL_threadID, int>::const_iterator i = threads.begin(); i != threads.end(); ++i)
+	{
+		out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << i->second
+			<< ",\"args\":{\"name\":\"";
+		if (i->second)
+			out << "worker " << i->second;
+		else
+			out << "main";
+		out << "\"}},\n";
+	}
+
+	out.setf(std::ios::fixed);
+	out.precision(0);
+	for (std::vector<Event>::const_iterator i = events.begin(); i != events.end(); ++i)
+	{
+		if (i != events.begin())
+			out << ",\n";
+		out << "{\"name\":\"" << i->name << "\",\"cat\":\"load\",\"pid\":1,\"tid\":" << threads[i->thread]
+			<< ",\"ts\":" << i->start * 1E6;
+		if (i->instant)
+		{
+			out << ",\"ph\":\"i\",\"s\":\"g\"}";
+			continue;
+		}
+		out << ",\"ph\":\"X\",\"dur\":" << i->duration * 1E6
+			<< ",\"args\":{\"bytes\":" << i->bytes;
+		if (!i->detail.empty())
+		{
+			out << ",\"asset\":";
+			WriteString(out, i->detail);
+		}
+		out << "}}";
+	}
+	out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+	SDL_UnlockMutex(lock);
+
+	return out.good();
+}
+
+void Scope::countFile(const std::string & path)
+{
+	struct stat info;
+	if (active && !stat(path.c_str(), &info) && std::size_t(info.st_size) > bytes)
+		bytes = info.st_size;
+}
+
+void Scope::begin()
+{
+	bytes = 0;
+	const SDL_threadID thread = SDL_ThreadID();
+	SDL_LockMutex(lock);
+	Scope * & top = current[thread];
+	parent = top;
+	top = this;
+	SDL_UnlockMutex(lock);
+	start = microbench::getTime() - origin;
+}
+
+void Scope::end()
+{
+	Event event;
+	event.name = name;
+	event.start = start;
+	event.duration = microbench::getTime() - origin - start;
+	event.thread = SDL_ThreadID();
+	event.bytes = bytes;
+	event.instant = false;
+
+	SDL_LockMutex(lock);
+	current[event.thread] = parent;
+	if (parent)
+		parent->bytes += bytes;
+	events.push_back(event);
+	events.back().detail.swap(detail);
+	SDL_UnlockMutex(lock);
+}
+
+}
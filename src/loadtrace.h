@@ -0,0 +1,108 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _LOADTRACE_H
+#define _LOADTRACE_H
+
+#include <string>
+#include <iosfwd>
+#include <cstddef>
+
+/// Hierarchical load phase tracing, enabled with the -trace argument.
+/// Records wall time, thread and bytes read of nested scopes, written
+/// as chrome trace_event json (chrome://tracing, ui.perfetto.dev).
+/// Scopes only check a flag while tracing is disabled.
+namespace loadtrace
+{
+	extern bool enabled;
+
+	/// Start recording, call before any worker threads are started.
+	void enable();
+
+	inline bool isEnabled() {return enabled;}
+
+	/// Add bytes read to the innermost scope of the calling thread.
+	void addBytes(std::size_t bytes);
+
+	/// Record an instant event on the calling thread.
+	void mark(const char * name);
+
+	/// Write the recorded events, false on error.
+	bool write(const std::string & path, std::ostream & error);
+
+	/// Timed phase, nested scopes of a thread form its hierarchy.
+	/// Bytes read in a scope are added to its parent when it ends.
+	class Scope
+	{
+	public:
+		Scope(const char * name);
+
+		/// Detail is shown as the asset argument, an asset name or path.
+		Scope(const char * name, const std::string & detail);
+
+		~Scope();
+
+		bool isActive() const {return active;}
+
+		/// Count the file size as read unless the scope counted more already.
+		void countFile(const std::string & path);
+
+	private:
+		friend void addBytes(std::size_t bytes);
+		const char * name;
+		std::string detail;
+		double start;
+		std::size_t bytes;
+		Scope * parent;
+		bool active;
+
+		void begin();
+		void end();
+
+		Scope(const Scope & other);
+		Scope & operator=(const Scope & other);
+	};
+}
+
+inline loadtrace::Scope::Scope(const char * name) :
+	name(name),
+	active(enabled)
+{
+	if (active)
+		begin();
+}
+
+inline loadtrace::Scope::Scope(const char * name, const std::string & detail) :
+	name(name),
+	active(enabled)
+{
+	if (active)
+	{
+		this->detail = detail;
+		begin();
+	}
+}
+
+inline loadtrace::Scope::~Scope()
+{
+	if (active)
+		end();
+}
+
+#endif // _LOADTRACE_H
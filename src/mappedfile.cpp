@@ -0,0 +1,179 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "mappedfile.h"
+#include "loadtrace.h"
+#include "pathmanager.h"
+#include "unittest.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <fstream>
+#include <sstream>
+
+MappedFile::MappedFile() :
+	data(0),
+	size(0),
+	open(false)
+#ifdef _WIN32
+	, file(INVALID_HANDLE_VALUE),
+	mapping(0)
+#endif
+{
+	// ctor
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const std::string & path)
+{
+	Close();
+
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size))
+	{
+		Close();
+		return false;
+	}
+
+	open = true;
+	size = file_size.QuadPart;
+	loadtrace::addBytes(size);
+	if (size == 0)
+		return true;
+
+	mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+	if (mapping)
+		data = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!data)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data)
+		UnmapViewOfFile(data);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+	data = 0;
+	size = 0;
+	open = false;
+	mapping = 0;
+	file = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+bool MappedFile::Open(const std::string & path)
+{
+	Close();
+
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	open = true;
+	size = st.st_size;
+	loadtrace::addBytes(size);
+	if (size > 0)
+	{
+		void * ptr = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (ptr == MAP_FAILED)
+		{
+			open = false;
+			size = 0;
+		}
+		else
+		{
+			data = static_cast<const char *>(ptr);
+		}
+	}
+
+	// the mapping stays valid after closing the descriptor
+	::close(fd);
+	return open;
+}
+
+void MappedFile::Close()
+{
+	if (data)
+		munmap(const_cast<char *>(data), size);
+	data = 0;
+	size = 0;
+	open = false;
+}
+
+#endif
+
+QT_TEST(mappedfile_test)
+{
+	std::ostringstream info, error;
+	PathManager paths;
+	paths.Init(info, error);
+	const std::string filename = paths.GetTemporaryFolder() + "/mappedfile_test.tmp";
+	const std::string content("mapped file content");
+	{
+		std::ofstream f(filename.c_str(), std::ios::binary);
+		f << content;
+	}
+
+	MappedFile file;
+	QT_CHECK(!file.IsOpen());
+	QT_CHECK(file.Open(filename));
+	QT_CHECK(file.IsOpen());
+	QT_CHECK_EQUAL(file.GetSize(), content.size());
+	QT_CHECK(file.GetData() && std::string(file.GetData(), file.GetSize()) == content);
+	file.Close();
+	QT_CHECK(!file.IsOpen());
+	QT_CHECK(!file.GetData());
+
+	PathManager::RemoveFile(filename);
+	QT_CHECK(!file.Open(filename));
+}
@@ -0,0 +1,75 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _MAPPEDFILE_H
+#define _MAPPEDFILE_H
+
+#include <string>
+#include <cstddef>
+
+/// Read only memory mapped file.
+class MappedFile
+{
+public:
+	MappedFile();
+
+	~MappedFile();
+
+	/// Map the whole file, false on error.
+	bool Open(const std::string & path);
+
+	/// Unmap the file.
+	void Close();
+
+	bool IsOpen() const;
+
+	/// File contents, null for an empty or closed file.
+	const char * GetData() const;
+
+	std::size_t GetSize() const;
+
+private:
+	const char * data;
+	std::size_t size;
+	bool open;
+#ifdef _WIN32
+	void * file;
+	void * mapping;
+#endif
+
+	MappedFile(const MappedFile & other);
+	MappedFile & operator=(const MappedFile & other);
+};
+
+inline bool MappedFile::IsOpen() const
+{
+	return open;
+}
+
+inline const char * MappedFile::GetData() const
+{
+	return data;
+}
+
+inline std::size_t MappedFile::GetSize() const
+{
+	return size;
+}
+
+#endif // _MAPPEDFILE_H
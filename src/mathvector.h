@@ -257,7 +257,8 @@ public:
 		return output;
 	}
 
-	bool Serialize(joeserialize::Serializer & s)
+	template <class S>
+	bool Serialize(S & s)
 	{
 		for (unsigned int i = 0; i < dimension; i++)
 		{
@@ -446,7 +447,8 @@ public:
 		return vec.Normalize() * scalar_projection;
 	}
 
-	bool Serialize(joeserialize::Serializer & s)
+	template <class S>
+	bool Serialize(S & s)
 	{
 		if (!s.Serialize("x",v.x)) return false;
 		if (!s.Serialize("y",v.y)) return false;
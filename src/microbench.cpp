@@ -0,0 +1,95 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "microbench.h"
+#include "quickprof.h"
+#include "pathmanager.h"
+
+#include <vector>
+#include <list>
+#include <iostream>
+
+namespace microbench
+{
+
+static std::vector<Benchmark*> & getBenchmarks()
+{
+	// function local to avoid static initialization order issues
+	static std::vector<Benchmark*> benchmarks;
+	return benchmarks;
+}
+
+Benchmark::Benchmark(const std::string & name) :
+	name(name)
+{
+	getBenchmarks().push_back(this);
+}
+
+int runBenchmarks(const std::string & filter, Context & ctx)
+{
+	ctx.info_output << "[------------ RUNNING MICRO BENCHMARKS -----------]" << std::endl;
+
+	int count = 0;
+	const std::vector<Benchmark*> & benchmarks = getBenchmarks();
+	for (std::vector<Benchmark*>::const_iterator i = benchmarks.begin(); i != benchmarks.end(); ++i)
+	{
+		if (!filter.empty() && (*i)->getName().find(filter) == std::string::npos)
+			continue;
+
+		ctx.info_output << "[" << (*i)->getName() << "]" << std::endl;
+		(*i)->run(ctx);
+		++count;
+	}
+
+	ctx.info_output << "Benchmarks run: " << count << std::endl;
+	ctx.info_output << "[----------- MICRO BENCHMARKS FINISHED -----------]" << std::endl;
+
+	return count;
+}
+
+double getTime()
+{
+	static quickprof::Clock clock;
+	return clock.getTimeMicroseconds() * 1E-6;
+}
+
+void getDataFiles(
+	const Context & ctx,
+	DataSet set,
+	const std::string & subdir,
+	const std::string & suffix,
+	std::vector<std::string> & files)
+{
+	const std::string path = ctx.paths.GetDataPath() + "/" +
+		(set == TRACKS ? ctx.paths.GetTracksDir() : ctx.paths.GetCarsDir());
+	std::list<std::string> dirs;
+	ctx.paths.GetFileList(path, dirs);
+	for (std::list<std::string>::const_iterator d = dirs.begin(); d != dirs.end(); ++d)
+	{
+		const std::string dir = subdir.empty() ? path + "/" + *d : path + "/" + *d + "/" + subdir;
+		std::list<std::string> names;
+		ctx.paths.GetFileList(dir, names, suffix);
+		for (std::list<std::string>::const_iterator n = names.begin(); n != names.end(); ++n)
+		{
+			files.push_back(dir + "/" + *n);
+		}
+	}
+}
+
+}
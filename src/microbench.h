@@ -0,0 +1,104 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _MICROBENCH_H
+#define _MICROBENCH_H
+
+#include <string>
+#include <vector>
+#include <iosfwd>
+
+class PathManager;
+class ContentManager;
+
+/// Self registering micro benchmarks, run with the -microbench argument.
+/// Modeled on the QuickTest QT_TEST registration.
+namespace microbench
+{
+	/// Environment handed to every benchmark.
+	struct Context
+	{
+		PathManager & paths;
+		ContentManager & content;
+		std::ostream & info_output;
+		std::ostream & error_output;
+
+		Context(
+			PathManager & paths,
+			ContentManager & content,
+			std::ostream & info_output,
+			std::ostream & error_output) :
+			paths(paths),
+			content(content),
+			info_output(info_output),
+			error_output(error_output)
+		{
+			// ctor
+		}
+	};
+
+	class Benchmark
+	{
+	public:
+		/// Register benchmark with the global list.
+		Benchmark(const std::string & name);
+
+		virtual ~Benchmark() {}
+
+		virtual void run(Context & ctx) = 0;
+
+		const std::string & getName() const {return name;}
+
+	private:
+		std::string name;
+	};
+
+	/// Run all benchmarks whose name contains filter, return count.
+	int runBenchmarks(const std::string & filter, Context & ctx);
+
+	/// Wall clock time in seconds since an arbitrary point.
+	double getTime();
+
+	/// Data sets of the loading benchmarks.
+	enum DataSet { TRACKS, CARS };
+
+	/// Append the paths of the files ending with suffix in subdir of every
+	/// track or car directory, subdir is relative to the track or car directory.
+	void getDataFiles(
+		const Context & ctx,
+		DataSet set,
+		const std::string & subdir,
+		const std::string & suffix,
+		std::vector<std::string> & files);
+}
+
+/// Define a benchmark, ctx is available in the body.
+#define MICROBENCH(benchName)\
+	class benchName##Bench : public microbench::Benchmark\
+	{\
+	public:\
+		benchName##Bench()\
+		: Benchmark(#benchName)\
+		{\
+		}\
+		void run(microbench::Context & ctx);\
+	}benchName##Instance;\
+	void benchName##Bench::run(microbench::Context & ctx)
+
+#endif // _MICROBENCH_H
@@ -41,7 +41,7 @@ namespace NUMPROCESSORS
 	#error This development environment doesnt support pthreads or windows threads
 #endif
 
-	unsigned int GetNumProcessors()
+	inline unsigned int GetNumProcessors()
 	{
 #if defined(WIN32) || defined(_WIN32) || defined (__WIN32) || defined(__WIN32__) \
 		|| defined (_WIN64) || defined(__CYGWIN__) || defined(__MINGW32__)
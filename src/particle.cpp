@@ -18,6 +18,7 @@
 /************************************************************************/
 
 #include "particle.h"
+#include "jobsystem.h"
 #include "content/contentmanager.h"
 #include "graphics/texture.h"
 #include "unittest.h"
@@ -86,6 +87,45 @@ void ParticleSystem::Update(float dt)
 	}
 }
 
+// transforms a range of particles into camera space
+struct ParticleSystem::CameraSpaceRange : public JobRange
+{
+	std::vector<Particle> & particles;
+	std::vector<float> & distance_from_cam;
+	const Quat & camdir;
+	const Vec3 & campos;
+
+	CameraSpaceRange(
+		std::vector<Particle> & particles,
+		std::vector<float> & distance_from_cam,
+		const Quat & camdir,
+		const Vec3 & campos) :
+		particles(particles),
+		distance_from_cam(distance_from_cam),
+		camdir(camdir),
+		campos(campos)
+	{
+		// ctor
+	}
+
+	void Execute(int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+		{
+			Particle & p = particles[i];
+			Vec3 pos = p.start_position;
+			pos = pos + p.direction * p.time * p.speed - campos;
+			camdir.RotateVector(pos);
+
+			// signed distance along z-axis in camera space
+			distance_from_cam[i] = -pos[2];
+
+			// store camera space position
+			p.position = pos;
+		}
+	}
+};
+
 void ParticleSystem::UpdateGraphics(
 	const Quat & camdir,
 	const Vec3 & campos,
@@ -99,20 +139,9 @@ void ParticleSystem::UpdateGraphics(
 	node.GetTransform().SetRotation(-camdir);
 
 	// get particle position in camera space
-	distance_from_cam.clear();
-	for (unsigned i = 0; i < particles.size(); ++i)
-	{
-		Particle & p = particles[i];
-		Vec3 pos = p.start_position;
-		pos = pos + p.direction * p.time * p.speed - campos;
-		camdir.RotateVector(pos);
-
-		// signed distance along z-axis in camera space
-		distance_from_cam.push_back(-pos[2]);
-
-		// store camera space position
-		p.position = pos;
-	}
+	distance_from_cam.resize(particles.size());
+	CameraSpaceRange range(particles, distance_from_cam, camdir, campos);
+	JobSystem::instance().ParallelFor(0, particles.size(), range, 512);
 
 	// sort particles by distance to camera
 
@@ -92,6 +92,7 @@ private:
 		float time;			///< particle age, time since the particle was created
 		int tid;			///< particle texture atlas tile id 0-8
 	};
+	struct CameraSpaceRange;
 	std::vector<Particle> particles;
 	std::vector<float> distance_from_cam;
 	unsigned max_particles;
@@ -99,6 +99,8 @@ void PathManager::Init(std::ostream & info_output, std::ostream & error_output)
 	MakeDir(GetTrackRecordsPath());
 	MakeDir(GetReplayPath());
 	MakeDir(GetScreenshotPath());
+	MakeDir(GetTrackCachePath());
+	MakeDir(GetTextureCachePath());
 	MakeDir(GetTemporaryFolder());
 
 	// Print diagnostic info.
@@ -316,6 +318,16 @@ std::string PathManager::GetReplayPath() const
 	return settings_path+"/replays";
 }
 
+std::string PathManager::GetTrackCachePath() const
+{
+	return settings_path+"/cache";
+}
+
+std::string PathManager::GetTextureCachePath() const
+{
+	return GetTrackCachePath()+"/textures";
+}
+
 std::string PathManager::GetScreenshotPath() const
 {
 	return settings_path+"/screenshots";
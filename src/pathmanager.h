@@ -58,6 +58,8 @@ public:
 	std::string GetCarControlsFile() const;
 	std::string GetDefaultCarControlsFile() const;
 	std::string GetReplayPath() const;
+	std::string GetTrackCachePath() const;
+	std::string GetTextureCachePath() const;
 	std::string GetScreenshotPath() const;
 	std::string GetStaticReflectionMap() const;
 	std::string GetStaticAmbientMap() const;
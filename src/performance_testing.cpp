@@ -19,18 +19,35 @@
 
 #include "performance_testing.h"
 #include "physics/carinput.h"
+#include "physics/carhistory.h"
+#include "replay.h"
+#include "replayanalyzer.h"
+#include "telemetry.h"
+#include "cartelemetry.h"
 #include "physics/dynamicsworld.h"
 #include "physics/tracksurface.h"
 #include "content/contentmanager.h"
 #include "cfg/ptree.h"
+#include "microbench.h"
+#include "pathmanager.h"
+#include "settings.h"
+#include "jobsystem.h"
+#include "graphics/model.h"
 
 #include "BulletCollision/CollisionDispatch/btCollisionObject.h"
+#include "BulletCollision/CollisionDispatch/btDefaultCollisionConfiguration.h"
+#include "BulletCollision/BroadphaseCollision/btDbvtBroadphase.h"
 #include "BulletCollision/CollisionShapes/btStaticPlaneShape.h"
+#include "BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolver.h"
 
 #include <vector>
+#include <list>
+#include <fstream>
 #include <iostream>
 #include <sstream>
 #include <ctime>
+#include <cmath>
+#include <cstdio>
 
 static inline float ConvertToMPH(float ms)
 {
@@ -114,14 +131,7 @@ void PerformanceTesting::Test(
 		<< "Center of mass: " << cm[0] << ", " << cm[1] << ", " << cm[2] << " m" << std::endl;
 	info_output << "Estimated maximum speed: " << ConvertToMPH(car.GetMaxSpeedMPS()) << " MPH" << std::endl;
 
-	std::ostringstream statestream;
-	joeserialize::BinaryOutputSerializer serialize_output(statestream);
-	if (!car.Serialize(serialize_output))
-	{
-		error_output << "Serialization error" << std::endl;
-	}
-	//else info_output << "Car state: " << statestream.str();
-	carstate = statestream.str();
+	car.GetSnapshot(carstate);
 
 	TestMaxSpeed(info_output, error_output);
 	TestStoppingDistance(false, info_output, error_output);
@@ -132,9 +142,7 @@ void PerformanceTesting::Test(
 
 void PerformanceTesting::ResetCar()
 {
-	std::istringstream statestream(carstate);
-	joeserialize::BinaryInputSerializer serialize_input(statestream);
-	car.Serialize(serialize_input);
+	car.SetSnapshot(carstate);
 
 	car.SetAutoShift(true);
 	car.SetAutoClutch(true);
@@ -312,3 +320,743 @@ void PerformanceTesting::TestStoppingDistance(bool abs, std::ostream & info_outp
 		info_output << "(no ABS)";
 	info_output << ": " << ConvertToFeet((stopend-stopstart).length()) << " ft" << std::endl;
 }
+
+// flat asphalt plane benchmark world
+struct PlaneWorld
+{
+	btDefaultCollisionConfiguration config;
+	btCollisionDispatcher dispatcher;
+	btDbvtBroadphase broadphase;
+	btSequentialImpulseConstraintSolver solver;
+	DynamicsWorld world;
+	TrackSurface surface;
+	btStaticPlaneShape plane;
+	btCollisionObject track;
+
+	PlaneWorld(btScalar dt) :
+		dispatcher(&config),
+		world(&dispatcher, &broadphase, &solver, &config, dt),
+		plane(btVector3(0, 0, 1), 0)
+	{
+		surface.type = TrackSurface::ASPHALT;
+		surface.bumpWaveLength = 1;
+		surface.bumpAmplitude = 0;
+		surface.frictionNonTread = 1;
+		surface.frictionTread = 1;
+		surface.rollResistanceCoefficient = 1;
+		surface.rollingDrag = 0;
+
+		plane.setUserPointer(static_cast<void*>(&surface));
+		track.setCollisionShape(&plane);
+		track.setActivationState(DISABLE_SIMULATION);
+		track.setUserPointer(static_cast<void*>(&surface));
+		world.addCollisionObject(&track);
+	}
+
+	~PlaneWorld()
+	{
+		world.removeCollisionObject(&track);
+	}
+};
+
+// first car with a config file in the data directory
+static bool FindCar(
+	microbench::Context & ctx,
+	std::tr1::shared_ptr<PTree> & cfg,
+	std::string & cardir)
+{
+	const std::string cars_path = ctx.paths.GetDataPath() + "/" + ctx.paths.GetCarsDir();
+	std::list<std::string> carlist;
+	ctx.paths.GetFileList(cars_path, carlist);
+	for (std::list<std::string>::const_iterator i = carlist.begin(); i != carlist.end() && !cfg.get(); ++i)
+	{
+		std::ifstream file((cars_path + "/" + *i + "/" + *i + ".car").c_str());
+		if (!file) continue;
+
+		cardir = ctx.paths.GetCarsDir() + "/" + *i;
+		ctx.content.load(cfg, cardir, *i + ".car");
+		ctx.info_output << "Car: " << *i << "\n";
+	}
+	if (!cfg.get() || !cfg->size())
+	{
+		ctx.error_output << "No car found in " << cars_path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// single car driving on the benchmark plane
+struct PlaneCar
+{
+	PlaneWorld plane_world;
+	DynamicsWorld & world;
+	btAlignedObjectArray<CarDynamics> cars;
+	std::vector<float> inputs;
+	const float dt;
+
+	PlaneCar(float dt) :
+		plane_world(dt),
+		world(plane_world.world),
+		inputs(CarInput::INVALID, 0.0f),
+		dt(dt)
+	{
+		// ctor
+	}
+
+	~PlaneCar()
+	{
+		cars.clear();
+	}
+
+	// load the first car of the data directory, full throttle ahead
+	bool Load(microbench::Context & ctx)
+	{
+		std::tr1::shared_ptr<PTree> cfg;
+		std::string cardir;
+		if (!FindCar(ctx, cfg, cardir))
+			return false;
+
+		cars.push_back(CarDynamics());
+		btVector3 pos(0.0, -2.0, 0.5);
+		if (!cars[0].Load(*cfg, cardir, "", pos, btQuaternion::getIdentity(), false, world, ctx.content, ctx.error_output))
+		{
+			ctx.error_output << "Failed to load car" << std::endl;
+			return false;
+		}
+		cars[0].SetAutoShift(true);
+		cars[0].SetAutoClutch(true);
+		inputs[CarInput::THROTTLE] = 1.0f;
+		return true;
+	}
+
+	CarDynamics & GetCar()
+	{
+		return cars[0];
+	}
+
+	// weave around, throttle alternating every ten seconds
+	void Weave(unsigned frame)
+	{
+		const float steer = std::sin(frame * dt * 0.5f);
+		inputs[CarInput::THROTTLE] = (frame / 900) % 2 ? 0.5f : 1.0f;
+		inputs[CarInput::STEER_RIGHT] = steer > 0 ? steer : 0;
+		inputs[CarInput::STEER_LEFT] = steer < 0 ? -steer : 0;
+	}
+
+	// advance the world and the car by one step
+	void Step()
+	{
+		world.update(dt);
+		cars[0].Update(inputs);
+	}
+
+	// weave around for frames, recording them into replay
+	void Record(Replay & replay, unsigned frames)
+	{
+		for (unsigned n = 0; n < frames; ++n)
+		{
+			Weave(n);
+			Step();
+			replay.RecordFrame(0, inputs, cars[0]);
+		}
+	}
+};
+
+// grid of count cars on the benchmark plane, full throttle, steering differently
+static bool LoadCarGrid(
+	const PTree & cfg,
+	const std::string & cardir,
+	int count,
+	DynamicsWorld & world,
+	ContentManager & content,
+	btAlignedObjectArray<CarDynamics> & cars,
+	std::vector<std::vector<float> > & inputs,
+	std::ostream & error_output)
+{
+	inputs.assign(count, std::vector<float>(CarInput::INVALID, 0.0f));
+	cars.reserve(count);
+	for (int i = 0; i < count; ++i)
+	{
+		btVector3 pos((i % 8) * 6.0, (i / 8) * 12.0, 0.5);
+		cars.push_back(CarDynamics());
+		if (!cars[i].Load(cfg, cardir, "", pos, btQuaternion::getIdentity(), false, world, content, error_output))
+			return false;
+		cars[i].SetAutoShift(true);
+		cars[i].SetAutoClutch(true);
+		inputs[i][CarInput::THROTTLE] = 1.0f;
+		inputs[i][CarInput::STEER_RIGHT] = 0.05f * (i % 5);
+	}
+	return true;
+}
+
+// drive count cars on a plane, return the simulation time and the final car states
+static bool RunCars(
+	const PTree & cfg,
+	const std::string & cardir,
+	ContentManager & content,
+	int count,
+	bool parallel,
+	int steps,
+	double & time,
+	std::string & state,
+	std::ostream & error_output)
+{
+	const float dt = 1 / 90.0;
+	PlaneWorld plane_world(dt);
+	DynamicsWorld & world = plane_world.world;
+	world.setParallelActions(parallel);
+
+	btAlignedObjectArray<CarDynamics> cars;
+	std::vector<std::vector<float> > inputs;
+	const bool loaded = LoadCarGrid(cfg, cardir, count, world, content, cars, inputs, error_output);
+	if (loaded)
+	{
+		double t0 = microbench::getTime();
+		for (int n = 0; n < steps; ++n)
+		{
+			for (int i = 0; i < count; ++i)
+			{
+				cars[i].Update(inputs[i]);
+			}
+			world.update(dt);
+		}
+		time = microbench::getTime() - t0;
+
+		std::ostringstream statestream;
+		joeserialize::BinaryOutputSerializer serialize_output(statestream);
+		for (int i = 0; i < count; ++i)
+		{
+			cars[i].Serialize(serialize_output);
+		}
+		state = statestream.str();
+	}
+
+	cars.clear();
+	return loaded;
+}
+
+// per car dynamics update on the job system against the serial update
+MICROBENCH(parallelcars)
+{
+	std::tr1::shared_ptr<PTree> cfg;
+	std::string cardir;
+	if (!FindCar(ctx, cfg, cardir))
+		return;
+
+	JobSystem & jobs = JobSystem::instance();
+	const int job_threads = jobs.GetNumThreads();
+	jobs.Init();
+	const int threads = jobs.GetNumThreads();
+	const int counts[] = {1, 4, 16, 64};
+	const int steps = 900;
+	for (unsigned n = 0; n < sizeof(counts) / sizeof(counts[0]); ++n)
+	{
+		double serial_time, parallel_time;
+		std::string serial_state, parallel_state;
+		if (!RunCars(*cfg, cardir, ctx.content, counts[n], false, steps, serial_time, serial_state, ctx.error_output) ||
+			!RunCars(*cfg, cardir, ctx.content, counts[n], true, steps, parallel_time, parallel_state, ctx.error_output))
+		{
+			ctx.error_output << "Failed to load cars" << std::endl;
+			break;
+		}
+
+		ctx.info_output << counts[n] << " cars: serial " << serial_time / steps * 1E3 << " ms/step, ";
+		ctx.info_output << threads << " threads " << parallel_time / steps * 1E3 << " ms/step, ";
+		ctx.info_output << "speedup " << serial_time / parallel_time << std::endl;
+		if (serial_state != parallel_state)
+			ctx.error_output << counts[n] << " cars: parallel state differs from serial state" << std::endl;
+	}
+	jobs.PrintStats(ctx.info_output);
+	jobs.Init(job_threads);
+}
+
+// car snapshot ring buffer against the serializer, rewind determinism
+MICROBENCH(carsnapshot)
+{
+	const float dt = 1 / 90.0;
+	PlaneCar plane(dt);
+	if (!plane.Load(ctx))
+		return;
+
+	CarDynamics & car = plane.GetCar();
+
+	plane.inputs[CarInput::STEER_RIGHT] = 0.1f;
+
+	// get the car moving
+	const int steps = 90;
+	for (int n = 0; n < steps; ++n)
+	{
+		plane.Step();
+	}
+
+	// record a second of driving, rewind it and drive it again
+	CarHistory history;
+	history.Init(1, steps);
+	for (int n = 0; n < steps; ++n)
+	{
+		history.Record(&car, 1);
+		plane.Step();
+	}
+	const std::string state = Replay::SerializeCar(car);
+	const int rewound = history.Rewind(&car, 1, steps);
+	for (int n = 0; n < rewound; ++n)
+	{
+		plane.Step();
+	}
+	if (rewound != steps || Replay::SerializeCar(car) != state)
+		ctx.error_output << "Car state after rewind differs from recorded state" << std::endl;
+
+	const int count = 100000;
+	double t0 = microbench::getTime();
+	for (int n = 0; n < count; ++n)
+	{
+		history.Record(&car, 1);
+		history.Rewind(&car, 1, 1);
+	}
+	const double snapshot_time = microbench::getTime() - t0;
+
+	t0 = microbench::getTime();
+	for (int n = 0; n < count; ++n)
+	{
+		std::ostringstream statestream;
+		joeserialize::BinaryOutputSerializer serialize_output(statestream);
+		car.Serialize(serialize_output);
+
+		std::istringstream instream(statestream.str());
+		joeserialize::BinaryInputSerializer serialize_input(instream);
+		car.Serialize(serialize_input);
+	}
+	const double serialize_time = microbench::getTime() - t0;
+
+	ctx.info_output << "Snapshot size " << sizeof(CarDynamics::Snapshot) << " bytes, ";
+	ctx.info_output << "serialized size " << state.size() << " bytes" << std::endl;
+	ctx.info_output << "Snapshot save/restore " << snapshot_time / count * 1E6 << " us, ";
+	ctx.info_output << "serializer " << serialize_time / count * 1E6 << " us, ";
+	ctx.info_output << "speedup " << serialize_time / snapshot_time << std::endl;
+	if (Replay::SerializeCar(car) != state)
+		ctx.error_output << "Car state changed by save/restore" << std::endl;
+}
+
+// play replay from its current frame to frame, the way the game loop does
+static void PlayReplay(Replay & replay, unsigned frame, CarDynamics & car, DynamicsWorld & world, float dt)
+{
+	while (replay.GetFrame() < frame && replay.GetPlaying())
+	{
+		world.update(dt);
+		car.Update(replay.PlayFrame(0, car));
+	}
+}
+
+// replay seek latency against replay length, keyframe seek against playing from the start
+MICROBENCH(replayseek)
+{
+	const float dt = 1 / 90.0;
+	PlaneCar plane(dt);
+	if (!plane.Load(ctx))
+		return;
+
+	DynamicsWorld & world = plane.world;
+	CarDynamics & car = plane.GetCar();
+
+	// record twenty minutes of weaving around on the plane
+	const unsigned minute = 60 * 90;
+	const unsigned frames = 20 * minute;
+	Replay replay(dt);
+	replay.StartRecording(std::vector<CarInfo>(1), "plane", Replay::Setup(), "", ctx.error_output);
+	double t0 = microbench::getTime();
+	plane.Record(replay, frames);
+	const double record_time = microbench::getTime() - t0;
+
+	const std::string replayfile = ctx.paths.GetTemporaryFolder() + "/replayseek.vdr";
+	replay.StopRecording(replayfile);
+	if (!replay.StartPlaying(replayfile, ctx.error_output))
+		return;
+
+	// seek against playing on from frame zero
+	const unsigned check = 7 * minute + 123;
+	replay.Seek(0, &car, 1, world);
+	PlayReplay(replay, check, car, world, dt);
+	const std::string state = Replay::SerializeCar(car);
+	replay.Seek(12 * minute, &car, 1, world);
+	replay.Seek(check, &car, 1, world);
+	if (Replay::SerializeCar(car) != state)
+		ctx.error_output << "Car state after seek differs from playback" << std::endl;
+
+	ctx.info_output << "Simulated " << frames / minute << " minutes in " << record_time << " s" << std::endl;
+	const unsigned lengths[] = {1, 5, 20};
+	const unsigned seeks = 50;
+	for (unsigned l = 0; l < sizeof(lengths) / sizeof(lengths[0]); ++l)
+	{
+		const unsigned length = lengths[l] * minute;
+
+		// deterministic pseudo random targets, back and forth
+		double seek_time = 0;
+		unsigned target = 0;
+		for (unsigned n = 0; n < seeks; ++n)
+		{
+			target = (target * 1103515245u + 12345u) % length;
+			t0 = microbench::getTime();
+			replay.Seek(target, &car, 1, world);
+			seek_time += microbench::getTime() - t0;
+		}
+
+		// restarting from frame zero plays half the replay on average
+		replay.Seek(0, &car, 1, world);
+		t0 = microbench::getTime();
+		PlayReplay(replay, length / 2, car, world, dt);
+		const double restart_time = microbench::getTime() - t0;
+
+		ctx.info_output << lengths[l] << " minutes: seek " << seek_time / seeks * 1E3 << " ms, ";
+		ctx.info_output << "restart " << restart_time * 1E3 << " ms" << std::endl;
+	}
+
+	replay.Reset();
+	std::remove(replayfile.c_str());
+}
+
+static long GetFileSize(const std::string & filename)
+{
+	std::ifstream f(filename.c_str(), std::ios::binary | std::ios::ate);
+	return f ? long(f.tellg()) : 0;
+}
+
+// replay size and recording cost, in memory v17 against streamed v20
+MICROBENCH(replayformat)
+{
+	const float dt = 1 / 90.0;
+	PlaneCar plane(dt);
+	if (!plane.Load(ctx))
+		return;
+
+	DynamicsWorld & world = plane.world;
+	CarDynamics & car = plane.GetCar();
+
+	const std::string folder = ctx.paths.GetTemporaryFolder();
+	const std::string memfile = folder + "/replayformat-v17.vdr";
+	const std::string streamfile = folder + "/replayformat-v20.vdr";
+	const std::string convertfile = folder + "/replayformat-v17-v20.vdr";
+
+	// record ten minutes into both formats
+	const unsigned minutes = 10;
+	const unsigned frames = minutes * 60 * 90;
+	Replay memreplay(dt), streamreplay(dt);
+	memreplay.StartRecording(std::vector<CarInfo>(1), "plane", Replay::Setup(), "", ctx.error_output);
+	streamreplay.StartRecording(std::vector<CarInfo>(1), "plane", Replay::Setup(), streamfile + ".tmp", ctx.error_output);
+	double sim_time = 0, mem_time = 0, stream_time = 0;
+	const std::clock_t c0 = std::clock();
+	for (unsigned n = 0; n < frames; ++n)
+	{
+		plane.Weave(n);
+		const double t0 = microbench::getTime();
+		plane.Step();
+		const double t1 = microbench::getTime();
+		memreplay.RecordFrame(0, plane.inputs, car);
+		const double t2 = microbench::getTime();
+		streamreplay.RecordFrame(0, plane.inputs, car);
+		const double t3 = microbench::getTime();
+		sim_time += t1 - t0;
+		mem_time += t2 - t1;
+		stream_time += t3 - t2;
+	}
+	double t0 = microbench::getTime();
+	memreplay.StopRecording(memfile);
+	mem_time += microbench::getTime() - t0;
+	t0 = microbench::getTime();
+	streamreplay.StopRecording(streamfile);
+	stream_time += microbench::getTime() - t0;
+	const double cpu_time = double(std::clock() - c0) / CLOCKS_PER_SEC;
+
+	const long memsize = GetFileSize(memfile);
+	const long streamsize = GetFileSize(streamfile);
+	ctx.info_output << "v17 " << memsize / minutes << " bytes/car-minute, ";
+	ctx.info_output << "record " << mem_time / sim_time * 100 << "% of simulation" << std::endl;
+	ctx.info_output << "v20 " << streamsize / minutes << " bytes/car-minute, ";
+	ctx.info_output << "record " << stream_time / sim_time * 100 << "% of simulation, ";
+	ctx.info_output << "size " << double(streamsize) / memsize * 100 << "% of v17" << std::endl;
+	ctx.info_output << "Process cpu " << cpu_time << " s, main thread ";
+	ctx.info_output << sim_time + mem_time + stream_time << " s" << std::endl;
+
+	// converting the v17 recording reproduces the stream
+	t0 = microbench::getTime();
+	if (!memreplay.Convert(memfile, convertfile, ctx.error_output))
+		return;
+	ctx.info_output << "Convert " << (microbench::getTime() - t0) * 1E3 << " ms" << std::endl;
+	if (GetFileSize(convertfile) != streamsize)
+		ctx.error_output << "Converted replay size differs from stream" << std::endl;
+
+	// both formats play back the same car state
+	std::string states[2];
+	const std::string * files[2] = {&memfile, &streamfile};
+	for (int i = 0; i < 2; ++i)
+	{
+		Replay replay(dt);
+		if (!replay.StartPlaying(*files[i], ctx.error_output))
+			return;
+		replay.Seek(0, &car, 1, world);
+		t0 = microbench::getTime();
+		PlayReplay(replay, frames - 1, car, world, dt);
+		ctx.info_output << (i ? "v20" : "v17") << " playback " << microbench::getTime() - t0 << " s" << std::endl;
+		states[i] = Replay::SerializeCar(car);
+	}
+	if (states[0] != states[1])
+		ctx.error_output << "Car state after v20 playback differs from v17" << std::endl;
+
+	std::remove(memfile.c_str());
+	std::remove(streamfile.c_str());
+	std::remove(convertfile.c_str());
+}
+
+// analyze two replays on worker threads, loading content concurrently must not deadlock
+MICROBENCH(replayanalyzer)
+{
+	std::vector<std::string> tracks;
+	microbench::getDataFiles(ctx, microbench::TRACKS, "", "track.txt", tracks);
+	if (tracks.empty())
+	{
+		ctx.error_output << "No track found" << std::endl;
+		return;
+	}
+	const std::string trackdir = tracks[0].substr(0, tracks[0].rfind('/'));
+	const std::string trackname = trackdir.substr(trackdir.rfind('/') + 1);
+	ctx.info_output << "Track: " << trackname << std::endl;
+
+	std::tr1::shared_ptr<PTree> cfg;
+	std::string cardir;
+	if (!FindCar(ctx, cfg, cardir))
+		return;
+
+	std::vector<CarInfo> carinfo(1);
+	std::ostringstream carconfig;
+	write_ini(*cfg, carconfig);
+	carinfo[0].config = carconfig.str();
+	carinfo[0].driver = "user";
+	carinfo[0].name = cardir.substr(cardir.rfind('/') + 1);
+
+	// two short recordings of the car, the analyzer puts it on the track start
+	const float dt = 1 / 90.0;
+	const std::string folder = ctx.paths.GetTemporaryFolder() + "/replayanalyzer";
+	PathManager::MakeDir(folder);
+	const char * names[] = {"/a.vdr", "/b.vdr"};
+	for (int i = 0; i < 2; ++i)
+	{
+		PlaneCar plane(dt);
+		if (!plane.Load(ctx))
+			return;
+		Replay replay(dt);
+		replay.StartRecording(carinfo, trackname, Replay::Setup(), folder + "/replay.tmp", ctx.error_output);
+		plane.Record(replay, 300);
+		replay.StopRecording(folder + names[i]);
+	}
+
+	// headless like -analyzereplays, with at least two workers
+	Factory<Texture> & textures = ctx.content.getFactory<Texture>();
+	const bool headless = textures.getHeadless();
+	textures.setHeadless(true);
+	JobSystem & jobs = JobSystem::instance();
+	const bool init_jobs = jobs.GetNumThreads() < 2;
+	if (init_jobs)
+		jobs.Init(3);
+
+	Settings settings;
+	ReplayAnalyzer analyzer(ctx.content, ctx.paths, settings, dt);
+	const double t0 = microbench::getTime();
+	const bool analyzed = analyzer.Run(folder, ctx.info_output, ctx.error_output);
+	ctx.info_output << "Analyzed on " << jobs.GetNumThreads() << " threads in ";
+	ctx.info_output << microbench::getTime() - t0 << " s" << std::endl;
+	if (!analyzed)
+		ctx.error_output << "Replay analysis failed" << std::endl;
+
+	if (init_jobs)
+		jobs.Deinit();
+	textures.setHeadless(headless);
+	ctx.content.sweep();
+
+	PathManager::RemoveFile(folder + names[0]);
+	PathManager::RemoveFile(folder + names[1]);
+	PathManager::RemoveFile(folder + "/replays.csv");
+	PathManager::RemoveFile(folder + "/replays.json");
+}
+
+// binary round trips of object through the virtual and the template serializers
+template <class T>
+static void BenchSerialize(const char * name, T & object, T & copy, int count, microbench::Context & ctx)
+{
+	std::string stream_data;
+	double t0 = microbench::getTime();
+	for (int n = 0; n < count; ++n)
+	{
+		std::ostringstream outstream;
+		joeserialize::BinaryOutputSerializer serialize_output(outstream);
+		object.Serialize(serialize_output);
+		stream_data = outstream.str();
+	}
+	const double write_virtual = microbench::getTime() - t0;
+
+	t0 = microbench::getTime();
+	for (int n = 0; n < count; ++n)
+	{
+		std::istringstream instream(stream_data);
+		joeserialize::BinaryInputSerializer serialize_input(instream);
+		copy.Serialize(serialize_input);
+	}
+	const double read_virtual = microbench::getTime() - t0;
+
+	std::string data;
+	t0 = microbench::getTime();
+	for (int n = 0; n < count; ++n)
+	{
+		data.clear();
+		joeserialize::BinaryWriter serialize_output(data);
+		object.Serialize(serialize_output);
+	}
+	const double write_template = microbench::getTime() - t0;
+
+	t0 = microbench::getTime();
+	for (int n = 0; n < count; ++n)
+	{
+		joeserialize::BinaryReader serialize_input(data);
+		copy.Serialize(serialize_input);
+	}
+	const double read_template = microbench::getTime() - t0;
+
+	ctx.info_output << name << " " << data.size() << " bytes, write ";
+	ctx.info_output << write_virtual / count * 1E6 << " us virtual, ";
+	ctx.info_output << write_template / count * 1E6 << " us template, speedup ";
+	ctx.info_output << write_virtual / write_template << ", read ";
+	ctx.info_output << read_virtual / count * 1E6 << " us virtual, ";
+	ctx.info_output << read_template / count * 1E6 << " us template, speedup ";
+	ctx.info_output << read_virtual / read_template << std::endl;
+	if (data != stream_data)
+		ctx.error_output << name << " template serialization is not byte compatible" << std::endl;
+}
+
+// template serialization fast path against the virtual serializers
+MICROBENCH(serialization)
+{
+	const float dt = 1 / 90.0;
+	PlaneCar plane(dt);
+	if (!plane.Load(ctx))
+		return;
+
+	CarDynamics & car = plane.GetCar();
+
+	// two minutes of driving in a replay
+	Replay replay(dt), replay_copy(dt);
+	replay.StartRecording(std::vector<CarInfo>(1), "plane", Replay::Setup(), "", ctx.error_output);
+	plane.Record(replay, 2 * 60 * 90);
+
+	// 256 x 256 vertex grid
+	const unsigned size = 256;
+	std::vector<float> vertices, texcoords, normals;
+	std::vector<unsigned int> faces;
+	for (unsigned y = 0; y < size; ++y)
+	{
+		for (unsigned x = 0; x < size; ++x)
+		{
+			vertices.push_back(x);
+			vertices.push_back(y);
+			vertices.push_back(std::sin(x * 0.1f) * std::cos(y * 0.1f));
+			texcoords.push_back(x / float(size));
+			texcoords.push_back(y / float(size));
+			normals.push_back(0);
+			normals.push_back(0);
+			normals.push_back(1);
+			if (x + 1 == size || y + 1 == size)
+				continue;
+			const unsigned i = y * size + x;
+			const unsigned quad[] = {i, i + 1, i + size, i + 1, i + size + 1, i + size};
+			faces.insert(faces.end(), quad, quad + 6);
+		}
+	}
+	VertexArray varray;
+	varray.Add(
+		&faces[0], faces.size(),
+		&vertices[0], vertices.size(),
+		&texcoords[0], texcoords.size(),
+		&normals[0], normals.size());
+	Model model, model_copy;
+	model.Load(varray, ctx.error_output);
+
+	const std::string state = Replay::SerializeCar(car);
+	BenchSerialize("CarDynamics", car, car, 10000, ctx);
+	if (Replay::SerializeCar(car) != state)
+		ctx.error_output << "Car state changed by serialization" << std::endl;
+	BenchSerialize("Replay", replay, replay_copy, 20, ctx);
+	BenchSerialize("Model", model, model_copy, 20, ctx);
+
+	replay.Reset();
+}
+
+// telemetry sampling cost against the simulation step, 20 cars at 360 Hz
+MICROBENCH(telemetry)
+{
+	std::tr1::shared_ptr<PTree> cfg;
+	std::string cardir;
+	if (!FindCar(ctx, cfg, cardir))
+		return;
+
+	const float dt = 1 / 360.0;
+	const int count = 20;
+	const int steps = 3600;
+	PlaneWorld plane_world(dt);
+	DynamicsWorld & world = plane_world.world;
+
+	btAlignedObjectArray<CarDynamics> cars;
+	std::vector<std::vector<float> > inputs;
+	if (!LoadCarGrid(*cfg, cardir, count, world, ctx.content, cars, inputs, ctx.error_output))
+	{
+		ctx.error_output << "Failed to load car" << std::endl;
+		return;
+	}
+
+	Telemetry telemetry;
+	std::vector<CarTelemetry> car_telemetry(count);
+	for (int i = 0; i < count; ++i)
+	{
+		std::ostringstream prefix;
+		prefix << "car" << i << ".";
+		car_telemetry[i].Register(telemetry, prefix.str());
+	}
+
+	const std::string filename = ctx.paths.GetTemporaryFolder() + "/telemetry.tlm";
+	if (!telemetry.Start(filename, ctx.error_output))
+		return;
+
+	double step_time = 0;
+	double sample_time = 0;
+	for (int n = 0; n < steps; ++n)
+	{
+		double t0 = microbench::getTime();
+		for (int i = 0; i < count; ++i)
+		{
+			cars[i].Update(inputs[i]);
+		}
+		world.update(dt);
+		double t1 = microbench::getTime();
+		for (int i = 0; i < count; ++i)
+		{
+			car_telemetry[i].Sample(cars[i], telemetry);
+		}
+		telemetry.Update(dt);
+		double t2 = microbench::getTime();
+		step_time += t1 - t0;
+		sample_time += t2 - t1;
+	}
+	const bool written = telemetry.Stop();
+
+	std::vector<std::string> channels;
+	std::vector<std::vector<float> > columns;
+	const bool read = written && Telemetry::Read(filename, channels, columns, ctx.error_output);
+	const size_t frames = read ? columns[0].size() : 0;
+
+	ctx.info_output << count << " cars, " << CarTelemetry::channels << " channels per car" << std::endl;
+	ctx.info_output << "Step " << step_time / steps * 1E3 << " ms, telemetry " << sample_time / steps * 1E6 << " us, ";
+	ctx.info_output << "overhead " << sample_time / step_time * 100 << " %" << std::endl;
+	const bool target = CarTelemetry::channels >= 50 && sample_time < step_time * 0.01;
+	ctx.info_output << "Target below 1% of step time at 50 channels x 20 cars ";
+	ctx.info_output << (target ? "met" : "missed") << std::endl;
+	ctx.info_output << "Written " << frames << " of " << steps << " frames, dropped " << telemetry.GetDropped() << std::endl;
+
+	cars.clear();
+	std::remove(filename.c_str());
+}
@@ -42,7 +42,7 @@ private:
 	TrackSurface surface;
 
 	std::vector<float> carinput;
-	std::string carstate;
+	CarDynamics::Snapshot carstate;
 	CarDynamics car;
 
 	/// flat plane test track
@@ -127,13 +127,33 @@ class CarBrake
 			return brake_factor;
 		}
 
-		bool Serialize(joeserialize::Serializer & s)
+		template <class S>
+		bool Serialize(S & s)
 		{
 			_SERIALIZE_(s, brake_factor);
 			_SERIALIZE_(s, handbrake_factor);
 			return true;
 		}
 
+		/// dynamic state, plain old data
+		struct State
+		{
+			btScalar brake_factor;
+			btScalar handbrake_factor;
+		};
+
+		void GetState(State & s) const
+		{
+			s.brake_factor = brake_factor;
+			s.handbrake_factor = handbrake_factor;
+		}
+
+		void SetState(const State & s)
+		{
+			brake_factor = s.brake_factor;
+			handbrake_factor = s.handbrake_factor;
+		}
+
 		void SetHandbrake(const btScalar & value)
 		{
 			handbrake = value;
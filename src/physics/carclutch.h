@@ -117,12 +117,32 @@ public:
 		return last_torque;
 	}
 
-	bool Serialize(joeserialize::Serializer & s)
+	template <class S>
+	bool Serialize(S & s)
 	{
 		_SERIALIZE_(s, clutch_position);
 		_SERIALIZE_(s, locked);
 		return true;
 	}
+
+	/// dynamic state, plain old data
+	struct State
+	{
+		btScalar clutch_position;
+		bool locked;
+	};
+
+	void GetState(State & s) const
+	{
+		s.clutch_position = clutch_position;
+		s.locked = locked;
+	}
+
+	void SetState(const State & s)
+	{
+		clutch_position = s.clutch_position;
+		locked = s.locked;
+	}
 };
 
 #endif
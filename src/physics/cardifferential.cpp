@@ -108,7 +108,8 @@ btScalar CarDifferential::GetFinalDrive() const
 	return final_drive;
 }
 
-bool CarDifferential::Serialize(joeserialize::Serializer & s)
+template <class S>
+bool CarDifferential::Serialize(S & s)
 {
 	_SERIALIZE_(s, side1_speed);
 	_SERIALIZE_(s, side2_speed);
@@ -116,3 +117,21 @@ bool CarDifferential::Serialize(joeserialize::Serializer & s)
 	_SERIALIZE_(s, side2_torque);
 	return true;
 }
+
+_SERIALIZE_INSTANTIATE_(CarDifferential);
+
+void CarDifferential::GetState(State & s) const
+{
+	s.side1_speed = side1_speed;
+	s.side2_speed = side2_speed;
+	s.side1_torque = side1_torque;
+	s.side2_torque = side2_torque;
+}
+
+void CarDifferential::SetState(const State & s)
+{
+	side1_speed = s.side1_speed;
+	side2_speed = s.side2_speed;
+	side1_torque = s.side1_torque;
+	side2_torque = s.side2_torque;
+}
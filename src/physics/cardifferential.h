@@ -56,7 +56,21 @@ public:
 
 	btScalar GetFinalDrive() const;
 
-	bool Serialize(joeserialize::Serializer & s);
+	template <class S>
+	bool Serialize(S & s);
+
+	/// dynamic state, plain old data
+	struct State
+	{
+		btScalar side1_speed;
+		btScalar side2_speed;
+		btScalar side1_torque;
+		btScalar side2_torque;
+	};
+
+	void GetState(State & s) const;
+
+	void SetState(const State & s);
 
 private:
 	// Constants (not actually declared as const because they can be changed after object creation).
@@ -24,12 +24,14 @@
 #include "fracturebody.h"
 #include "loadcollisionshape.h"
 #include "coordinatesystem.h"
+#include "tiretable.h"
 #include "content/contentmanager.h"
 #include "cfg/ptree.h"
 #include "macros.h"
 
 #include "BulletCollision/CollisionShapes/btCompoundShape.h"
 #include "BulletCollision/CollisionShapes/btCylinderShape.h"
+#include <cmath>
 
 template<class T>
 static inline bool isnan(const T & x)
@@ -525,6 +527,22 @@ bool CarDynamics::Load(
 		return false;
 	}
 
+	// optional adaptive substepping, legacy fixed 10 substeps by default
+	cfg.get("substeps-max", substeps_max);
+	substeps_min = substeps_max;
+	cfg.get("substeps-min", substeps_min);
+	if (substeps_max < 1 || substeps_min < 1 || substeps_min > substeps_max)
+	{
+		error << "Invalid substeps range: " << substeps_min << ", " << substeps_max << std::endl;
+		return false;
+	}
+
+#ifdef VDRIFTN
+	// optional precomputed tire forces: linear, cubic
+	std::string tire_table;
+	cfg.get("tire-table", tire_table);
+#endif
+
 	int i = 0;
 	for (PTree::const_iterator it = cfg_wheels->begin(); it != cfg_wheels->end(); ++it, ++i)
 	{
@@ -540,6 +558,16 @@ bool CarDynamics::Load(
 		#endif
 		content.load(cfg_tire, cardir, tirestr);
 		if (!LoadTire(cfg_wheel, *cfg_tire, tire[i], error)) return false;
+		#ifdef VDRIFTN
+		if (!tire_table.empty())
+		{
+			// tables are shared by all tires with the same parameters
+			std::tr1::shared_ptr<TireTable> table;
+			const TireInfo & info = tire[i].getInfo();
+			if (content.load(table, "", TireTable::getName(tirestr, info), info))
+				tire[i].setTable(table, tire_table == "cubic");
+		}
+		#endif
 
 		const PTree * cfg_brake;
 		if (!cfg_wheel.get("brake", cfg_brake, error)) return false;
@@ -557,6 +585,15 @@ bool CarDynamics::Load(
 		loadBody(cfg_wheel, error, shape, mass, true);
 	}
 
+#ifdef VDRIFTN
+	// table lookups are evaluated per tire
+	tire_batch.clear();
+	for (int i = 0; i < WHEEL_POSITION_SIZE && tire_table.empty(); ++i)
+	{
+		tire_batch.add(tire[i].getInfo());
+	}
+#endif
+
 	// load children bodies
 	for (PTree::const_iterator it = cfg.begin(); it != cfg.end(); ++it)
 	{
@@ -891,6 +928,11 @@ btScalar CarDynamics::GetAeordynamicDragCoefficient() const
 	return coeff;
 }
 
+const CarDynamics::SubstepStats & CarDynamics::GetSubstepStats() const
+{
+	return substep_stats;
+}
+
 btScalar CarDynamics::GetFeedback() const
 {
 	return feedback;
@@ -949,6 +991,8 @@ void CarDynamics::DebugPrint ( std::ostream & out, bool p1, bool p2, bool p3, bo
 		out << "Center of mass: " << -GetCenterOfMassOffset() << "\n";
 		out << "Total mass: " << 1 / body->getInvMass() << "\n";
 		out << "VelocityL: " << body->getCenterOfMassTransform().getBasis().transpose() * GetVelocity() << "\n";
+		out << "Substeps: " << substep_stats.last << " (" << substep_stats.min << " - " << substep_stats.max << ", avg ";
+		out << (substep_stats.steps ? btScalar(substep_stats.substeps) / substep_stats.steps : 0) << ")\n";
 		out << "\n";
 		fuel_tank.DebugPrint ( out );
 		out << "\n";
@@ -1032,7 +1076,8 @@ void CarDynamics::DebugPrint ( std::ostream & out, bool p1, bool p2, bool p3, bo
 	}
 }
 
-static bool serialize(joeserialize::Serializer & s, btQuaternion & q)
+template <class S>
+static bool serialize(S & s, btQuaternion & q)
 {
 	_SERIALIZE_(s, q[0]);
 	_SERIALIZE_(s, q[1]);
@@ -1041,7 +1086,8 @@ static bool serialize(joeserialize::Serializer & s, btQuaternion & q)
 	return true;
 }
 
-static bool serialize(joeserialize::Serializer & s, btVector3 & v)
+template <class S>
+static bool serialize(S & s, btVector3 & v)
 {
 	_SERIALIZE_(s, v[0]);
 	_SERIALIZE_(s, v[1]);
@@ -1049,7 +1095,8 @@ static bool serialize(joeserialize::Serializer & s, btVector3 & v)
 	return true;
 }
 
-static bool serialize(joeserialize::Serializer & s, btMatrix3x3 & m)
+template <class S>
+static bool serialize(S & s, btMatrix3x3 & m)
 {
 	if (!serialize(s, m[0])) return false;
 	if (!serialize(s, m[1])) return false;
@@ -1057,14 +1104,16 @@ static bool serialize(joeserialize::Serializer & s, btMatrix3x3 & m)
 	return true;
 }
 
-static bool serialize(joeserialize::Serializer & s, btTransform & t)
+template <class S>
+static bool serialize(S & s, btTransform & t)
 {
 	if (!serialize(s, t.getBasis())) return false;
 	if (!serialize(s, t.getOrigin())) return false;
 	return true;
 }
 
-static bool serialize(joeserialize::Serializer & s, btRigidBody & b)
+template <class S>
+static bool serialize(S & s, btRigidBody & b)
 {
 	btTransform t = b.getCenterOfMassTransform();
 	btVector3 v = b.getLinearVelocity();
@@ -1078,7 +1127,8 @@ static bool serialize(joeserialize::Serializer & s, btRigidBody & b)
 	return true;
 }
 
-bool CarDynamics::Serialize ( joeserialize::Serializer & s )
+template <class S>
+bool CarDynamics::Serialize(S & s)
 {
 	_SERIALIZE_(s, engine);
 	_SERIALIZE_(s, clutch);
@@ -1113,6 +1163,142 @@ bool CarDynamics::Serialize ( joeserialize::Serializer & s )
 	return true;
 }
 
+_SERIALIZE_INSTANTIATE_(CarDynamics);
+
+static inline void store(const btVector3 & v, btScalar s[3])
+{
+	s[0] = v[0];
+	s[1] = v[1];
+	s[2] = v[2];
+}
+
+static inline void load(const btScalar s[3], btVector3 & v)
+{
+	v.setValue(s[0], s[1], s[2]);
+}
+
+static inline void store(const btQuaternion & q, btScalar s[4])
+{
+	s[0] = q[0];
+	s[1] = q[1];
+	s[2] = q[2];
+	s[3] = q[3];
+}
+
+static inline void load(const btScalar s[4], btQuaternion & q)
+{
+	q.setValue(s[0], s[1], s[2], s[3]);
+}
+
+// store basis rows and origin, no quaternion round trip
+static inline void store(const btTransform & t, btScalar s[12])
+{
+	store(t.getBasis()[0], s);
+	store(t.getBasis()[1], s + 3);
+	store(t.getBasis()[2], s + 6);
+	store(t.getOrigin(), s + 9);
+}
+
+static inline void load(const btScalar s[12], btTransform & t)
+{
+	t.getBasis().setValue(
+		s[0], s[1], s[2],
+		s[3], s[4], s[5],
+		s[6], s[7], s[8]);
+	t.getOrigin().setValue(s[9], s[10], s[11]);
+}
+
+void CarDynamics::GetSnapshot(Snapshot & s) const
+{
+	engine.GetState(s.engine);
+	clutch.GetState(s.clutch);
+	transmission.GetState(s.transmission);
+	differential_front.GetState(s.differential_front);
+	differential_rear.GetState(s.differential_rear);
+	differential_center.GetState(s.differential_center);
+	fuel_tank.GetState(s.fuel_tank);
+	for (int i = 0; i < WHEEL_POSITION_SIZE; ++i)
+	{
+		brake[i].GetState(s.brake[i]);
+		wheel[i].GetState(s.wheel[i]);
+		tire[i].getState(s.tire[i]);
+		suspension[i]->GetState(s.suspension[i]);
+		store(wheel_velocity[i], s.wheel_velocity[i]);
+		store(wheel_position[i], s.wheel_position[i]);
+		store(wheel_orientation[i], s.wheel_orientation[i]);
+		s.abs_active[i] = abs_active[i];
+		s.tcs_active[i] = tcs_active[i];
+	}
+	store(body->getCenterOfMassTransform(), s.body_transform);
+	store(body->getLinearVelocity(), s.body_linear_velocity);
+	store(body->getAngularVelocity(), s.body_angular_velocity);
+	store(transform, s.transform);
+	store(linear_velocity, s.linear_velocity);
+	store(angular_velocity, s.angular_velocity);
+	s.driveshaft_rpm = driveshaft_rpm;
+	s.tacho_rpm = tacho_rpm;
+	s.remaining_shift_time = remaining_shift_time;
+	s.clutch_value = clutch_value;
+	s.brake_value = brake_value;
+	s.shift_gear = shift_gear;
+	s.shifted = shifted;
+	s.autoshift = autoshift;
+	s.abs = abs;
+	s.tcs = tcs;
+}
+
+void CarDynamics::SetSnapshot(const Snapshot & s)
+{
+	engine.SetState(s.engine);
+	clutch.SetState(s.clutch);
+	transmission.SetState(s.transmission);
+	differential_front.SetState(s.differential_front);
+	differential_rear.SetState(s.differential_rear);
+	differential_center.SetState(s.differential_center);
+	fuel_tank.SetState(s.fuel_tank);
+	for (int i = 0; i < WHEEL_POSITION_SIZE; ++i)
+	{
+		brake[i].SetState(s.brake[i]);
+		wheel[i].SetState(s.wheel[i]);
+		tire[i].setState(s.tire[i]);
+		suspension[i]->SetState(s.suspension[i]);
+		abs_active[i] = s.abs_active[i];
+		tcs_active[i] = s.tcs_active[i];
+	}
+
+	btTransform t;
+	btVector3 v, w;
+	load(s.body_transform, t);
+	load(s.body_linear_velocity, v);
+	load(s.body_angular_velocity, w);
+	body->setCenterOfMassTransform(t);
+	body->setLinearVelocity(v);
+	body->setAngularVelocity(w);
+	load(s.transform, transform);
+	load(s.linear_velocity, linear_velocity);
+	load(s.angular_velocity, angular_velocity);
+	driveshaft_rpm = s.driveshaft_rpm;
+	tacho_rpm = s.tacho_rpm;
+	remaining_shift_time = s.remaining_shift_time;
+	clutch_value = s.clutch_value;
+	brake_value = s.brake_value;
+	shift_gear = s.shift_gear;
+	shifted = s.shifted;
+	autoshift = s.autoshift;
+	abs = s.abs;
+	tcs = s.tcs;
+
+	// child bodies and graphics state, the world might not be stepped
+	UpdateWheelTransform();
+	for (int i = 0; i < WHEEL_POSITION_SIZE; ++i)
+	{
+		load(s.wheel_velocity[i], wheel_velocity[i]);
+		load(s.wheel_position[i], wheel_position[i]);
+		load(s.wheel_orientation[i], wheel_orientation[i]);
+	}
+	body->getMotionState()->setWorldTransform(t);
+}
+
 btVector3 CarDynamics::GetDownVector() const
 {
 	return -body->getCenterOfMassTransform().getBasis().getColumn(2);
@@ -1353,8 +1539,8 @@ btVector3 CarDynamics::ApplySuspensionForceToBody ( int i, btScalar dt, btVector
 	return suspension_force;
 }
 
-btVector3 CarDynamics::ComputeTireFrictionForce (int i, btScalar dt, btScalar normal_force,
-        btScalar rotvel, const btVector3 & linvel, const btQuaternion & wheel_orientation)
+void CarDynamics::ComputeTireInput (int i, const btVector3 & linvel, const btQuaternion & wheel_orientation,
+	btScalar & camber, btScalar & lonvel, btScalar & latvel, btScalar & friction_coeff) const
 {
 	btMatrix3x3 wheel_mat(wheel_orientation);
 	btVector3 xw = wheel_mat.getColumn(0);
@@ -1366,22 +1552,58 @@ btVector3 CarDynamics::ComputeTireFrictionForce (int i, btScalar dt, btScalar no
 	btVector3 x = (xw - z * coszxw).normalized();
 	btVector3 y = (yw - z * coszyw).normalized();
 
-	btScalar camber = M_PI_2 - btAcos(coszxw);
-	btScalar lonvel = y.dot(linvel);
-	btScalar latvel = -x.dot(linvel);
+	camber = M_PI_2 - btAcos(coszxw);
+	lonvel = y.dot(linvel);
+	latvel = -x.dot(linvel);
 
-	btScalar friction_coeff =
+	friction_coeff =
 		tire[i].getTread() * wheel_contact[i].GetSurface().frictionTread +
 		(1.0 - tire[i].getTread()) * wheel_contact[i].GetSurface().frictionNonTread;
+}
 
-	btVector3 friction_force = tire[i].getForce(
-		normal_force, friction_coeff, camber, rotvel, lonvel, latvel);
+btVector3 CarDynamics::ComputeTireFrictionForce (int i, btScalar dt, btScalar normal_force,
+        btScalar rotvel, const btVector3 & linvel, const btQuaternion & wheel_orientation)
+{
+	btVector3 friction_force;
+#ifdef VDRIFTN
+	if (tire_batch.size() > 0)
+	{
+		// input has been evaluated by ComputeTireFrictionForces
+		friction_force = tire[i].getForce(tire_batch, i);
+	}
+	else
+#endif
+	{
+		btScalar camber, lonvel, latvel, friction_coeff;
+		ComputeTireInput(i, linvel, wheel_orientation, camber, lonvel, latvel, friction_coeff);
+
+		friction_force = tire[i].getForce(
+			normal_force, friction_coeff, camber, rotvel, lonvel, latvel);
+	}
 
 	for (int n = 0; n < 3; ++n) assert(!isnan(friction_force[n]));
 
 	return friction_force;
 }
 
+#ifdef VDRIFTN
+void CarDynamics::ComputeTireFrictionForces()
+{
+	if (tire_batch.size() == 0)
+		return;
+
+	for (int i = 0; i < WHEEL_POSITION_SIZE; ++i)
+	{
+		btScalar normal_force = suspension_force[i].length();
+		btScalar rotvel = wheel[i].GetAngularVelocity() * wheel[i].GetRadius();
+		btScalar camber, lonvel, latvel, friction_coeff;
+		ComputeTireInput(i, wheel_velocity[i], wheel_orientation[i], camber, lonvel, latvel, friction_coeff);
+		tire_batch.setInput(i, normal_force, friction_coeff, camber, rotvel, lonvel, latvel);
+	}
+	tire_batch.getForces();
+}
+#endif
+
 void CarDynamics::ApplyWheelForces ( btScalar dt, btScalar wheel_drive_torque, int i, const btVector3 & suspension_force, btVector3 & force, btVector3 & torque )
 {
 	btScalar normal_force = suspension_force.length();
@@ -1488,6 +1710,10 @@ void CarDynamics::ApplyForces ( btScalar dt, const btVector3 & ext_force, const
 		}
 	}
 
+#ifdef VDRIFTN
+	ComputeTireFrictionForces();
+#endif
+
 	//compute wheel forces
 	for ( int i = 0; i < WHEEL_POSITION_SIZE; ++i )
 	{
@@ -1515,6 +1741,55 @@ void CarDynamics::Tick(btScalar dt, const btVector3 & force, const btVector3 & t
 	InterpolateWheelContacts();
 }
 
+int CarDynamics::ComputeSubsteps(btScalar dt) const
+{
+	if (substeps_min == substeps_max)
+		return substeps_max;
+
+	// below rest velocity the tire slip modes are not excited
+	// brake and wheel lock torque are clamped per tick
+	const btScalar rest_velocity = 0.1;
+
+	// explicit integration is stable below 2 * time constant
+	// use half of it, one time constant as tick limit
+	btScalar h = dt;
+	btScalar sprung_mass = 0.25 / body->getInvMass();
+	bool rest = linear_velocity.length2() < rest_velocity * rest_velocity;
+	for (int i = 0; i < WHEEL_POSITION_SIZE; ++i)
+	{
+		// suspension spring and damper acting on the sprung mass
+		const CarSuspension & s = *suspension[i];
+		btScalar k = s.GetSpringConstant() + s.GetAntiRoll();
+		btScalar c = s.GetMaxDamping();
+		if (k > 0) h = btMin(h, btSqrt(sprung_mass / k));
+		if (c > 0) h = btMin(h, sprung_mass / c);
+
+		btScalar load = suspension_force[i].length();
+		if (load <= 0)
+			continue;
+
+		btScalar radius = wheel[i].GetRadius();
+		btScalar rotvel = wheel[i].GetAngularVelocity() * radius;
+		btScalar velocity = wheel_velocity[i].length();
+		if (rest && btFabs(rotvel) < rest_velocity)
+			continue;
+
+		// tire relaxation, approximate relaxation length by tire radius
+		h = btMin(h, radius / btMax(velocity, rest_velocity));
+
+		// wheel spin mode, slip stiffness Fx / sigma against wheel inertia
+		// time constant is I * v / (K * r^2)
+		btScalar slip_stiffness = tire[i].getMaxFx(load) / btMax(tire[i].getIdealSlip(), btScalar(0.01));
+		btScalar velocity_ref = btMax(btMax(velocity, btFabs(rotvel)), rest_velocity);
+		if (slip_stiffness > 0)
+			h = btMin(h, wheel[i].GetInertia() * velocity_ref / (slip_stiffness * radius * radius));
+	}
+
+	int repeats = int(std::ceil(btMin(dt / h, btScalar(substeps_max))));
+	btClamp(repeats, substeps_min, substeps_max);
+	return repeats;
+}
+
 // executed as last function(after integration) in bullet singlestepsimulation
 void CarDynamics::updateAction(btCollisionWorld * collisionWorld, btScalar dt)
 {
@@ -1527,10 +1802,18 @@ void CarDynamics::updateAction(btCollisionWorld * collisionWorld, btScalar dt)
 	btVector3 torque = body->getInvInertiaTensorWorld().inverse() * dw / dt;
 	body->setLinearVelocity(linear_velocity);
 	body->setAngularVelocity(angular_velocity);
-	UpdateWheelContacts();
+	if (!wheel_contacts_queued)
+		UpdateWheelContacts();
+	wheel_contacts_queued = false;
+
+	int repeats = ComputeSubsteps(dt);
+	substep_stats.min = substep_stats.steps ? btMin(substep_stats.min, repeats) : repeats;
+	substep_stats.max = btMax(substep_stats.max, repeats);
+	substep_stats.last = repeats;
+	substep_stats.substeps += repeats;
+	substep_stats.steps++;
 
 	feedback = 0;
-	int repeats = 10;
 	for (int i = 0; i < repeats; ++i)
 	{
 		Tick(dt / repeats, force, torque);
@@ -1571,6 +1854,34 @@ void CarDynamics::UpdateWheelContacts()
 	}
 }
 
+void CarDynamics::getRayQueries(btAlignedObjectArray<RayQuery> & queries)
+{
+	// reset transform as updateAction does, the rays are cast before it runs
+	body->setCenterOfMassTransform(transform);
+	btVector3 raydir = GetDownVector();
+	btScalar raylen = 4;
+	for (int i = 0; i < WHEEL_POSITION_SIZE; ++i)
+	{
+		btVector3 raystart = wheel_position[i] - raydir * wheel[i].GetRadius();
+		if (body->getChildBody(i)->isInWorld())
+		{
+			// wheel separated
+			wheel_contact[i] = CollisionContact(raystart, raydir, raylen, -1, 0, TrackSurface::None(), 0);
+			continue;
+		}
+
+		RayQuery query;
+		query.position = raystart;
+		query.direction = raydir;
+		query.length = raylen;
+		query.caster = body;
+		query.contact = &wheel_contact[i];
+		query.hit = false;
+		queries.push_back(query);
+	}
+	wheel_contacts_queued = true;
+}
+
 void CarDynamics::InterpolateWheelContacts()
 {
 	btVector3 raydir = GetDownVector();
@@ -1990,6 +2301,10 @@ void CarDynamics::Init()
 	maxspeed = 0;
 	feedback_scale = 0;
 	feedback = 0;
+	wheel_contacts_queued = false;
+	substeps_min = 10;
+	substeps_max = 10;
+	substep_stats = SubstepStats();
 
 	suspension.resize(WHEEL_POSITION_SIZE, 0);
 	wheel.resize(WHEEL_POSITION_SIZE);
@@ -28,13 +28,16 @@
 #include "carsuspension.h"
 #include "carwheel.h"
 #include "cartire.h"
+#ifdef VDRIFTN
+#include "tirebatch.h"
+#endif
 #include "carbrake.h"
 #include "carwheelposition.h"
 #include "aerodevice.h"
 #include "collision_contact.h"
 #include "motionstate.h"
 #include "joeserialize.h"
-#include "BulletDynamics/Dynamics/btActionInterface.h"
+#include "dynamicsworld.h"
 
 #if (BT_BULLET_VERSION < 281)
 #define btCollisionObjectWrapper btCollisionObject
@@ -50,7 +53,7 @@ class FractureBody;
 class ContentManager;
 class PTree;
 
-class CarDynamics : public btActionInterface
+class CarDynamics : public RayQueryAction
 {
 friend class joeserialize::Serializer;
 
@@ -94,6 +97,9 @@ public:
 	void updateAction(btCollisionWorld * collisionWorld, btScalar dt);
 	void debugDraw(btIDebugDraw * debugDrawer);
 
+	// dynamics world interface, wheel contact queries
+	void getRayQueries(btAlignedObjectArray<RayQuery> & queries);
+
 	// graphics interpolated
 	btVector3 GetEnginePosition() const;
 	const btVector3 & GetPosition() const;
@@ -156,6 +162,18 @@ public:
 
 	btScalar GetFeedback() const;
 
+	// adaptive substepping statistics since load
+	struct SubstepStats
+	{
+		unsigned steps;		///< number of updateAction calls
+		unsigned substeps;	///< total number of ticks
+		int last;			///< ticks of the last step
+		int min;			///< minimum ticks per step
+		int max;			///< maximum ticks per step
+		SubstepStats() : steps(0), substeps(0), last(0), min(0), max(0) {}
+	};
+	const SubstepStats & GetSubstepStats() const;
+
 	btScalar GetTireSquealAmount(WheelPosition i) const;
 
 	// This is needed for ray casts in the AI implementation.
@@ -168,7 +186,52 @@ public:
 	// print debug info to the given ostream.  set p1, p2, etc if debug info part 1, and/or part 2, etc is desired
 	void DebugPrint(std::ostream & out, bool p1, bool p2, bool p3, bool p4) const;
 
-	bool Serialize(joeserialize::Serializer & s);
+	template <class S>
+	bool Serialize(S & s);
+
+	// fixed layout copy of the dynamic car state, plain old data
+	// a superset of the serialized state, can be memcpy'd, see CarHistory
+	struct Snapshot
+	{
+		CarEngine::State engine;
+		CarClutch::State clutch;
+		CarTransmission::State transmission;
+		CarDifferential::State differential_front;
+		CarDifferential::State differential_rear;
+		CarDifferential::State differential_center;
+		CarFuelTank::State fuel_tank;
+		CarBrake::State brake[WHEEL_POSITION_SIZE];
+		CarWheel::State wheel[WHEEL_POSITION_SIZE];
+		CarTire::State tire[WHEEL_POSITION_SIZE];
+		CarSuspension::State suspension[WHEEL_POSITION_SIZE];
+		btScalar wheel_velocity[WHEEL_POSITION_SIZE][3];
+		btScalar wheel_position[WHEEL_POSITION_SIZE][3];
+		btScalar wheel_orientation[WHEEL_POSITION_SIZE][4];
+		btScalar body_transform[12];
+		btScalar body_linear_velocity[3];
+		btScalar body_angular_velocity[3];
+		btScalar transform[12];
+		btScalar linear_velocity[3];
+		btScalar angular_velocity[3];
+		btScalar driveshaft_rpm;
+		btScalar tacho_rpm;
+		btScalar remaining_shift_time;
+		btScalar clutch_value;
+		btScalar brake_value;
+		int shift_gear;
+		bool shifted;
+		bool autoshift;
+		bool abs;
+		bool tcs;
+		bool abs_active[WHEEL_POSITION_SIZE];
+		bool tcs_active[WHEEL_POSITION_SIZE];
+	};
+
+	// copy dynamic state into snapshot, doesn't allocate
+	void GetSnapshot(Snapshot & s) const;
+
+	// restore dynamic state from snapshot, car has to be loaded
+	void SetSnapshot(const Snapshot & s);
 
 	static bool WheelContactCallback(
 		btManifoldPoint& cp,
@@ -200,6 +263,9 @@ protected:
 	btAlignedObjectArray<CarBrake> brake;
 	btAlignedObjectArray<CarWheel> wheel;
 	btAlignedObjectArray<CarTire> tire;
+#ifdef VDRIFTN
+	TireBatch tire_batch;
+#endif
 	btAlignedObjectArray<CarSuspension*> suspension;
 	btAlignedObjectArray<AeroDevice> aerodevice;
 
@@ -209,6 +275,7 @@ protected:
 	btAlignedObjectArray<btVector3> wheel_velocity;
 	btAlignedObjectArray<btVector3> wheel_position;
 	btAlignedObjectArray<btQuaternion> wheel_orientation;
+	bool wheel_contacts_queued;
 
 	enum { NONE = 0, FWD = 1, RWD = 2, AWD = 3 } drive;
 	btScalar driveshaft_rpm;
@@ -233,6 +300,11 @@ protected:
 	btScalar feedback_scale;
 	btScalar feedback;
 
+	// substep count bounds, fixed substepping if equal
+	int substeps_min;
+	int substeps_max;
+	SubstepStats substep_stats;
+
 	btVector3 GetDownVector() const;
 
 	btQuaternion LocalToWorld(const btQuaternion & local) const;
@@ -253,15 +325,26 @@ protected:
 
 	btVector3 ApplySuspensionForceToBody ( int i, btScalar dt, btVector3 & force, btVector3 & torque );
 
+	void ComputeTireInput ( int i, const btVector3 & linvel, const btQuaternion & wheel_orientation,
+		btScalar & camber, btScalar & lonvel, btScalar & latvel, btScalar & friction_coeff ) const;
+
 	btVector3 ComputeTireFrictionForce ( int i, btScalar dt, btScalar normal_force,
         btScalar rotvel, const btVector3 & linvel, const btQuaternion & wheel_orientation );
 
+#ifdef VDRIFTN
+	// evaluate tire forces of all wheels in one batch, before ApplyWheelForces
+	void ComputeTireFrictionForces ();
+#endif
+
 	void ApplyWheelForces ( btScalar dt, btScalar wheel_drive_torque, int i, const btVector3 & suspension_force, btVector3 & force, btVector3 & torque );
 
 	void ApplyForces ( btScalar dt, const btVector3 & force, const btVector3 & torque);
 
 	void Tick ( btScalar dt, const btVector3 & force, const btVector3 & torque);
 
+	// number of ticks to stably integrate tire and suspension over dt
+	int ComputeSubsteps ( btScalar dt ) const;
+
 	void UpdateWheelContacts();
 
 	void InterpolateWheelContacts();
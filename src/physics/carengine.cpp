@@ -243,7 +243,8 @@ void CarEngine::DebugPrint(std::ostream & out) const
 	out << "Running: " << !stalled << "\n";
 }
 
-bool CarEngine::Serialize(joeserialize::Serializer & s)
+template <class S>
+bool CarEngine::Serialize(S & s)
 {
 	_SERIALIZE_(s, shaft.ang_velocity);
 	_SERIALIZE_(s, throttle_position);
@@ -252,3 +253,27 @@ bool CarEngine::Serialize(joeserialize::Serializer & s)
 	_SERIALIZE_(s, rev_limit_exceeded);
 	return true;
 }
+
+_SERIALIZE_INSTANTIATE_(CarEngine);
+
+void CarEngine::GetState(State & s) const
+{
+	s.ang_velocity = shaft.ang_velocity;
+	s.throttle_position = throttle_position;
+	s.clutch_torque = clutch_torque;
+	s.nos_mass = nos_mass;
+	s.out_of_gas = out_of_gas;
+	s.rev_limit_exceeded = rev_limit_exceeded;
+	s.stalled = stalled;
+}
+
+void CarEngine::SetState(const State & s)
+{
+	shaft.ang_velocity = s.ang_velocity;
+	throttle_position = s.throttle_position;
+	clutch_torque = s.clutch_torque;
+	nos_mass = s.nos_mass;
+	out_of_gas = s.out_of_gas;
+	rev_limit_exceeded = s.rev_limit_exceeded;
+	stalled = s.stalled;
+}
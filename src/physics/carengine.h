@@ -191,7 +191,24 @@ public:
 
 	void DebugPrint(std::ostream & out) const;
 
-	bool Serialize(joeserialize::Serializer & s);
+	template <class S>
+	bool Serialize(S & s);
+
+	/// dynamic state, plain old data
+	struct State
+	{
+		btScalar ang_velocity;
+		btScalar throttle_position;
+		btScalar clutch_torque;
+		btScalar nos_mass;
+		bool out_of_gas;
+		bool rev_limit_exceeded;
+		bool stalled;
+	};
+
+	void GetState(State & s) const;
+
+	void SetState(const State & s);
 
 private:
 	CarEngineInfo info;
@@ -104,13 +104,33 @@ public:
 		volume = mass / density;
 	}
 
-	bool Serialize(joeserialize::Serializer & s)
+	template <class S>
+	bool Serialize(S & s)
 	{
 		_SERIALIZE_(s, mass);
 		_SERIALIZE_(s, volume);
 		return true;
 	}
 
+	/// dynamic state, plain old data
+	struct State
+	{
+		btScalar mass;
+		btScalar volume;
+	};
+
+	void GetState(State & s) const
+	{
+		s.mass = mass;
+		s.volume = volume;
+	}
+
+	void SetState(const State & s)
+	{
+		mass = s.mass;
+		volume = s.volume;
+	}
+
 private:
 	//constants (not actually declared as const because they can be changed after object creation)
 	btScalar capacity;
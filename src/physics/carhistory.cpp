@@ -0,0 +1,156 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "carhistory.h"
+#include "unittest.h"
+
+#include <cassert>
+
+CarHistory::CarHistory() :
+	cars(0),
+	capacity(0),
+	head(0),
+	frames(0)
+{
+	// ctor
+}
+
+void CarHistory::Init(int new_cars, int new_frames)
+{
+	assert(new_cars >= 0 && new_frames >= 0);
+	cars = new_cars;
+	capacity = new_frames;
+	snapshots.resize(cars * capacity);
+	Clear();
+}
+
+void CarHistory::Clear()
+{
+	head = 0;
+	frames = 0;
+}
+
+int CarHistory::GetCars() const
+{
+	return cars;
+}
+
+int CarHistory::GetFrames() const
+{
+	return frames;
+}
+
+int CarHistory::GetCapacity() const
+{
+	return capacity;
+}
+
+CarDynamics::Snapshot * CarHistory::Push()
+{
+	if (!capacity || !cars)
+		return 0;
+
+	CarDynamics::Snapshot * frame = &snapshots[head * cars];
+	head = (head + 1) % capacity;
+	if (frames < capacity)
+		frames++;
+	return frame;
+}
+
+const CarDynamics::Snapshot * CarHistory::Pop(int steps)
+{
+	if (steps > frames)
+		steps = frames;
+	if (steps <= 0)
+		return 0;
+
+	head = (head - steps + capacity) % capacity;
+	frames -= steps;
+	return &snapshots[head * cars];
+}
+
+void CarHistory::Record(const CarDynamics car[], int count)
+{
+	CarDynamics::Snapshot * frame = Push();
+	if (!frame)
+		return;
+
+	assert(count == GetCars());
+	for (int i = 0; i < count; ++i)
+	{
+		car[i].GetSnapshot(frame[i]);
+	}
+}
+
+int CarHistory::Rewind(CarDynamics car[], int count, int steps)
+{
+	if (steps > frames)
+		steps = frames;
+
+	const CarDynamics::Snapshot * frame = Pop(steps);
+	if (!frame)
+		return 0;
+
+	assert(count == GetCars());
+	for (int i = 0; i < count; ++i)
+	{
+		car[i].SetSnapshot(frame[i]);
+	}
+	return steps;
+}
+
+QT_TEST(carhistory_test)
+{
+	CarHistory history;
+	QT_CHECK(!history.Push());
+	QT_CHECK(!history.Pop());
+
+	// frame n car c is tagged with clutch value n * 10 + c
+	history.Init(2, 4);
+	for (int n = 0; n < 6; ++n)
+	{
+		CarDynamics::Snapshot * frame = history.Push();
+		QT_CHECK(frame);
+		frame[0].clutch_value = n * 10;
+		frame[1].clutch_value = n * 10 + 1;
+	}
+	QT_CHECK_EQUAL(history.GetFrames(), 4);
+
+	// newest frame first, oldest frames overwritten
+	const CarDynamics::Snapshot * frame = history.Pop();
+	QT_CHECK(frame);
+	QT_CHECK_EQUAL(frame[0].clutch_value, 50);
+	QT_CHECK_EQUAL(frame[1].clutch_value, 51);
+
+	frame = history.Pop(2);
+	QT_CHECK(frame);
+	QT_CHECK_EQUAL(frame[0].clutch_value, 30);
+	QT_CHECK_EQUAL(history.GetFrames(), 1);
+
+	// recording continues after the rewound frame
+	history.Push()[0].clutch_value = 100;
+	frame = history.Pop(5);
+	QT_CHECK(frame);
+	QT_CHECK_EQUAL(frame[0].clutch_value, 20);
+	QT_CHECK_EQUAL(history.GetFrames(), 0);
+	QT_CHECK(!history.Pop());
+
+	history.Clear();
+	QT_CHECK_EQUAL(history.GetCapacity(), 4);
+}
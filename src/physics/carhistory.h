@@ -0,0 +1,71 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _CARHISTORY_H
+#define _CARHISTORY_H
+
+#include "cardynamics.h"
+#include <vector>
+
+/// Ring buffer of car snapshots, one frame per simulation step.
+/// Storage is allocated once in Init, recording a frame doesn't allocate.
+class CarHistory
+{
+public:
+	CarHistory();
+
+	/// Allocate frames of cars snapshots, clears the history.
+	void Init(int cars, int frames);
+
+	/// Drop all recorded frames, keep the storage.
+	void Clear();
+
+	/// Number of cars per frame.
+	int GetCars() const;
+
+	/// Number of recorded frames.
+	int GetFrames() const;
+
+	/// Maximum number of recorded frames.
+	int GetCapacity() const;
+
+	/// Add a frame, overwrites the oldest frame when full.
+	/// Returns the frame storage, GetCars() snapshots.
+	CarDynamics::Snapshot * Push();
+
+	/// Remove the newest steps frames, the last removed frame is returned.
+	/// Steps is clamped to the recorded frames, null if there are none.
+	const CarDynamics::Snapshot * Pop(int steps = 1);
+
+	/// Record the current state of the cars.
+	void Record(const CarDynamics car[], int count);
+
+	/// Restore the cars to the state recorded steps frames back.
+	/// Newer frames are discarded, returns the number of frames rewound.
+	int Rewind(CarDynamics car[], int count, int steps);
+
+private:
+	std::vector<CarDynamics::Snapshot> snapshots;
+	int cars;
+	int capacity;
+	int head;
+	int frames;
+};
+
+#endif // _CARHISTORY_H
@@ -61,6 +61,11 @@ public:
 
 	const btScalar & GetAntiRoll() const {return info.anti_roll;}
 
+	const btScalar & GetSpringConstant() const {return info.spring_constant;}
+
+	/// maximum of bounce and rebound damping
+	btScalar GetMaxDamping() const {return btMax(info.bounce, info.rebound);}
+
 	const btScalar & GetMaxSteeringAngle() const {return info.steering_angle;}
 
 	/// wheel orientation relative to car
@@ -99,13 +104,33 @@ public:
 
 	void DebugPrint(std::ostream & out) const;
 
-	bool Serialize(joeserialize::Serializer & s)
+	template <class S>
+	bool Serialize(S & s)
 	{
 		_SERIALIZE_(s, steering_angle);
 		_SERIALIZE_(s, displacement);
 		return true;
 	}
 
+	/// dynamic state, plain old data
+	struct State
+	{
+		btScalar steering_angle;
+		btScalar displacement;
+	};
+
+	void GetState(State & s) const
+	{
+		s.steering_angle = steering_angle;
+		s.displacement = displacement;
+	}
+
+	void SetState(const State & s)
+	{
+		steering_angle = s.steering_angle;
+		displacement = s.displacement;
+	}
+
 	static bool Load(
 		const PTree & cfg_wheel,
 		CarSuspension *& suspension,
@@ -84,6 +84,19 @@ public:
 	btScalar getFy() const;
 	btScalar getMz() const;
 
+	/// cached state, plain old data
+	struct State
+	{
+		btScalar camber;
+		btScalar slide, slip;
+		btScalar ideal_slide, ideal_slip;
+		btScalar fx, fy, fz, mz;
+	};
+
+	void getState(State & s) const;
+
+	void setState(const State & s);
+
 	/// load is the normal force in newtons.
 	btScalar getMaxFx(btScalar load) const;
 
@@ -165,6 +178,32 @@ inline btScalar CarTire::getMz() const
 	return mz;
 }
 
+inline void CarTire::getState(State & s) const
+{
+	s.camber = camber;
+	s.slide = slide;
+	s.slip = slip;
+	s.ideal_slide = ideal_slide;
+	s.ideal_slip = ideal_slip;
+	s.fx = fx;
+	s.fy = fy;
+	s.fz = fz;
+	s.mz = mz;
+}
+
+inline void CarTire::setState(const State & s)
+{
+	camber = s.camber;
+	slide = s.slide;
+	slip = s.slip;
+	ideal_slide = s.ideal_slide;
+	ideal_slip = s.ideal_slip;
+	fx = s.fx;
+	fy = s.fy;
+	fz = s.fz;
+	mz = s.mz;
+}
+
 inline bool CarTire::Serialize(joeserialize::Serializer & s)
 {
 	//_SERIALIZE_(s, mz);
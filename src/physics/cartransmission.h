@@ -140,12 +140,29 @@ public:
 		out << "Driveshaft RPM: " << driveshaft_rpm << "\n";
 	}
 
-	bool Serialize(joeserialize::Serializer & s)
+	template <class S>
+	bool Serialize(S & s)
 	{
 		_SERIALIZE_(s, gear);
 		return true;
 	}
 
+	/// dynamic state, plain old data
+	struct State
+	{
+		int gear;
+	};
+
+	void GetState(State & s) const
+	{
+		s.gear = gear;
+	}
+
+	void SetState(const State & s)
+	{
+		gear = s.gear;
+	}
+
 private:
 	//constants (not actually declared as const because they can be changed after object creation)
 	std::map <int, btScalar> gear_ratios; ///< gear number and ratio.  reverse gears are negative integers. neutral is zero.
@@ -113,13 +113,33 @@ public:
 		out << "RPM: " << GetRPM() << "\n";
 	}
 
-	bool Serialize(joeserialize::Serializer & s)
+	template <class S>
+	bool Serialize(S & s)
 	{
 		_SERIALIZE_(s, shaft.ang_velocity);
 		_SERIALIZE_(s, shaft.angle);
 		return true;
 	}
 
+	/// dynamic state, plain old data
+	struct State
+	{
+		btScalar ang_velocity;
+		btScalar angle;
+	};
+
+	void GetState(State & s) const
+	{
+		s.ang_velocity = shaft.ang_velocity;
+		s.angle = shaft.angle;
+	}
+
+	void SetState(const State & s)
+	{
+		shaft.ang_velocity = s.ang_velocity;
+		shaft.angle = s.angle;
+	}
+
 private:
 	DriveShaft shaft;
 	btScalar radius;
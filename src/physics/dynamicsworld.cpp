@@ -22,8 +22,19 @@
 #include "collision_contact.h"
 #include "tobullet.h"
 #include "track.h"
+#include "jobsystem.h"
+#include "unittest.h"
 
 #include "BulletCollision/CollisionShapes/btCollisionShape.h"
+#include "LinearMath/btAabbUtil2.h"
+#include "LinearMath/btQuickprof.h"
+#include "BulletCollision/CollisionDispatch/btDefaultCollisionConfiguration.h"
+#include "BulletCollision/BroadphaseCollision/btDbvtBroadphase.h"
+#include "BulletCollision/CollisionShapes/btBoxShape.h"
+#include "BulletCollision/CollisionShapes/btSphereShape.h"
+#include "BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolver.h"
+
+#include <cstring>
 
 #define EXTBULLET
 
@@ -97,7 +108,8 @@ DynamicsWorld::DynamicsWorld(
 	btDiscreteDynamicsWorld(dispatcher, broadphase, constraintSolver, collisionConfig),
 	track(0),
 	timeStep(timeStep),
-	maxSubSteps(maxSubSteps)
+	maxSubSteps(maxSubSteps),
+	parallelActions(false)
 {
 	setGravity(btVector3(0.0, 0.0, -9.81));
 	setForceUpdateAllAabbs(false);
@@ -118,6 +130,118 @@ bool DynamicsWorld::castRay(
 	const btScalar length,
 	const btCollisionObject * caster,
 	CollisionContact & contact) const
+{
+	btVector3 p = origin + direction * length;
+	MyRayResultCallback ray(origin, p, caster);
+	rayTest(origin, p, ray);
+	return getContact(origin, direction, length, ray, contact);
+}
+
+// collects collision objects overlapping a ray packet
+struct RayPacketCallback : public btBroadphaseAabbCallback
+{
+	btAlignedObjectArray<btCollisionObject*> & objects;
+
+	RayPacketCallback(btAlignedObjectArray<btCollisionObject*> & objects) :
+		objects(objects)
+	{
+		// ctor
+	}
+
+	bool process(const btBroadphaseProxy * proxy)
+	{
+		objects.push_back(static_cast<btCollisionObject*>(proxy->m_clientObject));
+		return true;
+	}
+};
+
+// updates a range of actions, executed by the job system
+struct ActionRange : public JobRange
+{
+	btCollisionWorld * world;
+	btActionInterface ** actions;
+	btScalar dt;
+
+	ActionRange(btCollisionWorld * world, btActionInterface ** actions, btScalar dt) :
+		world(world), actions(actions), dt(dt)
+	{
+		// ctor
+	}
+
+	void Execute(int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+		{
+			actions[i]->updateAction(world, dt);
+		}
+	}
+};
+
+void DynamicsWorld::castRays(RayQuery * queries, int count) const
+{
+	btAlignedObjectArray<btCollisionObject*> objects;
+	btTransform from, to;
+	from.setIdentity();
+	to.setIdentity();
+
+	int begin = 0;
+	while (begin < count)
+	{
+		// ray packet bounds
+		const btCollisionObject * caster = queries[begin].caster;
+		btVector3 aabb_min = queries[begin].position;
+		btVector3 aabb_max = aabb_min;
+		int end = begin;
+		for (; end < count && queries[end].caster == caster; ++end)
+		{
+			const RayQuery & q = queries[end];
+			btVector3 p = q.position + q.direction * q.length;
+			aabb_min.setMin(q.position);
+			aabb_max.setMax(q.position);
+			aabb_min.setMin(p);
+			aabb_max.setMax(p);
+		}
+
+		// one broadphase query per packet
+		objects.resize(0);
+		RayPacketCallback packet(objects);
+		m_broadphasePairCache->aabbTest(aabb_min, aabb_max, packet);
+
+		for (int i = begin; i < end; ++i)
+		{
+			RayQuery & q = queries[i];
+			btVector3 p = q.position + q.direction * q.length;
+			MyRayResultCallback ray(q.position, p, caster);
+			from.setOrigin(q.position);
+			to.setOrigin(p);
+			for (int k = 0; k < objects.size(); ++k)
+			{
+				btCollisionObject * object = objects[k];
+				btBroadphaseProxy * proxy = object->getBroadphaseHandle();
+				if (object == caster || !ray.needsCollision(proxy))
+					continue;
+
+				// same culling as btCollisionWorld::rayTest
+				btScalar hit_lambda = ray.m_closestHitFraction;
+				btVector3 hit_normal;
+				if (btRayAabb(q.position, p, proxy->m_aabbMin, proxy->m_aabbMax, hit_lambda, hit_normal))
+				{
+					rayTestSingle(from, to, object, object->getCollisionShape(), object->getWorldTransform(), ray);
+				}
+			}
+			q.hit = getContact(q.position, q.direction, q.length, ray, *q.contact);
+		}
+
+		begin = end;
+	}
+}
+
+bool DynamicsWorld::getContact(
+	const btVector3 & origin,
+	const btVector3 & direction,
+	const btScalar length,
+	const MyRayResultCallback & ray,
+	CollisionContact & contact) const
 {
 	btVector3 p = origin + direction * length;
 	btVector3 n = -direction;
@@ -127,9 +251,6 @@ bool DynamicsWorld::castRay(
 	const TrackSurface * s = TrackSurface::None();
 	const btCollisionObject * c = 0;
 
-	MyRayResultCallback ray(origin, p, caster);
-	rayTest(origin, p, ray);
-
 	// track geometry collision
 	if (ray.hasHit())
 	{
@@ -181,6 +302,16 @@ bool DynamicsWorld::castRay(
 	return false;
 }
 
+void DynamicsWorld::setParallelActions(bool value)
+{
+	parallelActions = value;
+}
+
+bool DynamicsWorld::getParallelActions() const
+{
+	return parallelActions;
+}
+
 void DynamicsWorld::update(btScalar dt)
 {
 	stepSimulation(dt, maxSubSteps, timeStep);
@@ -192,6 +323,57 @@ void DynamicsWorld::debugPrint(std::ostream & out) const
 	out << "Collision objects: " << getNumCollisionObjects() << std::endl;
 }
 
+void DynamicsWorld::updateActions(btScalar timeStep)
+{
+	m_rayQueries.resize(0);
+	m_serialActions.resize(0);
+	m_parallelActions.resize(0);
+	int serialActionsBefore = 0;
+	for (int i = 0; i < m_actions.size(); ++i)
+	{
+		RayQueryAction * action = dynamic_cast<RayQueryAction*>(m_actions[i]);
+		if (action)
+		{
+			action->getRayQueries(m_rayQueries);
+			m_parallelActions.push_back(action);
+		}
+		else
+		{
+			if (m_parallelActions.size() == 0)
+				serialActionsBefore++;
+			m_serialActions.push_back(m_actions[i]);
+		}
+	}
+
+	// all rays are cast before the actions modify the world
+	if (m_rayQueries.size() > 0)
+		castRays(&m_rayQueries[0], m_rayQueries.size());
+
+	if (!parallelActions || m_parallelActions.size() < 2 || JobSystem::instance().GetNumThreads() < 2)
+	{
+		btDiscreteDynamicsWorld::updateActions(timeStep);
+		return;
+	}
+
+	BT_PROFILE("updateActions");
+
+	// keep the registration order relative to the batch of parallel actions,
+	// serial actions added before the first parallel one run before the batch
+	for (int i = 0; i < serialActionsBefore; ++i)
+	{
+		m_serialActions[i]->updateAction(this, timeStep);
+	}
+
+	// actions only touch their own state, results don't depend on the update order
+	ActionRange range(this, &m_parallelActions[0], timeStep);
+	JobSystem::instance().ParallelFor(0, m_parallelActions.size(), range);
+
+	for (int i = serialActionsBefore; i < m_serialActions.size(); ++i)
+	{
+		m_serialActions[i]->updateAction(this, timeStep);
+	}
+}
+
 void DynamicsWorld::solveConstraints(btContactSolverInfo& solverInfo)
 {
 	// todo: after fracture we should run the solver again for better realism
@@ -288,3 +470,120 @@ void DynamicsWorld::fractureCallback()
 	}
 #endif
 }
+
+// ball hovering on a ray spring, updates its own body only
+struct HoverAction : public RayQueryAction
+{
+	btRigidBody body;
+	CollisionContact contact;
+
+	HoverAction(btCollisionShape * shape, const btVector3 & position) :
+		body(1, 0, shape)
+	{
+		body.setCenterOfMassTransform(btTransform(btQuaternion::getIdentity(), position));
+		body.setActivationState(DISABLE_DEACTIVATION);
+	}
+
+	void getRayQueries(btAlignedObjectArray<RayQuery> & queries)
+	{
+		RayQuery query;
+		query.position = body.getCenterOfMassPosition();
+		query.direction = btVector3(0, 0, -1);
+		query.length = 4;
+		query.caster = &body;
+		query.contact = &contact;
+		query.hit = false;
+		queries.push_back(query);
+	}
+
+	void updateAction(btCollisionWorld *, btScalar dt)
+	{
+		// substepped nonlinear spring damper
+		const int substeps = 50;
+		btScalar h = dt / substeps;
+		btScalar depth = contact.GetDepth();
+		btVector3 v = body.getLinearVelocity();
+		for (int i = 0; i < substeps; ++i)
+		{
+			btScalar x = 2 - depth;
+			btScalar f = 40 * x * btFabs(x) - 2 * v.z() + btSin(depth * 7);
+			v.setZ(v.z() + f * h);
+			depth -= v.z() * h;
+		}
+		body.setLinearVelocity(v);
+	}
+
+	void debugDraw(btIDebugDraw *)
+	{
+		// nothing to draw
+	}
+};
+
+// runs hover actions on a ground box, returns the final ball states
+static void RunHoverWorld(bool parallel, int count, int steps, btAlignedObjectArray<btVector3> & states)
+{
+	btDefaultCollisionConfiguration config;
+	btCollisionDispatcher dispatcher(&config);
+	btDbvtBroadphase broadphase;
+	btSequentialImpulseConstraintSolver solver;
+	DynamicsWorld world(&dispatcher, &broadphase, &solver, &config);
+	world.setParallelActions(parallel);
+
+	btBoxShape ground_shape(btVector3(1000, 1000, 1));
+	btCollisionObject ground;
+	ground.setCollisionShape(&ground_shape);
+	ground.setWorldTransform(btTransform(btQuaternion::getIdentity(), btVector3(0, 0, -1)));
+	world.addCollisionObject(&ground);
+
+	btSphereShape ball_shape(0.5);
+	btAlignedObjectArray<HoverAction*> actions;
+	for (int i = 0; i < count; ++i)
+	{
+		HoverAction * action = new HoverAction(&ball_shape, btVector3(i * 3, 0, 1 + 0.1 * i));
+		world.addRigidBody(&action->body);
+		world.addAction(action);
+		actions.push_back(action);
+	}
+
+	for (int i = 0; i < steps; ++i)
+	{
+		world.stepSimulation(1 / 90.0, 1, 1 / 90.0);
+	}
+
+	states.resize(0);
+	for (int i = 0; i < count; ++i)
+	{
+		states.push_back(actions[i]->body.getCenterOfMassPosition());
+		states.push_back(actions[i]->body.getLinearVelocity());
+		world.removeAction(actions[i]);
+		world.removeRigidBody(&actions[i]->body);
+		delete actions[i];
+	}
+	world.removeCollisionObject(&ground);
+}
+
+QT_TEST(dynamicsworld_parallel_actions_test)
+{
+	const int count = 16;
+	const int steps = 200;
+	btAlignedObjectArray<btVector3> serial, parallel;
+	RunHoverWorld(false, count, steps, serial);
+
+	JobSystem & jobs = JobSystem::instance();
+	const int threads = jobs.GetNumThreads();
+	jobs.Init(4);
+	RunHoverWorld(true, count, steps, parallel);
+	jobs.Init(threads);
+	QT_CHECK_EQUAL(serial.size(), 2 * count);
+	QT_CHECK_EQUAL(parallel.size(), serial.size());
+
+	// balls have been moving, results are bit identical
+	QT_CHECK(serial[0].z() != btScalar(1));
+	for (int i = 0; i < serial.size() && i < parallel.size(); ++i)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			QT_CHECK(std::memcmp(&serial[i][k], &parallel[i][k], sizeof(btScalar)) == 0);
+		}
+	}
+}
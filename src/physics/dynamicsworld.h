@@ -21,6 +21,7 @@
 #define _DYNAMICSWORLD_H
 
 #include "BulletDynamics/Dynamics/btDiscreteDynamicsWorld.h"
+#include "BulletDynamics/Dynamics/btActionInterface.h"
 
 #include <iosfwd>
 
@@ -28,6 +29,27 @@ class Track;
 class CollisionContact;
 class FractureBody;
 class Bezier;
+struct MyRayResultCallback;
+
+struct RayQuery
+{
+	btVector3 position;
+	btVector3 direction;
+	btScalar length;
+	const btCollisionObject * caster; ///< excluded from hits
+	CollisionContact * contact; ///< result, patch id is used as warm start
+	bool hit;
+};
+
+/// action with ray queries, queries of all actions are cast in one batch before the actions update
+/// updateAction may only modify the action's own state and bodies, the world is read-only then,
+/// ray query actions are updated concurrently if action threads are enabled
+class RayQueryAction : public btActionInterface
+{
+public:
+	/// append queries for the next updateAction
+	virtual void getRayQueries(btAlignedObjectArray<RayQuery> & queries) = 0;
+};
 
 class DynamicsWorld  : public btDiscreteDynamicsWorld
 {
@@ -60,6 +82,14 @@ public:
 		const btCollisionObject * caster,
 		CollisionContact & contact) const;
 
+	// cast ray batch, consecutive rays of the same caster share broadphase queries
+	void castRays(RayQuery * queries, int count) const;
+
+	// update ray query actions in parallel on the job system
+	void setParallelActions(bool value);
+
+	bool getParallelActions() const;
+
 	void update(btScalar dt);
 
 	void draw();
@@ -75,12 +105,28 @@ protected:
 		int id;
 	};
 	btAlignedObjectArray<ActiveCon> m_activeConnections;
+	btAlignedObjectArray<RayQuery> m_rayQueries;
+	btAlignedObjectArray<btActionInterface*> m_serialActions;
+	btAlignedObjectArray<btActionInterface*> m_parallelActions;
 	const Track * track;
 	btScalar timeStep;
 	int maxSubSteps;
+	bool parallelActions;
 
 	void reset();
 
+	// batch ray queries of all actions, then update actions
+	// ray query actions are updated in parallel if enabled
+	void updateActions(btScalar timeStep);
+
+	// fill contact from ray test result, includes track bezier patch collision
+	bool getContact(
+		const btVector3 & origin,
+		const btVector3 & direction,
+		const btScalar length,
+		const MyRayResultCallback & ray,
+		CollisionContact & contact) const;
+
 	void solveConstraints(btContactSolverInfo& solverInfo);
 
 	void fractureCallback();
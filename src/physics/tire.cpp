@@ -18,6 +18,8 @@
 /************************************************************************/
 
 #include "tire.h"
+#include "tirebatch.h"
+#include "tiretable.h"
 
 template <typename T>
 inline T sgn(T val)
@@ -41,6 +43,7 @@ TireInfo::TireInfo() :
 }
 
 Tire::Tire() :
+	table_cubic(false),
 	slip(0),
 	slip_angle(0),
 	ideal_slip(0),
@@ -58,6 +61,12 @@ void Tire::init(const TireInfo & info)
 	initSigmaHatAlphaHat();
 }
 
+void Tire::setTable(const std::tr1::shared_ptr<const TireTable> & value, bool cubic)
+{
+	table = value;
+	table_cubic = cubic;
+}
+
 void Tire::getSigmaHatAlphaHat(btScalar load, btScalar & sh, btScalar & ah) const
 {
 	btScalar rload = load / max_load * tablesize - 1.0;
@@ -96,23 +105,33 @@ btVector3 Tire::getForce(
 	btScalar sigma = -lon_slip_velocity / denom;
 	btScalar alpha = btAtan(lat_velocity / denom);
 
-	// force parameters
 	btScalar Fz = normal_load;
-	btScalar Fz0 = nominal_load;
-	btScalar dFz = (Fz - Fz0) / Fz0;
-
-	// pure slip
-	btScalar Dy, BCy, Shf;
-	btScalar Fx0 = PacejkaFx(sigma, Fz, dFz, friction_coeff);
-	btScalar Fy0 = PacejkaFy(alpha, camber, Fz, dFz, friction_coeff, Dy, BCy, Shf);
-	btScalar Mz0 = PacejkaMz(alpha, camber, Fz, dFz, friction_coeff, Fy0, BCy, Shf);
-
-	// combined slip
-	btScalar Gx = PacejkaGx(sigma, alpha);
-	btScalar Gy = PacejkaGy(sigma, alpha);
-	btScalar Svy = PacejkaSvy(sigma, alpha, camber, dFz, Dy);
-	btScalar Fx = Gx * Fx0;
-	btScalar Fy = Gy * Fy0 + Svy;
+	btScalar Fx, Fy, Mz;
+	if (table)
+	{
+		TireTable::Interpolation interpolation = table_cubic ? TireTable::CUBIC : TireTable::LINEAR;
+		table->getForce(Fz, friction_coeff, camber, sigma, alpha, interpolation, Fx, Fy, Mz);
+	}
+	else
+	{
+		// force parameters
+		btScalar Fz0 = nominal_load;
+		btScalar dFz = (Fz - Fz0) / Fz0;
+
+		// pure slip
+		btScalar Dy, BCy, Shf;
+		btScalar Fx0 = PacejkaFx(sigma, Fz, dFz, friction_coeff);
+		btScalar Fy0 = PacejkaFy(alpha, camber, Fz, dFz, friction_coeff, Dy, BCy, Shf);
+		btScalar Mz0 = PacejkaMz(alpha, camber, Fz, dFz, friction_coeff, Fy0, BCy, Shf);
+
+		// combined slip
+		btScalar Gx = PacejkaGx(sigma, alpha);
+		btScalar Gy = PacejkaGy(sigma, alpha);
+		btScalar Svy = PacejkaSvy(sigma, alpha, camber, dFz, Dy);
+		Fx = Gx * Fx0;
+		Fy = Gy * Fy0 + Svy;
+		Mz = Mz0;
+	}
 
 	// ideal slip and angle
 	btScalar sigma_hat(0), alpha_hat(0);
@@ -125,11 +144,36 @@ btVector3 Tire::getForce(
 	fx = Fx;
 	fy = Fy;
 	fz = Fz;
-	mz = Mz0;
+	mz = Mz;
 	vx = lon_slip_velocity;
 	vy = lat_velocity;
 
-	return btVector3(Fx, Fy, Mz0);
+	return btVector3(Fx, Fy, Mz);
+}
+
+btVector3 Tire::getForce(const TireBatch & batch, int i)
+{
+	fz = batch.getFz(i);
+	if (fz == 0)
+	{
+		slip = slip_angle = 0;
+		ideal_slip = ideal_slip_angle = 1;
+		fx = fy = mz = 0;
+		vx = vy = 0;
+		return btVector3(0, 0, 0);
+	}
+
+	getSigmaHatAlphaHat(fz, ideal_slip, ideal_slip_angle);
+
+	slip = batch.getSlip(i);
+	slip_angle = batch.getSlipAngle(i);
+	fx = batch.getFx(i);
+	fy = batch.getFy(i);
+	mz = batch.getMz(i);
+	vx = batch.getSlipVelocityX(i);
+	vy = batch.getSlipVelocityY(i);
+
+	return btVector3(fx, fy, mz);
 }
 
 btScalar Tire::getSqueal() const
@@ -307,7 +351,7 @@ btScalar Tire::PacejkaMz(
 
 btScalar Tire::PacejkaGx(
 	btScalar sigma,
-	btScalar alpha)
+	btScalar alpha) const
 {
 	const btScalar * p = coefficients;
 	btScalar B = p[RBX1] * btCos(btAtan(p[RBX2] * sigma));
@@ -321,7 +365,7 @@ btScalar Tire::PacejkaGx(
 
 btScalar Tire::PacejkaGy(
 	btScalar sigma,
-	btScalar alpha)
+	btScalar alpha) const
 {
 	const btScalar * p = coefficients;
 	btScalar B = p[RBY1] * btCos(btAtan(p[RBY2] * (alpha - p[RBY3])));
@@ -338,7 +382,7 @@ btScalar Tire::PacejkaSvy(
 	btScalar alpha,
 	btScalar gamma,
 	btScalar dFz,
-	btScalar Dy)
+	btScalar Dy) const
 {
 	const btScalar * p = coefficients;
 	btScalar Dv = Dy * (p[RVY1] + p[RVY2] * dFz + p[RVY3] * gamma) * btCos(btAtan(p[RVY4] * alpha));
@@ -21,6 +21,10 @@
 #define _TIRE_H
 
 #include "LinearMath/btVector3.h"
+#include "memory.h"
+
+class TireBatch;
+class TireTable;
 
 struct TireInfo
 {
@@ -83,6 +87,14 @@ public:
 	/// init tire
 	void init(const TireInfo & info);
 
+	/// get tire parameters
+	const TireInfo & getInfo() const;
+
+	/// use precomputed force table instead of evaluating the magic formula
+	/// cubic selects Catmull-Rom interpolation along the slip axes
+	/// table has to be built from the same tire parameters, null to disable
+	void setTable(const std::tr1::shared_ptr<const TireTable> & table, bool cubic = false);
+
 	/// get tire tread fraction
 	btScalar getTread() const;
 
@@ -100,6 +112,10 @@ public:
 		btScalar lon_velocty,
 		btScalar lat_velocity);
 
+	/// update cached state from lane i of an evaluated tire batch
+	/// return force as getForce does
+	btVector3 getForce(const TireBatch & batch, int i);
+
 	btScalar getRollingResistance(
 		const btScalar velocity,
 		const btScalar resistance_factor) const;
@@ -113,6 +129,20 @@ public:
 	btScalar getFy() const;
 	btScalar getMz() const;
 
+	/// cached state, plain old data
+	struct State
+	{
+		btScalar slip, slip_angle;
+		btScalar ideal_slip, ideal_slip_angle;
+		btScalar vx, vy;
+		btScalar fx, fy, fz;
+		btScalar mz;
+	};
+
+	void getState(State & s) const;
+
+	void setState(const State & s);
+
 	/// calculate tire squeal factor [0, 1] based on ideal slide/slip
 	btScalar getSqueal() const;
 
@@ -123,6 +153,9 @@ public:
 	btScalar getMaxFy(btScalar load, btScalar camber) const;
 
 private:
+	friend class TireTable;
+	std::tr1::shared_ptr<const TireTable> table;
+	bool table_cubic;
 	btScalar slip;				///< ratio of tire contact patch speed to road speed, minus one
 	btScalar slip_angle;		///< angle (in degrees) between the wheel heading and the wheel velocity
 	btScalar ideal_slip;		///< ideal slip ratio
@@ -163,12 +196,12 @@ private:
 	/// combined slip longitudinal factor
 	btScalar PacejkaGx(
 		btScalar sigma,
-		btScalar alpha);
+		btScalar alpha) const;
 
 	/// combined slip lateral factor
 	btScalar PacejkaGy(
 		btScalar sigma,
-		btScalar alpha);
+		btScalar alpha) const;
 
 	/// combined slip lateral offset
 	btScalar PacejkaSvy(
@@ -176,7 +209,7 @@ private:
 		btScalar alpha,
 		btScalar gamma,
 		btScalar dFz,
-		btScalar Dy);
+		btScalar Dy) const;
 
 	/// get ideal slide ratio, slip angle
 	void getSigmaHatAlphaHat(
@@ -197,6 +230,11 @@ private:
 
 // implementation
 
+inline const TireInfo & Tire::getInfo() const
+{
+	return *this;
+}
+
 inline btScalar Tire::getTread() const
 {
 	return tread;
@@ -237,6 +275,34 @@ inline btScalar Tire::getMz() const
 	return mz;
 }
 
+inline void Tire::getState(State & s) const
+{
+	s.slip = slip;
+	s.slip_angle = slip_angle;
+	s.ideal_slip = ideal_slip;
+	s.ideal_slip_angle = ideal_slip_angle;
+	s.vx = vx;
+	s.vy = vy;
+	s.fx = fx;
+	s.fy = fy;
+	s.fz = fz;
+	s.mz = mz;
+}
+
+inline void Tire::setState(const State & s)
+{
+	slip = s.slip;
+	slip_angle = s.slip_angle;
+	ideal_slip = s.ideal_slip;
+	ideal_slip_angle = s.ideal_slip_angle;
+	vx = s.vx;
+	vy = s.vy;
+	fx = s.fx;
+	fy = s.fy;
+	fz = s.fz;
+	mz = s.mz;
+}
+
 inline btScalar Tire::getRollingResistance(
 	const btScalar velocity,
 	const btScalar resistance_factor) const
@@ -0,0 +1,494 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "tirebatch.h"
+#include "tiresample.h"
+#include "microbench.h"
+#include "unittest.h"
+
+#include <iostream>
+#include <cstdlib>
+
+#if defined(__SSE2__) && !defined(BT_USE_DOUBLE_PRECISION)
+#define TIRE_BATCH_SSE
+#include <emmintrin.h>
+#endif
+
+#ifdef TIRE_BATCH_SSE
+
+/// four packed floats
+struct Vec4
+{
+	__m128 v;
+	Vec4() {}
+	Vec4(__m128 v) : v(v) {}
+	Vec4(float s) : v(_mm_set1_ps(s)) {}
+	static Vec4 load(const btScalar * p) {return _mm_load_ps(p);}
+	void store(btScalar * p) const {_mm_store_ps(p, v);}
+};
+
+static inline Vec4 operator+(Vec4 a, Vec4 b) {return _mm_add_ps(a.v, b.v);}
+static inline Vec4 operator-(Vec4 a, Vec4 b) {return _mm_sub_ps(a.v, b.v);}
+static inline Vec4 operator*(Vec4 a, Vec4 b) {return _mm_mul_ps(a.v, b.v);}
+static inline Vec4 operator/(Vec4 a, Vec4 b) {return _mm_div_ps(a.v, b.v);}
+static inline Vec4 operator-(Vec4 a) {return _mm_xor_ps(a.v, _mm_set1_ps(-0.0f));}
+static inline Vec4 operator<(Vec4 a, Vec4 b) {return _mm_cmplt_ps(a.v, b.v);}
+static inline Vec4 operator>(Vec4 a, Vec4 b) {return _mm_cmpgt_ps(a.v, b.v);}
+static inline Vec4 operator&(Vec4 a, Vec4 b) {return _mm_and_ps(a.v, b.v);}
+static inline Vec4 vmin(Vec4 a, Vec4 b) {return _mm_min_ps(a.v, b.v);}
+static inline Vec4 vmax(Vec4 a, Vec4 b) {return _mm_max_ps(a.v, b.v);}
+static inline Vec4 vabs(Vec4 a) {return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v);}
+static inline Vec4 vsqrt(Vec4 a) {return _mm_sqrt_ps(a.v);}
+
+/// mask ? a : b
+static inline Vec4 vselect(Vec4 mask, Vec4 a, Vec4 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));
+}
+
+/// sign of a: 1, 0 or -1
+static inline Vec4 vsgn(Vec4 a)
+{
+	Vec4 zero(0.0f), one(1.0f);
+	return (one & (zero < a)) - (one & (a < zero));
+}
+
+/// cephes atanf, max abs error about 2E-7
+static inline Vec4 vatan(Vec4 x)
+{
+	const Vec4 t3p8(2.414213562373095f); // tan(3 pi / 8)
+	const Vec4 tp8(0.4142135623730950f); // tan(pi / 8)
+	Vec4 sign = _mm_and_ps(x.v, _mm_set1_ps(-0.0f));
+	Vec4 ax = vabs(x);
+
+	Vec4 big = ax > t3p8;
+	Vec4 mid = _mm_andnot_ps(big.v, (ax > tp8).v);
+	Vec4 y = vselect(big, Vec4(SIMD_HALF_PI), vselect(mid, Vec4(SIMD_PI * 0.25f), Vec4(0.0f)));
+	Vec4 xb = -Vec4(1.0f) / ax;
+	Vec4 xm = (ax - Vec4(1.0f)) / (ax + Vec4(1.0f));
+	ax = vselect(big, xb, vselect(mid, xm, ax));
+
+	Vec4 z = ax * ax;
+	Vec4 p = ((Vec4(8.05374449538e-2f) * z - Vec4(1.38776856032e-1f)) * z +
+		Vec4(1.99777106478e-1f)) * z - Vec4(3.33329491539e-1f);
+	y = y + p * z * ax + ax;
+
+	return _mm_xor_ps(y.v, sign.v);
+}
+
+/// cephes sinf, max abs error about 3E-7 for |x| < 8192
+static inline Vec4 vsin(Vec4 x)
+{
+	Vec4 sign = _mm_and_ps(x.v, _mm_set1_ps(-0.0f));
+	Vec4 ax = vabs(x);
+
+	// octant j = (int(x * 4 / pi) + 1) & ~1
+	__m128i j = _mm_cvttps_epi32((ax * Vec4(1.27323954473516f)).v);
+	j = _mm_add_epi32(j, _mm_set1_epi32(1));
+	j = _mm_and_si128(j, _mm_set1_epi32(~1));
+	Vec4 y = _mm_cvtepi32_ps(j);
+
+	// quadrant sign flip and polynomial selection
+	__m128i flip = _mm_slli_epi32(_mm_and_si128(j, _mm_set1_epi32(4)), 29);
+	sign = _mm_xor_ps(sign.v, _mm_castsi128_ps(flip));
+	Vec4 poly_mask = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), _mm_set1_epi32(2)));
+
+	// extended precision modular arithmetic
+	ax = ((ax - y * Vec4(0.78515625f)) - y * Vec4(2.4187564849853515625e-4f)) - y * Vec4(3.77489497744594108e-8f);
+
+	Vec4 z = ax * ax;
+	Vec4 c = ((Vec4(2.443315711809948e-5f) * z - Vec4(1.388731625493765e-3f)) * z +
+		Vec4(4.166664568298827e-2f)) * z * z - Vec4(0.5f) * z + Vec4(1.0f);
+	Vec4 s = ((Vec4(-1.9515295891e-4f) * z + Vec4(8.3321608736e-3f)) * z -
+		Vec4(1.6666654611e-1f)) * z * ax + ax;
+	y = vselect(poly_mask, c, s);
+
+	return _mm_xor_ps(y.v, sign.v);
+}
+
+static inline Vec4 vcos(Vec4 x)
+{
+	return vsin(x + Vec4(SIMD_HALF_PI));
+}
+
+/// cephes expf, max rel error about 2E-7 for |x| < 88
+static inline Vec4 vexp(Vec4 x)
+{
+	x = vmin(vmax(x, Vec4(-87.0f)), Vec4(88.0f));
+
+	// x = n * ln2 + r, |r| < ln2 / 2
+	Vec4 fx = x * Vec4(1.44269504088896341f) + Vec4(0.5f);
+	__m128i n = _mm_cvttps_epi32(fx.v);
+	Vec4 fn = _mm_cvtepi32_ps(n);
+	Vec4 gt = fn > fx;
+	fn = fn - (Vec4(1.0f) & gt);
+	n = _mm_cvttps_epi32(fn.v);
+	x = x - fn * Vec4(0.693359375f) - fn * Vec4(-2.12194440e-4f);
+
+	Vec4 z = x * x;
+	Vec4 y = (((((Vec4(1.9875691500e-4f) * x + Vec4(1.3981999507e-3f)) * x +
+		Vec4(8.3334519073e-3f)) * x + Vec4(4.1665795894e-2f)) * x +
+		Vec4(1.6666665459e-1f)) * x + Vec4(5.0000001201e-1f)) * z + x + Vec4(1.0f);
+
+	// scale by 2^n
+	__m128i e = _mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23);
+	return y * Vec4(_mm_castsi128_ps(e));
+}
+
+#else
+
+/// four scalars, reference implementation using libm
+struct Vec4
+{
+	btScalar v[4];
+	Vec4() {}
+	Vec4(btScalar s) {v[0] = v[1] = v[2] = v[3] = s;}
+	static Vec4 load(const btScalar * p) {Vec4 r; for (int i = 0; i < 4; ++i) r.v[i] = p[i]; return r;}
+	void store(btScalar * p) const {for (int i = 0; i < 4; ++i) p[i] = v[i];}
+};
+
+#define VEC4_BINARY(op, expr) \
+static inline Vec4 op(Vec4 a, Vec4 b) {Vec4 r; for (int i = 0; i < 4; ++i) r.v[i] = expr; return r;}
+#define VEC4_UNARY(op, expr) \
+static inline Vec4 op(Vec4 a) {Vec4 r; for (int i = 0; i < 4; ++i) r.v[i] = expr; return r;}
+
+VEC4_BINARY(operator+, a.v[i] + b.v[i])
+VEC4_BINARY(operator-, a.v[i] - b.v[i])
+VEC4_BINARY(operator*, a.v[i] * b.v[i])
+VEC4_BINARY(operator/, a.v[i] / b.v[i])
+VEC4_BINARY(operator<, a.v[i] < b.v[i])
+VEC4_BINARY(operator>, a.v[i] > b.v[i])
+VEC4_BINARY(operator&, a.v[i] * b.v[i])
+VEC4_BINARY(vmin, btMin(a.v[i], b.v[i]))
+VEC4_BINARY(vmax, btMax(a.v[i], b.v[i]))
+VEC4_UNARY(operator-, -a.v[i])
+VEC4_UNARY(vabs, btFabs(a.v[i]))
+VEC4_UNARY(vsqrt, btSqrt(a.v[i]))
+VEC4_UNARY(vsgn, btScalar((0 < a.v[i]) - (a.v[i] < 0)))
+VEC4_UNARY(vatan, btAtan(a.v[i]))
+VEC4_UNARY(vsin, btSin(a.v[i]))
+VEC4_UNARY(vcos, btCos(a.v[i]))
+VEC4_UNARY(vexp, btExp(a.v[i]))
+
+#undef VEC4_BINARY
+#undef VEC4_UNARY
+
+/// mask (0 or 1) ? a : b
+static inline Vec4 vselect(Vec4 mask, Vec4 a, Vec4 b)
+{
+	Vec4 r;
+	for (int i = 0; i < 4; ++i) r.v[i] = mask.v[i] != 0 ? a.v[i] : b.v[i];
+	return r;
+}
+
+#endif // TIRE_BATCH_SSE
+
+/// cos(atan(x))
+static inline Vec4 vcosatan(Vec4 x)
+{
+	return Vec4(1.0f) / vsqrt(Vec4(1.0f) + x * x);
+}
+
+/// magic formula shape: sin(C * atan(B * x - E * (B * x - atan(B * x))))
+static inline Vec4 vshape(Vec4 B, Vec4 C, Vec4 E, Vec4 x)
+{
+	Vec4 Bx = B * x;
+	return vsin(C * vatan(Bx - E * (Bx - vatan(Bx))));
+}
+
+const btScalar TireBatch::tolerance = 1E-5;
+
+TireBatch::TireBatch() :
+	count(0)
+{
+	// ctor
+}
+
+void TireBatch::clear()
+{
+	for (int c = 0; c < CHANNEL_NUM; ++c)
+		channel[c].clear();
+	count = 0;
+}
+
+int TireBatch::add(const TireInfo & info)
+{
+	int i = count;
+	resize(count + 1);
+	set(i, info);
+	return i;
+}
+
+void TireBatch::set(int i, const TireInfo & info)
+{
+	btAssert(i < count);
+	for (int c = 0; c < TireInfo::CNUM; ++c)
+		channel[c][i] = info.coefficients[c];
+	channel[NOMINAL_LOAD][i] = info.nominal_load;
+	channel[MAX_LOAD][i] = info.max_load;
+	channel[MAX_CAMBER][i] = info.max_camber;
+}
+
+void TireBatch::resize(int newcount)
+{
+	// padding lanes have zero load, zero nominal load is avoided to keep them finite
+	int padded = (newcount + width - 1) / width * width;
+	for (int c = 0; c < CHANNEL_NUM; ++c)
+		channel[c].resize(padded, btScalar(0));
+	for (int i = count; i < padded; ++i)
+		channel[NOMINAL_LOAD][i] = 1;
+	count = newcount;
+}
+
+bool TireBatch::simd()
+{
+#ifdef TIRE_BATCH_SSE
+	return true;
+#else
+	return false;
+#endif
+}
+
+void TireBatch::getForces()
+{
+	const Vec4 zero(0.0f), one(1.0f);
+	const int padded = channel[LOAD].size();
+	for (int n = 0; n < padded; n += width)
+	{
+		#define COEFF(x) Vec4 x = Vec4::load(&channel[TireInfo::x][n])
+		#define INPUT(c) Vec4::load(&channel[c][n])
+
+		Vec4 normal_load = INPUT(LOAD);
+		Vec4 friction_coeff = INPUT(FRICTION);
+		Vec4 camber = INPUT(CAMBER);
+		Vec4 rot_velocity = INPUT(ROT_VELOCITY);
+		Vec4 lon_velocity = INPUT(LON_VELOCITY);
+		Vec4 lat_velocity = INPUT(LAT_VELOCITY);
+		Vec4 max_load = INPUT(MAX_LOAD);
+		Vec4 max_camber = INPUT(MAX_CAMBER);
+		Vec4 Fz0 = INPUT(NOMINAL_LOAD);
+
+		// lanes without contact produce zero output
+		Vec4 active = (normal_load * friction_coeff) > Vec4(1E-6f);
+
+		// limit input
+		normal_load = vmin(vmax(normal_load, zero), max_load);
+		camber = vmin(vmax(camber, -max_camber), max_camber);
+
+		// sigma and alpha
+		Vec4 denom = vmax(vabs(lon_velocity), Vec4(1E-3f));
+		Vec4 lon_slip_velocity = lon_velocity - rot_velocity;
+		Vec4 sigma = -lon_slip_velocity / denom;
+		Vec4 alpha = vatan(lat_velocity / denom);
+
+		// force parameters
+		Vec4 Fz = normal_load;
+		Vec4 dFz = (Fz - Fz0) / Fz0;
+		Vec4 gamma = camber;
+
+		// pure slip longitudinal, see Tire::PacejkaFx
+		Vec4 Fx0;
+		{
+			COEFF(PVX1); COEFF(PVX2); COEFF(PHX1); COEFF(PHX2);
+			COEFF(PKX1); COEFF(PKX2); COEFF(PKX3);
+			COEFF(PEX1); COEFF(PEX2); COEFF(PEX3); COEFF(PEX4);
+			COEFF(PDX1); COEFF(PDX2); COEFF(PCX1);
+			Vec4 Sv = Fz * (PVX1 + PVX2 * dFz);
+			Vec4 S = sigma + PHX1 + PHX2 * dFz;
+			Vec4 K = Fz * (PKX1 + PKX2 * dFz) * vexp(-PKX3 * dFz);
+			Vec4 E = (PEX1 + PEX2 * dFz + PEX3 * dFz * dFz) * (one - PEX4 * vsgn(S));
+			Vec4 D = Fz * (PDX1 + PDX2 * dFz);
+			Vec4 C = PCX1;
+			Vec4 B = K / (C * D);
+			Fx0 = (D * vshape(B, C, E, S) + Sv) * friction_coeff;
+		}
+
+		// pure slip lateral, see Tire::PacejkaFy
+		Vec4 Fy0, Dy, BCy, Shf;
+		{
+			COEFF(PVY1); COEFF(PVY2); COEFF(PVY3); COEFF(PVY4);
+			COEFF(PHY1); COEFF(PHY2); COEFF(PHY3);
+			COEFF(PKY1); COEFF(PKY2); COEFF(PKY3);
+			COEFF(PEY1); COEFF(PEY2); COEFF(PEY3); COEFF(PEY4);
+			COEFF(PDY1); COEFF(PDY2); COEFF(PDY3); COEFF(PCY1);
+			Vec4 Sv = Fz * (PVY1 + PVY2 * dFz + (PVY3 + PVY4 * dFz) * gamma);
+			Vec4 Sh = PHY1 + PHY2 * dFz + PHY3 * gamma;
+			Vec4 A = alpha + Sh;
+			// sin(2 atan(t)) = 2 t / (1 + t^2)
+			Vec4 t = Fz / (PKY2 * Fz0);
+			Vec4 K = PKY1 * Fz0 * (Vec4(2.0f) * t / (one + t * t)) * (one - PKY3 * vabs(gamma));
+			Vec4 E = (PEY1 + PEY2 * dFz) * (one - (PEY3 + PEY4 * gamma) * vsgn(A));
+			Vec4 D = Fz * (PDY1 + PDY2 * dFz) * (one - PDY3 * gamma * gamma);
+			Vec4 C = PCY1;
+			Vec4 B = K / (C * D);
+			Fy0 = (D * vshape(B, C, E, A) + Sv) * friction_coeff;
+			Dy = D;
+			BCy = B * C;
+			Shf = Sh + Sv / K;
+		}
+
+		// aligning torque, see Tire::PacejkaMz
+		Vec4 Mz0;
+		{
+			COEFF(QHZ1); COEFF(QHZ2); COEFF(QHZ3); COEFF(QHZ4);
+			COEFF(QBZ1); COEFF(QBZ2); COEFF(QBZ3); COEFF(QBZ4); COEFF(QBZ5);
+			COEFF(QCZ1); COEFF(QDZ1); COEFF(QDZ2); COEFF(QDZ3); COEFF(QDZ4);
+			COEFF(QEZ1); COEFF(QEZ2); COEFF(QEZ3); COEFF(QEZ4); COEFF(QEZ5);
+			COEFF(QBZ10); COEFF(QDZ6); COEFF(QDZ7); COEFF(QDZ8); COEFF(QDZ9);
+			const Vec4 R0(0.3f);
+			Vec4 yz = gamma;
+			Vec4 cos_alpha = vcos(alpha);
+			Vec4 Sht = QHZ1 + QHZ2 * dFz + (QHZ3 + QHZ4 * dFz) * yz;
+			Vec4 At = alpha + Sht;
+			Vec4 Bt = (QBZ1 + QBZ2 * dFz + QBZ3 * dFz * dFz) * (one + QBZ4 * yz + QBZ5 * vabs(yz));
+			Vec4 Ct = QCZ1;
+			Vec4 Dt = Fz * (QDZ1 + QDZ2 * dFz) * (one + QDZ3 * yz + QDZ4 * yz * yz) * (R0 / Fz0);
+			Vec4 Et = (QEZ1 + QEZ2 * dFz + QEZ3 * dFz * dFz) * (one + (QEZ4 + QEZ5 * yz) * vatan(Bt * Ct * At));
+			Vec4 BtAt = Bt * At;
+			Vec4 Mzt = -Fy0 * Dt * vcos(Ct * vatan(BtAt - Et * (BtAt - vatan(BtAt)))) * cos_alpha;
+			Vec4 Ar = alpha + Shf;
+			Vec4 Br = QBZ10 * BCy;
+			Vec4 Dr = Fz * (QDZ6 + QDZ7 * dFz + (QDZ8 + QDZ9 * dFz) * yz) * R0;
+			Vec4 Mzr = Dr * vcosatan(Br * Ar) * cos_alpha * friction_coeff;
+			Mz0 = Mzt + Mzr;
+		}
+
+		// combined slip, see Tire::PacejkaGx, PacejkaGy, PacejkaSvy
+		Vec4 Fx, Fy;
+		{
+			COEFF(RBX1); COEFF(RBX2); COEFF(RCX1); COEFF(RHX1);
+			COEFF(RBY1); COEFF(RBY2); COEFF(RBY3); COEFF(RCY1); COEFF(RHY1);
+			COEFF(RVY1); COEFF(RVY2); COEFF(RVY3); COEFF(RVY4); COEFF(RVY5); COEFF(RVY6);
+			Vec4 Bx = RBX1 * vcosatan(RBX2 * sigma);
+			Vec4 Gx = vcos(RCX1 * vatan(Bx * (alpha + RHX1))) / vcos(RCX1 * vatan(Bx * RHX1));
+			Vec4 By = RBY1 * vcosatan(RBY2 * (alpha - RBY3));
+			Vec4 Gy = vcos(RCY1 * vatan(By * (sigma + RHY1))) / vcos(RCY1 * vatan(By * RHY1));
+			Vec4 Dv = Dy * (RVY1 + RVY2 * dFz + RVY3 * gamma) * vcosatan(RVY4 * alpha);
+			Vec4 Svy = Dv * vsin(RVY5 * vatan(RVY6 * sigma));
+			Fx = Gx * Fx0;
+			Fy = Gy * Fy0 + Svy;
+		}
+
+		vselect(active, Fx, zero).store(&channel[FX][n]);
+		vselect(active, Fy, zero).store(&channel[FY][n]);
+		vselect(active, Mz0, zero).store(&channel[MZ][n]);
+		vselect(active, Fz, zero).store(&channel[FZ][n]);
+		vselect(active, sigma, zero).store(&channel[SIGMA][n]);
+		vselect(active, alpha, zero).store(&channel[ALPHA][n]);
+		vselect(active, lon_slip_velocity, zero).store(&channel[VX][n]);
+		vselect(active, lat_velocity, zero).store(&channel[VY][n]);
+
+		#undef COEFF
+		#undef INPUT
+	}
+}
+
+QT_TEST(tirebatch_test)
+{
+	TireInfo info;
+	InitSampleTire(info);
+
+	const int count = 101;
+	std::vector<Tire> tires(count);
+	std::vector<btScalar> inputs(count * 6);
+	TireBatch batch;
+	std::srand(0);
+	for (int i = 0; i < count; ++i)
+	{
+		btScalar * in = &inputs[i * 6];
+		InitSampleInput(i, in);
+		tires[i].init(info);
+		QT_CHECK_EQUAL(batch.add(info), i);
+		batch.setInput(i, in[0], in[1], in[2], in[3], in[4], in[5]);
+	}
+	QT_CHECK_EQUAL(batch.size(), count);
+
+	batch.getForces();
+
+	for (int i = 0; i < count; ++i)
+	{
+		const btScalar * in = &inputs[i * 6];
+		btVector3 f = tires[i].getForce(in[0], in[1], in[2], in[3], in[4], in[5]);
+		btScalar tol = TireBatch::tolerance * btMax(in[0], btScalar(1));
+		QT_CHECK_CLOSE(batch.getFx(i), f[0], tol);
+		QT_CHECK_CLOSE(batch.getFy(i), f[1], tol);
+		QT_CHECK_CLOSE(batch.getMz(i), f[2], tol);
+		QT_CHECK_CLOSE(batch.getSlip(i), tires[i].getSlip(), 1E-5);
+		QT_CHECK_CLOSE(batch.getSlipAngle(i), tires[i].getSlipAngle(), 1E-5);
+	}
+}
+
+MICROBENCH(tirebatch)
+{
+	TireInfo info;
+	InitSampleTire(info);
+
+	// 30 cars
+	const int count = 120;
+	const int repeats = 5000;
+	std::vector<Tire> tires(count);
+	std::vector<btScalar> inputs(count * 6);
+	TireBatch batch;
+	std::srand(0);
+	for (int i = 0; i < count; ++i)
+	{
+		btScalar * in = &inputs[i * 6];
+		InitSampleInput(i, in);
+		tires[i].init(info);
+		batch.add(info);
+		batch.setInput(i, in[0], in[1], in[2], in[3], in[4], in[5]);
+	}
+
+	btScalar sum = 0;
+	double t0 = microbench::getTime();
+	for (int n = 0; n < repeats; ++n)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			const btScalar * in = &inputs[i * 6];
+			sum += tires[i].getForce(in[0], in[1], in[2], in[3], in[4], in[5])[0];
+		}
+	}
+	double t1 = microbench::getTime();
+	for (int n = 0; n < repeats; ++n)
+	{
+		batch.getForces();
+		sum += batch.getFx(0);
+	}
+	double t2 = microbench::getTime();
+
+	double max_error = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		const btScalar * in = &inputs[i * 6];
+		btVector3 f = tires[i].getForce(in[0], in[1], in[2], in[3], in[4], in[5]);
+		btScalar load = btMax(in[0], btScalar(1));
+		max_error = btMax(max_error, double(btFabs(f[0] - batch.getFx(i)) / load));
+		max_error = btMax(max_error, double(btFabs(f[1] - batch.getFy(i)) / load));
+		max_error = btMax(max_error, double(btFabs(f[2] - batch.getMz(i)) / load));
+	}
+
+	double evals = double(count) * repeats;
+	ctx.info_output << "Tires: " << count << ", SIMD: " << (TireBatch::simd() ? "yes" : "no") << "\n";
+	ctx.info_output << "Scalar: " << evals / (t1 - t0) * 1E-6 << " M tires/s\n";
+	ctx.info_output << "Batch: " << evals / (t2 - t1) * 1E-6 << " M tires/s\n";
+	ctx.info_output << "Speedup: " << (t1 - t0) / (t2 - t1) << "\n";
+	ctx.info_output << "Max error / load: " << max_error << " (tolerance " << TireBatch::tolerance << ")" << std::endl;
+	if (sum != sum) ctx.error_output << "Tire force is NaN" << std::endl;
+}
@@ -0,0 +1,177 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _TIREBATCH_H
+#define _TIREBATCH_H
+
+#include "tire.h"
+#include "LinearMath/btAlignedObjectArray.h"
+
+/// Structure of arrays tire batch, evaluates the Tire model width lanes at a time.
+/// With SSE2 (single precision) the kernel uses polynomial atan/sin/exp approximations,
+/// forces match Tire::getForce within tolerance * normal_load.
+/// Without SSE2 the kernel falls back to the libm functions.
+class TireBatch
+{
+public:
+	/// number of lanes evaluated per iteration
+	static const int width = 4;
+
+	/// max deviation from Tire::getForce relative to normal load
+	static const btScalar tolerance;
+
+	TireBatch();
+
+	/// remove all tires
+	void clear();
+
+	/// append tire, return its lane index
+	int add(const TireInfo & info);
+
+	/// set tire coefficients of lane i
+	void set(int i, const TireInfo & info);
+
+	/// number of tires
+	int size() const;
+
+	/// set force input of lane i, parameters as in Tire::getForce
+	void setInput(
+		int i,
+		btScalar normal_load,
+		btScalar friction_coeff,
+		btScalar camber,
+		btScalar rot_velocity,
+		btScalar lon_velocity,
+		btScalar lat_velocity);
+
+	/// evaluate all lanes
+	void getForces();
+
+	/// results of the last getForces call
+	btScalar getFx(int i) const;
+	btScalar getFy(int i) const;
+	btScalar getMz(int i) const;
+	btScalar getFz(int i) const;
+	btScalar getSlip(int i) const;
+	btScalar getSlipAngle(int i) const;
+	btScalar getSlipVelocityX(int i) const;
+	btScalar getSlipVelocityY(int i) const;
+
+	/// true if the SIMD kernel is used
+	static bool simd();
+
+private:
+	enum ChannelEnum
+	{
+		// tire parameters
+		NOMINAL_LOAD = TireInfo::CNUM,
+		MAX_LOAD,
+		MAX_CAMBER,
+		// force input
+		LOAD,
+		FRICTION,
+		CAMBER,
+		ROT_VELOCITY,
+		LON_VELOCITY,
+		LAT_VELOCITY,
+		// force output
+		FX,
+		FY,
+		MZ,
+		FZ,
+		SIGMA,
+		ALPHA,
+		VX,
+		VY,
+		CHANNEL_NUM
+	};
+
+	/// one array per channel, padded to a multiple of width
+	btAlignedObjectArray<btScalar> channel[CHANNEL_NUM];
+	int count;
+
+	void resize(int newcount);
+};
+
+// implementation
+
+inline int TireBatch::size() const
+{
+	return count;
+}
+
+inline void TireBatch::setInput(
+	int i,
+	btScalar normal_load,
+	btScalar friction_coeff,
+	btScalar camber,
+	btScalar rot_velocity,
+	btScalar lon_velocity,
+	btScalar lat_velocity)
+{
+	btAssert(i < count);
+	channel[LOAD][i] = normal_load;
+	channel[FRICTION][i] = friction_coeff;
+	channel[CAMBER][i] = camber;
+	channel[ROT_VELOCITY][i] = rot_velocity;
+	channel[LON_VELOCITY][i] = lon_velocity;
+	channel[LAT_VELOCITY][i] = lat_velocity;
+}
+
+inline btScalar TireBatch::getFx(int i) const
+{
+	return channel[FX][i];
+}
+
+inline btScalar TireBatch::getFy(int i) const
+{
+	return channel[FY][i];
+}
+
+inline btScalar TireBatch::getMz(int i) const
+{
+	return channel[MZ][i];
+}
+
+inline btScalar TireBatch::getFz(int i) const
+{
+	return channel[FZ][i];
+}
+
+inline btScalar TireBatch::getSlip(int i) const
+{
+	return channel[SIGMA][i];
+}
+
+inline btScalar TireBatch::getSlipAngle(int i) const
+{
+	return channel[ALPHA][i];
+}
+
+inline btScalar TireBatch::getSlipVelocityX(int i) const
+{
+	return channel[VX][i];
+}
+
+inline btScalar TireBatch::getSlipVelocityY(int i) const
+{
+	return channel[VY][i];
+}
+
+#endif
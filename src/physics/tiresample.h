@@ -0,0 +1,68 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _TIRESAMPLE_H
+#define _TIRESAMPLE_H
+
+#include "tire.h"
+
+#include <cstdlib>
+
+/// tire parameters and inputs shared by the tire tests and benchmarks
+
+// sample road tire coefficients, MF 5.2 like magnitudes
+inline void InitSampleTire(TireInfo & info)
+{
+	for (int i = 0; i < TireInfo::CNUM; ++i)
+		info.coefficients[i] = 0;
+
+	btScalar * p = info.coefficients;
+	p[TireInfo::PCX1] = 1.6; p[TireInfo::PDX1] = 1.2; p[TireInfo::PDX2] = -0.1;
+	p[TireInfo::PEX1] = 0.3; p[TireInfo::PEX2] = 0.1; p[TireInfo::PEX4] = 0.1;
+	p[TireInfo::PKX1] = 25; p[TireInfo::PKX3] = 0.2; p[TireInfo::PHX1] = 0.001;
+	p[TireInfo::PCY1] = 1.3; p[TireInfo::PDY1] = 1.1; p[TireInfo::PDY2] = -0.1; p[TireInfo::PDY3] = 1;
+	p[TireInfo::PEY1] = -0.8; p[TireInfo::PEY2] = -0.6; p[TireInfo::PEY3] = 0.1; p[TireInfo::PEY4] = -6;
+	p[TireInfo::PKY1] = -20; p[TireInfo::PKY2] = 2; p[TireInfo::PKY3] = 0.3;
+	p[TireInfo::PHY1] = 0.003; p[TireInfo::PHY2] = 0.002; p[TireInfo::PHY3] = 0.03;
+	p[TireInfo::PVY1] = 0.04; p[TireInfo::PVY2] = -0.01; p[TireInfo::PVY3] = -0.3; p[TireInfo::PVY4] = 0.1;
+	p[TireInfo::QBZ1] = 10; p[TireInfo::QBZ2] = -1.5; p[TireInfo::QBZ3] = 0.5; p[TireInfo::QBZ4] = 0.1; p[TireInfo::QBZ5] = -0.1;
+	p[TireInfo::QCZ1] = 1.2; p[TireInfo::QDZ1] = 0.1; p[TireInfo::QDZ2] = -0.005; p[TireInfo::QDZ3] = 0.2; p[TireInfo::QDZ4] = -2;
+	p[TireInfo::QEZ1] = -1.5; p[TireInfo::QEZ2] = 0.1; p[TireInfo::QEZ4] = 0.2; p[TireInfo::QEZ5] = -3;
+	p[TireInfo::QHZ1] = 0.002; p[TireInfo::QHZ2] = 0.002; p[TireInfo::QHZ3] = 0.2; p[TireInfo::QHZ4] = 0.1;
+	p[TireInfo::QBZ9] = 18; p[TireInfo::QDZ6] = 0.002; p[TireInfo::QDZ7] = -0.001; p[TireInfo::QDZ8] = -0.3; p[TireInfo::QDZ9] = 0.03;
+	p[TireInfo::RBX1] = 12; p[TireInfo::RBX2] = -10; p[TireInfo::RCX1] = 1.1; p[TireInfo::RHX1] = 0.01;
+	p[TireInfo::RBY1] = 7; p[TireInfo::RBY2] = 2.5; p[TireInfo::RBY3] = 0.02; p[TireInfo::RCY1] = 1.05; p[TireInfo::RHY1] = 0.02;
+	p[TireInfo::RVY1] = 0.05; p[TireInfo::RVY2] = 0.02; p[TireInfo::RVY3] = -0.2;
+	p[TireInfo::RVY4] = 20; p[TireInfo::RVY5] = 1.9; p[TireInfo::RVY6] = 10;
+	info.max_camber = 0.3;
+}
+
+// random force input: load, friction, camber, rot_velocity, lon_velocity, lat_velocity
+inline void InitSampleInput(int i, btScalar input[6])
+{
+	btScalar lon_velocity = (std::rand() % 2000 - 1000) * 0.1;
+	input[0] = (i % 50 == 0) ? 0 : (std::rand() % 1000) * 9.0;
+	input[1] = 0.8 + (std::rand() % 100) * 0.004;
+	input[2] = (std::rand() % 200 - 100) * 0.002;
+	input[3] = lon_velocity * (1 + (std::rand() % 200 - 100) * 0.0033);
+	input[4] = (i % 7 == 0) ? 5E-4 : lon_velocity;
+	input[5] = (std::rand() % 2000 - 1000) * 0.01;
+}
+
+#endif
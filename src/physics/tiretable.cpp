@@ -0,0 +1,400 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "tiretable.h"
+#include "tiresample.h"
+#include "microbench.h"
+#include "unittest.h"
+
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+
+// grid resolution
+static const int load_size = 33;
+static const int slip_size = 129;
+static const int slip_angle_size = 129;
+static const int camber_size = 9;
+
+// slip axes are compressed by x / (|x| + k), forces saturate at the ends
+static const btScalar slip_max = 1E4;
+static const btScalar slip_compress = 0.1;
+static const btScalar slip_angle_max = M_PI_2;
+static const btScalar slip_angle_compress = 0.1;
+
+// camber beyond the typical suspension range is clamped
+static const btScalar camber_max = 0.35;
+
+void TireTable::Axis::init(btScalar xmin, btScalar xmax, btScalar k, int n)
+{
+	btScalar tmin = (k > 0) ? xmin / (btFabs(xmin) + k) : xmin;
+	btScalar tmax = (k > 0) ? xmax / (btFabs(xmax) + k) : xmax;
+	min = tmin;
+	scale = (n > 1 && tmax > tmin) ? (n - 1) / (tmax - tmin) : 0;
+	compress = k;
+	size = (scale > 0) ? n : 1;
+}
+
+btScalar TireTable::Axis::getValue(int i) const
+{
+	btScalar t = (scale > 0) ? min + i / scale : min;
+	if (compress > 0)
+		return compress * t / (1 - btFabs(t));
+	return t;
+}
+
+TireTable::TireTable()
+{
+	// ctor
+}
+
+void TireTable::init(const TireInfo & info)
+{
+	// tire is used to evaluate the pacejka terms
+	Tire tire;
+	tire.TireInfo::operator=(info);
+
+	const btScalar * p = info.coefficients;
+	btScalar Fz0 = info.nominal_load;
+	btScalar gmax = btMin(btFabs(info.max_camber), camber_max);
+
+	load.init(0, info.max_load, 0, load_size);
+	slip.init(-slip_max, slip_max, slip_compress, slip_size);
+	slip_angle.init(-slip_angle_max, slip_angle_max, slip_angle_compress, slip_angle_size);
+	camber.init(-gmax, gmax, 0, camber_size);
+
+	Gx.resize(slip.size * slip_angle.size);
+	Gy.resize(slip.size * slip_angle.size);
+	for (int s = 0; s < slip.size; ++s)
+	{
+		btScalar sigma = slip.getValue(s);
+		for (int a = 0; a < slip_angle.size; ++a)
+		{
+			btScalar alpha = slip_angle.getValue(a);
+			Gx[s * slip_angle.size + a] = tire.PacejkaGx(sigma, alpha);
+			Gy[s * slip_angle.size + a] = tire.PacejkaGy(sigma, alpha);
+		}
+	}
+
+	Fx0.resize(load.size * slip.size);
+	for (int l = 0; l < load.size; ++l)
+	{
+		btScalar Fz = load.getValue(l);
+		btScalar dFz = (Fz - Fz0) / Fz0;
+		for (int s = 0; s < slip.size; ++s)
+		{
+			btScalar sigma = slip.getValue(s);
+			Fx0[l * slip.size + s] = (Fz > 0) ? tire.PacejkaFx(sigma, Fz, dFz, 1) : 0;
+		}
+	}
+
+	Fy0.resize(load.size * slip_angle.size * camber.size);
+	Mz0.resize(load.size * slip_angle.size * camber.size);
+	Dv.resize(load.size * camber.size);
+	for (int l = 0; l < load.size; ++l)
+	{
+		btScalar Fz = load.getValue(l);
+		btScalar dFz = (Fz - Fz0) / Fz0;
+		for (int c = 0; c < camber.size; ++c)
+		{
+			btScalar gamma = camber.getValue(c);
+			btScalar Dy(0), BCy(0), Shf(0);
+			for (int a = 0; a < slip_angle.size; ++a)
+			{
+				btScalar alpha = slip_angle.getValue(a);
+				btScalar Fy(0), Mz(0);
+				if (Fz > 0)
+				{
+					Fy = tire.PacejkaFy(alpha, gamma, Fz, dFz, 1, Dy, BCy, Shf);
+					Mz = tire.PacejkaMz(alpha, gamma, Fz, dFz, 1, Fy, BCy, Shf);
+				}
+				int n = (l * slip_angle.size + a) * camber.size + c;
+				Fy0[n] = Fy;
+				Mz0[n] = Mz;
+			}
+
+			// peak part of the combined slip lateral offset, see Tire::PacejkaSvy
+			Dv[l * camber.size + c] = Dy * (p[TireInfo::RVY1] + p[TireInfo::RVY2] * dFz + p[TireInfo::RVY3] * gamma);
+		}
+	}
+
+	Va.resize(slip_angle.size);
+	for (int a = 0; a < slip_angle.size; ++a)
+	{
+		btScalar alpha = slip_angle.getValue(a);
+		Va[a] = btCos(btAtan(p[TireInfo::RVY4] * alpha));
+	}
+
+	Vs.resize(slip.size);
+	for (int s = 0; s < slip.size; ++s)
+	{
+		btScalar sigma = slip.getValue(s);
+		Vs[s] = btSin(p[TireInfo::RVY5] * btAtan(p[TireInfo::RVY6] * sigma));
+	}
+}
+
+void TireTable::getForce(
+	btScalar Fz,
+	btScalar mu,
+	btScalar gamma,
+	btScalar sigma,
+	btScalar alpha,
+	Interpolation interpolation,
+	btScalar & Fx,
+	btScalar & Fy,
+	btScalar & Mz) const
+{
+	bool cubic = (interpolation == CUBIC);
+	Sample l, s, a, c;
+	getSample(load, Fz, false, l);
+	getSample(slip, sigma, cubic, s);
+	getSample(slip_angle, alpha, cubic, a);
+	getSample(camber, gamma, false, c);
+
+	btScalar gx = lookup(Gx, s, a, slip_angle.size);
+	btScalar gy = lookup(Gy, s, a, slip_angle.size);
+	btScalar fx0 = lookup(Fx0, l, s, slip.size);
+	btScalar fy0 = lookup(Fy0, l, a, c, slip_angle.size, camber.size);
+	btScalar mz0 = lookup(Mz0, l, a, c, slip_angle.size, camber.size);
+	btScalar svy = lookup(Dv, l, c, camber.size) * lookup(Va, a) * lookup(Vs, s);
+
+	Fx = mu * gx * fx0;
+	Fy = mu * gy * fy0 + svy;
+	Mz = mu * mz0;
+}
+
+unsigned TireTable::getMemorySize() const
+{
+	unsigned count = Gx.size() + Gy.size() + Fx0.size() + Fy0.size() +
+		Mz0.size() + Dv.size() + Va.size() + Vs.size();
+	return sizeof(TireTable) + count * sizeof(btScalar);
+}
+
+std::string TireTable::getName(const std::string & tire_type, const TireInfo & info)
+{
+	// facing direction modifies the coefficients, so hash them (FNV-1a)
+	unsigned hash = 2166136261u;
+	const unsigned char * data = reinterpret_cast<const unsigned char *>(info.coefficients);
+	for (unsigned i = 0; i < sizeof(info.coefficients); ++i)
+	{
+		hash = (hash ^ data[i]) * 16777619u;
+	}
+	const btScalar limits[] = {info.nominal_load, info.max_load, info.max_camber};
+	data = reinterpret_cast<const unsigned char *>(limits);
+	for (unsigned i = 0; i < sizeof(limits); ++i)
+	{
+		hash = (hash ^ data[i]) * 16777619u;
+	}
+
+	std::ostringstream s;
+	s << tire_type << "." << std::hex << hash;
+	return s.str();
+}
+
+void TireTable::getSample(const Axis & axis, btScalar x, bool cubic, Sample & s)
+{
+	if (axis.size == 1)
+	{
+		s.index[0] = 0;
+		s.weight[0] = 1;
+		s.taps = 1;
+		return;
+	}
+
+	btScalar t = (axis.compress > 0) ? x / (btFabs(x) + axis.compress) : x;
+	btScalar u = (t - axis.min) * axis.scale;
+	btClamp(u, btScalar(0), btScalar(axis.size - 1));
+	int i = btMin(int(u), axis.size - 2);
+	btScalar f = u - i;
+
+	if (!cubic)
+	{
+		s.index[0] = i;
+		s.index[1] = i + 1;
+		s.weight[0] = 1 - f;
+		s.weight[1] = f;
+		s.taps = 2;
+		return;
+	}
+
+	// Catmull-Rom spline, edge nodes are repeated
+	btScalar f2 = f * f;
+	btScalar f3 = f2 * f;
+	s.index[0] = btMax(i - 1, 0);
+	s.index[1] = i;
+	s.index[2] = i + 1;
+	s.index[3] = btMin(i + 2, axis.size - 1);
+	s.weight[0] = 0.5 * (-f3 + 2 * f2 - f);
+	s.weight[1] = 0.5 * (3 * f3 - 5 * f2 + 2);
+	s.weight[2] = 0.5 * (-3 * f3 + 4 * f2 + f);
+	s.weight[3] = 0.5 * (f3 - f2);
+	s.taps = 4;
+}
+
+btScalar TireTable::lookup(const std::vector<btScalar> & t, const Sample & a)
+{
+	btScalar v = 0;
+	for (int i = 0; i < a.taps; ++i)
+	{
+		v += a.weight[i] * t[a.index[i]];
+	}
+	return v;
+}
+
+btScalar TireTable::lookup(const std::vector<btScalar> & t, const Sample & a, const Sample & b, int nb)
+{
+	btScalar v = 0;
+	for (int i = 0; i < a.taps; ++i)
+	{
+		const btScalar * row = &t[a.index[i] * nb];
+		btScalar vb = 0;
+		for (int j = 0; j < b.taps; ++j)
+		{
+			vb += b.weight[j] * row[b.index[j]];
+		}
+		v += a.weight[i] * vb;
+	}
+	return v;
+}
+
+btScalar TireTable::lookup(const std::vector<btScalar> & t, const Sample & a, const Sample & b, const Sample & c, int nb, int nc)
+{
+	btScalar v = 0;
+	for (int i = 0; i < a.taps; ++i)
+	{
+		btScalar vb = 0;
+		for (int j = 0; j < b.taps; ++j)
+		{
+			const btScalar * row = &t[(a.index[i] * nb + b.index[j]) * nc];
+			btScalar vc = 0;
+			for (int k = 0; k < c.taps; ++k)
+			{
+				vc += c.weight[k] * row[c.index[k]];
+			}
+			vb += b.weight[j] * vc;
+		}
+		v += a.weight[i] * vb;
+	}
+	return v;
+}
+
+// maximum force error relative to load
+static btScalar GetMaxError(
+	const TireInfo & info,
+	const std::tr1::shared_ptr<TireTable> & table,
+	TireTable::Interpolation interpolation,
+	int count)
+{
+	Tire tire, tire_table;
+	tire.init(info);
+	tire_table.init(info);
+	tire_table.setTable(table, interpolation == TireTable::CUBIC);
+
+	btScalar max_error = 0;
+	std::srand(0);
+	for (int i = 0; i < count; ++i)
+	{
+		btScalar in[6];
+		InitSampleInput(i, in);
+		btVector3 f = tire.getForce(in[0], in[1], in[2], in[3], in[4], in[5]);
+		btVector3 ft = tire_table.getForce(in[0], in[1], in[2], in[3], in[4], in[5]);
+		btScalar load = btMax(in[0], btScalar(1));
+		for (int n = 0; n < 3; ++n)
+		{
+			max_error = btMax(max_error, btFabs(f[n] - ft[n]) / load);
+		}
+	}
+	return max_error;
+}
+
+QT_TEST(tiretable_test)
+{
+	TireInfo info;
+	InitSampleTire(info);
+
+	std::tr1::shared_ptr<TireTable> table(new TireTable());
+	table->init(info);
+
+	// two percent of load
+	QT_CHECK_LESS(GetMaxError(info, table, TireTable::LINEAR, 1000), 2E-2);
+	QT_CHECK_LESS(GetMaxError(info, table, TireTable::CUBIC, 1000), 2E-2);
+
+	// tables depend on coefficients
+	TireInfo info_left(info);
+	info_left.coefficients[TireInfo::PHY1] *= -1;
+	QT_CHECK(TireTable::getName("touring", info) != TireTable::getName("touring", info_left));
+	QT_CHECK_EQUAL(TireTable::getName("touring", info), TireTable::getName("touring", info));
+}
+
+MICROBENCH(tiretable)
+{
+	TireInfo info;
+	InitSampleTire(info);
+
+	// 30 cars
+	const int count = 120;
+	const int repeats = 5000;
+
+	double t0 = microbench::getTime();
+	std::tr1::shared_ptr<TireTable> table(new TireTable());
+	table->init(info);
+	double t1 = microbench::getTime();
+
+	std::vector<btScalar> inputs(count * 6);
+	std::vector<Tire> tires(count);
+	std::vector<Tire> tires_linear(count);
+	std::vector<Tire> tires_cubic(count);
+	std::srand(0);
+	for (int i = 0; i < count; ++i)
+	{
+		InitSampleInput(i, &inputs[i * 6]);
+		tires[i].init(info);
+		tires_linear[i].init(info);
+		tires_linear[i].setTable(table, false);
+		tires_cubic[i].init(info);
+		tires_cubic[i].setTable(table, true);
+	}
+
+	std::vector<Tire> * sets[] = {&tires, &tires_linear, &tires_cubic};
+	double times[3];
+	btScalar sum = 0;
+	for (int k = 0; k < 3; ++k)
+	{
+		std::vector<Tire> & t = *sets[k];
+		double ts = microbench::getTime();
+		for (int n = 0; n < repeats; ++n)
+		{
+			for (int i = 0; i < count; ++i)
+			{
+				const btScalar * in = &inputs[i * 6];
+				sum += t[i].getForce(in[0], in[1], in[2], in[3], in[4], in[5])[0];
+			}
+		}
+		times[k] = microbench::getTime() - ts;
+	}
+
+	double evals = double(count) * repeats;
+	ctx.info_output << "Table: " << table->getMemorySize() / 1024 << " KB, baked in " << (t1 - t0) * 1E3 << " ms\n";
+	ctx.info_output << "Analytic: " << evals / times[0] * 1E-6 << " M tires/s\n";
+	ctx.info_output << "Linear: " << evals / times[1] * 1E-6 << " M tires/s, speedup " << times[0] / times[1] <<
+		", max error / load " << GetMaxError(info, table, TireTable::LINEAR, 10000) << "\n";
+	ctx.info_output << "Cubic: " << evals / times[2] * 1E-6 << " M tires/s, speedup " << times[0] / times[2] <<
+		", max error / load " << GetMaxError(info, table, TireTable::CUBIC, 10000) << std::endl;
+	if (sum != sum) ctx.error_output << "Tire force is NaN" << std::endl;
+}
@@ -0,0 +1,106 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _TIRETABLE_H
+#define _TIRETABLE_H
+
+#include "tire.h"
+
+#include <vector>
+#include <string>
+
+/// Precomputed Tire forces, baked once per tire type and shared between cars.
+/// The magic formula is linear in the surface friction mu and factorizes into
+/// low dimensional grids over load Fz, slip sigma, slip angle alpha and camber gamma:
+/// Fx = mu * Gx(sigma, alpha) * Fx0(Fz, sigma)
+/// Fy = mu * Gy(sigma, alpha) * Fy0(Fz, alpha, gamma) + Dv(Fz, gamma) * Va(alpha) * Vs(sigma)
+/// Mz = mu * Mz0(Fz, alpha, gamma)
+/// Slip axes are compressed towards zero where the force peaks are.
+class TireTable
+{
+public:
+	/// LINEAR is bi/trilinear, CUBIC uses Catmull-Rom weights along the slip axes
+	enum Interpolation { LINEAR, CUBIC };
+
+	TireTable();
+
+	/// bake tables for given tire parameters
+	void init(const TireInfo & info);
+
+	/// tire space force and aligning torque, inputs as used by Tire::getForce
+	/// Fz normal load in N, mu surface friction, gamma camber in rad, sigma slip ratio, alpha slip angle in rad
+	void getForce(
+		btScalar Fz,
+		btScalar mu,
+		btScalar gamma,
+		btScalar sigma,
+		btScalar alpha,
+		Interpolation interpolation,
+		btScalar & Fx,
+		btScalar & Fy,
+		btScalar & Mz) const;
+
+	/// table memory in bytes
+	unsigned getMemorySize() const;
+
+	/// unique content cache name for given tire type and parameters
+	static std::string getName(const std::string & tire_type, const TireInfo & info);
+
+private:
+	struct Axis
+	{
+		btScalar min;		///< first node, in compressed space if compress > 0
+		btScalar scale;		///< nodes per unit
+		btScalar compress;	///< x / (|x| + compress) mapping, zero for uniform spacing
+		int size;			///< node count
+
+		void init(btScalar xmin, btScalar xmax, btScalar compress, int size);
+		btScalar getValue(int i) const;
+	};
+
+	/// node indices and weights of a lookup along one axis
+	struct Sample
+	{
+		int index[4];
+		btScalar weight[4];
+		int taps;
+	};
+
+	Axis load, slip, slip_angle, camber;
+
+	std::vector<btScalar> Gx;	///< slip x slip_angle
+	std::vector<btScalar> Gy;	///< slip x slip_angle
+	std::vector<btScalar> Fx0;	///< load x slip
+	std::vector<btScalar> Fy0;	///< load x slip_angle x camber
+	std::vector<btScalar> Mz0;	///< load x slip_angle x camber
+	std::vector<btScalar> Dv;	///< load x camber
+	std::vector<btScalar> Va;	///< slip_angle
+	std::vector<btScalar> Vs;	///< slip
+
+	static void getSample(const Axis & axis, btScalar x, bool cubic, Sample & s);
+
+	static btScalar lookup(const std::vector<btScalar> & t, const Sample & a);
+
+	/// row major table lookups, nb and nc are the sizes of the inner axes
+	static btScalar lookup(const std::vector<btScalar> & t, const Sample & a, const Sample & b, int nb);
+
+	static btScalar lookup(const std::vector<btScalar> & t, const Sample & a, const Sample & b, const Sample & c, int nb, int nc);
+};
+
+#endif
@@ -446,7 +446,8 @@ public:
 		return qout;
 	}
 
-	bool Serialize(joeserialize::Serializer & s)
+	template <class S>
+	bool Serialize(S & s)
 	{
 		if (!s.Serialize("x",v[0])) return false;
 		if (!s.Serialize("y",v[1])) return false;
@@ -22,17 +22,372 @@
 #include "cfg/ptree.h"
 #include "physics/carinput.h"
 #include "physics/cardynamics.h"
+#include "physics/dynamicsworld.h"
+
+#include <SDL2/SDL.h>
 
 #include <sstream>
 #include <fstream>
+#include <algorithm>
+#include <iterator>
+#include <deque>
+#include <cstring>
+#include <cstdio>
+#include <stdint.h>
+
+// V20 stream layout, integers little endian:
+// "VDRIFTREPLAYV20", u32 header size, header (serialized version, track, car info, optional setup)
+// chunks: u32 first frame, u32 frames, u32 data size, data (u32 size + frames per car)
+// index: u64 chunk offset per chunk
+// footer: u64 index offset, u32 chunk count, "RIDX"
+static const char stream_version[] = "VDRIFTREPLAYV20";
+static const char stream_footer[] = "RIDX";
+static const unsigned stream_version_size = sizeof(stream_version) - 1;
+static const unsigned chunk_header_size = 12;
+static const unsigned footer_size = 16;
+static const uint32_t max_state_size = 1 << 20; // serialized car states are a few kilobytes
+
+static void WriteU32(std::string & out, uint32_t v)
+{
+	for (int i = 0; i < 4; ++i)
+		out.push_back(char((v >> (8 * i)) & 0xff));
+}
+
+static void WriteU64(std::string & out, uint64_t v)
+{
+	for (int i = 0; i < 8; ++i)
+		out.push_back(char((v >> (8 * i)) & 0xff));
+}
+
+static uint32_t ReadU32(const char * p)
+{
+	const unsigned char * b = reinterpret_cast<const unsigned char *>(p);
+	return b[0] | (b[1] << 8) | (b[2] << 16) | (uint32_t(b[3]) << 24);
+}
+
+static uint64_t ReadU64(const char * p)
+{
+	return ReadU32(p) | (uint64_t(ReadU32(p + 4)) << 32);
+}
+
+static void WriteVarint(std::string & out, uint32_t v)
+{
+	while (v >= 0x80)
+	{
+		out.push_back(char((v & 0x7f) | 0x80));
+		v >>= 7;
+	}
+	out.push_back(char(v));
+}
+
+static bool ReadVarint(const char *& p, const char * end, uint32_t & v)
+{
+	v = 0;
+	for (int shift = 0; shift < 35 && p < end; shift += 7)
+	{
+		const unsigned char b = *p++;
+		v |= uint32_t(b & 0x7f) << shift;
+		if (!(b & 0x80))
+			return true;
+	}
+	return false;
+}
+
+// input values are exact 0 or 1, 16 bit quantized if that is lossless, or raw floats
+enum { INPUT_ZERO, INPUT_ONE, INPUT_QUANTIZED, INPUT_FLOAT };
+
+static void WriteInput(std::string & out, float value)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	if (bits == 0)
+	{
+		out.push_back(INPUT_ZERO);
+		return;
+	}
+	if (value == 1.0f)
+	{
+		out.push_back(INPUT_ONE);
+		return;
+	}
+	if (value > 0.0f && value < 1.0f)
+	{
+		const uint32_t q = uint32_t(value * 65535.0f + 0.5f);
+		if (float(q) / 65535.0f == value)
+		{
+			out.push_back(INPUT_QUANTIZED);
+			out.push_back(char(q & 0xff));
+			out.push_back(char(q >> 8));
+			return;
+		}
+	}
+	out.push_back(INPUT_FLOAT);
+	WriteU32(out, bits);
+}
+
+static bool ReadInput(const char *& p, const char * end, float & value)
+{
+	if (p >= end)
+		return false;
+
+	const char tag = *p++;
+	if (tag == INPUT_ZERO)
+	{
+		value = 0.0f;
+		return true;
+	}
+	if (tag == INPUT_ONE)
+	{
+		value = 1.0f;
+		return true;
+	}
+	if (tag == INPUT_QUANTIZED && end - p >= 2)
+	{
+		const unsigned char * b = reinterpret_cast<const unsigned char *>(p);
+		const uint32_t q = b[0] | (b[1] << 8);
+		value = float(q) / 65535.0f;
+		p += 2;
+		return true;
+	}
+	if (tag == INPUT_FLOAT && end - p >= 4)
+	{
+		const uint32_t bits = ReadU32(p);
+		std::memcpy(&value, &bits, sizeof(value));
+		p += 4;
+		return true;
+	}
+	return false;
+}
+
+// state bytes are xor'ed with the previous state of the car, most of them cancel out
+// stored as varint size, then pairs of zero runs and literal runs
+static void WriteState(std::string & out, const std::string & state, const std::string & prev)
+{
+	WriteVarint(out, state.size());
+	std::string delta(state);
+	for (size_t i = 0; i < delta.size() && i < prev.size(); ++i)
+	{
+		delta[i] ^= prev[i];
+	}
+
+	size_t i = 0;
+	while (i < delta.size())
+	{
+		const size_t zeros_start = i;
+		while (i < delta.size() && delta[i] == 0)
+			++i;
+		const size_t literals_start = i;
+
+		// literal run ends at the next pair of zero bytes
+		while (i < delta.size() && !(delta[i] == 0 && (i + 1 == delta.size() || delta[i + 1] == 0)))
+			++i;
+
+		WriteVarint(out, literals_start - zeros_start);
+		WriteVarint(out, i - literals_start);
+		out.append(delta, literals_start, i - literals_start);
+	}
+}
+
+static bool ReadState(const char *& p, const char * end, const std::string & prev, std::string & state)
+{
+	uint32_t size;
+	if (!ReadVarint(p, end, size) || size > max_state_size)
+		return false;
+
+	state.assign(size, 0);
+	size_t i = 0;
+	while (i < size)
+	{
+		uint32_t zeros, literals;
+		if (!ReadVarint(p, end, zeros) || !ReadVarint(p, end, literals) ||
+			zeros > size - i || literals > size - i - zeros || literals > uint32_t(end - p))
+			return false;
+
+		i += zeros;
+		state.replace(i, literals, p, literals);
+		p += literals;
+		i += literals;
+	}
+
+	for (size_t i = 0; i < state.size() && i < prev.size(); ++i)
+	{
+		state[i] ^= prev[i];
+	}
+	return true;
+}
+
+class Replay::Writer
+{
+public:
+	Writer();
+
+	~Writer();
+
+	/// create file, write header and start the writer thread
+	bool Open(const std::string & filename, const std::string & header);
+
+	/// queue chunk for writing, takes ownership
+	void Push(Chunk * chunk);
+
+	/// write the queued chunks and the chunk index, close file
+	/// false on write error
+	bool Finish();
+
+private:
+	std::ofstream file;
+	std::vector<uint64_t> offsets;
+	std::deque<Chunk *> queue;
+	SDL_Thread * thread;
+	SDL_mutex * lock;
+	SDL_cond * cond;
+	bool quit;
+
+	static int Run(void * writer);
+
+	void Write(const Chunk & chunk, std::string & buffer);
+};
+
+Replay::Writer::Writer() :
+	thread(0),
+	lock(0),
+	cond(0),
+	quit(false)
+{
+	// ctor
+}
+
+Replay::Writer::~Writer()
+{
+	if (file.is_open())
+		Finish();
+}
+
+bool Replay::Writer::Open(const std::string & filename, const std::string & header)
+{
+	file.open(filename.c_str(), std::ios::binary);
+	if (!file)
+		return false;
+
+	std::string data(stream_version, stream_version_size);
+	WriteU32(data, header.size());
+	data.append(header);
+	file.write(data.data(), data.size());
+
+	// write chunks on the calling thread if there is no writer thread
+	lock = SDL_CreateMutex();
+	cond = SDL_CreateCond();
+	quit = false;
+	thread = SDL_CreateThread(&Writer::Run, "replay writer", this);
+	return file.good();
+}
+
+void Replay::Writer::Push(Chunk * chunk)
+{
+	if (!thread)
+	{
+		std::string buffer;
+		Write(*chunk, buffer);
+		delete chunk;
+		return;
+	}
+
+	SDL_LockMutex(lock);
+	queue.push_back(chunk);
+	SDL_CondSignal(cond);
+	SDL_UnlockMutex(lock);
+}
+
+bool Replay::Writer::Finish()
+{
+	if (thread)
+	{
+		SDL_LockMutex(lock);
+		quit = true;
+		SDL_CondSignal(cond);
+		SDL_UnlockMutex(lock);
+		SDL_WaitThread(thread, 0);
+		thread = 0;
+	}
+	SDL_DestroyCond(cond);
+	SDL_DestroyMutex(lock);
+	cond = 0;
+	lock = 0;
+
+	std::string index;
+	const uint64_t index_offset = file.tellp();
+	for (size_t i = 0; i < offsets.size(); ++i)
+	{
+		WriteU64(index, offsets[i]);
+	}
+	WriteU64(index, index_offset);
+	WriteU32(index, offsets.size());
+	index.append(stream_footer, 4);
+	file.write(index.data(), index.size());
+
+	const bool good = file.good();
+	file.close();
+	offsets.clear();
+	return good;
+}
+
+int Replay::Writer::Run(void * data)
+{
+	Writer & writer = *static_cast<Writer *>(data);
+	std::string buffer;
+	while (true)
+	{
+		SDL_LockMutex(writer.lock);
+		while (writer.queue.empty() && !writer.quit)
+		{
+			SDL_CondWait(writer.cond, writer.lock);
+		}
+		if (writer.queue.empty())
+		{
+			SDL_UnlockMutex(writer.lock);
+			break;
+		}
+		Chunk * chunk = writer.queue.front();
+		writer.queue.pop_front();
+		SDL_UnlockMutex(writer.lock);
+
+		writer.Write(*chunk, buffer);
+		delete chunk;
+	}
+	return 0;
+}
+
+void Replay::Writer::Write(const Chunk & chunk, std::string & buffer)
+{
+	buffer.clear();
+	WriteU32(buffer, chunk.first_frame);
+	WriteU32(buffer, chunk.frames);
+	WriteU32(buffer, 0);
+	chunk.Encode(buffer);
+
+	// patch data size
+	std::string size;
+	WriteU32(size, buffer.size() - chunk_header_size);
+	buffer.replace(8, 4, size);
+
+	offsets.push_back(file.tellp());
+	file.write(buffer.data(), buffer.size());
+}
 
 Replay::Replay(float framerate) :
-	version_info("VDRIFTREPLAYV16", CarInput::INVALID, framerate),
-	replaymode(IDLE)
+	version_info("VDRIFTREPLAYV17", CarInput::INVALID, framerate),
+	replaymode(IDLE),
+	has_setup(false),
+	writer(0),
+	chunk_frame(0)
 {
 	// ctor
 }
 
+Replay::~Replay()
+{
+	Reset();
+}
+
 bool Replay::StartPlaying(const std::string & replayfilename, std::ostream & error_output)
 {
 	Reset();
@@ -44,8 +399,23 @@ bool Replay::StartPlaying(const std::string & replayfilename, std::ostream & err
 		return false;
 	}
 
-	if (!Load(replaystream, error_output))
+	char format[stream_version_size];
+	replaystream.read(format, stream_version_size);
+	const bool streamed = replaystream && std::memcmp(format, stream_version, stream_version_size) == 0;
+	replaystream.seekg(0);
+	if (streamed)
+	{
+		replaystream.close();
+		if (!OpenStream(replayfilename, error_output))
+		{
+			Reset();
+			return false;
+		}
+	}
+	else if (!Load(replaystream, error_output))
+	{
 		return false;
+	}
 
 	for (size_t i = 0; i < carstate.size(); ++i)
 	{
@@ -59,15 +429,32 @@ bool Replay::StartPlaying(const std::string & replayfilename, std::ostream & err
 
 void Replay::Reset()
 {
+	// discard unfinished stream recording
+	if (writer)
+	{
+		writer->Finish();
+		delete writer;
+		writer = 0;
+		std::remove(stream_filename.c_str());
+	}
+	stream_filename.clear();
+	chunk_frame = 0;
+	stream.Close();
+	chunks.clear();
+
 	replaymode = IDLE;
 	track.clear();
 	carinfo.clear();
 	carstate.clear();
+	setup = Setup();
+	has_setup = false;
 }
 
 void Replay::StartRecording(
 	const std::vector<CarInfo> & ncarinfo,
 	const std::string & trackname,
+	const Setup & nsetup,
+	const std::string & streamfilename,
 	std::ostream & error_log)
 {
 	Reset();
@@ -75,18 +462,55 @@ void Replay::StartRecording(
 	replaymode = RECORDING;
 	carinfo = ncarinfo;
 	track = trackname;
+	setup = nsetup;
+	has_setup = true;
 
 	carstate.resize(carinfo.size());
 	for (size_t i = 0; i < carstate.size(); ++i)
 	{
 		carstate[i].Reset();
 	}
+
+	if (!streamfilename.empty())
+	{
+		std::string header;
+		joeserialize::BinaryWriter serialize_output(header);
+		version_info.Serialize(serialize_output);
+		SerializeHeader(serialize_output);
+		setup.Serialize(serialize_output);
+
+		writer = new Writer();
+		if (writer->Open(streamfilename, header))
+		{
+			stream_filename = streamfilename;
+		}
+		else
+		{
+			error_log << "Error creating replay file: " << streamfilename << std::endl;
+			delete writer;
+			writer = 0;
+		}
+	}
 }
 
 void Replay::StopRecording(const std::string & replayfilename)
 {
 	replaymode = IDLE;
-	if (!replayfilename.empty())
+	if (writer)
+	{
+		while (!carstate.empty() && carstate[0].frame > chunk_frame)
+			FlushChunk(std::min(chunk_frame + CHUNK_FRAMES, carstate[0].frame));
+		const bool good = writer->Finish();
+		delete writer;
+		writer = 0;
+
+		std::remove(replayfilename.c_str());
+		if (!good || replayfilename.empty() ||
+			std::rename(stream_filename.c_str(), replayfilename.c_str()) != 0)
+			std::remove(stream_filename.c_str());
+		Reset();
+	}
+	else if (!replayfilename.empty())
 	{
 		std::ofstream f(replayfilename.c_str(), std::ios::binary);
 		if (f)
@@ -101,9 +525,32 @@ const std::vector<float> & Replay::PlayFrame(unsigned carid, CarDynamics & car)
 	assert(carid < carstate.size());
 	assert(unsigned(version_info.inputs_supported) == CarInput::INVALID);
 
-	if (GetPlaying() && !carstate[carid].PlayFrame(car))
+	if (GetPlaying())
+	{
+		// streams continue in the next chunk
+		CarState & cs = carstate[carid];
+		const bool loaded = chunks.empty() || LoadChunk(carid, cs.frame + 1);
+		const bool more_chunks = cs.chunk + 1 < int(chunks.size());
+		if (!loaded || (!cs.PlayFrame(car) && !more_chunks))
+			replaymode = IDLE;
+	}
+	return carstate[carid].inputbuffer;
+}
+
+const std::vector<float> & Replay::CheckFrame(unsigned carid, const std::string * & state)
+{
+	assert(carid < carstate.size());
+	assert(unsigned(version_info.inputs_supported) == CarInput::INVALID);
+
+	state = 0;
+	if (GetPlaying())
 	{
-		replaymode = IDLE;
+		CarState & cs = carstate[carid];
+		const bool loaded = chunks.empty() || LoadChunk(carid, cs.frame);
+		if (!loaded || cs.frame >= GetNumFrames())
+			replaymode = IDLE;
+		else
+			state = cs.CheckFrame();
 	}
 	return carstate[carid].inputbuffer;
 }
@@ -120,7 +567,55 @@ void Replay::RecordFrame(unsigned carid, const std::vector <float> & inputs, Car
 			replaymode = IDLE;
 
 		carstate[carid].RecordFrame(inputs, car);
+
+		// the last car completes a frame, stream full chunks
+		// the newest chunk stays in memory, it can still be rewound
+		if (writer && carid + 1 == carstate.size() &&
+			carstate[carid].frame - chunk_frame >= 2 * CHUNK_FRAMES)
+			FlushChunk(chunk_frame + CHUNK_FRAMES);
+	}
+}
+
+bool Replay::Rewind(unsigned frames)
+{
+	// the first frame of a chunk is a state frame, keep it to restore the input delta base
+	const unsigned first = chunk_frame ? chunk_frame + 1 : 0;
+	if (!GetRecording() || carstate.empty() || carstate[0].frame < first + frames)
+		return false;
+
+	const unsigned frame = carstate[0].frame - frames;
+	for (size_t i = 0; i < carstate.size(); ++i)
+	{
+		carstate[i].Truncate(frame);
+	}
+	return true;
+}
+
+void Replay::FlushChunk(unsigned end)
+{
+	assert(writer);
+	if (carstate.empty() || end <= chunk_frame)
+		return;
+
+	Chunk * chunk = new Chunk(chunk_frame, end - chunk_frame, carstate.size());
+	for (size_t i = 0; i < carstate.size(); ++i)
+	{
+		CarState & cs = carstate[i];
+		unsigned inputs = 0, states = 0;
+		while (inputs < cs.inputframes.size() && cs.inputframes[inputs].GetFrame() < end)
+			inputs++;
+		while (states < cs.stateframes.size() && cs.stateframes[states].GetFrame() < end)
+			states++;
+
+		CarState & out = chunk->cars[i];
+		out.inputframes.assign(cs.inputframes.begin(), cs.inputframes.begin() + inputs);
+		out.stateframes.assign(cs.stateframes.begin(), cs.stateframes.begin() + states);
+		cs.inputframes.erase(cs.inputframes.begin(), cs.inputframes.begin() + inputs);
+		cs.stateframes.erase(cs.stateframes.begin(), cs.stateframes.begin() + states);
+		cs.BuildIndex();
 	}
+	chunk_frame = end;
+	writer->Push(chunk);
 }
 
 void Replay::CarState::RecordFrame(const std::vector <float> & inputs, CarDynamics & car)
@@ -141,19 +636,49 @@ void Replay::CarState::RecordFrame(const std::vector <float> & inputs, CarDynami
 		inputframes.push_back(newinputframe);
 
 	// record every 30th state, input frame
-	if (frame % 30 == 0)
+	if (frame % STATE_INTERVAL == 0)
 	{
-		std::ostringstream statestream;
-		joeserialize::BinaryOutputSerializer serialize_output(statestream);
-		car.Serialize(serialize_output);
+		const std::string state = SerializeCar(car);
+		keyframes.push_back(KeyFrame(frame, stateframes.size(), inputframes.size()));
 		stateframes.push_back(StateFrame(frame));
-		stateframes.back().SetBinaryStateData(statestream.str());
+		stateframes.back().SetBinaryStateData(state);
 		stateframes.back().SetInputSnapshot(inputs);
 	}
 
 	frame++;
 }
 
+void Replay::CarState::Truncate(unsigned newframe)
+{
+	assert(newframe <= frame);
+	while (!inputframes.empty() && inputframes.back().GetFrame() >= newframe)
+		inputframes.pop_back();
+	while (!stateframes.empty() && stateframes.back().GetFrame() >= newframe)
+		stateframes.pop_back();
+	while (!keyframes.empty() && keyframes.back().frame >= newframe)
+		keyframes.pop_back();
+	frame = newframe;
+
+	// the next input delta frame is coded against the inputs of the last kept frame
+	if (keyframes.empty())
+	{
+		assert(newframe == 0);
+		inputbuffer.assign(inputbuffer.size(), 0);
+		return;
+	}
+
+	const KeyFrame & keyframe = keyframes.back();
+	const std::vector<float> & snapshot = stateframes[keyframe.stateframe].GetInputSnapshot();
+	for (unsigned i = 0; i < inputbuffer.size() && i < snapshot.size(); i++)
+	{
+		inputbuffer[i] = snapshot[i];
+	}
+	for (unsigned i = keyframe.inputframe; i < inputframes.size(); i++)
+	{
+		ProcessPlayInputFrame(inputframes[i]);
+	}
+}
+
 bool Replay::CarState::PlayFrame(CarDynamics & car)
 {
 	frame++;
@@ -180,6 +705,79 @@ bool Replay::CarState::PlayFrame(CarDynamics & car)
 	return (cur_stateframe != stateframes.size() || cur_inputframe != inputframes.size());
 }
 
+const std::string * Replay::CarState::CheckFrame()
+{
+	assert(inputbuffer.size() == CarInput::INVALID);
+
+	// same frame numbering as RecordFrame, the state follows the inputs
+	while (cur_inputframe < inputframes.size() &&
+		inputframes[cur_inputframe].GetFrame() <= frame)
+	{
+		ProcessPlayInputFrame(inputframes[cur_inputframe]);
+		cur_inputframe++;
+	}
+
+	const std::string * state = 0;
+	while (cur_stateframe < stateframes.size() &&
+		stateframes[cur_stateframe].GetFrame() <= frame)
+	{
+		if (stateframes[cur_stateframe].GetFrame() == frame)
+			state = &stateframes[cur_stateframe].GetBinaryStateData();
+		cur_stateframe++;
+	}
+
+	frame++;
+	return state;
+}
+
+void Replay::CarState::BuildIndex()
+{
+	keyframes.clear();
+	keyframes.reserve(stateframes.size());
+	unsigned inputframe = 0;
+	for (unsigned i = 0; i < stateframes.size(); ++i)
+	{
+		const unsigned stateframe = stateframes[i].GetFrame();
+		while (inputframe < inputframes.size() &&
+			inputframes[inputframe].GetFrame() <= stateframe)
+		{
+			inputframe++;
+		}
+		keyframes.push_back(KeyFrame(stateframe, i, inputframe));
+	}
+}
+
+int Replay::CarState::FindKeyFrame(unsigned target) const
+{
+	// binary search for the first keyframe after target
+	int first = 0;
+	int count = keyframes.size();
+	while (count > 0)
+	{
+		const int step = count / 2;
+		if (keyframes[first + step].frame <= target)
+		{
+			first += step + 1;
+			count -= step + 1;
+		}
+		else
+		{
+			count = step;
+		}
+	}
+	return first - 1;
+}
+
+void Replay::CarState::PlayKeyFrame(const KeyFrame & keyframe, CarDynamics & car)
+{
+	// same playback position as after PlayFrame reached keyframe.frame
+	assert(keyframe.stateframe < stateframes.size());
+	frame = keyframe.frame;
+	cur_stateframe = keyframe.stateframe + 1;
+	cur_inputframe = keyframe.inputframe;
+	ProcessPlayStateFrame(stateframes[keyframe.stateframe], car);
+}
+
 void Replay::CarState::ProcessPlayInputFrame(const InputFrame & frame)
 {
 	for (unsigned i = 0; i < frame.GetNumInputs(); i++)
@@ -198,12 +796,473 @@ void Replay::CarState::ProcessPlayStateFrame(const StateFrame & frame, CarDynami
 	}
 
 	// process binary car state
-	std::istringstream statestream(frame.GetBinaryStateData());
-	joeserialize::BinaryInputSerializer serialize_input(statestream);
+	joeserialize::BinaryReader serialize_input(frame.GetBinaryStateData());
 	car.Serialize(serialize_input);
 }
 
-bool Replay::Serialize(joeserialize::Serializer & s)
+unsigned Replay::GetFrame() const
+{
+	return carstate.empty() ? 0 : carstate[0].frame;
+}
+
+unsigned Replay::GetNumFrames() const
+{
+	if (!chunks.empty())
+		return chunks.back().first_frame + chunks.back().frames;
+
+	unsigned frames = 0;
+	for (size_t i = 0; i < carstate.size(); ++i)
+	{
+		const CarState & cs = carstate[i];
+		if (!cs.inputframes.empty())
+			frames = std::max(frames, cs.inputframes.back().GetFrame() + 1);
+		if (!cs.stateframes.empty())
+			frames = std::max(frames, cs.stateframes.back().GetFrame() + 1);
+	}
+	return frames;
+}
+
+std::string Replay::SerializeCar(CarDynamics & car)
+{
+	std::string state;
+	joeserialize::BinaryWriter serialize_output(state);
+	car.Serialize(serialize_output);
+	return state;
+}
+
+bool Replay::GetKeyFrame() const
+{
+	return GetPlaying() && GetFrame() % STATE_INTERVAL == 0;
+}
+
+bool Replay::Seek(
+	unsigned frame,
+	CarDynamics cars[],
+	unsigned count,
+	DynamicsWorld & world,
+	SeekListener * listener)
+{
+	assert(count == carstate.size());
+	if (!GetPlaying() || carstate.empty())
+		return false;
+
+	// streams have to restore a keyframe if frame is in another chunk,
+	// keep the current chunks to stay at the current position on failure
+	bool chunk_changed = false;
+	std::vector<CarState> previous;
+	if (!chunks.empty())
+	{
+		const int chunk = FindChunk(frame);
+		for (unsigned i = 0; i < count && !chunk_changed; ++i)
+		{
+			chunk_changed = (carstate[i].chunk != chunk);
+		}
+		if (chunk_changed)
+		{
+			previous = carstate;
+			for (unsigned i = 0; i < count; ++i)
+			{
+				if (!LoadChunk(i, frame))
+				{
+					carstate.swap(previous);
+					return false;
+				}
+			}
+		}
+	}
+
+	// cars are recorded in lockstep, use the earliest keyframe of all cars
+	unsigned keyframe = frame;
+	for (unsigned i = 0; i < count; ++i)
+	{
+		const int k = carstate[i].FindKeyFrame(frame);
+		keyframe = (k < 0) ? 0 : std::min(keyframe, carstate[i].keyframes[k].frame);
+	}
+
+	// restore keyframe unless it is closer to play on from the current frame
+	unsigned start = GetFrame();
+	bool restore = (chunk_changed || frame < start || frame - start > frame - keyframe);
+	for (unsigned i = 0; i < count && restore; ++i)
+	{
+		const int k = carstate[i].FindKeyFrame(keyframe);
+		restore = (k >= 0 && carstate[i].keyframes[k].frame == keyframe);
+	}
+	if (restore)
+	{
+		for (unsigned i = 0; i < count; ++i)
+		{
+			CarState & cs = carstate[i];
+			cs.PlayKeyFrame(cs.keyframes[cs.FindKeyFrame(keyframe)], cars[i]);
+			cars[i].Update(cs.inputbuffer);
+		}
+		start = keyframe;
+		if (listener)
+			listener->SeekRestored(start);
+	}
+	else if (frame < start || chunk_changed)
+	{
+		if (chunk_changed)
+			carstate.swap(previous);
+		return false;
+	}
+
+	// play on without rendering, the way the game loop does
+	const float dt = version_info.framerate;
+	for (unsigned n = start; n < frame && GetPlaying(); ++n)
+	{
+		world.update(dt);
+		for (unsigned i = 0; i < count; ++i)
+		{
+			cars[i].Update(PlayFrame(i, cars[i]));
+		}
+		if (listener)
+			listener->SeekStepped(GetFrame());
+	}
+
+	return true;
+}
+
+bool Replay::Convert(
+	const std::string & infilename,
+	const std::string & outfilename,
+	std::ostream & error_output)
+{
+	if (!StartPlaying(infilename, error_output))
+		return false;
+
+	if (!chunks.empty())
+	{
+		error_output << "Replay is already streamed: " << infilename << std::endl;
+		Reset();
+		return false;
+	}
+
+	std::string header;
+	joeserialize::BinaryWriter serialize_output(header);
+	version_info.Serialize(serialize_output);
+	SerializeHeader(serialize_output);
+
+	Writer converter;
+	if (!converter.Open(outfilename, header))
+	{
+		error_output << "Error creating replay file: " << outfilename << std::endl;
+		Reset();
+		return false;
+	}
+
+	// split the frames of every car into chunks
+	const unsigned frames = GetNumFrames();
+	std::vector<unsigned> inputframe(carstate.size(), 0);
+	std::vector<unsigned> stateframe(carstate.size(), 0);
+	for (unsigned first = 0; first < frames; first += CHUNK_FRAMES)
+	{
+		const unsigned end = std::min(first + CHUNK_FRAMES, frames);
+		Chunk * chunk = new Chunk(first, end - first, carstate.size());
+		for (size_t i = 0; i < carstate.size(); ++i)
+		{
+			const CarState & cs = carstate[i];
+			CarState & cc = chunk->cars[i];
+			for (; inputframe[i] < cs.inputframes.size() &&
+				cs.inputframes[inputframe[i]].GetFrame() < end; ++inputframe[i])
+			{
+				cc.inputframes.push_back(cs.inputframes[inputframe[i]]);
+			}
+			for (; stateframe[i] < cs.stateframes.size() &&
+				cs.stateframes[stateframe[i]].GetFrame() < end; ++stateframe[i])
+			{
+				cc.stateframes.push_back(cs.stateframes[stateframe[i]]);
+			}
+		}
+		converter.Push(chunk);
+	}
+
+	Reset();
+	if (!converter.Finish())
+	{
+		error_output << "Error writing replay file: " << outfilename << std::endl;
+		return false;
+	}
+	return true;
+}
+
+template <class S>
+bool Replay::SerializeHeader(S & s)
+{
+	_SERIALIZE_(s, track);
+	_SERIALIZE_(s, carinfo);
+	return true;
+}
+
+bool Replay::OpenStream(const std::string & filename, std::ostream & error_output)
+{
+	if (!stream.Open(filename))
+	{
+		error_output << "Error mapping replay file: " << filename << std::endl;
+		return false;
+	}
+
+	const char * data = stream.GetData();
+	const std::size_t size = stream.GetSize();
+	const std::size_t header_offset = stream_version_size + 4;
+	if (size < header_offset || size - header_offset < ReadU32(data + stream_version_size))
+	{
+		error_output << "Truncated replay file: " << filename << std::endl;
+		return false;
+	}
+
+	// header, version info followed by track and cars
+	const std::size_t header_size = ReadU32(data + stream_version_size);
+	joeserialize::BinaryReader serialize_input(data + header_offset, header_size);
+	Version file_version(stream_version, 0, 0);
+	if (!file_version.Serialize(serialize_input) || !SerializeHeader(serialize_input))
+	{
+		error_output << "Error loading replay header: " << filename << std::endl;
+		return false;
+	}
+
+	// the setup follows if the stream was recorded with one
+	has_setup = setup.Serialize(serialize_input);
+	if (!has_setup)
+		setup = Setup();
+
+	Version expected_version(version_info);
+	expected_version.format_version = stream_version;
+	if (!(file_version == expected_version))
+	{
+		error_output << "Stream version " <<
+			file_version.inputs_supported << "/" <<
+			file_version.framerate <<
+			" does not match expected version " <<
+			version_info.inputs_supported << "/" <<
+			version_info.framerate << std::endl;
+		return false;
+	}
+
+	// chunk index, scan the chunks if the recording was cut short
+	chunks.clear();
+	std::vector<std::size_t> offsets;
+	const std::size_t chunks_offset = header_offset + header_size;
+	if (size >= chunks_offset + footer_size &&
+		std::memcmp(data + size - 4, stream_footer, 4) == 0)
+	{
+		const uint64_t index_offset = ReadU64(data + size - footer_size);
+		const uint32_t count = ReadU32(data + size - 8);
+		if (index_offset >= chunks_offset && index_offset + uint64_t(count) * 8 + footer_size == size)
+		{
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				offsets.push_back(ReadU64(data + index_offset + i * 8));
+			}
+		}
+	}
+	if (offsets.empty())
+	{
+		std::size_t offset = chunks_offset;
+		while (offset + chunk_header_size <= size &&
+			ReadU32(data + offset + 8) <= size - offset - chunk_header_size)
+		{
+			offsets.push_back(offset);
+			offset += chunk_header_size + ReadU32(data + offset + 8);
+		}
+	}
+
+	for (std::size_t i = 0; i < offsets.size(); ++i)
+	{
+		const std::size_t offset = offsets[i];
+		if (offset < chunks_offset || offset + chunk_header_size > size ||
+			ReadU32(data + offset + 8) > size - offset - chunk_header_size)
+		{
+			error_output << "Corrupt replay chunk index: " << filename << std::endl;
+			chunks.clear();
+			return false;
+		}
+
+		ChunkInfo info;
+		info.offset = offset + chunk_header_size;
+		info.size = ReadU32(data + offset + 8);
+		info.first_frame = ReadU32(data + offset);
+		info.frames = ReadU32(data + offset + 4);
+		chunks.push_back(info);
+	}
+
+	carstate.resize(carinfo.size());
+	return true;
+}
+
+int Replay::FindChunk(unsigned frame) const
+{
+	// last chunk starting at or before frame
+	int first = 0;
+	int count = chunks.size();
+	while (count > 0)
+	{
+		const int step = count / 2;
+		if (chunks[first + step].first_frame <= frame)
+		{
+			first += step + 1;
+			count -= step + 1;
+		}
+		else
+		{
+			count = step;
+		}
+	}
+	return std::max(first - 1, 0);
+}
+
+bool Replay::LoadChunk(unsigned carid, unsigned frame)
+{
+	assert(carid < carstate.size());
+	if (chunks.empty())
+		return false;
+
+	CarState & cs = carstate[carid];
+	const int chunk = FindChunk(frame);
+	if (cs.chunk == chunk)
+		return true;
+
+	cs.chunk = -1;
+	cs.cur_inputframe = 0;
+	cs.cur_stateframe = 0;
+	const ChunkInfo & info = chunks[chunk];
+	if (!Chunk::Decode(stream.GetData() + info.offset, info.size, carid, cs))
+		return false;
+
+	cs.chunk = chunk;
+	return true;
+}
+
+Replay::Chunk::Chunk(unsigned first_frame, unsigned frames, unsigned cars) :
+	first_frame(first_frame),
+	frames(frames),
+	cars(cars)
+{
+	// ctor
+}
+
+void Replay::Chunk::Encode(std::string & out) const
+{
+	std::string data;
+	for (size_t c = 0; c < cars.size(); ++c)
+	{
+		const CarState & car = cars[c];
+		data.clear();
+
+		// inputs, frame delta coded
+		unsigned frame = first_frame;
+		WriteVarint(data, car.inputframes.size());
+		for (size_t i = 0; i < car.inputframes.size(); ++i)
+		{
+			const InputFrame & inputframe = car.inputframes[i];
+			WriteVarint(data, inputframe.GetFrame() - frame);
+			WriteVarint(data, inputframe.GetNumInputs());
+			for (unsigned n = 0; n < inputframe.GetNumInputs(); ++n)
+			{
+				WriteVarint(data, inputframe.GetInput(n).first);
+				WriteInput(data, inputframe.GetInput(n).second);
+			}
+			frame = inputframe.GetFrame();
+		}
+
+		// states, delta coded against the previous state in the chunk
+		const std::string empty;
+		WriteVarint(data, car.stateframes.size());
+		for (size_t i = 0; i < car.stateframes.size(); ++i)
+		{
+			const StateFrame & stateframe = car.stateframes[i];
+			const std::vector<float> & snapshot = stateframe.GetInputSnapshot();
+			WriteVarint(data, stateframe.GetFrame() - first_frame);
+			WriteVarint(data, snapshot.size());
+			for (size_t n = 0; n < snapshot.size(); ++n)
+			{
+				WriteInput(data, snapshot[n]);
+			}
+			const std::string & prev = i ? car.stateframes[i - 1].GetBinaryStateData() : empty;
+			WriteState(data, stateframe.GetBinaryStateData(), prev);
+		}
+
+		WriteU32(out, data.size());
+		out.append(data);
+	}
+}
+
+bool Replay::Chunk::Decode(const char * data, unsigned size, unsigned carid, CarState & car)
+{
+	car.inputframes.clear();
+	car.stateframes.clear();
+	car.keyframes.clear();
+
+	// skip other cars
+	const char * p = data;
+	const char * end = data + size;
+	for (unsigned c = 0; c < carid; ++c)
+	{
+		if (end - p < 4 || ReadU32(p) > uint32_t(end - p - 4))
+			return false;
+		p += 4 + ReadU32(p);
+	}
+	if (end - p < 4 || ReadU32(p) > uint32_t(end - p - 4))
+		return false;
+	end = p + 4 + ReadU32(p);
+	p += 4;
+
+	const unsigned first_frame = ReadU32(data - chunk_header_size);
+	unsigned frame = first_frame;
+	uint32_t count;
+	if (!ReadVarint(p, end, count) || count > uint32_t(end - p))
+		return false;
+	car.inputframes.reserve(count);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		uint32_t delta, inputs;
+		if (!ReadVarint(p, end, delta) || !ReadVarint(p, end, inputs))
+			return false;
+
+		frame += delta;
+		car.inputframes.push_back(InputFrame(frame));
+		for (uint32_t n = 0; n < inputs; ++n)
+		{
+			uint32_t index;
+			float value;
+			if (!ReadVarint(p, end, index) || index >= CarInput::INVALID || !ReadInput(p, end, value))
+				return false;
+			car.inputframes.back().AddInput(index, value);
+		}
+	}
+
+	if (!ReadVarint(p, end, count) || count > uint32_t(end - p))
+		return false;
+	car.stateframes.reserve(count);
+	std::vector<float> snapshot;
+	std::string state;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		uint32_t offset, inputs;
+		if (!ReadVarint(p, end, offset) || !ReadVarint(p, end, inputs) || inputs > CarInput::INVALID)
+			return false;
+
+		snapshot.resize(inputs);
+		for (uint32_t n = 0; n < inputs; ++n)
+		{
+			if (!ReadInput(p, end, snapshot[n]))
+				return false;
+		}
+
+		const std::string prev = i ? car.stateframes[i - 1].GetBinaryStateData() : std::string();
+		if (!ReadState(p, end, prev, state))
+			return false;
+
+		car.stateframes.push_back(StateFrame(first_frame + offset));
+		car.stateframes.back().SetInputSnapshot(snapshot);
+		car.stateframes.back().SetBinaryStateData(state);
+	}
+
+	car.BuildIndex();
+	return true;
+}
+
+template <class S>
+bool Replay::Serialize(S & s)
 {
 	_SERIALIZE_(s, track);
 	_SERIALIZE_(s, carinfo);
@@ -211,6 +1270,8 @@ bool Replay::Serialize(joeserialize::Serializer & s)
 	return true;
 }
 
+_SERIALIZE_INSTANTIATE_(Replay);
+
 void Replay::Save(std::ostream & outstream)
 {
 	// write the file format version data manually
@@ -219,18 +1280,36 @@ void Replay::Save(std::ostream & outstream)
 	// which isn't exactly what we want
 	version_info.Save(outstream);
 
-	joeserialize::BinaryOutputSerializer serialize_output(outstream);
+	std::string data;
+	joeserialize::BinaryWriter serialize_output(data);
 	Serialize(serialize_output);
+	SerializeIndex(serialize_output);
+	outstream.write(data.data(), data.size());
 
 	Reset();
 }
 
+template <class S>
+bool Replay::SerializeIndex(S & s)
+{
+	for (size_t i = 0; i < carstate.size(); ++i)
+	{
+		_SERIALIZE_(s, carstate[i].keyframes);
+	}
+	return true;
+}
+
 bool Replay::Load(std::istream & instream, std::ostream & error_output)
 {
 	Version stream_version;
 	stream_version.Load(instream);
 
-	if (!(stream_version == version_info))
+	// V16 is V17 without the keyframe index
+	Version legacy_version(version_info);
+	legacy_version.format_version = "VDRIFTREPLAYV16";
+	const bool legacy = (stream_version == legacy_version);
+
+	if (!legacy && !(stream_version == version_info))
 	{
 		error_output << "Stream version " <<
 			stream_version.format_version << "/" <<
@@ -243,13 +1322,20 @@ bool Replay::Load(std::istream & instream, std::ostream & error_output)
 		return false;
 	}
 
-	joeserialize::BinaryInputSerializer serialize_input(instream);
-	if (!Serialize(serialize_input))
+	const std::string data((std::istreambuf_iterator<char>(instream)), std::istreambuf_iterator<char>());
+	joeserialize::BinaryReader serialize_input(data);
+	if (!Serialize(serialize_input) || (!legacy && !SerializeIndex(serialize_input)))
 	{
 		error_output << "Error loading replay." << std::endl;
 		return false;
 	}
 
+	for (size_t i = 0; i < carstate.size(); ++i)
+	{
+		if (carstate[i].keyframes.size() != carstate[i].stateframes.size())
+			carstate[i].BuildIndex();
+	}
+
 	return true;
 }
 
@@ -269,13 +1355,16 @@ Replay::Version::Version(const std::string & ver,  unsigned ins, float newfr) :
 	// ctor
 }
 
-bool Replay::Version::Serialize(joeserialize::Serializer & s)
+template <class S>
+bool Replay::Version::Serialize(S & s)
 {
 	_SERIALIZE_(s, inputs_supported);
 	_SERIALIZE_(s, framerate);
 	return true;
 }
 
+_SERIALIZE_INSTANTIATE_(Replay::Version);
+
 void Replay::Version::Save(std::ostream & outstream)
 {
 	// write the file format version data manually
@@ -311,6 +1400,60 @@ bool Replay::Version::operator==(const Version & other) const
 			framerate == other.framerate);
 }
 
+Replay::KeyFrame::KeyFrame() :
+	frame(0),
+	stateframe(0),
+	inputframe(0)
+{
+	// ctor
+}
+
+Replay::KeyFrame::KeyFrame(unsigned newframe, unsigned newstateframe, unsigned newinputframe) :
+	frame(newframe),
+	stateframe(newstateframe),
+	inputframe(newinputframe)
+{
+	// ctor
+}
+
+template <class S>
+bool Replay::KeyFrame::Serialize(S & s)
+{
+	_SERIALIZE_(s, frame);
+	_SERIALIZE_(s, stateframe);
+	_SERIALIZE_(s, inputframe);
+	return true;
+}
+
+_SERIALIZE_INSTANTIATE_(Replay::KeyFrame);
+
+Replay::Setup::Setup() :
+	abs(false),
+	tcs(false),
+	autoshift(false),
+	autoclutch(false),
+	damage(false),
+	track_reverse(false),
+	track_dynamic(false)
+{
+	// ctor
+}
+
+template <class S>
+bool Replay::Setup::Serialize(S & s)
+{
+	_SERIALIZE_(s, abs);
+	_SERIALIZE_(s, tcs);
+	_SERIALIZE_(s, autoshift);
+	_SERIALIZE_(s, autoclutch);
+	_SERIALIZE_(s, damage);
+	_SERIALIZE_(s, track_reverse);
+	_SERIALIZE_(s, track_dynamic);
+	return true;
+}
+
+_SERIALIZE_INSTANTIATE_(Replay::Setup);
+
 Replay::InputFrame::InputFrame() :
 	frame(0)
 {
@@ -323,13 +1466,16 @@ Replay::InputFrame::InputFrame(unsigned newframe) :
 	// ctor
 }
 
-bool Replay::InputFrame::Serialize(joeserialize::Serializer & s)
+template <class S>
+bool Replay::InputFrame::Serialize(S & s)
 {
 	_SERIALIZE_(s, frame);
 	_SERIALIZE_(s, inputs);
 	return true;
 }
 
+_SERIALIZE_INSTANTIATE_(Replay::InputFrame);
+
 void Replay::InputFrame::AddInput(int index, float value)
 {
 	inputs.push_back(std::make_pair(index, value));
@@ -363,7 +1509,8 @@ Replay::StateFrame::StateFrame(unsigned newframe) :
 	// ctor
 }
 
-bool Replay::StateFrame::Serialize(joeserialize::Serializer & s)
+template <class S>
+bool Replay::StateFrame::Serialize(S & s)
 {
 	_SERIALIZE_(s, frame);
 	_SERIALIZE_(s, binary_state_data);
@@ -371,6 +1518,8 @@ bool Replay::StateFrame::Serialize(joeserialize::Serializer & s)
 	return true;
 }
 
+_SERIALIZE_INSTANTIATE_(Replay::StateFrame);
+
 void Replay::StateFrame::SetBinaryStateData(const std::string & value)
 {
 	binary_state_data = value;
@@ -408,15 +1557,19 @@ void Replay::CarState::Reset()
 	cur_inputframe = 0;
 	cur_stateframe = 0;
 	frame = 0;
+	chunk = -1;
 }
 
-bool Replay::CarState::Serialize(joeserialize::Serializer & s)
+template <class S>
+bool Replay::CarState::Serialize(S & s)
 {
 	_SERIALIZE_(s, inputframes);
 	_SERIALIZE_(s, stateframes);
 	return true;
 }
 
+_SERIALIZE_INSTANTIATE_(Replay::CarState);
+
 QT_TEST(replay_test)
 {
 	/*//basic version validity check
@@ -427,3 +1580,91 @@ QT_TEST(replay_test)
 		QT_CHECK(replay.Load(teststream, std::cerr));
 	}*/
 }
+
+QT_TEST(replay_stream_test)
+{
+	// varints
+	{
+		std::string data;
+		const uint32_t values[] = {0, 127, 128, 300, 0xffffffff};
+		for (int i = 0; i < 5; ++i)
+			WriteVarint(data, values[i]);
+		const char * p = data.data();
+		const char * end = p + data.size();
+		for (int i = 0; i < 5; ++i)
+		{
+			uint32_t v;
+			QT_CHECK(ReadVarint(p, end, v));
+			QT_CHECK_EQUAL(v, values[i]);
+		}
+		QT_CHECK(p == end);
+	}
+
+	// inputs are lossless, compact for common values
+	{
+		std::string data;
+		const float values[] = {0.0f, 1.0f, float(257) / 65535.0f, 0.1f, -0.25f, 2.0f};
+		for (int i = 0; i < 6; ++i)
+			WriteInput(data, values[i]);
+		QT_CHECK_EQUAL(data.size(), 1 + 1 + 3 + 5 + 5 + 5);
+		const char * p = data.data();
+		const char * end = p + data.size();
+		for (int i = 0; i < 6; ++i)
+		{
+			float v;
+			QT_CHECK(ReadInput(p, end, v));
+			QT_CHECK_EQUAL(v, values[i]);
+		}
+		QT_CHECK(p == end);
+	}
+
+	// states round trip, unchanged bytes cost next to nothing
+	{
+		std::string prev(200, 'a'), state(prev);
+		state[3] = 'b';
+		state[150] = 'c';
+		state[151] = 'd';
+		state.append("tail");
+
+		std::string data;
+		WriteState(data, state, prev);
+		WriteState(data, prev, std::string());
+		QT_CHECK(data.size() < 20 + 4 + prev.size());
+
+		const char * p = data.data();
+		const char * end = p + data.size();
+		std::string decoded;
+		QT_CHECK(ReadState(p, end, prev, decoded));
+		QT_CHECK(decoded == state);
+		QT_CHECK(ReadState(p, end, std::string(), decoded));
+		QT_CHECK(decoded == prev);
+		QT_CHECK(p == end);
+
+		// truncated data
+		p = data.data();
+		QT_CHECK(!ReadState(p, p + 5, prev, decoded));
+	}
+
+	// unchanged state as the last record, a car at rest in the final frame
+	{
+		std::string prev(1000, 'a');
+		prev[500] = 'b';
+
+		std::string data;
+		WriteState(data, prev, prev);
+		QT_CHECK(data.size() < 8);
+
+		const char * p = data.data();
+		const char * end = p + data.size();
+		std::string decoded;
+		QT_CHECK(ReadState(p, end, prev, decoded));
+		QT_CHECK(decoded == prev);
+		QT_CHECK(p == end);
+
+		// oversized state
+		data.clear();
+		WriteVarint(data, max_state_size + 1);
+		p = data.data();
+		QT_CHECK(!ReadState(p, p + data.size(), prev, decoded));
+	}
+}
@@ -22,19 +22,24 @@
 
 #include "carinfo.h"
 #include "joeserialize.h"
+#include "mappedfile.h"
 #include "macros.h"
 
 #include <iosfwd>
 #include <string>
 
 class CarDynamics;
+class DynamicsWorld;
 
 class Replay
 {
 public:
 	Replay(float framerate);
 
-	/// true on success
+	~Replay();
+
+	/// play V16, V17 or V20 replay file, true on success
+	/// V20 files are memory mapped and decoded one chunk at a time
 	bool StartPlaying(
 		const std::string & replayfilename,
 		std::ostream & error_output);
@@ -45,12 +50,35 @@ public:
 	/// true if the replay system is currently playing
 	bool GetPlaying() const;
 
+	/// game settings the cars and the track were set up with
+	struct Setup
+	{
+		bool abs;
+		bool tcs;
+		bool autoshift;
+		bool autoclutch;
+		bool damage;
+		bool track_reverse;
+		bool track_dynamic;
+
+		Setup();
+
+		template <class S>
+		bool Serialize(S & s);
+	};
+
+	/// record to a V20 stream written to streamfilename while recording
+	/// record in memory if streamfilename is empty, saved as V17
+	/// the setup is kept in the V20 header only
 	void StartRecording(
 		const std::vector<CarInfo> & carinfo,
 		const std::string & trackname,
+		const Setup & setup,
+		const std::string & streamfilename,
 		std::ostream & error_log);
 
 	/// if replayfilename is empty, do not save the data
+	/// a V20 stream is moved to replayfilename
 	void StopRecording(const std::string & replayfilename);
 
 	/// true if the replay system is currently recording
@@ -59,18 +87,77 @@ public:
 	/// set car state, return car inputs
 	const std::vector<float> & PlayFrame(unsigned carid, CarDynamics & car);
 
+	/// return car inputs without restoring car states, for determinism checks
+	/// state is set to the car state recorded after the update with these inputs, or NULL
+	const std::vector<float> & CheckFrame(unsigned carid, const std::string * & state);
+
 	/// record car inputs and state
 	void RecordFrame(unsigned carid, const std::vector <float> & inputs, CarDynamics & car);
 
-	bool Serialize(joeserialize::Serializer & s);
+	/// drop the last frames recorded frames of all cars, to follow a rewind
+	/// the last CHUNK_FRAMES frames at least are kept back from the writer
+	/// returns false if not recording or the frames have been written already
+	bool Rewind(unsigned frames);
+
+	/// current playback frame
+	unsigned GetFrame() const;
+
+	/// number of recorded frames
+	unsigned GetNumFrames() const;
+
+	/// game state that has to follow the cars on seek, like lap timing
+	class SeekListener
+	{
+	public:
+		virtual ~SeekListener() {}
+
+		/// cars have been restored to the state keyframe at frame
+		virtual void SeekRestored(unsigned frame) = 0;
+
+		/// cars have been simulated forward to frame
+		virtual void SeekStepped(unsigned frame) = 0;
+	};
+
+	/// binary car state, the way state frames record it
+	static std::string SerializeCar(CarDynamics & car);
+
+	/// true if the current playback frame is a state keyframe, seek restores these
+	bool GetKeyFrame() const;
+
+	/// jump to frame, cars are restored to the nearest prior state keyframe
+	/// and simulated forward from there, stepping the world at the replay rate
+	/// listener is notified of the restore and of every simulated frame
+	/// returns false if not playing or frame is out of reach
+	bool Seek(
+		unsigned frame,
+		CarDynamics cars[],
+		unsigned count,
+		DynamicsWorld & world,
+		SeekListener * listener = 0);
+
+	/// convert a V16 or V17 replay file to V20, resets the replay
+	bool Convert(
+		const std::string & infilename,
+		const std::string & outfilename,
+		std::ostream & error_output);
+
+	template <class S>
+	bool Serialize(S & s);
 
 	const std::vector<CarInfo> & GetCarInfo() const;
 
 	const std::string & GetTrack() const;
 
+	/// setup the replay was recorded with, false if it has none
+	/// V16, V17 and converted replays do not store it
+	bool GetSetup(Setup & value) const;
+
 private:
 	friend class joeserialize::Serializer;
 
+	/// frames between state frames, frames per V20 chunk
+	enum { STATE_INTERVAL = 30, CHUNK_FRAMES = 30 * STATE_INTERVAL };
+
 	class Version
 	{
 	public:
@@ -82,7 +169,8 @@ private:
 
 		Version(const std::string & ver, unsigned ins, float newfr);
 
-		bool Serialize(joeserialize::Serializer & s);
+		template <class S>
+		bool Serialize(S & s);
 
 		void Save(std::ostream & outstream);
 
@@ -99,7 +187,8 @@ private:
 
 		InputFrame(unsigned newframe);
 
-		bool Serialize(joeserialize::Serializer & s);
+		template <class S>
+		bool Serialize(S & s);
 
 		void AddInput(int index, float value);
 
@@ -123,7 +212,8 @@ private:
 
 		StateFrame(unsigned newframe);
 
-		bool Serialize(joeserialize::Serializer & s);
+		template <class S>
+		bool Serialize(S & s);
 
 		void SetBinaryStateData(const std::string & value);
 
@@ -142,17 +232,34 @@ private:
 		std::vector<float> input_snapshot;
 	};
 
+	/// state frame index entry, state frames are the seek keyframes
+	struct KeyFrame
+	{
+		unsigned frame; ///< frame number
+		unsigned stateframe; ///< offset into stateframes
+		unsigned inputframe; ///< offset of the first input frame after frame
+
+		KeyFrame();
+
+		KeyFrame(unsigned frame, unsigned stateframe, unsigned inputframe);
+
+		template <class S>
+		bool Serialize(S & s);
+	};
+
 	struct CarState
 	{
 		/// serialized
 		std::vector<InputFrame> inputframes;
 		std::vector<StateFrame> stateframes;
+		std::vector<KeyFrame> keyframes;
 
 		/// not serialized
 		std::vector<float> inputbuffer; // buffer for input delta frame decoding
 		unsigned cur_inputframe;
 		unsigned cur_stateframe;
 		unsigned frame;
+		int chunk; // loaded V20 chunk, -1 if none
 
 		/// true if we have zero recorded frames
 		bool Empty() const;
@@ -160,20 +267,64 @@ private:
 		/// reset state
 		void Reset();
 
-		/// write state into outstream
-		bool Serialize(joeserialize::Serializer & s);
+		/// write state into outstream, keyframe index excluded
+		template <class S>
+		bool Serialize(S & s);
+
+		/// rebuild keyframe index from state and input frames
+		void BuildIndex();
+
+		/// index of the last keyframe at or before frame, -1 if there is none
+		int FindKeyFrame(unsigned frame) const;
+
+		/// restore car and playback position to keyframe
+		void PlayKeyFrame(const KeyFrame & keyframe, CarDynamics & car);
 
 		/// set car, update inputbuffer, false if we are out of frames
 		bool PlayFrame(CarDynamics & car);
 
+		/// update inputbuffer, return the recorded state of this frame or NULL
+		const std::string * CheckFrame();
+
 		/// get car state, save input delta frame
 		void RecordFrame(const std::vector<float> & inputs, CarDynamics & car);
 
+		/// drop recorded frames from newframe on, restore the input delta base
+		void Truncate(unsigned newframe);
+
 		void ProcessPlayInputFrame(const InputFrame & frame);
 
 		void ProcessPlayStateFrame(const StateFrame & frame, CarDynamics & car);
 	};
 
+	/// V20 chunk, frames of all cars
+	struct Chunk
+	{
+		unsigned first_frame;
+		unsigned frames;
+		std::vector<CarState> cars; // input and state frames only
+
+		Chunk(unsigned first_frame, unsigned frames, unsigned cars);
+
+		/// delta and varint coded inputs, xor delta and zero run coded states
+		void Encode(std::string & out) const;
+
+		/// decode frames of car carid from chunk data, false on error
+		static bool Decode(const char * data, unsigned size, unsigned carid, CarState & car);
+	};
+
+	/// V20 chunk location in the stream
+	struct ChunkInfo
+	{
+		std::size_t offset; // chunk data offset
+		unsigned size; // chunk data size
+		unsigned first_frame;
+		unsigned frames;
+	};
+
+	/// V20 chunk encoder and file writer thread
+	class Writer;
+
 	/// serialized
 	Version version_info;
 	std::string track;
@@ -183,6 +334,39 @@ private:
 	/// not serialized
 	enum {IDLE, RECORDING, PLAYING} replaymode;
 
+	/// V20 header only
+	Setup setup;
+	bool has_setup;
+
+	/// V20 playback
+	MappedFile stream;
+	std::vector<ChunkInfo> chunks;
+
+	/// V20 recording
+	Writer * writer;
+	std::string stream_filename;
+	unsigned chunk_frame; // first frame of the chunk being recorded
+
+	/// V20 header, track and car info, after the version info
+	template <class S>
+	bool SerializeHeader(S & s);
+
+	/// map V20 stream and read its chunk index, false on error
+	bool OpenStream(const std::string & filename, std::ostream & error_output);
+
+	/// index of the chunk containing frame
+	int FindChunk(unsigned frame) const;
+
+	/// decode the chunk containing frame for car carid, false on error
+	bool LoadChunk(unsigned carid, unsigned frame);
+
+	/// hand the recorded frames of all cars before end over to the writer
+	void FlushChunk(unsigned end);
+
+	/// keyframe index of all cars, stored after the cars since V17
+	template <class S>
+	bool SerializeIndex(S & s);
+
 	/// load all input and state frames to the stream
 	bool Load(std::istream & instream, std::ostream & error_output);
 
@@ -212,4 +396,11 @@ inline const std::string & Replay::GetTrack() const
 	return track;
 }
 
+inline bool Replay::GetSetup(Setup & value) const
+{
+	if (has_setup)
+		value = setup;
+	return has_setup;
+}
+
 #endif
@@ -0,0 +1,418 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "replayanalyzer.h"
+#include "replayrunner.h"
+#include "replay.h"
+#include "track.h"
+#include "timer.h"
+#include "crashdetection.h"
+#include "pathmanager.h"
+#include "jobsystem.h"
+#include "microbench.h"
+#include "physics/cardynamics.h"
+#include "physics/dynamicsworld.h"
+#include "unittest.h"
+
+#include "BulletCollision/CollisionDispatch/btDefaultCollisionConfiguration.h"
+#include "BulletCollision/BroadphaseCollision/btDbvtBroadphase.h"
+#include "BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolver.h"
+
+#include <SDL2/SDL_mutex.h>
+
+#include <fstream>
+#include <sstream>
+#include <list>
+
+struct AnalyzeRange : public JobRange
+{
+	ReplayAnalyzer & analyzer;
+	const std::vector<std::string> & files;
+	std::vector<ReplayStats> & stats;
+
+	AnalyzeRange(
+		ReplayAnalyzer & analyzer,
+		const std::vector<std::string> & files,
+		std::vector<ReplayStats> & stats) :
+		analyzer(analyzer), files(files), stats(stats)
+	{
+		// ctor
+	}
+
+	void Execute(int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+		{
+			analyzer.Analyze(files[i], stats[i]);
+		}
+	}
+};
+
+// first line of a log stream
+static std::string FirstLine(const std::ostringstream & log)
+{
+	const std::string text = log.str();
+	return text.substr(0, text.find('\n'));
+}
+
+static std::string CsvString(const std::string & value)
+{
+	std::string quoted = "\"";
+	for (size_t i = 0; i < value.size(); ++i)
+	{
+		if (value[i] == '"')
+			quoted += '"';
+		quoted += value[i];
+	}
+	return quoted + "\"";
+}
+
+static std::string JsonString(const std::string & value)
+{
+	std::string quoted = "\"";
+	for (size_t i = 0; i < value.size(); ++i)
+	{
+		const char c = value[i];
+		if (c == '"' || c == '\\')
+			quoted += '\\';
+		if (c == '\n')
+			quoted += "\\n";
+		else if (c == '\t')
+			quoted += "\\t";
+		else
+			quoted += c;
+	}
+	return quoted + "\"";
+}
+
+static void JsonArray(const std::vector<float> & values, std::ostream & out)
+{
+	out << "[";
+	for (size_t i = 0; i < values.size(); ++i)
+	{
+		if (i)
+			out << ", ";
+		out << values[i];
+	}
+	out << "]";
+}
+
+ReplayAnalyzer::ReplayAnalyzer(
+	ContentManager & content,
+	PathManager & paths,
+	const Settings & settings,
+	float timestep) :
+	content(content),
+	paths(paths),
+	settings(settings),
+	timestep(timestep),
+	content_lock(SDL_CreateMutex())
+{
+	// ctor
+}
+
+ReplayAnalyzer::~ReplayAnalyzer()
+{
+	SDL_DestroyMutex(content_lock);
+}
+
+bool ReplayAnalyzer::Run(
+	const std::string & folder,
+	std::ostream & info_output,
+	std::ostream & error_output)
+{
+	std::list<std::string> filelist;
+	if (!paths.GetFileList(folder, filelist, ".vdr"))
+	{
+		error_output << "Unable to list replay folder: " << folder << std::endl;
+		return false;
+	}
+	filelist.sort();
+
+	std::vector<std::string> files;
+	for (std::list<std::string>::const_iterator i = filelist.begin(); i != filelist.end(); ++i)
+	{
+		files.push_back(folder + "/" + *i);
+	}
+
+	JobSystem & jobs = JobSystem::instance();
+	info_output << "Analyzing " << files.size() << " replays on " << jobs.GetNumThreads() << " threads" << std::endl;
+
+	std::vector<ReplayStats> stats(files.size());
+	AnalyzeRange range(*this, files, stats);
+	const double t0 = microbench::getTime();
+	jobs.ParallelFor(0, files.size(), range);
+	const double wall_time = microbench::getTime() - t0;
+
+	unsigned failed = 0;
+	double sim_time = 0;
+	for (size_t i = 0; i < stats.size(); ++i)
+	{
+		if (!stats[i].error.empty())
+		{
+			error_output << stats[i].filename << ": " << stats[i].error << std::endl;
+			failed++;
+		}
+		sim_time += stats[i].duration;
+	}
+
+	const std::string csvpath = folder + "/replays.csv";
+	std::ofstream csv(csvpath.c_str());
+	WriteCsv(stats, csv);
+
+	const std::string jsonpath = folder + "/replays.json";
+	std::ofstream json(jsonpath.c_str());
+	WriteJson(stats, json);
+
+	if (!csv || !json)
+	{
+		error_output << "Failed to write " << csvpath << " or " << jsonpath << std::endl;
+		return false;
+	}
+
+	info_output << "Analyzed " << files.size() - failed << " of " << files.size() << " replays, ";
+	info_output << sim_time << " simulated seconds in " << wall_time << " s" << std::endl;
+	if (wall_time > 0)
+		info_output << files.size() / wall_time * 60 << " replays per minute" << std::endl;
+	info_output << "Summary written to " << csvpath << " and " << jsonpath << std::endl;
+
+	return failed == 0;
+}
+
+bool ReplayAnalyzer::Analyze(const std::string & replayfilename, ReplayStats & stats)
+{
+	const double t0 = microbench::getTime();
+	std::ostringstream info_output, error_output;
+	stats = ReplayStats();
+	stats.filename = replayfilename;
+
+	Replay replay(timestep);
+	if (!replay.StartPlaying(replayfilename, error_output))
+	{
+		stats.error = FirstLine(error_output);
+		return false;
+	}
+	stats.track = replay.GetTrack();
+
+	// every worker steps its own world
+	btDefaultCollisionConfiguration collisionconfig;
+	btCollisionDispatcher collisiondispatch(&collisionconfig);
+	btDbvtBroadphase collisionbroadphase;
+	btSequentialImpulseConstraintSolver collisionsolver;
+	DynamicsWorld world(
+		&collisiondispatch,
+		&collisionbroadphase,
+		&collisionsolver,
+		&collisionconfig,
+		timestep);
+
+	Track track;
+	btAlignedObjectArray<CarDynamics> cars;
+	ReplayRunner runner(world, content, paths, settings, timestep);
+
+	SDL_LockMutex(content_lock);
+	world.setContactAddedCallback(&CarDynamics::WheelContactCallback);
+	const bool loaded = runner.Load(replay, track, cars, info_output, error_output);
+	SDL_UnlockMutex(content_lock);
+
+	const std::vector<CarInfo> & carinfo = replay.GetCarInfo();
+	Timer timer;
+	std::vector<CrashDetection> crashes(cars.size());
+	std::vector<std::vector<float> > splits(cars.size());
+	stats.cars.resize(carinfo.size());
+	for (size_t i = 0; i < carinfo.size(); ++i)
+	{
+		stats.cars[i].name = carinfo[i].name;
+		stats.cars[i].driver = carinfo[i].driver;
+		if (loaded)
+			timer.AddCar(carinfo[i].name);
+	}
+
+	// play back the recorded states, track laps, sectors and crashes
+	const unsigned frames = replay.GetNumFrames();
+	while (loaded && replay.GetPlaying() && replay.GetFrame() < frames)
+	{
+		const float time = replay.GetFrame() * timestep;
+		world.update(timestep);
+		for (int i = 0; i < cars.size() && replay.GetPlaying(); ++i)
+		{
+			cars[i].Update(replay.PlayFrame(i, cars[i]));
+
+			ReplayCarStats & car = stats.cars[i];
+			const int sector = timer.GetLastSector(i);
+			timer.UpdateCar(i, cars[i], track);
+			const int nextsector = timer.GetLastSector(i);
+			if (nextsector != sector)
+			{
+				if (nextsector != 0)
+				{
+					splits[i].push_back(timer.GetCarLapTime(i));
+				}
+				else
+				{
+					// the first crossing of the start line only starts timing
+					if (sector >= 0)
+					{
+						car.laps.push_back(timer.GetCarLastLap(i));
+						car.splits.push_back(splits[i]);
+					}
+					splits[i].clear();
+				}
+			}
+
+			const float speed = cars[i].GetSpeed();
+			if (speed > car.top_speed)
+				car.top_speed = speed;
+
+			crashes[i].Update(speed, timestep);
+			if (crashes[i].GetMaxDecel() > 0)
+				car.incidents.push_back(std::make_pair(time, crashes[i].GetMaxDecel()));
+		}
+		timer.Tick(timestep);
+	}
+	stats.duration = replay.GetFrame() * timestep;
+
+	// track and car content is released under the lock too
+	SDL_LockMutex(content_lock);
+	cars.clear();
+	track.Clear();
+	SDL_UnlockMutex(content_lock);
+
+	if (!loaded)
+		stats.error = FirstLine(error_output);
+
+	stats.wall_time = microbench::getTime() - t0;
+	return loaded;
+}
+
+void ReplayAnalyzer::WriteCsv(const std::vector<ReplayStats> & stats, std::ostream & out)
+{
+	out << "replay,track,car,driver,laps,best_lap,lap_times,top_speed_kmh,incidents,error\n";
+	for (size_t r = 0; r < stats.size(); ++r)
+	{
+		const ReplayStats & replay = stats[r];
+		if (replay.cars.empty() || !replay.error.empty())
+		{
+			out << CsvString(replay.filename) << "," << CsvString(replay.track);
+			out << ",,,,,,,," << CsvString(replay.error) << "\n";
+			continue;
+		}
+
+		for (size_t c = 0; c < replay.cars.size(); ++c)
+		{
+			const ReplayCarStats & car = replay.cars[c];
+			float best_lap = 0;
+			std::ostringstream lap_times;
+			for (size_t l = 0; l < car.laps.size(); ++l)
+			{
+				if (l)
+					lap_times << " ";
+				lap_times << car.laps[l];
+				if (best_lap == 0 || car.laps[l] < best_lap)
+					best_lap = car.laps[l];
+			}
+
+			out << CsvString(replay.filename) << "," << CsvString(replay.track) << ",";
+			out << CsvString(car.name) << "," << CsvString(car.driver) << ",";
+			out << car.laps.size() << "," << best_lap << "," << lap_times.str() << ",";
+			out << car.top_speed * 3.6f << "," << car.incidents.size() << ",\n";
+		}
+	}
+}
+
+void ReplayAnalyzer::WriteJson(const std::vector<ReplayStats> & stats, std::ostream & out)
+{
+	out << "[\n";
+	for (size_t r = 0; r < stats.size(); ++r)
+	{
+		const ReplayStats & replay = stats[r];
+		out << "  {\"replay\": " << JsonString(replay.filename);
+		out << ", \"track\": " << JsonString(replay.track);
+		out << ", \"duration\": " << replay.duration;
+		out << ", \"wall_time\": " << replay.wall_time;
+		if (!replay.error.empty())
+			out << ", \"error\": " << JsonString(replay.error);
+		out << ", \"cars\": [";
+		for (size_t c = 0; c < replay.cars.size(); ++c)
+		{
+			const ReplayCarStats & car = replay.cars[c];
+			out << (c ? ",\n" : "\n");
+			out << "    {\"car\": " << JsonString(car.name);
+			out << ", \"driver\": " << JsonString(car.driver);
+			out << ", \"top_speed\": " << car.top_speed;
+			out << ", \"laps\": ";
+			JsonArray(car.laps, out);
+			out << ", \"splits\": [";
+			for (size_t l = 0; l < car.splits.size(); ++l)
+			{
+				if (l)
+					out << ", ";
+				JsonArray(car.splits[l], out);
+			}
+			out << "], \"incidents\": [";
+			for (size_t i = 0; i < car.incidents.size(); ++i)
+			{
+				if (i)
+					out << ", ";
+				out << "{\"time\": " << car.incidents[i].first;
+				out << ", \"decel\": " << car.incidents[i].second << "}";
+			}
+			out << "]}";
+		}
+		out << (replay.cars.empty() ? "]}" : "\n  ]}");
+		out << (r + 1 < stats.size() ? ",\n" : "\n");
+	}
+	out << "]\n";
+}
+
+QT_TEST(replayanalyzer_test)
+{
+	std::vector<ReplayStats> stats(2);
+	stats[0].filename = "a.vdr";
+	stats[0].track = "ring";
+	stats[0].cars.resize(1);
+	stats[0].cars[0].name = "XS";
+	stats[0].cars[0].driver = "user";
+	stats[0].cars[0].laps.push_back(62.5f);
+	stats[0].cars[0].laps.push_back(61.25f);
+	stats[0].cars[0].splits.resize(2, std::vector<float>(1, 30));
+	stats[0].cars[0].incidents.push_back(std::make_pair(12.5f, 250.0f));
+	stats[0].cars[0].top_speed = 50;
+	stats[1].filename = "b.vdr";
+	stats[1].error = "Error \"opening\" replay";
+
+	std::ostringstream csv;
+	ReplayAnalyzer::WriteCsv(stats, csv);
+	QT_CHECK_EQUAL(csv.str(),
+		"replay,track,car,driver,laps,best_lap,lap_times,top_speed_kmh,incidents,error\n"
+		"\"a.vdr\",\"ring\",\"XS\",\"user\",2,61.25,62.5 61.25,180,1,\n"
+		"\"b.vdr\",\"\",,,,,,,,\"Error \"\"opening\"\" replay\"\n");
+
+	std::ostringstream json;
+	ReplayAnalyzer::WriteJson(stats, json);
+	QT_CHECK_EQUAL(json.str(),
+		"[\n"
+		"  {\"replay\": \"a.vdr\", \"track\": \"ring\", \"duration\": 0, \"wall_time\": 0, \"cars\": [\n"
+		"    {\"car\": \"XS\", \"driver\": \"user\", \"top_speed\": 50, \"laps\": [62.5, 61.25], "
+		"\"splits\": [[30], [30]], \"incidents\": [{\"time\": 12.5, \"decel\": 250}]}\n"
+		"  ]},\n"
+		"  {\"replay\": \"b.vdr\", \"track\": \"\", \"duration\": 0, \"wall_time\": 0, "
+		"\"error\": \"Error \\\"opening\\\" replay\", \"cars\": []}\n"
+		"]\n");
+}
@@ -0,0 +1,97 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _REPLAYANALYZER_H
+#define _REPLAYANALYZER_H
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include <utility>
+
+class ContentManager;
+class PathManager;
+class Settings;
+struct SDL_mutex;
+
+/// Lap times, sector splits, top speed and crashes of a replay car.
+struct ReplayCarStats
+{
+	std::string name;
+	std::string driver;
+	std::vector<float> laps; ///< completed lap times in seconds
+	std::vector<std::vector<float> > splits; ///< sector split times of each completed lap
+	std::vector<std::pair<float, float> > incidents; ///< replay time and peak deceleration of each crash
+	float top_speed; ///< in meters per second
+
+	ReplayCarStats() : top_speed(0) {}
+};
+
+/// Summary of a replay, error is set if it could not be simulated.
+struct ReplayStats
+{
+	std::string filename;
+	std::string track;
+	std::string error;
+	std::vector<ReplayCarStats> cars;
+	float duration; ///< simulated seconds
+	double wall_time; ///< seconds spent loading and simulating
+
+	ReplayStats() : duration(0), wall_time(0) {}
+};
+
+/// Simulates a folder of replays without graphics and sound, one replay per
+/// job system worker. Every replay gets its own dynamics world. Timer lap logic
+/// and crash detection are run on the played back cars.
+class ReplayAnalyzer
+{
+public:
+	ReplayAnalyzer(
+		ContentManager & content,
+		PathManager & paths,
+		const Settings & settings,
+		float timestep);
+
+	~ReplayAnalyzer();
+
+	/// analyze all .vdr files in folder, write replays.csv and replays.json into it
+	/// report replays processed per minute, returns false if a replay failed
+	bool Run(
+		const std::string & folder,
+		std::ostream & info_output,
+		std::ostream & error_output);
+
+	/// simulate a single replay, safe to call from multiple threads
+	bool Analyze(const std::string & replayfilename, ReplayStats & stats);
+
+	/// one row per car, or per failed replay
+	static void WriteCsv(const std::vector<ReplayStats> & stats, std::ostream & out);
+
+	/// all replays including lap sector splits and incidents
+	static void WriteJson(const std::vector<ReplayStats> & stats, std::ostream & out);
+
+private:
+	ContentManager & content;
+	PathManager & paths;
+	const Settings & settings;
+	const float timestep;
+	SDL_mutex * content_lock; ///< content loading is not thread safe
+};
+
+#endif // _REPLAYANALYZER_H
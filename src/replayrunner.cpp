@@ -0,0 +1,281 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "replayrunner.h"
+#include "replay.h"
+#include "track.h"
+#include "tobullet.h"
+#include "settings.h"
+#include "pathmanager.h"
+#include "microbench.h"
+#include "physics/carinput.h"
+#include "physics/cardynamics.h"
+#include "physics/dynamicsworld.h"
+#include "content/contentmanager.h"
+#include "cfg/ptree.h"
+#include "unittest.h"
+
+#include <sstream>
+#include <vector>
+
+static std::string DumpCar(CarDynamics & car)
+{
+	std::ostringstream textstream;
+	joeserialize::TextOutputSerializer serialize_output(textstream);
+	car.Serialize(serialize_output);
+	return textstream.str();
+}
+
+// first differing value of two text serializations, field is the dotted path of its name
+static bool FindField(
+	const std::string & a,
+	const std::string & b,
+	std::string & field,
+	std::string & value_a,
+	std::string & value_b)
+{
+	std::istringstream sa(a), sb(b);
+	std::vector<std::string> path;
+	std::string la, lb;
+	while (std::getline(sa, la) && std::getline(sb, lb))
+	{
+		const size_t na = la.find_first_not_of(' ');
+		const size_t nb = lb.find_first_not_of(' ');
+		la = la.substr(na == std::string::npos ? la.size() : na);
+		lb = lb.substr(nb == std::string::npos ? lb.size() : nb);
+
+		const size_t ea = la.find(" = ");
+		if (la != lb)
+		{
+			const size_t eb = lb.find(" = ");
+			for (size_t i = 0; i < path.size(); ++i)
+				field += path[i] + ".";
+			field += la.substr(0, ea);
+			value_a = ea == std::string::npos ? la : la.substr(ea + 3);
+			value_b = eb == std::string::npos ? lb : lb.substr(eb + 3);
+			return true;
+		}
+
+		if (la == "}")
+		{
+			if (!path.empty())
+				path.pop_back();
+		}
+		else if (la != "{" && ea == std::string::npos)
+		{
+			path.push_back(la);
+		}
+	}
+	return false;
+}
+
+// report the first field of car that differs from the recorded state
+static void ReportDivergence(
+	CarDynamics & car,
+	const std::string & recorded,
+	unsigned frame,
+	unsigned carid,
+	std::ostream & error_output)
+{
+	const std::string simulated_text = DumpCar(car);
+
+	// inspect the recorded state on the car, then restore the simulation
+	CarDynamics::Snapshot snapshot;
+	car.GetSnapshot(snapshot);
+	joeserialize::BinaryReader serialize_input(recorded);
+	car.Serialize(serialize_input);
+	const std::string recorded_text = DumpCar(car);
+	car.SetSnapshot(snapshot);
+
+	error_output << "Car " << carid << " diverges at frame " << frame;
+	std::string field, simulated, expected;
+	if (FindField(simulated_text, recorded_text, field, simulated, expected))
+		error_output << ", " << field << " is " << simulated << ", recorded " << expected;
+	error_output << std::endl;
+}
+
+ReplayRunner::ReplayRunner(
+	DynamicsWorld & world,
+	ContentManager & content,
+	PathManager & paths,
+	const Settings & settings,
+	float timestep) :
+	world(world),
+	content(content),
+	paths(paths),
+	settings(settings),
+	timestep(timestep)
+{
+	// ctor
+}
+
+bool ReplayRunner::Load(
+	const Replay & replay,
+	Track & track,
+	btAlignedObjectArray<CarDynamics> & cars,
+	std::ostream & info_output,
+	std::ostream & error_output)
+{
+	const std::string & trackname = replay.GetTrack();
+	const std::vector<CarInfo> & carinfo = replay.GetCarInfo();
+
+	// set up the way the replay was recorded, older replays fall back to the current settings
+	Replay::Setup setup;
+	if (!replay.GetSetup(setup))
+	{
+		info_output << "Replay has no recorded setup, using the current settings" << std::endl;
+		setup.abs = settings.GetABS();
+		setup.tcs = settings.GetTCS();
+		setup.autoshift = settings.GetAutoShift();
+		setup.autoclutch = settings.GetAutoClutch();
+		setup.damage = settings.GetVehicleDamage();
+		setup.track_reverse = settings.GetTrackReverse();
+		setup.track_dynamic = settings.GetTrackDynamic();
+	}
+
+	// track collision data, textures are not loaded
+	// no cooked track cache, runners might load the same track concurrently
+	if (!track.DeferredLoad(
+		content, world,
+		info_output, error_output,
+		paths.GetTracksPath(trackname),
+		paths.GetTracksDir() + "/" + trackname,
+		paths.GetEffectsTextureDir(),
+		paths.GetTrackPartsPath(),
+		std::string(),
+		settings.GetAnisotropy(),
+		setup.track_reverse,
+		setup.track_dynamic,
+		false))
+	{
+		error_output << "Error loading track: " << trackname << std::endl;
+		return false;
+	}
+
+	bool success = true;
+	while (!track.Loaded() && success)
+	{
+		success = track.ContinueDeferredLoad();
+	}
+	if (!success)
+	{
+		error_output << "Error loading track (deferred): " << trackname << std::endl;
+		return false;
+	}
+
+	// car physics, set up the way the game does
+	cars.reserve(carinfo.size());
+	for (size_t i = 0; i < carinfo.size(); ++i)
+	{
+		const CarInfo & info = carinfo[i];
+		const size_t n0 = info.name.find("/");
+		const std::string cardir = paths.GetCarsDir() + "/" + info.name.substr(0, n0);
+
+		PTree carconf;
+		std::istringstream carstream(info.config);
+		read_ini(carstream, carconf);
+
+		cars.push_back(CarDynamics());
+		CarDynamics & car = cars[cars.size() - 1];
+		const std::pair<Vec3, Quat> start = track.GetStart(i);
+		if (!car.Load(
+			carconf, cardir, info.tire,
+			ToBulletVector(start.first),
+			ToBulletQuaternion(start.second),
+			setup.damage,
+			world, content, error_output))
+		{
+			error_output << "Failed to load physics for car: " << info.name << std::endl;
+			return false;
+		}
+
+		const bool isai = (info.driver != "user");
+		car.SetAutoClutch(setup.autoclutch || isai);
+		car.SetAutoShift(setup.autoshift || isai);
+		car.SetABS(setup.abs || isai);
+		car.SetTCS(setup.tcs || isai);
+	}
+
+	return true;
+}
+
+bool ReplayRunner::Run(
+	const std::string & replayfilename,
+	std::ostream & info_output,
+	std::ostream & error_output)
+{
+	Replay replay(timestep);
+	if (!replay.StartPlaying(replayfilename, error_output))
+		return false;
+
+	info_output << "Replay " << replayfilename << ": " << replay.GetTrack() << ", ";
+	info_output << replay.GetCarInfo().size() << " cars, " << replay.GetNumFrames() << " frames" << std::endl;
+
+	Track track;
+	btAlignedObjectArray<CarDynamics> cars;
+	if (!Load(replay, track, cars, info_output, error_output))
+		return false;
+
+	// play as fast as possible, check every recorded state
+	const unsigned frames = replay.GetNumFrames();
+	unsigned checked = 0;
+	unsigned diverged = 0;
+	const double t0 = microbench::getTime();
+	while (replay.GetPlaying() && replay.GetFrame() < frames)
+	{
+		const unsigned frame = replay.GetFrame();
+		world.update(timestep);
+		for (int i = 0; i < cars.size() && replay.GetPlaying(); ++i)
+		{
+			const std::string * state = 0;
+			cars[i].Update(replay.CheckFrame(i, state));
+			if (!state)
+				continue;
+
+			checked++;
+			if (Replay::SerializeCar(cars[i]) == *state)
+				continue;
+
+			if (!diverged)
+				ReportDivergence(cars[i], *state, frame, i, error_output);
+			diverged++;
+		}
+	}
+	const double wall_time = microbench::getTime() - t0;
+	const double sim_time = replay.GetFrame() * timestep;
+
+	info_output << "Simulated " << sim_time << " s in " << wall_time << " s, ";
+	info_output << sim_time / wall_time << " simulated seconds per second" << std::endl;
+	info_output << "Checked " << checked << " states, " << diverged << " diverged" << std::endl;
+
+	cars.clear();
+	return diverged == 0;
+}
+
+QT_TEST(replayrunner_test)
+{
+	const std::string a = "engine\n{\n  rpm = 1\n}\nwheel\n{\n  *item\n  {\n    speed = 2\n  }\n}\n";
+	const std::string b = "engine\n{\n  rpm = 1\n}\nwheel\n{\n  *item\n  {\n    speed = 3\n  }\n}\n";
+	std::string field, va, vb;
+	QT_CHECK(!FindField(a, a, field, va, vb));
+	QT_CHECK(FindField(a, b, field, va, vb));
+	QT_CHECK_EQUAL(field, "wheel.*item.speed");
+	QT_CHECK_EQUAL(va, "2");
+	QT_CHECK_EQUAL(vb, "3");
+}
@@ -0,0 +1,72 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _REPLAYRUNNER_H
+#define _REPLAYRUNNER_H
+
+#include "LinearMath/btAlignedObjectArray.h"
+
+#include <iosfwd>
+#include <string>
+
+class Replay;
+class Track;
+class CarDynamics;
+class DynamicsWorld;
+class ContentManager;
+class PathManager;
+class Settings;
+
+/// Plays a replay at full speed without graphics and sound.
+/// Simulated car states are compared with the recorded state frames.
+class ReplayRunner
+{
+public:
+	ReplayRunner(
+		DynamicsWorld & world,
+		ContentManager & content,
+		PathManager & paths,
+		const Settings & settings,
+		float timestep);
+
+	/// load the replay track and set up its cars the way the game recorded them
+	/// returns false and reports to error_output on failure
+	bool Load(
+		const Replay & replay,
+		Track & track,
+		btAlignedObjectArray<CarDynamics> & cars,
+		std::ostream & info_output,
+		std::ostream & error_output);
+
+	/// report throughput and the first divergent frame and field
+	/// returns true if the replay played back deterministically
+	bool Run(
+		const std::string & replayfilename,
+		std::ostream & info_output,
+		std::ostream & error_output);
+
+private:
+	DynamicsWorld & world;
+	ContentManager & content;
+	PathManager & paths;
+	const Settings & settings;
+	const float timestep;
+};
+
+#endif // _REPLAYRUNNER_H
@@ -25,8 +25,28 @@ bool RoadPatch::Collide(
 	float seglen, Vec3 & outtri,
 	Vec3 & normal) const
 {
-	bool col = patch.CollideSubDivQuadSimpleNorm(origin, direction, outtri, normal);
-	float len = (outtri - origin).Magnitude();
-	return col && len <= seglen;
+	if (grid.Empty())
+	{
+		bool col = patch.CollideSubDivQuadSimpleNorm(origin, direction, outtri, normal);
+		float len = (outtri - origin).Magnitude();
+		return col && len <= seglen;
+	}
+
+	float t, px, py;
+	if (!grid.CollideRay(origin, direction, seglen, t, px, py))
+		return false;
+
+	if (grid_exact && patch.CollideNewton(origin, direction, t, px, py, outtri, normal))
+		return (outtri - origin).Magnitude() <= seglen;
+
+	outtri = origin + direction * t;
+	normal = patch.SurfNorm(px, py);
+	return true;
+}
+
+void RoadPatch::Tessellate(int resolution, bool exact)
+{
+	grid.Build(patch, resolution);
+	grid_exact = exact;
 }
 
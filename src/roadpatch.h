@@ -21,11 +21,12 @@
 #define _ROADPATCH_H
 
 #include "bezier.h"
+#include "beziergrid.h"
 
 class RoadPatch
 {
 public:
-	RoadPatch() : track_curvature(0) {}
+	RoadPatch() : track_curvature(0), grid_exact(false) {}
 
 	const Bezier & GetPatch() const {return patch;}
 
@@ -40,6 +41,12 @@ public:
 		Vec3 & outtri,
 		Vec3 & normal) const;
 
+	///precompute a triangle grid of the patch used by Collide instead of the recursive subdivision.
+	/// resolution < 1 removes the grid, exact refines grid hits on the bezier surface.
+	void Tessellate(int resolution, bool exact);
+
+	const BezierGrid & GetGrid() const {return grid;}
+
 	float GetTrackCurvature() const
 	{
 		return track_curvature;
@@ -64,8 +71,10 @@ public:
 
 private:
 	Bezier patch;
+	BezierGrid grid;
 	float track_curvature;
 	Vec3 racing_line;
+	bool grid_exact;
 };
 
 #endif // _ROADPATCH_H
@@ -18,7 +18,14 @@
 /************************************************************************/
 
 #include "roadstrip.h"
+#include "aabbtree.h"
+#include "aabbbvh.h"
+#include "microbench.h"
+#include "pathmanager.h"
+
 #include <algorithm>
+#include <fstream>
+#include <list>
 
 RoadStrip::RoadStrip() :
 	closed(false)
@@ -71,6 +78,16 @@ bool RoadStrip::ReadFrom(
 		}
 	}
 
+	Connect();
+
+	return true;
+}
+
+void RoadStrip::Connect()
+{
+	if (patches.empty())
+		return;
+
 	// Close the roadstrip if it ends near where it starts.
 	closed = (patches.size() > 2) &&
 		((patches.back().GetPatch().GetFL() - patches.front().GetPatch().GetBL()).Magnitude() < 0.1) &&
@@ -86,61 +103,271 @@ bool RoadStrip::ReadFrom(
 	{
 		patches.back().GetPatch().Attach(patches.front().GetPatch());
 	}
+}
 
-	GenerateSpacePartitioning();
-
-	return true;
+void RoadStrip::Tessellate(int resolution, bool exact)
+{
+	for (std::vector<RoadPatch>::iterator i = patches.begin(); i != patches.end(); ++i)
+	{
+		i->Tessellate(resolution, exact);
+	}
 }
 
-void RoadStrip::GenerateSpacePartitioning()
+unsigned RoadStrip::GetTessellationMemorySize() const
 {
-	aabb_part.Clear();
-	for (unsigned i = 0; i < patches.size(); ++i)
+	unsigned size = 0;
+	for (std::vector<RoadPatch>::const_iterator i = patches.begin(); i != patches.end(); ++i)
 	{
-		aabb_part.Add(i, patches[i].GetPatch().GetAABB());
+		size += i->GetGrid().GetMemorySize();
 	}
-	aabb_part.Optimize();
+	return size;
 }
 
-bool RoadStrip::Collide(
-	const Vec3 & origin,
-	const Vec3 & direction,
-	const float seglen,
-	int & patch_id,
-	Vec3 & outtri,
-	const Bezier * & colpatch,
-	Vec3 & normal) const
+void RoadPatchRay::operator()(int i, float & len)
 {
-	if (patch_id >= 0 && patch_id < (int)patches.size())
+	Vec3 colpoint, colnormal;
+	if (patches[i]->Collide(origin, direction, seglen, colpoint, colnormal))
 	{
-		Vec3 coltri, colnorm;
-		if (patches[patch_id].Collide(origin, direction, seglen, coltri, colnorm))
+		float dist = (colpoint - origin).Magnitude();
+		if (id < 0 || dist < len)
 		{
-			outtri = coltri;
-			normal = colnorm;
-			colpatch = &patches[patch_id].GetPatch();
-			return true;
+			point = colpoint;
+			normal = colnormal;
+			id = i;
+			len = dist;
 		}
 	}
+}
+
+// counts bvh candidates
+struct RoadPatchCount
+{
+	int count;
+	RoadPatchCount() : count(0) {}
+	void operator()(int, float &) {++count;}
+};
+
+MICROBENCH(roadbvh)
+{
+	const std::string tracks_path = ctx.paths.GetDataPath() + "/" + ctx.paths.GetTracksDir();
+	std::list<std::string> tracks;
+	ctx.paths.GetFileList(tracks_path, tracks);
+	if (tracks.empty())
+	{
+		ctx.error_output << "No tracks found in " << tracks_path << std::endl;
+		return;
+	}
 
-	bool col = false;
-	std::vector<int> candidates;
-	aabb_part.Query(Aabb<float>::Ray(origin, direction, seglen), candidates);
-	for (std::vector<int>::iterator i = candidates.begin(); i != candidates.end(); ++i)
+	const int ray_count = 2000;
+	const float ray_length = 4;
+	const Vec3 ray_dir(0, 0, -1);
+	for (std::list<std::string>::const_iterator t = tracks.begin(); t != tracks.end(); ++t)
 	{
-		Vec3 coltri, colnorm;
-		if (patches[*i].Collide(origin, direction, seglen, coltri, colnorm))
+		std::ifstream file((tracks_path + "/" + *t + "/roads.trk").c_str());
+		if (!file) continue;
+
+		std::list<RoadStrip> roads;
+		int road_count = 0;
+		file >> road_count;
+		for (int i = 0; i < road_count && file; ++i)
+		{
+			roads.push_back(RoadStrip());
+			roads.back().ReadFrom(file, false, ctx.error_output);
+		}
+
+		// per strip trees, as used before the track bvh
+		std::vector<const RoadPatch*> patches;
+		std::vector<Aabb<float> > bounds;
+		std::vector<AabbTreeNode<unsigned> > trees(roads.size());
+		std::vector<const RoadStrip*> strips;
+		for (std::list<RoadStrip>::const_iterator r = roads.begin(); r != roads.end(); ++r)
+		{
+			AabbTreeNode<unsigned> & tree = trees[strips.size()];
+			const std::vector<RoadPatch> & rp = r->GetPatches();
+			for (unsigned i = 0; i < rp.size(); ++i)
+			{
+				tree.Add(i, rp[i].GetPatch().GetAABB());
+				patches.push_back(&rp[i]);
+				bounds.push_back(rp[i].GetPatch().GetAABB());
+			}
+			tree.Optimize();
+			strips.push_back(&*r);
+		}
+		if (patches.empty()) continue;
+
+		double t0 = microbench::getTime();
+		AabbBvh bvh;
+		bvh.Build(bounds);
+		double t1 = microbench::getTime();
+
+		// rays from above the patch centers
+		std::vector<Vec3> origins(ray_count);
+		for (int i = 0; i < ray_count; ++i)
 		{
-			if (!col || (coltri-origin).MagnitudeSquared() < (outtri-origin).MagnitudeSquared())
+			origins[i] = bounds[(i * 7919) % bounds.size()].GetCenter() + Vec3(0, 0, ray_length * 0.5f);
+		}
+
+		// candidate search only
+		int tree_candidates = 0, bvh_candidates = 0;
+		std::vector<int> candidates;
+		double t2 = microbench::getTime();
+		for (int i = 0; i < ray_count; ++i)
+		{
+			for (unsigned s = 0; s < trees.size(); ++s)
 			{
-				outtri = coltri;
-				normal = colnorm;
-				colpatch = &patches[*i].GetPatch();
-				patch_id = *i;
+				candidates.clear();
+				trees[s].Query(Aabb<float>::Ray(origins[i], ray_dir, ray_length), candidates);
+				tree_candidates += candidates.size();
 			}
-			col = true;
 		}
+		double t3 = microbench::getTime();
+		for (int i = 0; i < ray_count; ++i)
+		{
+			RoadPatchCount count;
+			bvh.QueryRay(origins[i], ray_dir, ray_length, count);
+			bvh_candidates += count.count;
+		}
+		double t4 = microbench::getTime();
+
+		// closest hit, including patch collision
+		int tree_hits = 0, bvh_hits = 0;
+		for (int i = 0; i < ray_count; ++i)
+		{
+			bool hit = false;
+			for (unsigned s = 0; s < trees.size(); ++s)
+			{
+				std::vector<int> c;
+				trees[s].Query(Aabb<float>::Ray(origins[i], ray_dir, ray_length), c);
+				for (unsigned k = 0; k < c.size(); ++k)
+				{
+					Vec3 point, normal;
+					hit |= strips[s]->GetPatches()[c[k]].Collide(origins[i], ray_dir, ray_length, point, normal);
+				}
+			}
+			tree_hits += hit;
+		}
+		double t5 = microbench::getTime();
+		for (int i = 0; i < ray_count; ++i)
+		{
+			RoadPatchRay hit(patches, origins[i], ray_dir, ray_length);
+			bvh.QueryRay(origins[i], ray_dir, ray_length, hit);
+			bvh_hits += (hit.id >= 0);
+		}
+		double t6 = microbench::getTime();
+
+		ctx.info_output << *t << ": " << roads.size() << " strips, " << patches.size() << " patches, ";
+		ctx.info_output << bvh.GetNodeCount() << " nodes, " << bvh.GetMemorySize() / 1024 << " KB, built in " << (t1 - t0) * 1E3 << " ms\n";
+		ctx.info_output << "  Query: tree " << (t3 - t2) / ray_count * 1E6 << " us, bvh " << (t4 - t3) / ray_count * 1E6 << " us, ";
+		ctx.info_output << "candidates " << tree_candidates << " / " << bvh_candidates << "\n";
+		ctx.info_output << "  CastRay: tree " << (t5 - t4) / ray_count * 1E6 << " us, bvh " << (t6 - t5) / ray_count * 1E6 << " us, ";
+		ctx.info_output << "hits " << tree_hits << " / " << bvh_hits << std::endl;
+		if (tree_hits != bvh_hits)
+			ctx.error_output << *t << ": bvh hits differ from tree hits" << std::endl;
+	}
+}
+
+// ray queries per second of the track road patches without and with collision grids
+MICROBENCH(roadpatch)
+{
+	const std::string tracks_path = ctx.paths.GetDataPath() + "/" + ctx.paths.GetTracksDir();
+	std::list<std::string> tracks;
+	ctx.paths.GetFileList(tracks_path, tracks);
+	if (tracks.empty())
+	{
+		ctx.error_output << "No tracks found in " << tracks_path << std::endl;
+		return;
 	}
 
-	return col;
+	const int ray_count = 20000;
+	const float ray_length = 4;
+	const Vec3 ray_dir(0, 0, -1);
+	const int resolutions[] = {0, 4, 8, 16};
+	for (std::list<std::string>::const_iterator t = tracks.begin(); t != tracks.end(); ++t)
+	{
+		std::ifstream file((tracks_path + "/" + *t + "/roads.trk").c_str());
+		if (!file) continue;
+
+		std::list<RoadStrip> roads;
+		int road_count = 0;
+		file >> road_count;
+		for (int i = 0; i < road_count && file; ++i)
+		{
+			roads.push_back(RoadStrip());
+			roads.back().ReadFrom(file, false, ctx.error_output);
+		}
+
+		std::vector<const RoadPatch*> patches;
+		std::vector<Aabb<float> > bounds;
+		for (std::list<RoadStrip>::const_iterator r = roads.begin(); r != roads.end(); ++r)
+		{
+			const std::vector<RoadPatch> & rp = r->GetPatches();
+			for (unsigned i = 0; i < rp.size(); ++i)
+			{
+				patches.push_back(&rp[i]);
+				bounds.push_back(rp[i].GetPatch().GetAABB());
+			}
+		}
+		if (patches.empty()) continue;
+
+		AabbBvh bvh;
+		bvh.Build(bounds);
+
+		// rays from above random surface points
+		std::vector<Vec3> origins(ray_count);
+		unsigned seed = 12345;
+		for (int i = 0; i < ray_count; ++i)
+		{
+			seed = seed * 1664525 + 1013904223;
+			float u = (seed >> 8) / float(1 << 24);
+			seed = seed * 1664525 + 1013904223;
+			float v = (seed >> 8) / float(1 << 24);
+			const Bezier & b = patches[(i * 7919) % patches.size()]->GetPatch();
+			origins[i] = b.SurfCoord(u, v) + Vec3(0, 0, ray_length * 0.5f);
+		}
+
+		ctx.info_output << *t << ": " << patches.size() << " patches\n";
+		std::vector<Vec3> reference(ray_count), points(ray_count);
+		for (unsigned n = 0; n < sizeof(resolutions) / sizeof(resolutions[0]); ++n)
+		{
+			for (int exact = 0; exact < 2; ++exact)
+			{
+				if (resolutions[n] == 0 && exact) continue;
+
+				unsigned size = 0;
+				for (std::list<RoadStrip>::iterator r = roads.begin(); r != roads.end(); ++r)
+				{
+					r->Tessellate(resolutions[n], exact);
+					size += r->GetTessellationMemorySize();
+				}
+
+				int hits = 0;
+				double t0 = microbench::getTime();
+				for (int i = 0; i < ray_count; ++i)
+				{
+					RoadPatchRay hit(patches, origins[i], ray_dir, ray_length);
+					bvh.QueryRay(origins[i], ray_dir, ray_length, hit);
+					points[i] = hit.id >= 0 ? hit.point : origins[i];
+					hits += (hit.id >= 0);
+				}
+				double t1 = microbench::getTime();
+
+				// deviation from the subdivision contact points
+				if (resolutions[n] == 0)
+					reference = points;
+				float error = 0;
+				for (int i = 0; i < ray_count; ++i)
+				{
+					if (points[i] != origins[i] && reference[i] != origins[i])
+						error = std::max(error, (points[i] - reference[i]).Magnitude());
+				}
+
+				ctx.info_output << "  " << (resolutions[n] ? "grid " : "subdivision");
+				if (resolutions[n])
+					ctx.info_output << resolutions[n] << (exact ? " exact" : "");
+				ctx.info_output << ": " << ray_count / (t1 - t0) * 1E-6 << " Mrays/s, ";
+				ctx.info_output << size / 1024 << " KB, hits " << hits << ", max deviation " << error << " m\n";
+			}
+		}
+		ctx.info_output << std::flush;
+	}
 }
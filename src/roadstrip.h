@@ -21,7 +21,6 @@
 #define _ROADSTRIP_H
 
 #include "roadpatch.h"
-#include "aabbtree.h"
 
 #include <iosfwd>
 #include <vector>
@@ -36,14 +35,14 @@ public:
 		bool reverse,
 		std::ostream & error_output);
 
-	bool Collide(
-		const Vec3 & origin,
-		const Vec3 & direction,
-		const float seglen,
-		int & patch_id,
-		Vec3 & outtri,
-		const Bezier * & colpatch,
-		Vec3 & normal) const;
+	/// close the strip if it ends near where it starts and attach adjacent patches
+	void Connect();
+
+	/// build the collision grids of all patches, see RoadPatch::Tessellate
+	void Tessellate(int resolution, bool exact);
+
+	/// memory used by the patch collision grids in bytes
+	unsigned GetTessellationMemorySize() const;
 
 	const std::vector<RoadPatch> & GetPatches() const
 	{
@@ -62,10 +61,35 @@ public:
 
 private:
 	std::vector<RoadPatch> patches;
-	AabbTreeNode <unsigned> aabb_part;
 	bool closed;
+};
+
+/// closest road patch hit of a bvh ray query, see AabbBvh::QueryRay
+struct RoadPatchRay
+{
+	const std::vector<const RoadPatch*> & patches;
+	const Vec3 & origin;
+	const Vec3 & direction;
+	const float seglen;
+	Vec3 point;
+	Vec3 normal;
+	int id;
+
+	RoadPatchRay(
+		const std::vector<const RoadPatch*> & patches,
+		const Vec3 & origin,
+		const Vec3 & direction,
+		const float seglen) :
+		patches(patches),
+		origin(origin),
+		direction(direction),
+		seglen(seglen),
+		id(-1)
+	{
+		// ctor
+	}
 
-	void GenerateSpacePartitioning();
+	void operator()(int i, float & len);
 };
 
 #endif // _ROADSTRIP_H
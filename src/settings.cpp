@@ -73,6 +73,7 @@ Settings::Settings() :
 	selected_replay("none"),
 	texture_size("large"),
 	texture_compress(true),
+	content_budget(512),
 	button_ramp(5),
 	ff_device("/dev/input/event0"),
 	ff_gain(1.0),
@@ -170,6 +171,7 @@ void Settings::Serialize(bool write, Config & config)
 	Param(config, write, section, "racingline", racingline);
 	Param(config, write, section, "texture_size", texture_size);
 	Param(config, write, section, "texture_compress", texture_compress);
+	Param(config, write, section, "content_budget", content_budget);
 	Param(config, write, section, "shadows", shadows);
 	Param(config, write, section, "shadow_distance", shadow_distance);
 	Param(config, write, section, "shadow_quality", shadow_quality);
@@ -222,6 +222,11 @@ public:
 		return texture_compress;
 	}
 
+	int GetContentBudget() const
+	{
+		return content_budget;
+	}
+
 	float GetButtonRamp() const
 	{
 		return button_ramp;
@@ -434,6 +439,7 @@ private:
 	std::string selected_replay;
 	std::string texture_size;
 	bool texture_compress;
+	int content_budget;
 	float button_ramp;
 	std::string ff_device;
 	float ff_gain;
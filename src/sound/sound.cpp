@@ -19,6 +19,7 @@
 
 #include "sound.h"
 #include "coordinatesystem.h"
+#include "jobsystem.h"
 #include <SDL2/SDL.h>
 #include <algorithm>
 #include <cassert>
@@ -434,65 +435,93 @@ void Sound::ProcessSourceRemove()
 	sources_remove.clear();
 }
 
-void Sound::ProcessSources()
+// calculates sampler gains and pitch of a range of sources
+struct Sound::SourceRange : public JobRange
 {
-	std::vector<SamplerSet> & supdate = samplers_update.getFirst().sset;
-	supdate.resize(sources_num);
+	const Sound & sound;
+	std::vector<SamplerSet> & supdate;
+	std::vector<int> & sgain;
 
-	sources_active.clear();
-	for (size_t i = 0; i < sources_num; ++i)
+	SourceRange(const Sound & sound, std::vector<SamplerSet> & supdate, std::vector<int> & sgain) :
+		sound(sound), supdate(supdate), sgain(sgain)
 	{
-		Source & src = sources[i];
-		if (!src.playing) continue;
+		// ctor
+	}
 
-		float gain1 = 0.0, gain2 = 0.0;
-		if (src.gain > 0)
+	void Execute(int begin, int end)
+	{
+		const float * attenuation = sound.attenuation;
+		for (int i = begin; i < end; ++i)
 		{
-			if (src.is3d)
-			{
-				Vec3 relvec = src.position - listener_pos;
-				float len = relvec.Magnitude();
-				if (len < 0.1f) len = 0.1f;
-
-				// distance attenuation
-				// y = a * (x - b)^c + d
-				float cgain = attenuation[0] * powf(len - attenuation[1], attenuation[2]) + attenuation[3];
-				cgain = clamp(cgain, 0.0f, 1.0f);
-
-				// directional attenuation
-				// maximum at 0.75 (source on opposite side)
-				relvec = relvec * (1.0f / len);
-				(-listener_rot).RotateVector(relvec);
-				float xcoord = relvec.dot(Direction::Right) * 0.75f;
-				float pgain1 = xcoord;			// left attenuation
-				float pgain2 = -xcoord;			// right attenuation
-				if (pgain1 < 0) pgain1 = 0;
-				if (pgain2 < 0) pgain2 = 0;
-
-				gain1 = cgain * src.gain * (1 - pgain1);
-				gain2 = cgain * src.gain * (1 - pgain2);
-			}
-			else
-			{
-				gain1 = gain2 = src.gain;
-			}
+			sgain[i] = 0;
+
+			const Source & src = sound.sources[i];
+			if (!src.playing) continue;
 
-			int maxgain = std::max(gain1, gain2) * Sampler::denom;
-			if (maxgain > 0)
+			float gain1 = 0.0, gain2 = 0.0;
+			if (src.gain > 0)
 			{
-				SourceActive sa;
-				sa.gain = maxgain;
-				sa.id = i;
-				sources_active.push_back(sa);
+				if (src.is3d)
+				{
+					Vec3 relvec = src.position - sound.listener_pos;
+					float len = relvec.Magnitude();
+					if (len < 0.1f) len = 0.1f;
+
+					// distance attenuation
+					// y = a * (x - b)^c + d
+					float cgain = attenuation[0] * powf(len - attenuation[1], attenuation[2]) + attenuation[3];
+					cgain = clamp(cgain, 0.0f, 1.0f);
+
+					// directional attenuation
+					// maximum at 0.75 (source on opposite side)
+					relvec = relvec * (1.0f / len);
+					(-sound.listener_rot).RotateVector(relvec);
+					float xcoord = relvec.dot(Direction::Right) * 0.75f;
+					float pgain1 = xcoord;			// left attenuation
+					float pgain2 = -xcoord;			// right attenuation
+					if (pgain1 < 0) pgain1 = 0;
+					if (pgain2 < 0) pgain2 = 0;
+
+					gain1 = cgain * src.gain * (1 - pgain1);
+					gain2 = cgain * src.gain * (1 - pgain2);
+				}
+				else
+				{
+					gain1 = gain2 = src.gain;
+				}
+
+				sgain[i] = std::max(gain1, gain2) * Sampler::denom;
 			}
+
+			// fade sound volume
+			float volume = sound.set_pause ? 0 : sound.sound_volume;
+
+			supdate[i].gain1 = volume * gain1 * Sampler::denom;
+			supdate[i].gain2 = volume * gain2 * Sampler::denom;
+			supdate[i].pitch = src.pitch * Sampler::denom;
 		}
+	}
+};
+
+void Sound::ProcessSources()
+{
+	std::vector<SamplerSet> & supdate = samplers_update.getFirst().sset;
+	supdate.resize(sources_num);
+	sources_gain.resize(sources_num);
 
-		// fade sound volume
-		float volume = set_pause ? 0 : sound_volume;
+	SourceRange range(*this, supdate, sources_gain);
+	JobSystem::instance().ParallelFor(0, sources_num, range, 64);
 
-		supdate[i].gain1 = volume * gain1 * Sampler::denom;
-		supdate[i].gain2 = volume * gain2 * Sampler::denom;
-		supdate[i].pitch = src.pitch * Sampler::denom;
+	sources_active.clear();
+	for (size_t i = 0; i < sources_num; ++i)
+	{
+		if (sources_gain[i] > 0)
+		{
+			SourceActive sa;
+			sa.gain = sources_gain[i];
+			sa.id = i;
+			sources_active.push_back(sa);
+		}
 	}
 
 	LimitActiveSources();
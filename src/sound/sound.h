@@ -165,7 +165,9 @@ private:
 	SDL_mutex * source_lock;
 
 	// sound sources state
+	struct SourceRange;
 	std::vector<SourceActive> sources_active;
+	std::vector<int> sources_gain;
 	std::vector<size_t> sources_remove;
 	std::vector<Source> sources;
 	size_t max_active_sources;
@@ -61,6 +61,12 @@ public:
 		return loaded;
 	}
 
+	/// Sample data size in bytes.
+	size_t GetMemorySize() const
+	{
+		return loaded ? size_t(info.samples) * info.bytespersample : 0;
+	}
+
 private:
 	SoundInfo info;
 	unsigned int size;
@@ -0,0 +1,397 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "telemetry.h"
+#include "mappedfile.h"
+#include "joeserialize.h"
+#include "pathmanager.h"
+#include "unittest.h"
+
+#include <SDL2/SDL.h>
+
+#include <algorithm>
+#include <sstream>
+#include <stdint.h>
+
+static const char telemetry_version[] = "VDTELE01";
+static const unsigned telemetry_version_size = 8;
+
+// milliseconds the writer sleeps while the ring holds less than a block
+static const unsigned writer_delay = 10;
+
+static void WriteU32(std::string & out, uint32_t v)
+{
+	for (int i = 0; i < 4; ++i)
+		out.push_back(char((v >> (8 * i)) & 0xff));
+}
+
+static uint32_t ReadU32(const char * p)
+{
+	const unsigned char * b = reinterpret_cast<const unsigned char *>(p);
+	return b[0] | (b[1] << 8) | (b[2] << 16) | (uint32_t(b[3]) << 24);
+}
+
+// floats are stored little-endian
+static void WriteFloats(std::string & out, const float * values, unsigned count)
+{
+	const size_t size = out.size();
+	out.resize(size + count * sizeof(float));
+	joeserialize::ByteOrder::Copy<float>(
+		&out[size], reinterpret_cast<const char *>(values), count,
+		!joeserialize::ByteOrder::IsBigEndian());
+}
+
+static void ReadFloats(const char * data, unsigned count, float * values)
+{
+	joeserialize::ByteOrder::Copy<float>(
+		reinterpret_cast<char *>(values), data, count,
+		!joeserialize::ByteOrder::IsBigEndian());
+}
+
+Telemetry::Telemetry() :
+	names(1, "time"),
+	frame(1, 0.0f),
+	time(0),
+	dropped(0),
+	ring_frames(0),
+	block_frames(0),
+	head(0),
+	tail(0),
+	writer(0),
+	write_error(false)
+{
+	SDL_AtomicSet(&ring_head, 0);
+	SDL_AtomicSet(&ring_tail, 0);
+	SDL_AtomicSet(&quit, 0);
+}
+
+Telemetry::~Telemetry()
+{
+	Stop();
+}
+
+int Telemetry::AddChannel(const std::string & name)
+{
+	assert(!writer);
+	names.push_back(name);
+	frame.push_back(0.0f);
+	return names.size() - 1;
+}
+
+void Telemetry::ClearChannels()
+{
+	assert(!writer);
+	names.resize(1);
+	frame.resize(1);
+}
+
+bool Telemetry::Start(
+	const std::string & filename,
+	std::ostream & error_output,
+	unsigned new_ring_frames,
+	unsigned new_block_frames)
+{
+	Stop();
+
+	file.open(filename.c_str(), std::ios::binary);
+	if (!file)
+	{
+		error_output << "Unable to create telemetry file: " << filename << std::endl;
+		return false;
+	}
+
+	std::string header(telemetry_version, telemetry_version_size);
+	WriteU32(header, names.size());
+	for (size_t i = 0; i < names.size(); ++i)
+	{
+		WriteU32(header, names[i].size());
+		header.append(names[i]);
+	}
+	file.write(header.data(), header.size());
+
+	ring_frames = std::max(new_ring_frames, 2u);
+	block_frames = std::min(std::max(new_block_frames, 1u), ring_frames / 2);
+	ring.resize(ring_frames * frame.size());
+	time = 0;
+	dropped = 0;
+	head = tail = 0;
+	write_error = false;
+	SDL_AtomicSet(&ring_head, 0);
+	SDL_AtomicSet(&ring_tail, 0);
+	SDL_AtomicSet(&quit, 0);
+
+	writer = SDL_CreateThread(&Telemetry::WriterThread, "telemetry writer", this);
+	if (!writer)
+	{
+		error_output << "Failed to create telemetry writer thread: " << SDL_GetError() << std::endl;
+		file.close();
+		return false;
+	}
+	return true;
+}
+
+bool Telemetry::Stop()
+{
+	if (!writer)
+		return true;
+
+	SDL_AtomicSet(&quit, 1);
+	SDL_WaitThread(writer, 0);
+	writer = 0;
+
+	const bool good = file.good() && !write_error;
+	file.close();
+	std::vector<float>().swap(ring);
+	return good;
+}
+
+void Telemetry::Update(double dt)
+{
+	time += dt;
+	frame[0] = time;
+	if (!writer)
+		return;
+
+	// only reload the consumer position when the ring looks full
+	if (head - tail == ring_frames)
+	{
+		tail = SDL_AtomicGet(&ring_tail);
+		SDL_MemoryBarrierAcquire();
+		if (head - tail == ring_frames)
+		{
+			dropped++;
+			return;
+		}
+	}
+
+	const unsigned stride = frame.size();
+	std::copy(frame.begin(), frame.end(), ring.begin() + (head % ring_frames) * stride);
+	head++;
+
+	// publish the frame after its values
+	SDL_MemoryBarrierRelease();
+	SDL_AtomicSet(&ring_head, head);
+}
+
+int Telemetry::WriterThread(void * data)
+{
+	Telemetry & telemetry = *static_cast<Telemetry *>(data);
+	std::string buffer;
+	unsigned tail = 0;
+	while (true)
+	{
+		const bool quit = SDL_AtomicGet(&telemetry.quit);
+		const unsigned head = SDL_AtomicGet(&telemetry.ring_head);
+		SDL_MemoryBarrierAcquire();
+
+		const unsigned count = head - tail;
+		if (count >= telemetry.block_frames || (quit && count))
+		{
+			const unsigned frames = std::min(count, telemetry.block_frames);
+			telemetry.WriteBlock(tail, frames, buffer);
+			tail += frames;
+
+			// hand the slots back after they have been read
+			SDL_MemoryBarrierRelease();
+			SDL_AtomicSet(&telemetry.ring_tail, tail);
+			continue;
+		}
+
+		if (quit)
+			break;
+
+		SDL_Delay(writer_delay);
+	}
+	return 0;
+}
+
+void Telemetry::WriteBlock(unsigned first, unsigned count, std::string & buffer)
+{
+	// transpose frames into channel columns
+	const unsigned stride = frame.size();
+	std::vector<float> column(count);
+	buffer.clear();
+	WriteU32(buffer, count);
+	for (unsigned c = 0; c < stride; ++c)
+	{
+		for (unsigned i = 0; i < count; ++i)
+		{
+			column[i] = ring[((first + i) % ring_frames) * stride + c];
+		}
+		WriteFloats(buffer, &column[0], count);
+	}
+
+	file.write(buffer.data(), buffer.size());
+	if (!file)
+		write_error = true;
+}
+
+bool Telemetry::Read(
+	const std::string & filename,
+	std::vector<std::string> & channels,
+	std::vector<std::vector<float> > & columns,
+	std::ostream & error_output)
+{
+	MappedFile mapped;
+	if (!mapped.Open(filename))
+	{
+		error_output << "Unable to open telemetry file: " << filename << std::endl;
+		return false;
+	}
+
+	const char * data = mapped.GetData();
+	const char * end = data + mapped.GetSize();
+	if (mapped.GetSize() < telemetry_version_size + 4 ||
+		std::string(data, telemetry_version_size) != std::string(telemetry_version, telemetry_version_size))
+	{
+		error_output << "Not a telemetry file: " << filename << std::endl;
+		return false;
+	}
+	data += telemetry_version_size;
+
+	const unsigned count = ReadU32(data);
+	data += 4;
+	channels.clear();
+	for (unsigned i = 0; i < count; ++i)
+	{
+		const uint32_t size = (end - data >= 4) ? ReadU32(data) : 0;
+		if (end - data < 4 || uint32_t(end - data - 4) < size)
+		{
+			error_output << "Truncated telemetry header: " << filename << std::endl;
+			return false;
+		}
+		channels.push_back(std::string(data + 4, size));
+		data += 4 + size;
+	}
+
+	columns.clear();
+	columns.resize(count);
+	while (end - data >= 4)
+	{
+		const uint32_t frames = ReadU32(data);
+		data += 4;
+		if (uint64_t(end - data) < uint64_t(frames) * count * sizeof(float))
+		{
+			error_output << "Truncated telemetry block: " << filename << std::endl;
+			return false;
+		}
+
+		for (unsigned c = 0; c < count; ++c)
+		{
+			std::vector<float> & column = columns[c];
+			const size_t size = column.size();
+			column.resize(size + frames);
+			if (frames)
+				ReadFloats(data, frames, &column[size]);
+			data += frames * sizeof(float);
+		}
+	}
+	return true;
+}
+
+bool Telemetry::Export(
+	const std::string & filename,
+	const std::string & name,
+	std::ostream & error_output)
+{
+	std::vector<std::string> channels;
+	std::vector<std::vector<float> > columns;
+	if (!Read(filename, channels, columns, error_output))
+		return false;
+
+	// one row per frame, time first
+	std::ofstream dat((name + ".dat").c_str());
+	const size_t frames = columns.empty() ? 0 : columns[0].size();
+	for (size_t i = 0; i < frames && dat; ++i)
+	{
+		for (size_t c = 0; c < columns.size(); ++c)
+		{
+			dat << columns[c][i] << " ";
+		}
+		dat << "\n";
+	}
+
+	// plot every channel against time
+	std::ofstream plt((name + ".plt").c_str());
+	plt << "plot ";
+	for (size_t c = 1; c < channels.size(); ++c)
+	{
+		plt << "\\" << std::endl << "\"" << name + ".dat" << "\" u 1:" << c + 1 << " t '" << channels[c] << "' w lines";
+		if (c + 1 < channels.size())
+			plt << ",";
+		plt << " ";
+	}
+	plt << std::endl;
+
+	if (!dat || !plt)
+	{
+		error_output << "Failed to write " << name << ".dat or " << name << ".plt" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+QT_TEST(telemetry_test)
+{
+	std::ostringstream info, error;
+	PathManager paths;
+	paths.Init(info, error);
+	const std::string filename = paths.GetTemporaryFolder() + "/telemetry_test.tlm";
+
+	// small ring and blocks, the writer has to wrap around
+	Telemetry telemetry;
+	const int speed = telemetry.AddChannel("speed");
+	const int rpm = telemetry.AddChannel("rpm");
+	QT_CHECK_EQUAL(speed, 1);
+	QT_CHECK_EQUAL(rpm, 2);
+	QT_CHECK(telemetry.Start(filename, error, 64, 16));
+	const int frames = 1000;
+	for (int i = 0; i < frames; ++i)
+	{
+		telemetry.Set(speed, i * 0.5f);
+		telemetry.Set(rpm, 1000 + i);
+		telemetry.Update(0.25);
+		if (telemetry.GetDropped())
+		{
+			// let the writer catch up, drops are counted, not retried
+			SDL_Delay(1);
+		}
+	}
+	QT_CHECK(telemetry.Stop());
+
+	std::vector<std::string> channels;
+	std::vector<std::vector<float> > columns;
+	QT_CHECK(Telemetry::Read(filename, channels, columns, error));
+	QT_CHECK_EQUAL(channels.size(), 3);
+	QT_CHECK_EQUAL(channels[0], "time");
+	QT_CHECK_EQUAL(channels[2], "rpm");
+	QT_CHECK_EQUAL(columns.size(), 3);
+	QT_CHECK_EQUAL(columns[0].size() + telemetry.GetDropped(), frames);
+
+	// frames are written in order, each frame intact
+	bool ordered = true;
+	for (size_t i = 0; i < columns[0].size(); ++i)
+	{
+		const int n = int(columns[0][i] / 0.25f + 0.5f) - 1;
+		ordered = ordered && columns[1][i] == n * 0.5f && columns[2][i] == 1000 + n;
+		ordered = ordered && (i == 0 || columns[0][i] > columns[0][i - 1]);
+	}
+	QT_CHECK(ordered);
+	PathManager::RemoveFile(filename);
+}
@@ -0,0 +1,124 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _TELEMETRY_H
+#define _TELEMETRY_H
+
+#include <SDL2/SDL_atomic.h>
+
+#include <cassert>
+#include <fstream>
+#include <string>
+#include <vector>
+
+struct SDL_Thread;
+
+/// Records float channels once per simulation step. Channels are registered
+/// up front and addressed by the integer id returned at registration, channel
+/// zero is the time. Update copies the current frame into a single producer
+/// single consumer ring, a writer thread drains the ring into a columnar binary
+/// file. The recording thread never waits for the writer, frames are dropped
+/// if the ring is full.
+class Telemetry
+{
+public:
+	Telemetry();
+
+	~Telemetry();
+
+	/// register a channel and return its id, not while recording
+	int AddChannel(const std::string & name);
+
+	/// remove all channels but time, not while recording
+	void ClearChannels();
+
+	unsigned GetNumChannels() const {return names.size();}
+
+	const std::string & GetChannelName(int id) const {return names[id];}
+
+	/// create filename and start the writer thread
+	/// the ring buffers ring_frames frames, the writer flushes blocks of up to block_frames
+	bool Start(
+		const std::string & filename,
+		std::ostream & error_output,
+		unsigned ring_frames = 2048,
+		unsigned block_frames = 256);
+
+	/// write the remaining frames, stop the writer thread and close the file
+	/// returns false on write error
+	bool Stop();
+
+	bool GetRecording() const {return writer != 0;}
+
+	/// set a channel value of the current frame
+	void Set(int id, float value)
+	{
+		assert(id > 0 && id < int(frame.size()));
+		frame[id] = value;
+	}
+
+	/// advance time by dt and queue the current frame
+	void Update(double dt);
+
+	/// frames lost because the ring was full
+	unsigned GetDropped() const {return dropped;}
+
+	/// read a telemetry file, columns are indexed by channel id
+	static bool Read(
+		const std::string & filename,
+		std::vector<std::string> & channels,
+		std::vector<std::vector<float> > & columns,
+		std::ostream & error_output);
+
+	/// convert a telemetry file to gnuplot data name.dat and plot script name.plt
+	static bool Export(
+		const std::string & filename,
+		const std::string & name,
+		std::ostream & error_output);
+
+private:
+	std::vector<std::string> names;
+	std::vector<float> frame;
+	double time;
+	unsigned dropped;
+
+	// ring of frames, head and tail count written and consumed frames
+	std::vector<float> ring;
+	unsigned ring_frames;
+	unsigned block_frames;
+	unsigned head;			///< producer copy of ring_head
+	unsigned tail;			///< producer cache of ring_tail
+	SDL_atomic_t ring_head;
+	SDL_atomic_t ring_tail;
+	SDL_atomic_t quit;
+
+	std::ofstream file;
+	SDL_Thread * writer;
+	bool write_error;
+
+	static int WriterThread(void * telemetry);
+
+	/// write count frames starting at ring position first as one block
+	void WriteBlock(unsigned first, unsigned count, std::string & buffer);
+
+	Telemetry(const Telemetry & other);
+	Telemetry & operator=(const Telemetry & other);
+};
+
+#endif // _TELEMETRY_H
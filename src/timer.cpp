@@ -18,6 +18,9 @@
 /************************************************************************/
 
 #include "timer.h"
+#include "track.h"
+#include "tobullet.h"
+#include "physics/cardynamics.h"
 #include "unittest.h"
 
 #include <string>
@@ -61,6 +64,61 @@ void Timer::Unload()
 	loaded = false;
 }
 
+void Timer::UpdateCar(const unsigned int carid, const CarDynamics & car, const Track & track)
+{
+	bool advance = false;
+	int nextsector = 0;
+	if (track.GetSectors() > 0)
+	{
+		nextsector = (GetLastSector(carid) + 1) % track.GetSectors();
+		for (int p = 0; p < 4; ++p)
+		{
+			const Bezier * patch = car.GetWheelContact(WheelPosition(p)).GetPatch();
+			if (patch == track.GetSectorPatch(nextsector))
+			{
+				advance = true;
+			}
+		}
+	}
+
+	if (advance)
+		Lap(carid, nextsector);
+
+	// Update how far the car is on the track...
+	// Find the patch under the front left wheel...
+	const Bezier * curpatch = car.GetWheelContact(FRONT_LEFT).GetPatch();
+	if (!curpatch)
+		curpatch = car.GetWheelContact(FRONT_RIGHT).GetPatch();
+
+	// Only update if car is on track.
+	if (curpatch)
+	{
+		Vec3 pos = ToMathVector<float>(car.GetCenterOfMass());
+		Vec3 back_left, back_right, front_left;
+		if (!track.IsReversed())
+		{
+			back_left = curpatch->GetBL();
+			back_right = curpatch->GetBR();
+			front_left = curpatch->GetFL();
+		}
+		else
+		{
+			back_left = curpatch->GetFL();
+			back_right = curpatch->GetFR();
+			front_left = curpatch->GetBL();
+		}
+
+		Vec3 forwardvec = front_left - back_left;
+		Vec3 relative_pos = pos - back_left;
+		float dist_from_back = 0;
+
+		if (forwardvec.Magnitude() > 0.0001)
+			dist_from_back = relative_pos.dot(forwardvec.Normalize());
+
+		UpdateDistance(carid, curpatch->GetDistFromStart() + dist_from_back);
+	}
+}
+
 void Timer::Tick(float dt)
 {
 	float elapsed_time = dt;
@@ -30,6 +30,9 @@
 #include <vector>
 #include <map>
 
+class CarDynamics;
+class Track;
+
 class Timer
 {
 public:
@@ -54,8 +57,18 @@ public:
 
 	void UpdateDistance(const unsigned int carid, const double newdistance);
 
+	///advance the car's sector when a wheel touches the next sector patch and update its lap distance
+	void UpdateCar(const unsigned int carid, const CarDynamics & car, const Track & track);
+
 	void DebugPrint(std::ostream & out) const;
 
+	///lap timing and drift scores of all cars, to move the timer back in time along with the cars
+	struct State;
+
+	void GetState(State & state) const;
+
+	void SetState(const State & state);
+
 	float GetPlayerTime() {assert(playercarindex<car.size());return car[playercarindex].GetTime();}
 
 	float GetLastLap() {assert(playercarindex<car.size());return car[playercarindex].GetLastLap();}
@@ -80,6 +93,12 @@ public:
 			return curbestlap;
 	}
 
+	float GetCarLapTime(unsigned int index) const {assert(index<car.size()); return car[index].GetTime();}
+
+	float GetCarLastLap(unsigned int index) const {assert(index<car.size()); return car[index].GetLastLap();}
+
+	float GetCarBestLap(unsigned int index) const {assert(index<car.size()); return car[index].GetBestLap();}
+
 	int GetPlayerCurrentLap() const {return GetCurrentLap(playercarindex);}
 
 	int GetCurrentLap(unsigned int index) const {assert(index<car.size()); return car[index].GetCurrentLap();}
@@ -374,6 +393,26 @@ private:
 			return driftscore;
 		}
 	};
+
+public:
+	struct State
+	{
+		std::vector <LapInfo> car;
+		float pretime;
+	};
 };
 
+inline void Timer::GetState(State & state) const
+{
+	state.car = car;
+	state.pretime = pretime;
+}
+
+inline void Timer::SetState(const State & state)
+{
+	assert(state.car.size() == car.size());
+	car = state.car;
+	pretime = state.pretime;
+}
+
 #endif
@@ -25,6 +25,7 @@
 
 #include "BulletCollision/CollisionShapes/btCollisionShape.h"
 #include "BulletCollision/CollisionShapes/btStridingMeshInterface.h"
+#include "LinearMath/btAlignedAllocator.h"
 
 Track::Track() : racingline_visible(false)
 {
@@ -45,6 +46,7 @@ bool Track::DeferredLoad(
 	const std::string & trackdir,
 	const std::string & texturedir,
 	const std::string & sharedobjectpath,
+	const std::string & cachepath,
 	const int anisotropy,
 	const bool reverse,
 	const bool dynamicobjects,
@@ -61,7 +63,7 @@ bool Track::DeferredLoad(
 			info_output, error_output,
 			trackpath, trackdir,
 			texturedir,	sharedobjectpath,
-			anisotropy, reverse,
+			cachepath, anisotropy, reverse,
 			dynamicobjects,
 			dynamicshadows));
 
@@ -112,6 +114,9 @@ void Track::Clear()
 	}
 	data.meshes.clear();
 
+	btAlignedFree(data.shape_bvh_data);
+	data.shape_bvh_data = 0;
+
 	data.static_node.Clear();
 	data.surfaces.clear();
 	data.models.clear();
@@ -120,6 +125,8 @@ void Track::Clear()
 	data.body_transforms.clear();
 	data.lap.clear();
 	data.roads.clear();
+	data.road_patches.clear();
+	data.road_bvh.Clear();
 	data.start_positions.clear();
 	data.racingline_node.Clear();
 	data.loaded = false;
@@ -134,23 +141,31 @@ bool Track::CastRay(
 	const Bezier * & colpatch,
 	Vec3 & normal) const
 {
-	bool col = false;
-	for (std::list <RoadStrip>::const_iterator i = data.roads.begin(); i != data.roads.end(); ++i)
+	const std::vector<const RoadPatch*> & patches = data.road_patches;
+
+	// last hit patch first
+	if (patch_id >= 0 && patch_id < (int)patches.size())
 	{
 		Vec3 coltri, colnorm;
-		const Bezier * colbez = NULL;
-		if (i->Collide(origin, direction, seglen, patch_id, coltri, colbez, colnorm))
+		if (patches[patch_id]->Collide(origin, direction, seglen, coltri, colnorm))
 		{
-			if (!col || (coltri - origin).MagnitudeSquared() < (outtri - origin).MagnitudeSquared())
-			{
-				outtri = coltri;
-				normal = colnorm;
-				colpatch = colbez;
-			}
-			col = true;
+			outtri = coltri;
+			normal = colnorm;
+			colpatch = &patches[patch_id]->GetPatch();
+			return true;
 		}
 	}
-	return col;
+
+	RoadPatchRay ray(patches, origin, direction, seglen);
+	data.road_bvh.QueryRay(origin, direction, seglen, ray);
+	if (ray.id < 0)
+		return false;
+
+	outtri = ray.point;
+	normal = ray.normal;
+	colpatch = &patches[ray.id]->GetPatch();
+	patch_id = ray.id;
+	return true;
 }
 
 void Track::Update()
@@ -183,6 +198,7 @@ std::pair <Vec3, Quat > Track::GetStart(unsigned int index) const
 
 Track::Data::Data() :
 	world(0),
+	shape_bvh_data(0),
 	reverse(false),
 	loaded(false),
 	cull(true),
@@ -21,6 +21,7 @@
 #define _TRACK_H
 
 #include "roadstrip.h"
+#include "aabbbvh.h"
 #include "mathvector.h"
 #include "quaternion.h"
 #include "graphics/scenenode.h"
@@ -53,6 +54,7 @@ public:
     /// The track won't be loaded until more calls to ContinueDeferredLoad().
     /// Use Loaded() to see if loading is complete yet.
     /// Returns true if successful.
+    /// Cooked track data is cached in files starting with cachepath, empty to disable the cache.
 	bool DeferredLoad(
 		ContentManager & content,
 		DynamicsWorld & world,
@@ -62,6 +64,7 @@ public:
 		const std::string & trackdir,
 		const std::string & effects_texturepath,
 		const std::string & sharedobjectpath,
+		const std::string & cachepath,
 		const int anisotropy,
 		const bool reverse,
 		const bool dynamicobjects,
@@ -157,6 +160,8 @@ public:
 	}
 
 private:
+	friend class TrackCache;
+
 	struct Data
 	{
 		DynamicsWorld* world;
@@ -171,6 +176,7 @@ private:
 		std::vector<btStridingMeshInterface*> meshes;
 		std::vector<btCollisionShape*> shapes;
 		std::vector<btCollisionObject*> objects;
+		void * shape_bvh_data; ///< cooked static mesh bvhs, used in place by the shapes
 
 		// dynamic track objects
 		SceneNode dynamic_node;
@@ -180,6 +186,8 @@ private:
 		// road information
 		std::vector<const Bezier*> lap;
 		std::list<RoadStrip> roads;
+		std::vector<const RoadPatch*> road_patches; ///< bvh object ids, collision patch ids
+		AabbBvh road_bvh;
 		std::vector<std::pair<Vec3, Quat > > start_positions;
 
 		SceneNode racingline_node;
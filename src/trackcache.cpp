@@ -0,0 +1,523 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#include "trackcache.h"
+#include "mappedfile.h"
+
+#include "BulletCollision/CollisionShapes/btBvhTriangleMeshShape.h"
+#include "BulletCollision/CollisionShapes/btOptimizedBvh.h"
+#include "BulletCollision/CollisionShapes/btStridingMeshInterface.h"
+#include "LinearMath/btAlignedAllocator.h"
+
+#include <sys/stat.h>
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+static const char cooked_magic[8] = {'V', 'D', 'T', 'R', 'A', 'C', 'K', 'C'};
+static const unsigned cooked_version = 2;
+static const unsigned cooked_align = 16;
+
+struct CookedHeader
+{
+	char magic[8];
+	unsigned version;
+	unsigned key;
+	unsigned size;
+	unsigned surface_count;
+	unsigned road_count;
+	unsigned patch_count;
+	unsigned node_count;
+	unsigned start_count;
+	unsigned lap_count;
+	unsigned shape_count;
+	unsigned shape_size;
+};
+
+struct CookedSurface
+{
+	int type;
+	float bump_wavelength;
+	float bump_amplitude;
+	float friction_non_tread;
+	float friction_tread;
+	float roll_resistance;
+	float rolling_drag;
+};
+
+struct CookedRoad
+{
+	unsigned patch_count;
+	unsigned closed;
+};
+
+struct CookedPatch
+{
+	float points[16][3];
+	float racing_line[3];
+	float curvature;
+	float dist_from_start;
+	unsigned racingline;
+};
+
+struct CookedStart
+{
+	float position[3];
+	float orientation[4];
+};
+
+// followed by the name and the serialized bvh, each padded
+struct CookedShape
+{
+	unsigned name_size;
+	unsigned bvh_size;
+	int vertex_count;
+	int triangle_count;
+	unsigned mesh_hash;
+};
+
+// bounds checked sequential access to 16 byte aligned sections
+struct CookedReader
+{
+	const char * pos;
+	const char * end;
+
+	CookedReader(const char * data, std::size_t size) :
+		pos(data),
+		end(data + size)
+	{
+		// ctor
+	}
+
+	const void * Get(unsigned count, unsigned size)
+	{
+		const std::size_t avail = end - pos;
+		if (count > avail / size)
+			return 0;
+
+		const std::size_t bytes = count * std::size_t(size);
+		const std::size_t padded = (bytes + cooked_align - 1) & ~std::size_t(cooked_align - 1);
+		const void * data = pos;
+		pos += std::min(padded, avail);
+		return data;
+	}
+};
+
+// fnv-1a
+static void Hash(unsigned & hash, const void * data, unsigned size)
+{
+	const unsigned char * bytes = static_cast<const unsigned char *>(data);
+	for (unsigned i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+}
+
+static void Hash(unsigned & hash, unsigned value)
+{
+	Hash(hash, &value, sizeof(value));
+}
+
+// vertex and triangle count and a hash of the mesh data, edited models don't match a cooked bvh
+static void GetMeshInfo(const btStridingMeshInterface & mesh, int & vertex_count, int & triangle_count, unsigned & hash)
+{
+	vertex_count = 0;
+	triangle_count = 0;
+	hash = 2166136261u;
+	for (int i = 0; i < mesh.getNumSubParts(); ++i)
+	{
+		const unsigned char * vertices;
+		const unsigned char * indices;
+		PHY_ScalarType vertex_type, index_type;
+		int vertex_num, vertex_stride, index_stride, face_num;
+		mesh.getLockedReadOnlyVertexIndexBase(
+			&vertices, vertex_num, vertex_type, vertex_stride,
+			&indices, index_stride, face_num, index_type, i);
+		const int vertex_size = vertex_type == PHY_DOUBLE ? 3 * sizeof(double) : 3 * sizeof(float);
+		for (int v = 0; v < vertex_num; ++v)
+		{
+			Hash(hash, vertices + v * vertex_stride, vertex_size);
+		}
+		Hash(hash, indices, face_num * index_stride);
+		mesh.unLockReadOnlyVertexBase(i);
+		vertex_count += vertex_num;
+		triangle_count += face_num;
+	}
+}
+
+static void Pad(std::ostream & out)
+{
+	const char zero[cooked_align] = {0};
+	const unsigned pos = out.tellp();
+	const unsigned pad = (cooked_align - pos % cooked_align) % cooked_align;
+	out.write(zero, pad);
+}
+
+static void WriteSection(std::ostream & out, const void * data, std::size_t size)
+{
+	if (size)
+		out.write(static_cast<const char *>(data), size);
+	Pad(out);
+}
+
+template <typename T>
+static void WriteSection(std::ostream & out, const std::vector<T> & records)
+{
+	WriteSection(out, records.empty() ? 0 : &records[0], records.size() * sizeof(T));
+}
+
+unsigned TrackCache::GetKey(const std::vector<std::string> & files, unsigned options)
+{
+	unsigned hash = 2166136261u;
+	Hash(hash, cooked_version);
+	Hash(hash, AabbBvh::GetNodeSize());
+	Hash(hash, options);
+	for (std::vector<std::string>::const_iterator i = files.begin(); i != files.end(); ++i)
+	{
+		Hash(hash, i->data(), i->size());
+
+		struct stat st;
+		if (stat(i->c_str(), &st) == 0)
+		{
+			Hash(hash, unsigned(st.st_size));
+			Hash(hash, unsigned(st.st_mtime));
+		}
+		else
+		{
+			Hash(hash, ~0u);
+		}
+	}
+	return hash;
+}
+
+bool TrackCache::Read(const std::string & path, unsigned key, Track::Data & data)
+{
+	shape_bvhs.clear();
+
+	MappedFile file;
+	if (!file.Open(path))
+		return false;
+
+	CookedReader in(file.GetData(), file.GetSize());
+	const CookedHeader * header = static_cast<const CookedHeader *>(in.Get(1, sizeof(CookedHeader)));
+	if (!header ||
+		std::memcmp(header->magic, cooked_magic, sizeof(cooked_magic)) ||
+		header->version != cooked_version ||
+		header->key != key ||
+		header->size != file.GetSize())
+	{
+		return false;
+	}
+
+	const CookedSurface * surfaces = static_cast<const CookedSurface *>(in.Get(header->surface_count, sizeof(CookedSurface)));
+	const CookedRoad * roads = static_cast<const CookedRoad *>(in.Get(header->road_count, sizeof(CookedRoad)));
+	const CookedPatch * patches = static_cast<const CookedPatch *>(in.Get(header->patch_count, sizeof(CookedPatch)));
+	const void * nodes = in.Get(header->node_count, AabbBvh::GetNodeSize());
+	const CookedStart * starts = static_cast<const CookedStart *>(in.Get(header->start_count, sizeof(CookedStart)));
+	const unsigned * laps = static_cast<const unsigned *>(in.Get(header->lap_count, sizeof(unsigned)));
+	const char * shapes = static_cast<const char *>(in.Get(header->shape_size, 1));
+	if (!surfaces || !roads || !patches || !nodes || !starts || !laps || !shapes)
+		return false;
+
+	// validate ids before touching the track data
+	unsigned patch_count = 0;
+	for (unsigned i = 0; i < header->road_count; ++i)
+	{
+		if (roads[i].patch_count > header->patch_count - patch_count)
+			return false;
+		patch_count += roads[i].patch_count;
+	}
+	if (patch_count != header->patch_count)
+		return false;
+
+	for (unsigned i = 0; i < header->lap_count; ++i)
+	{
+		if (laps[i] >= patch_count)
+			return false;
+	}
+
+	// bvhs are deserialized in place, they need a writable aligned copy
+	void * shape_data = 0;
+	if (header->shape_size)
+	{
+		shape_data = btAlignedAlloc(header->shape_size, cooked_align);
+		std::memcpy(shape_data, shapes, header->shape_size);
+
+		CookedReader sin(static_cast<const char *>(shape_data), header->shape_size);
+		for (unsigned i = 0; i < header->shape_count; ++i)
+		{
+			const CookedShape * shape = static_cast<const CookedShape *>(sin.Get(1, sizeof(CookedShape)));
+			const char * name = shape ? static_cast<const char *>(sin.Get(shape->name_size, 1)) : 0;
+			const void * bvh_data = shape ? sin.Get(shape->bvh_size, 1) : 0;
+			btOptimizedBvh * bvh = 0;
+			if (bvh_data)
+			{
+				bvh = btOptimizedBvh::deSerializeInPlace(
+					const_cast<void *>(bvh_data), shape->bvh_size, false);
+			}
+			if (!bvh)
+			{
+				shape_bvhs.clear();
+				btAlignedFree(shape_data);
+				return false;
+			}
+
+			ShapeBvh & sb = shape_bvhs[std::string(name, shape->name_size)];
+			sb.bvh = bvh;
+			sb.vertex_count = shape->vertex_count;
+			sb.triangle_count = shape->triangle_count;
+			sb.mesh_hash = shape->mesh_hash;
+		}
+	}
+	assert(!data.shape_bvh_data);
+	data.shape_bvh_data = shape_data;
+
+	for (unsigned i = 0; i < header->surface_count; ++i)
+	{
+		const CookedSurface & cs = surfaces[i];
+		data.surfaces.push_back(TrackSurface());
+		TrackSurface & surface = data.surfaces.back();
+		surface.type = (cs.type > 0 && cs.type < TrackSurface::NumTypes) ?
+			TrackSurface::Type(cs.type) : TrackSurface::NONE;
+		surface.bumpWaveLength = cs.bump_wavelength;
+		surface.bumpAmplitude = cs.bump_amplitude;
+		surface.frictionNonTread = cs.friction_non_tread;
+		surface.frictionTread = cs.friction_tread;
+		surface.rollResistanceCoefficient = cs.roll_resistance;
+		surface.rollingDrag = cs.rolling_drag;
+	}
+
+	const CookedPatch * cp = patches;
+	for (unsigned i = 0; i < header->road_count; ++i)
+	{
+		data.roads.push_back(RoadStrip());
+		std::vector<RoadPatch> & strip_patches = data.roads.back().GetPatches();
+		strip_patches.resize(roads[i].patch_count);
+		for (unsigned j = 0; j < roads[i].patch_count; ++j)
+		{
+			RoadPatch & patch = strip_patches[j];
+			Bezier & b = patch.GetPatch();
+			for (int n = 0; n < 16; ++n)
+			{
+				b.points[n / 4][n % 4].Set(cp[j].points[n][0], cp[j].points[n][1], cp[j].points[n][2]);
+			}
+			if (cp[j].racingline)
+			{
+				patch.SetRacingLine(Vec3(cp[j].racing_line[0], cp[j].racing_line[1], cp[j].racing_line[2]));
+			}
+			patch.SetTrackCurvature(cp[j].curvature);
+		}
+
+		// attach recomputes the connection data, distances are
+		// restored afterwards as they depend on the load history
+		data.roads.back().Connect();
+		for (unsigned j = 0; j < roads[i].patch_count; ++j)
+		{
+			strip_patches[j].GetPatch().dist_from_start = cp[j].dist_from_start;
+		}
+		cp += roads[i].patch_count;
+
+		for (unsigned j = 0; j < strip_patches.size(); ++j)
+		{
+			data.road_patches.push_back(&strip_patches[j]);
+		}
+	}
+	data.road_bvh.SetNodeData(nodes, header->node_count, patch_count);
+
+	for (unsigned i = 0; i < header->start_count; ++i)
+	{
+		const CookedStart & s = starts[i];
+		Vec3 pos(s.position[0], s.position[1], s.position[2]);
+		Quat rot(s.orientation[0], s.orientation[1], s.orientation[2], s.orientation[3]);
+		data.start_positions.push_back(std::make_pair(pos, rot));
+	}
+
+	for (unsigned i = 0; i < header->lap_count; ++i)
+	{
+		data.lap.push_back(&data.road_patches[laps[i]]->GetPatch());
+	}
+
+	return true;
+}
+
+btOptimizedBvh * TrackCache::GetShapeBvh(const std::string & name, const btStridingMeshInterface & mesh) const
+{
+	std::map<std::string, ShapeBvh>::const_iterator i = shape_bvhs.find(name);
+	if (i == shape_bvhs.end())
+		return 0;
+
+	int vertex_count, triangle_count;
+	unsigned mesh_hash;
+	GetMeshInfo(mesh, vertex_count, triangle_count, mesh_hash);
+	if (vertex_count != i->second.vertex_count ||
+		triangle_count != i->second.triangle_count ||
+		mesh_hash != i->second.mesh_hash)
+		return 0;
+
+	return i->second.bvh;
+}
+
+bool TrackCache::Write(
+	const std::string & path,
+	unsigned key,
+	const Track::Data & data,
+	const ShapeMap & shapes,
+	std::ostream & error_output)
+{
+	std::vector<CookedSurface> surfaces(data.surfaces.size());
+	for (unsigned i = 0; i < surfaces.size(); ++i)
+	{
+		const TrackSurface & surface = data.surfaces[i];
+		CookedSurface & cs = surfaces[i];
+		cs.type = surface.type;
+		cs.bump_wavelength = surface.bumpWaveLength;
+		cs.bump_amplitude = surface.bumpAmplitude;
+		cs.friction_non_tread = surface.frictionNonTread;
+		cs.friction_tread = surface.frictionTread;
+		cs.roll_resistance = surface.rollResistanceCoefficient;
+		cs.rolling_drag = surface.rollingDrag;
+	}
+
+	std::vector<CookedRoad> roads;
+	std::vector<CookedPatch> patches;
+	std::map<const Bezier *, unsigned> patch_ids;
+	for (std::list<RoadStrip>::const_iterator r = data.roads.begin(); r != data.roads.end(); ++r)
+	{
+		const std::vector<RoadPatch> & strip_patches = r->GetPatches();
+		CookedRoad road;
+		road.patch_count = strip_patches.size();
+		road.closed = r->GetClosed();
+		roads.push_back(road);
+
+		for (std::vector<RoadPatch>::const_iterator p = strip_patches.begin(); p != strip_patches.end(); ++p)
+		{
+			const Bezier & b = p->GetPatch();
+			CookedPatch cp;
+			std::memset(&cp, 0, sizeof(cp));
+			for (int n = 0; n < 16; ++n)
+			{
+				for (int k = 0; k < 3; ++k)
+					cp.points[n][k] = b.points[n / 4][n % 4][k];
+			}
+			for (int k = 0; k < 3; ++k)
+				cp.racing_line[k] = p->GetRacingLine()[k];
+			cp.curvature = p->GetTrackCurvature();
+			cp.dist_from_start = b.dist_from_start;
+			cp.racingline = b.have_racingline;
+			patch_ids[&b] = patches.size();
+			patches.push_back(cp);
+		}
+	}
+
+	std::vector<CookedStart> starts(data.start_positions.size());
+	for (unsigned i = 0; i < starts.size(); ++i)
+	{
+		for (int k = 0; k < 3; ++k)
+			starts[i].position[k] = data.start_positions[i].first[k];
+		for (int k = 0; k < 4; ++k)
+			starts[i].orientation[k] = data.start_positions[i].second[k];
+	}
+
+	std::vector<unsigned> laps;
+	for (std::vector<const Bezier *>::const_iterator i = data.lap.begin(); i != data.lap.end(); ++i)
+	{
+		std::map<const Bezier *, unsigned>::const_iterator id = patch_ids.find(*i);
+		if (id == patch_ids.end())
+		{
+			error_output << "Track cache: lap sequence patch is not part of a road" << std::endl;
+			return false;
+		}
+		laps.push_back(id->second);
+	}
+
+	// write to a temporary file, replace the cache when complete
+	const std::string temp_path = path + ".tmp";
+	std::ofstream out(temp_path.c_str(), std::ios::binary);
+	if (!out)
+	{
+		error_output << "Failed to open track cache file: " << temp_path << std::endl;
+		return false;
+	}
+
+	CookedHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, cooked_magic, sizeof(cooked_magic));
+	header.version = cooked_version;
+	header.key = key;
+	header.surface_count = surfaces.size();
+	header.road_count = roads.size();
+	header.patch_count = patches.size();
+	header.node_count = data.road_bvh.GetNodeCount();
+	header.start_count = starts.size();
+	header.lap_count = laps.size();
+	header.shape_count = shapes.size();
+	WriteSection(out, &header, sizeof(header));
+
+	WriteSection(out, surfaces);
+	WriteSection(out, roads);
+	WriteSection(out, patches);
+	WriteSection(out, data.road_bvh.GetNodeData(), header.node_count * std::size_t(AabbBvh::GetNodeSize()));
+	WriteSection(out, starts);
+	WriteSection(out, laps);
+
+	const unsigned shape_begin = out.tellp();
+	for (ShapeMap::const_iterator i = shapes.begin(); i != shapes.end(); ++i)
+	{
+		const btOptimizedBvh * bvh = i->second->getOptimizedBvh();
+		assert(bvh);
+
+		CookedShape cs;
+		cs.name_size = i->first.size();
+		cs.bvh_size = bvh->calculateSerializeBufferSize();
+		GetMeshInfo(*i->second->getMeshInterface(), cs.vertex_count, cs.triangle_count, cs.mesh_hash);
+
+		void * bvh_data = btAlignedAlloc(cs.bvh_size, cooked_align);
+		bvh->serializeInPlace(bvh_data, cs.bvh_size, false);
+		WriteSection(out, &cs, sizeof(cs));
+		WriteSection(out, i->first.data(), cs.name_size);
+		WriteSection(out, bvh_data, cs.bvh_size);
+		btAlignedFree(bvh_data);
+	}
+	header.shape_size = unsigned(out.tellp()) - shape_begin;
+
+	header.size = out.tellp();
+	out.seekp(0);
+	out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	out.close();
+
+	if (out.fail())
+	{
+		error_output << "Failed to write track cache file: " << temp_path << std::endl;
+		std::remove(temp_path.c_str());
+		return false;
+	}
+
+	std::remove(path.c_str());
+	if (std::rename(temp_path.c_str(), path.c_str()) != 0)
+	{
+		error_output << "Failed to replace track cache file: " << path << std::endl;
+		std::remove(temp_path.c_str());
+		return false;
+	}
+
+	return true;
+}
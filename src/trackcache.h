@@ -0,0 +1,78 @@
+/************************************************************************/
+/*                                                                      */
+/* This file is part of VDrift.                                         */
+/*                                                                      */
+/* VDrift is free software: you can redistribute it and/or modify       */
+/* it under the terms of the GNU General Public License as published by */
+/* the Free Software Foundation, either version 3 of the License, or    */
+/* (at your option) any later version.                                  */
+/*                                                                      */
+/* VDrift is distributed in the hope that it will be useful,            */
+/* but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/* GNU General Public License for more details.                         */
+/*                                                                      */
+/* You should have received a copy of the GNU General Public License    */
+/* along with VDrift.  If not, see <http://www.gnu.org/licenses/>.      */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef _TRACKCACHE_H
+#define _TRACKCACHE_H
+
+#include "track.h"
+
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+
+class btOptimizedBvh;
+class btBvhTriangleMeshShape;
+class btStridingMeshInterface;
+
+/// Cooked track data, written after the first load of a track and read
+/// instead of the text sources and the racing line computation while
+/// the sources are unchanged.
+/// Holds surfaces, road patches with racing line, road bvh, start positions,
+/// lap sequence and the bullet bvhs of static meshes. Sections are 16 byte
+/// aligned fixed size records, read from the mapped file without parsing.
+class TrackCache
+{
+public:
+	/// static mesh shapes by body name
+	typedef std::map<std::string, btBvhTriangleMeshShape *> ShapeMap;
+
+	/// Key over size and modification time of the source files and the load options.
+	static unsigned GetKey(const std::vector<std::string> & files, unsigned options);
+
+	/// Restore track data from the cache file, false if it is missing, broken or stale.
+	/// Static mesh bvhs are deserialized into data.shape_bvh_data, see GetShapeBvh.
+	bool Read(const std::string & path, unsigned key, Track::Data & data);
+
+	/// Cooked bvh of the named static mesh, null if missing or not matching the mesh
+	/// vertices and triangles. Loose model files are not part of the key, edited
+	/// models are caught here.
+	/// Thread safe after Read.
+	btOptimizedBvh * GetShapeBvh(const std::string & name, const btStridingMeshInterface & mesh) const;
+
+	/// Write the cooked track, false on error.
+	static bool Write(
+		const std::string & path,
+		unsigned key,
+		const Track::Data & data,
+		const ShapeMap & shapes,
+		std::ostream & error_output);
+
+private:
+	struct ShapeBvh
+	{
+		btOptimizedBvh * bvh;
+		int vertex_count;
+		int triangle_count;
+		unsigned mesh_hash;
+	};
+	std::map<std::string, ShapeBvh> shape_bvhs;
+};
+
+#endif // _TRACKCACHE_H
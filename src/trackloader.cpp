@@ -25,11 +25,15 @@
 #include "k1999.h"
 #include "content/contentmanager.h"
 #include "graphics/texture.h"
-#include "graphics/model.h"
+#include "graphics/model_joe03.h"
+#include "jobsystem.h"
+#include "microbench.h"
+#include "loadtrace.h"
 
 #include "BulletCollision/CollisionShapes/btBoxShape.h"
 #include "BulletCollision/CollisionShapes/btBvhTriangleMeshShape.h"
 #include "BulletCollision/CollisionShapes/btCompoundShape.h"
+#include "BulletCollision/CollisionShapes/btOptimizedBvh.h"
 #include "BulletCollision/CollisionShapes/btTriangleIndexVertexArray.h"
 #include "BulletDynamics/Dynamics/btRigidBody.h"
 
@@ -95,6 +99,59 @@ struct Track::Loader::Object
 	bool cached;
 };
 
+struct Track::Loader::BodyJob : public Job
+{
+	Track::Loader & loader;
+	const PTree & cfg;
+	BodyJob * source;				///< job loading the model, if shared
+	std::tr1::shared_ptr<Model> model;
+	std::string model_name;
+	std::string model_path;			///< cache path of the model
+	std::vector<std::string> texture_names;
+	std::ostringstream error;
+	Body body;
+	JobCounter counter;
+	double model_time;
+	double shape_time;
+	bool alphablend;
+	bool doublesided;
+	bool cache;						///< model loaded by this job
+	bool skip;
+	bool finished;					///< shapes owned by track data
+
+	BodyJob(Track::Loader & loader, const PTree & cfg) :
+		loader(loader), cfg(cfg), source(0), texture_names(3),
+		model_time(0), shape_time(0), alphablend(false),
+		doublesided(false), cache(false),
+		skip(false), finished(false)
+	{
+		// ctor
+	}
+
+	void Execute()
+	{
+		loader.LoadBody(*this);
+	}
+};
+
+// set relative path for models and textures, ugly hack
+// need to identify body references
+static std::string GetBodyName(const PTree & cfg, std::string & rel_path)
+{
+	if (cfg.value() == "body" && cfg.parent())
+	{
+		return cfg.parent()->value();
+	}
+
+	const std::string & name = cfg.value();
+	size_t npos = name.rfind("/");
+	if (npos < name.length())
+	{
+		rel_path = name.substr(0, npos+1);
+	}
+	return name;
+}
+
 Track::Loader::Loader(
 	ContentManager & content,
 	DynamicsWorld & world,
@@ -105,6 +162,7 @@ Track::Loader::Loader(
 	const std::string & trackdir,
 	const std::string & texturedir,
 	const std::string & sharedobjectpath,
+	const std::string & cachepath,
 	const int anisotropy,
 	const bool reverse,
 	const bool dynamic_objects,
@@ -121,6 +179,7 @@ Track::Loader::Loader(
 	anisotropy(anisotropy),
 	dynamic_objects(dynamic_objects),
 	dynamic_shadows(dynamic_shadows),
+	cachefile(cachepath.empty() ? cachepath : cachepath + (reverse ? ".reverse.cooked" : ".cooked")),
 	packload(false),
 	numobjects(0),
 	numloaded(0),
@@ -129,6 +188,8 @@ Track::Loader::Loader(
 	min_params(14),
 	error(false),
 	list(false),
+	cache_key(0),
+	cooked(false),
 	track_shape(0)
 {
 	objectpath = trackpath + "/objects";
@@ -143,6 +204,26 @@ Track::Loader::~Loader()
 
 void Track::Loader::Clear()
 {
+	// jobs might depend on each other, wait for all of them before cleanup
+	JobSystem & jobs = JobSystem::instance();
+	for (body_job_map::iterator i = body_jobs.begin(); i != body_jobs.end(); ++i)
+	{
+		jobs.Wait(i->second->counter);
+	}
+	for (body_job_map::iterator i = body_jobs.begin(); i != body_jobs.end(); ++i)
+	{
+		BodyJob * job = i->second;
+		if (!job->finished)
+		{
+			delete job->body.shape;
+			delete job->body.mesh;
+		}
+		delete job;
+	}
+	body_jobs.clear();
+	model_jobs.clear();
+	textures.clear();
+
 	bodies.clear();
 	objectfile.close();
 	pack.Close();
@@ -150,28 +231,34 @@ void Track::Loader::Clear()
 
 bool Track::Loader::BeginLoad()
 {
+	loadtrace::Scope trace("Track::Loader::BeginLoad");
+
 	Clear();
 
 	info_output << "Loading track from path: " << trackpath << std::endl;
 
-	if (!LoadSurfaces())
-	{
-		info_output << "No Surfaces File. Continuing with standard surfaces" << std::endl;
-	}
-
-	if (!LoadRoads())
+	// cooked track data is keyed by its sources
+	const double start = microbench::getTime();
+	std::string info_path = trackpath + "/track.txt";
+	std::vector<std::string> sources;
+	sources.push_back(info_path);
+	sources.push_back(trackpath + "/roads.trk");
+	sources.push_back(trackpath + "/surfaces.txt");
+	sources.push_back(objectpath + "/objects.txt");
+	sources.push_back(objectpath + "/objects.jpk");
+	sources.push_back(objectpath + "/list.txt");
+	cache_key = TrackCache::GetKey(sources, data.reverse);
+	cooked = !cachefile.empty() && cache.Read(cachefile, cache_key, data);
+	if (cooked)
 	{
-		error_output << "Error during road loading; continuing with an unsmoothed track" << std::endl;
-		data.roads.clear();
+		info_output << "Loaded cooked track: " << cachefile << std::endl;
 	}
-
-	if (!CreateRacingLines())
+	else if (!LoadSurfaces())
 	{
-		return false;
+		info_output << "No Surfaces File. Continuing with standard surfaces" << std::endl;
 	}
 
 	// load info
-	std::string info_path = trackpath + "/track.txt";
 	std::ifstream file(info_path.c_str());
 	if (!file.good())
 	{
@@ -185,6 +272,33 @@ bool Track::Loader::BeginLoad()
 	info.get("cull faces", data.cull);
 	info.get("vertical tracking skyboxes", data.vertical_tracking_skyboxes);
 
+	if (cooked)
+	{
+		TessellateRoads(info);
+		for (std::list<RoadStrip>::iterator i = data.roads.begin(); i != data.roads.end(); ++i)
+		{
+			if (!i->GetPatches().empty() && i->GetPatches().front().GetPatch().HasRacingline())
+			{
+				CreateRacingLine(*i);
+			}
+		}
+		info_output << "Road setup took " << microbench::getTime() - start << " s" << std::endl;
+		return BeginObjectLoad();
+	}
+
+	if (!LoadRoads(info))
+	{
+		error_output << "Error during road loading; continuing with an unsmoothed track" << std::endl;
+		data.roads.clear();
+		data.road_patches.clear();
+		data.road_bvh.Clear();
+	}
+
+	if (!CreateRacingLines())
+	{
+		return false;
+	}
+
 	if (!LoadStartPositions(info))
 	{
 		return false;
@@ -195,6 +309,8 @@ bool Track::Loader::BeginLoad()
 		return false;
 	}
 
+	info_output << "Road setup took " << microbench::getTime() - start << " s" << std::endl;
+
 	if (!BeginObjectLoad())
 	{
 		return false;
@@ -227,6 +343,14 @@ bool Track::Loader::ContinueLoad()
 		data.shapes.push_back(track_shape);
 		track_shape = 0;
 #endif
+		if (!list)
+		{
+			LogTiming();
+		}
+		if (!cachefile.empty())
+		{
+			WriteCache();
+		}
 		data.loaded = true;
 		Clear();
 	}
@@ -236,11 +360,16 @@ bool Track::Loader::ContinueLoad()
 
 bool Track::Loader::BeginObjectLoad()
 {
+	loadtrace::Scope trace("Track::Loader::BeginObjectLoad");
+
 #ifndef EXTBULLET
 	assert(track_shape == 0);
 	track_shape = new btCompoundShape(true);
 #endif
 
+	timing = Timing();
+	timing.begin = microbench::getTime();
+
 	list = true;
 	packload = pack.Load(objectpath + "/objects.jpk");
 
@@ -277,6 +406,7 @@ std::pair<bool, bool> Track::Loader::ContinueObjectLoad()
 
 bool Track::Loader::Begin()
 {
+	const double start = microbench::getTime();
 	content.load(track_config, objectdir, "objects.txt");
 	if (track_config.get())
 	{
@@ -286,6 +416,19 @@ bool Track::Loader::Begin()
 			node_it = nodes->begin();
 			numobjects = nodes->size();
 			data.meshes.reserve(numobjects);
+
+			// queue all bodies up front, workers load them
+			// while the main thread adds the objects in order
+			for (PTree::const_iterator i = nodes->begin(); i != nodes->end(); ++i)
+			{
+				const PTree * sec_body;
+				if (i->second.get("body", sec_body))
+				{
+					QueueBody(*sec_body);
+				}
+			}
+
+			timing.parse = microbench::getTime() - start;
 			return true;
 		}
 	}
@@ -315,7 +458,6 @@ bool Track::Loader::LoadShape(const PTree & cfg, const Model & model, Body & bod
 	{
 		btTriangleIndexVertexArray * mesh = new btTriangleIndexVertexArray();
 		mesh->addIndexedMesh(GetIndexedMesh(model));
-		data.meshes.push_back(mesh);
 		body.mesh = mesh;
 
 		int surface = 0;
@@ -325,9 +467,20 @@ bool Track::Loader::LoadShape(const PTree & cfg, const Model & model, Body & bod
 			surface = 0;
 		}
 
-		btBvhTriangleMeshShape * shape = new btBvhTriangleMeshShape(mesh, true);
+		// use the cooked bvh if the mesh matches
+		btBvhTriangleMeshShape * shape = 0;
+		std::string rel_path;
+		btOptimizedBvh * bvh = cache.GetShapeBvh(GetBodyName(cfg, rel_path), *mesh);
+		if (bvh)
+		{
+			shape = new btBvhTriangleMeshShape(mesh, true, false);
+			shape->setOptimizedBvh(bvh);
+		}
+		else
+		{
+			shape = new btBvhTriangleMeshShape(mesh, true);
+		}
 		shape->setUserPointer((void*)&data.surfaces[surface]);
-		data.shapes.push_back(shape);
 		body.shape = shape;
 	}
 	else
@@ -352,7 +505,6 @@ bool Track::Loader::LoadShape(const PTree & cfg, const Model & model, Body & bod
 		{
 			shape = compound;
 		}
-		data.shapes.push_back(shape);
 
 		shape->calculateLocalInertia(body.mass, body.inertia);
 		body.shape = shape;
@@ -362,88 +514,216 @@ bool Track::Loader::LoadShape(const PTree & cfg, const Model & model, Body & bod
 	return true;
 }
 
-Track::Loader::body_iterator Track::Loader::LoadBody(const PTree & cfg)
+void Track::Loader::QueueBody(const PTree & cfg)
 {
-	Body body;
+	std::string rel_path;
+	const std::string name = GetBodyName(cfg, rel_path);
+	if (body_jobs.find(name) != body_jobs.end())
+	{
+		return;
+	}
+
+	BodyJob * job = new BodyJob(*this, cfg);
+	body_jobs[name] = job;
+
 	std::string texture_str;
-	std::string model_name;
 	int clampuv = 0;
 	bool mipmap = true;
-	bool alphablend = false;
-	bool doublesided = false;
 	bool isashadow = false;
-
 	cfg.get("texture", texture_str, error_output);
-	cfg.get("model", model_name, error_output);
+	cfg.get("model", job->model_name, error_output);
 	cfg.get("clampuv", clampuv);
 	cfg.get("mipmap", mipmap);
-	cfg.get("alphablend", alphablend);
-	cfg.get("doublesided", doublesided);
+	cfg.get("alphablend", job->alphablend);
+	cfg.get("doublesided", job->doublesided);
 	cfg.get("isashadow", isashadow);
-	cfg.get("skybox", body.skybox);
-	cfg.get("nolighting", body.nolighting);
+	cfg.get("skybox", job->body.skybox);
+	cfg.get("nolighting", job->body.nolighting);
+	job->body.collidable = cfg.get("mass", job->body.mass);
 
-	std::vector<std::string> texture_names(3);
+	std::vector<std::string> & texture_names = job->texture_names;
 	std::istringstream s(texture_str);
 	s >> texture_names;
 
-	// set relative path for models and textures, ugly hack
-	// need to identify body references
-	std::string name;
-	if (cfg.value() == "body" && cfg.parent())
+	if (!rel_path.empty())
 	{
-		name = cfg.parent()->value();
+		job->model_name = rel_path + job->model_name;
+		texture_names[0] = rel_path + texture_names[0];
+		if (!texture_names[1].empty())
+			texture_names[1] = rel_path + texture_names[1];
+		if (!texture_names[2].empty())
+			texture_names[2] = rel_path + texture_names[2];
 	}
-	else
+
+	if (dynamic_shadows && isashadow)
+	{
+		job->skip = true;
+		return;
+	}
+
+	TextureInfo texinfo;
+	texinfo.mipmap = mipmap || anisotropy; //always mipmap if anisotropy is on
+	texinfo.anisotropy = anisotropy;
+	texinfo.repeatu = clampuv != 1 && clampuv != 2;
+	texinfo.repeatv = clampuv != 1 && clampuv != 3;
+	QueueTexture(texture_names[0], texinfo);
+	if (!texture_names[1].empty())
+	{
+		QueueTexture(texture_names[1], texinfo);
+	}
+	if (!texture_names[2].empty())
+	{
+		texinfo.compress = false;
+		QueueTexture(texture_names[2], texinfo);
+	}
+
+	JobSystem & jobs = JobSystem::instance();
+	if (content.get(job->model, objectdir, job->model_name))
+	{
+		jobs.Run(*job, &job->counter);
+		return;
+	}
+
+	// bodies sharing a model wait for the job loading it
+	body_job_map::const_iterator i = model_jobs.find(job->model_name);
+	if (i != model_jobs.end())
+	{
+		job->source = i->second;
+		jobs.Run(*job, &job->counter, &job->source->counter);
+		return;
+	}
+
+	model_jobs[job->model_name] = job;
+	jobs.Run(*job, &job->counter);
+}
+
+void Track::Loader::QueueTexture(const std::string & name, const TextureInfo & info)
+{
+	if (textures.find(name) == textures.end())
 	{
-		name = cfg.value();
-		size_t npos = name.rfind("/");
-		if (npos < name.length())
+		textures[name] = content.loadAsync<Texture>(objectdir, name, info);
+	}
+}
+
+void Track::Loader::LoadBody(BodyJob & job)
+{
+	loadtrace::Scope trace("Track::Loader::LoadBody", job.model_name);
+
+	const double start = microbench::getTime();
+	if (job.source)
+	{
+		job.model = job.source->model;
+	}
+	else if (!job.model.get())
+	{
+		std::tr1::shared_ptr<ModelJoe03> model(new ModelJoe03());
+		bool loaded = false;
+		if (packload)
+		{
+			// the mapped pack is read concurrently
+			loaded = model->Load(job.model_name, job.error, &pack);
+			job.model_path = objectdir;
+		}
+		std::string model_file;
+		if (!loaded && content.find(objectdir, job.model_name, job.model_path, model_file))
 		{
-			std::string rel_path = name.substr(0, npos+1);
-			model_name = rel_path + model_name;
-			texture_names[0] = rel_path + texture_names[0];
-			if (!texture_names[1].empty())
-				texture_names[1] = rel_path + texture_names[1];
-			if (!texture_names[2].empty())
-				texture_names[2] = rel_path + texture_names[2];
+			loaded = model->Load(model_file, job.error);
+		}
+		if (loaded)
+		{
+			job.model = model;
+			job.cache = true;
 		}
 	}
+	const double model_end = microbench::getTime();
+	job.model_time = model_end - start;
 
-	if (dynamic_shadows && isashadow)
+	if (job.model.get() && job.body.collidable)
 	{
-		return bodies.end();
+		LoadShape(job.cfg, *job.model, job.body);
 	}
+	job.shape_time = microbench::getTime() - model_end;
+}
 
-	std::tr1::shared_ptr<Model> model;
-	if ((packload && content.load(model, objectdir, model_name, pack)) ||
-		content.load(model, objectdir, model_name))
+std::tr1::shared_ptr<Texture> Track::Loader::FinishTexture(const std::string & name)
+{
+	std::tr1::shared_ptr<Texture> tex;
+	texture_map::const_iterator i = textures.find(name);
+	if (i != textures.end())
 	{
-		data.models.insert(model);
+		const double start = microbench::getTime();
+		i->second.wait();
+		timing.wait += microbench::getTime() - start;
+		i->second.get(tex);
 	}
-	else
+	return tex;
+}
+
+Track::Loader::body_iterator Track::Loader::FinishBody(const PTree & cfg)
+{
+	std::string rel_path;
+	const std::string name = GetBodyName(cfg, rel_path);
+	body_iterator ib = bodies.find(name);
+	if (ib != bodies.end())
+	{
+		return ib;
+	}
+
+	body_job_map::const_iterator ij = body_jobs.find(name);
+	if (ij == body_jobs.end())
+	{
+		QueueBody(cfg);
+		ij = body_jobs.find(name);
+	}
+
+	BodyJob & job = *ij->second;
+	if (job.skip)
 	{
-		info_output << "Failed to load body " << cfg.value() << " model " << model_name << std::endl;
 		return bodies.end();
 	}
 
-	body.collidable = cfg.get("mass", body.mass);
-	if (body.collidable)
+	const double start = microbench::getTime();
+	JobSystem::instance().Wait(job.counter);
+	const double done = microbench::getTime();
+	timing.wait += done - start;
+	timing.model += job.model_time;
+	timing.shape += job.shape_time;
+
+	if (!job.model.get())
 	{
-		LoadShape(cfg, *model, body);
+		error_output << job.error.str();
+		info_output << "Failed to load body " << cfg.value() << " model " << job.model_name << std::endl;
+		job.skip = true;
+		return bodies.end();
 	}
 
-	// load textures
+	if (job.cache)
+	{
+		std::tr1::shared_ptr<Model> model;
+		content.load(model, job.model_path, job.model_name, job.model);
+	}
+	data.models.insert(job.model);
+
+	// track data owns the shapes from here on
+	Body & body = job.body;
+	if (body.mesh)
+	{
+		data.meshes.push_back(body.mesh);
+	}
+	if (body.shape)
+	{
+		data.shapes.push_back(body.shape);
+	}
+	job.finished = true;
+
+	// upload textures
+	const double wait = timing.wait;
+	const std::vector<std::string> & texture_names = job.texture_names;
 	std::tr1::shared_ptr<Texture> tex[3];
-	TextureInfo texinfo;
-	texinfo.mipmap = mipmap || anisotropy; //always mipmap if anisotropy is on
-	texinfo.anisotropy = anisotropy;
-	texinfo.repeatu = clampuv != 1 && clampuv != 2;
-	texinfo.repeatv = clampuv != 1 && clampuv != 3;
-	content.load(tex[0], objectdir, texture_names[0], texinfo);
+	tex[0] = FinishTexture(texture_names[0]);
 	if (!texture_names[1].empty())
 	{
-		content.load(tex[1], objectdir, texture_names[1], texinfo);
+		tex[1] = FinishTexture(texture_names[1]);
 		data.textures.insert(tex[1]);
 	}
 	else
@@ -452,8 +732,7 @@ Track::Loader::body_iterator Track::Loader::LoadBody(const PTree & cfg)
 	}
 	if (!texture_names[2].empty())
 	{
-		texinfo.compress = false;
-		content.load(tex[2], objectdir, texture_names[2], texinfo);
+		tex[2] = FinishTexture(texture_names[2]);
 		data.textures.insert(tex[2]);
 	}
 	else
@@ -463,10 +742,12 @@ Track::Loader::body_iterator Track::Loader::LoadBody(const PTree & cfg)
 
 	// setup drawable
 	Drawable & drawable = body.drawable;
-	drawable.SetModel(*model);
+	drawable.SetModel(*job.model);
 	drawable.SetTextures(tex[0]->GetId(), tex[1]->GetId(), tex[2]->GetId());
-	drawable.SetDecal(alphablend);
-	drawable.SetCull(data.cull && !doublesided);
+	drawable.SetDecal(job.alphablend);
+	drawable.SetCull(data.cull && !job.doublesided);
+
+	timing.upload += microbench::getTime() - done - (timing.wait - wait);
 
 	return bodies.insert(std::make_pair(name, body)).first;
 }
@@ -503,19 +784,23 @@ void Track::Loader::AddBody(SceneNode & scene, const Body & body)
 
 bool Track::Loader::LoadNode(const PTree & sec)
 {
+	loadtrace::Scope trace("Track::Loader::LoadNode", sec.value());
+
 	const PTree * sec_body;
 	if (!sec.get("body", sec_body, error_output))
 	{
 		return false;
 	}
 
-	body_iterator ib = LoadBody(*sec_body);
+	body_iterator ib = FinishBody(*sec_body);
 	if (ib == bodies.end())
 	{
 		//info_output << "Object " << sec.value() << " failed to load body" << std::endl;
 		return true;
 	}
 
+	const double start = microbench::getTime();
+
 	Vec3 position, angle;
 	bool has_transform = sec.get("position",  position) | sec.get("rotation", angle);
 	Quat rotation(angle[0]/180*M_PI, angle[1]/180*M_PI, angle[2]/180*M_PI);
@@ -612,9 +897,62 @@ bool Track::Loader::LoadNode(const PTree & sec)
 		}
 	}
 
+	timing.insert += microbench::getTime() - start;
 	return true;
 }
 
+void Track::Loader::LogTiming()
+{
+	// serial cost is the time a single thread would have spent loading
+	const double total = microbench::getTime() - timing.begin;
+	for (texture_map::const_iterator i = textures.begin(); i != textures.end(); ++i)
+	{
+		timing.decode += i->second.time();
+	}
+	const double serial = timing.parse + timing.model + timing.shape +
+		timing.decode + timing.upload + timing.insert;
+	info_output << "Loaded " << numobjects << " track objects in " << total << " s"
+		<< " (serial " << serial << " s, " << JobSystem::instance().GetNumThreads() << " threads)\n"
+		<< "  parse objects: " << timing.parse << " s\n"
+		<< "  load models: " << timing.model << " s (workers)\n"
+		<< "  build collision shapes: " << timing.shape << " s (workers)\n"
+		<< "  decode textures: " << timing.decode << " s (workers)\n"
+		<< "  upload textures, create drawables: " << timing.upload << " s\n"
+		<< "  insert objects: " << timing.insert << " s\n"
+		<< "  wait for workers: " << timing.wait << " s" << std::endl;
+}
+
+void Track::Loader::WriteCache()
+{
+	loadtrace::Scope trace("Track::Loader::WriteCache");
+
+	// cache is current if all static shapes use cooked bvhs
+	TrackCache::ShapeMap shapes;
+	bool current = cooked;
+	for (body_iterator i = bodies.begin(); i != bodies.end(); ++i)
+	{
+		const Body & body = i->second;
+		if (!body.mesh)
+		{
+			continue;
+		}
+		btBvhTriangleMeshShape * shape = static_cast<btBvhTriangleMeshShape *>(body.shape);
+		shapes[i->first] = shape;
+		current = current && shape->getOptimizedBvh() == cache.GetShapeBvh(i->first, *body.mesh);
+	}
+	if (current)
+	{
+		return;
+	}
+
+	const double start = microbench::getTime();
+	if (TrackCache::Write(cachefile, cache_key, data, shapes, error_output))
+	{
+		info_output << "Wrote cooked track " << cachefile << " in "
+			<< microbench::getTime() - start << " s" << std::endl;
+	}
+}
+
 /// read from the file stream and put it in "output".
 /// return true if the get was successful, else false
 template <typename T>
@@ -679,6 +1017,8 @@ bool Track::Loader::BeginOld()
 
 bool Track::Loader::AddObject(const Object & object)
 {
+	loadtrace::Scope trace("Track::Loader::AddObject", object.texture);
+
 	data.models.insert(object.model);
 
 	TextureInfo texinfo;
@@ -841,6 +1181,8 @@ std::pair<bool, bool> Track::Loader::ContinueOld()
 
 bool Track::Loader::LoadSurfaces()
 {
+	loadtrace::Scope trace("Track::Loader::LoadSurfaces");
+
 	std::string path = trackpath + "/surfaces.txt";
 	std::ifstream file(path.c_str());
 	if (!file.good())
@@ -895,9 +1237,13 @@ bool Track::Loader::LoadSurfaces()
 	return true;
 }
 
-bool Track::Loader::LoadRoads()
+bool Track::Loader::LoadRoads(const PTree & info)
 {
+	loadtrace::Scope trace("Track::Loader::LoadRoads");
+
 	data.roads.clear();
+	data.road_patches.clear();
+	data.road_bvh.Clear();
 
 	std::string roadpath = trackpath + "/roads.trk";
 	std::ifstream trackfile(roadpath.c_str());
@@ -915,11 +1261,48 @@ bool Track::Loader::LoadRoads()
 		data.roads.back().ReadFrom(trackfile, data.reverse, error_output);
 	}
 
+	TessellateRoads(info);
+
+	// one bvh over all road patches
+	std::vector<Aabb<float> > bounds;
+	data.road_patches.clear();
+	for (std::list<RoadStrip>::const_iterator r = data.roads.begin(); r != data.roads.end(); ++r)
+	{
+		const std::vector<RoadPatch> & patches = r->GetPatches();
+		for (std::vector<RoadPatch>::const_iterator p = patches.begin(); p != patches.end(); ++p)
+		{
+			data.road_patches.push_back(&*p);
+			bounds.push_back(p->GetPatch().GetAABB());
+		}
+	}
+	data.road_bvh.Build(bounds);
+
 	return true;
 }
 
+void Track::Loader::TessellateRoads(const PTree & info)
+{
+	// optional patch collision grids
+	int tessellation = 0;
+	bool tessellation_exact = true;
+	info.get("road tessellation", tessellation);
+	info.get("road tessellation exact", tessellation_exact);
+	if (tessellation > 0)
+	{
+		unsigned size = 0;
+		for (std::list<RoadStrip>::iterator r = data.roads.begin(); r != data.roads.end(); ++r)
+		{
+			r->Tessellate(tessellation, tessellation_exact);
+			size += r->GetTessellationMemorySize();
+		}
+		info_output << "Road tessellation " << tessellation << ", " << size / 1024 << " KB" << std::endl;
+	}
+}
+
 bool Track::Loader::CreateRacingLines()
 {
+	loadtrace::Scope trace("Track::Loader::CreateRacingLines");
+
 	K1999 k1999data;
 	for (std::list <RoadStrip>::iterator i = data.roads.begin(); i != data.roads.end(); ++i)
 	{
@@ -23,6 +23,8 @@
 #include "track.h"
 #include "cfg/ptree.h"
 #include "joepack.h"
+#include "trackcache.h"
+#include "content/contentmanager.h"
 
 /*
 [object.foo]
@@ -46,7 +48,6 @@ model = body.joe
 */
 
 class DynamicsWorld;
-class ContentManager;
 class btStridingMeshInterface;
 class btCompoundShape;
 class btCollisionShape;
@@ -65,6 +66,7 @@ public:
 		const std::string & trackdir,
 		const std::string & texturedir,
 		const std::string & sharedobjectpath,
+		const std::string & cachepath,
 		const int anisotropy,
 		const bool reverse,
 		const bool dynamic_shadows,
@@ -94,6 +96,7 @@ private:
 	const int anisotropy;
 	const bool dynamic_objects;
 	const bool dynamic_shadows;
+	const std::string cachefile;
 
 	std::string objectpath;
 	std::string objectdir;
@@ -130,6 +133,39 @@ private:
 	typedef std::map<std::string, Body>::const_iterator body_iterator;
 	std::map<std::string, Body> bodies;
 
+	// bodies are loaded by worker threads, the main thread only uploads
+	// textures and inserts objects into the scene and world
+	struct BodyJob;
+	typedef std::map<std::string, BodyJob *> body_job_map;
+	typedef std::map<std::string, ContentHandle<Texture> > texture_map;
+	body_job_map body_jobs;
+	body_job_map model_jobs;
+	texture_map textures;
+
+	// load stage times in seconds, worker stages are summed over all jobs
+	struct Timing
+	{
+		Timing() : begin(0), parse(0), model(0), shape(0), decode(0),
+			upload(0), insert(0), wait(0)
+		{
+			// ctor
+		}
+		double begin;
+		double parse;
+		double model;
+		double shape;
+		double decode;
+		double upload;
+		double insert;
+		double wait;
+	};
+	Timing timing;
+
+	// cooked track data
+	TrackCache cache;
+	unsigned cache_key;
+	bool cooked;
+
 	// compound track shape
 	btCompoundShape * track_shape;
 
@@ -140,7 +176,9 @@ private:
 
 	bool LoadSurfaces();
 
-	bool LoadRoads();
+	bool LoadRoads(const PTree & info);
+
+	void TessellateRoads(const PTree & info);
 
 	bool CreateRacingLines();
 
@@ -168,7 +206,25 @@ private:
 
 	bool LoadShape(const PTree & body_cfg, const Model & body_model, Body & body);
 
-	body_iterator LoadBody(const PTree & cfg);
+	/// queue body loading job, bodies are loaded once
+	void QueueBody(const PTree & cfg);
+
+	/// queue asynchronous texture load, textures are loaded once
+	void QueueTexture(const std::string & name, const TextureInfo & info);
+
+	/// worker thread part of body loading
+	void LoadBody(BodyJob & job);
+
+	/// main thread part of body loading, waits for the body job
+	body_iterator FinishBody(const PTree & cfg);
+
+	/// wait for the texture decoding, uploads it if necessary
+	std::tr1::shared_ptr<Texture> FinishTexture(const std::string & name);
+
+	void LogTiming();
+
+	/// write cooked track data if the cache is missing or stale
+	void WriteCache();
 
 	void AddBody(SceneNode & scene, const Body & body);
 
@@ -21,6 +21,7 @@
 #define _TRIPPLEBUFFER_H
 
 #include <cassert>
+#include <algorithm>
 
 template <class T>
 class TrippleBuffer